@@ -0,0 +1,85 @@
+/**
+ * @file unwind_bench.c
+ * @brief 调用栈采集开销微基准
+ *
+ * 在不同调用深度下比较帧指针回溯与glibc backtrace()
+ * 每次采集的平均耗时：
+ * ```
+ * ./bench/unwind_bench [iterations]
+ * TOY_ASAN_OPTIONS=malloc_context_size=32 ./bench/unwind_bench
+ * ```
+ *
+ * @author Toy ASan Project
+ * @version 1.0
+ */
+
+#include "../toy_asan/toy_asan.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static volatile int sink;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static double measure(enum unwinder_mode mode, int iterations, int *frames_out) {
+  void *frames[MAX_STACK_DEPTH];
+  int depth = toy_asan_flags.malloc_context_size;
+  int n = 0;
+
+  // 预热：backtrace()首次调用会加载libgcc_s
+  for (int i = 0; i < 100; i++) {
+    n = capture_stack_trace_with(mode, frames, depth);
+  }
+
+  uint64_t start = now_ns();
+  for (int i = 0; i < iterations; i++) {
+    n = capture_stack_trace_with(mode, frames, depth);
+    sink += n;
+  }
+  uint64_t elapsed = now_ns() - start;
+
+  *frames_out = n;
+  return (double)elapsed / iterations;
+}
+
+// 人为加深调用栈，模拟真实程序中的分配深度
+__attribute__((noinline)) static void run_at_depth(int depth, int iterations) {
+  if (depth > 0) {
+    run_at_depth(depth - 1, iterations);
+    sink++; // 阻止尾调用优化
+    return;
+  }
+
+  int fp_frames, dwarf_frames;
+  double fp_ns = measure(UNWINDER_FP, iterations, &fp_frames);
+  double dwarf_ns = measure(UNWINDER_DWARF, iterations, &dwarf_frames);
+  printf(" %9.1f ns (%2d frames) %9.1f ns (%2d frames) %7.1fx\n", fp_ns,
+         fp_frames, dwarf_ns, dwarf_frames, dwarf_ns / fp_ns);
+}
+
+int main(int argc, char **argv) {
+  int iterations = argc > 1 ? atoi(argv[1]) : 200000;
+  if (iterations <= 0) {
+    iterations = 200000;
+  }
+
+  toy_asan_init();
+  register_current_thread();
+
+  printf("=== Unwind benchmark: %d captures per case, max %d frames ===\n",
+         iterations, toy_asan_flags.malloc_context_size);
+  printf("%-8s %22s %22s %8s\n", "depth", "fp", "dwarf", "ratio");
+
+  int depths[] = {2, 8, 32};
+  for (size_t i = 0; i < sizeof(depths) / sizeof(depths[0]); i++) {
+    printf("%-8d", depths[i]);
+    fflush(stdout);
+    run_at_depth(depths[i], iterations);
+  }
+  return 0;
+}
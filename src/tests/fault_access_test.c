@@ -0,0 +1,163 @@
+/**
+ * @file fault_access_test.c
+ * @brief 出错指令解码（fault_access.c）测试
+ *
+ * 每种访问形式fork一个子进程，用内联汇编在右保护页附近执行一条指定的指令；
+ * 子进程报告后退出，父进程从结构化报告（log_path）读回access字段，
+ * 检查类型、宽度和起始地址：
+ * - 8字节写跨越保护页边界（起始地址在用户页内）
+ * - 2字节读跨越边界
+ * - movups / movdqu（16字节）
+ * - AVX vmovdqu（32字节，CPU不支持AVX时跳过）
+ * - rep stosb（出错时RDI指向第一个不可写字节）
+ * - SIB寻址（disp8和disp32位移）
+ * - 跳到保护页上执行（EXEC，不读取RIP处的字节）
+ * 期望：全部通过，以0退出。
+ */
+
+#include "../toy_asan/toy_asan.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static size_t page;
+
+static void store8_straddle(char *end) {
+    __asm__ volatile("movq %1, (%0)" : : "r"(end - 4), "r"(0x1122334455667788L) : "memory");
+}
+
+static void load2_straddle(char *end) {
+    int out;
+    __asm__ volatile("movzwl (%1), %0" : "=r"(out) : "r"(end - 1) : "memory");
+    (void)out;
+}
+
+static void movups16(char *end) {
+    __asm__ volatile("xorps %%xmm0, %%xmm0\n\tmovups %%xmm0, (%0)" : : "r"(end - 8)
+                     : "xmm0", "memory");
+}
+
+static void movdqu16(char *end) {
+    __asm__ volatile("pxor %%xmm1, %%xmm1\n\tmovdqu %%xmm1, (%0)" : : "r"(end - 12)
+                     : "xmm1", "memory");
+}
+
+static void avx32(char *end) {
+    __asm__ volatile("vpxor %%xmm2, %%xmm2, %%xmm2\n\tvmovdqu %%ymm2, (%0)\n\tvzeroupper"
+                     : : "r"(end - 16) : "xmm2", "memory");
+}
+
+static void rep_stosb(char *end) {
+    char *dst = end - 3;
+    size_t count = 10;
+    __asm__ volatile("rep stosb" : "+D"(dst), "+c"(count) : "a"(0) : "memory");
+}
+
+static void sib_disp32_store(char *end) {
+    // end - 4096 + 2 * 8 + 4080 = end
+    __asm__ volatile("movw $1, 4080(%0,%1,8)" : : "r"(end - 4096), "r"(2L) : "memory");
+}
+
+static void sib_store(char *end) {
+    // end - 24 + 4 * 4 + 8 = end
+    __asm__ volatile("movl $1, 8(%0,%1,4)" : : "r"(end - 24), "r"(4L) : "memory");
+}
+
+static void jump_into_guard(char *end) {
+    ((void (*)(void))end)();
+}
+
+struct access_case {
+    const char *name;
+    void (*run)(char *end);
+    const char *type;
+    size_t size;
+    long start;            // 相对于用户页末尾
+    bool needs_avx;
+};
+
+static const struct access_case cases[] = {
+    {"8-byte store straddling the guard", store8_straddle, "WRITE", 8, -4, false},
+    {"2-byte load straddling the guard", load2_straddle, "READ", 2, -1, false},
+    {"movups", movups16, "WRITE", 16, -8, false},
+    {"movdqu", movdqu16, "WRITE", 16, -12, false},
+    {"AVX vmovdqu ymm", avx32, "WRITE", 32, -16, true},
+    {"rep stosb", rep_stosb, "WRITE", 1, 0, false},
+    {"SIB-addressed store", sib_store, "WRITE", 4, 0, false},
+    {"SIB + disp32 16-bit store", sib_disp32_store, "WRITE", 2, 0, false},
+    {"jump into the guard", jump_into_guard, "EXEC", 0, 0, false},
+};
+
+static bool run_case(const struct access_case *c, char *buf, const char *log_path) {
+    char *end = buf + page;
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0) {
+        c->run(end);
+        _exit(0);
+    }
+    int status;
+    waitpid(child, &status, 0);
+
+    char path[96];
+    snprintf(path, sizeof(path), "%s.%d", log_path, (int)child);
+    char line[16384];
+    int fd = open(path, O_RDONLY);
+    ssize_t n = fd >= 0 ? read(fd, line, sizeof(line) - 1) : -1;
+    if (fd >= 0) {
+        close(fd);
+    }
+    unlink(path);
+    if (n <= 0) {
+        printf("FAIL %s: no report (child exited with %d)\n", c->name,
+               WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+        return false;
+    }
+    line[n] = '\0';
+
+    char expected[128];
+    snprintf(expected, sizeof(expected), "\"access\":{\"type\":\"%s\",\"size\":%zu,\"start\":\"%p\"",
+             c->type, c->size, (void *)(end + c->start));
+    if (!strstr(line, expected)) {
+        const char *got = strstr(line, "\"access\":");
+        printf("FAIL %s: expected %s, got %.100s\n", c->name, expected, got ? got : line);
+        return false;
+    }
+    printf("ok   %s: %s of size %zu at end%+ld\n", c->name, c->type, c->size, c->start);
+    return true;
+}
+
+int main() {
+    char log_path[64];
+    snprintf(log_path, sizeof(log_path), "/tmp/toy_asan_fault_access_test_%d", (int)getpid());
+    char options[128];
+    snprintf(options, sizeof(options), "log_path=%s:detect_leaks=0", log_path);
+    setenv("TOY_ASAN_OPTIONS", options, 1);
+    toy_asan_init();
+
+    page = get_system_page_size();
+    char *buf = toy_malloc(page);  // 整页：用户页末尾紧挨右保护页
+
+    int failures = 0;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        if (cases[i].needs_avx && !__builtin_cpu_supports("avx")) {
+            printf("skip %s: no AVX\n", cases[i].name);
+            continue;
+        }
+        failures += !run_case(&cases[i], buf, log_path);
+    }
+
+    char path[96];
+    snprintf(path, sizeof(path), "%s.%d", log_path, (int)getpid());
+    unlink(path);
+    toy_free(buf);
+    if (failures > 0) {
+        printf("%d case(s) failed\n", failures);
+        return 1;
+    }
+    printf("All fault access cases decoded correctly\n");
+    return 0;
+}
@@ -0,0 +1,75 @@
+/**
+ * @file heap_dump_test.c
+ * @brief 二进制堆快照导出测试
+ *
+ * 分配若干块内存（分别归属parser/cache标签，cache带预算）
+ * 后调用toy_asan_dump_heap()写出快照，
+ * 再增加一批分配写出第二个快照，然后可以用离线工具查看：
+ * ```
+ * tools/toy_asan_heapdump heap_dump_test.snap
+ * tools/toy_asan_heapdump heap_dump_test.snap --csv
+ * tools/toy_asan_heapdiff heap_dump_test.snap heap_dump_test_after.snap
+ * ```
+ */
+
+#include "../toy_asan/toy_asan.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+static int parser_tag;
+static int cache_tag;
+
+static void *alloc_from_parser(size_t size) {
+    TOY_ASAN_SCOPED_TAG(parser_tag);   // 作用域标签：普通toy_malloc也归属parser
+    return toy_malloc(size);
+}
+
+static void *alloc_from_cache(size_t size) {
+    return toy_malloc_tagged(size, cache_tag);
+}
+
+int main() {
+    printf("=== Heap Dump Test ===\n");
+    parser_tag = toy_asan_tag_register("parser", 0);
+    cache_tag = toy_asan_tag_register("cache", 8000);  // 超出后退化为不受保护分配
+
+    void *blocks[10];
+    for (int i = 0; i < 3; i++) {
+        blocks[i] = alloc_from_parser(64 * (i + 1));
+    }
+    for (int i = 3; i < 6; i++) {
+        blocks[i] = alloc_from_cache(1000);
+    }
+    toy_free(blocks[0]);
+
+    const char *path = "heap_dump_test.snap";
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("open");
+        return 1;
+    }
+    if (toy_asan_dump_heap(fd) != 0) {
+        perror("toy_asan_dump_heap");
+        close(fd);
+        return 1;
+    }
+    close(fd);
+    printf("Snapshot written to %s\n", path);
+
+    // 第二个时间点：cache调用点继续增长
+    for (int i = 6; i < 10; i++) {
+        blocks[i] = alloc_from_cache(2000);
+    }
+    if (toy_asan_dump_heap_to_file("heap_dump_test_after.snap") != 0) {
+        perror("toy_asan_dump_heap_to_file");
+        return 1;
+    }
+    printf("Snapshot written to heap_dump_test_after.snap\n");
+    toy_asan_print_tag_stats();
+
+    for (int i = 1; i < 10; i++) {
+        toy_free(blocks[i]);
+    }
+    return 0;
+}
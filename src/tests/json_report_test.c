@@ -0,0 +1,147 @@
+/**
+ * @file json_report_test.c
+ * @brief 结构化（JSON）报告测试
+ *
+ * 设置log_path（恢复模式，越界后继续运行）后fork三个子进程，
+ * 各自按自己的pid写<log_path>.<子进程pid>，父进程读回并检查字段：
+ * - 越界写一次：恰好一行heap-buffer-overflow，包含error/access/region/stacks/modules
+ * - 同一处越界写3次后写去重汇总：error-summary行，hits为3
+ * - 丢失一个块的指针后手动做泄漏检测：memory-leak行，带分配栈和模块
+ * 期望：全部通过，以0退出。
+ */
+
+#include "../toy_asan/toy_asan.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static char log_path[64];
+static char line[16384];
+
+static void overflow_once(char *buf) {
+    buf[get_system_page_size()] = 'x';  // 用户页之后的右保护页
+}
+
+static void __attribute__((noinline)) overflow_three_times(char *buf) {
+    for (int i = 0; i < 3; i++) {
+        buf[get_system_page_size()] = (char)i;
+    }
+    report_dedup_summary();
+}
+
+static void __attribute__((noinline)) lose_block(void) {
+    char *leaked = toy_malloc(64);
+    memset(&leaked, 0, sizeof(leaked));
+}
+
+// 清掉lose_block留在更深栈区的残留指针
+static void __attribute__((noinline)) scrub_stack(void) {
+    volatile char scrub[16384];
+    memset((char *)scrub, 0, sizeof(scrub));
+}
+
+static void leak_and_check(char *buf) {
+    (void)buf;
+    lose_block();
+    scrub_stack();
+    toy_asan_check_leaks();
+}
+
+/**
+ * @brief 在子进程中运行fn，读回子进程的结构化报告
+ * @return 读到的字节数，没有报告时返回0
+ */
+static ssize_t run_child(void (*fn)(char *), char *buf) {
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0) {
+        fn(buf);
+        _exit(0);
+    }
+    int status;
+    waitpid(child, &status, 0);
+    printf("Child exited with %d\n", WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+
+    char path[96];
+    snprintf(path, sizeof(path), "%s.%d", log_path, (int)child);
+    int fd = open(path, O_RDONLY);
+    ssize_t n = fd >= 0 ? read(fd, line, sizeof(line) - 1) : -1;
+    if (fd >= 0) {
+        close(fd);
+    }
+    unlink(path);
+    if (n <= 0) {
+        printf("FAIL: no structured report in %s\n", path);
+        return 0;
+    }
+    line[n] = '\0';
+    printf("%s", line);
+    return n;
+}
+
+static bool expect_fields(const char *const *expected, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (!strstr(line, expected[i])) {
+            printf("FAIL: missing %s\n", expected[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main() {
+    snprintf(log_path, sizeof(log_path), "/tmp/toy_asan_json_test_%d", (int)getpid());
+    char options[128];
+    snprintf(options, sizeof(options), "log_path=%s:halt_on_error=0:detect_leaks=0", log_path);
+    setenv("TOY_ASAN_OPTIONS", options, 1);
+    toy_asan_init();
+
+    char *buf = toy_malloc(100);
+
+    ssize_t n = run_child(overflow_once, buf);
+    const char *overflow[] = {
+        "{\"error\":\"heap-buffer-overflow\"", "\"access\":{\"type\":\"WRITE\",\"size\":1",
+        "\"region\":{", "\"relation\":\"right\"", "\"stacks\":{\"current\":[",
+        "\"allocated\":[", "\"modules\":[",
+    };
+    if (n <= 0 || !expect_fields(overflow, sizeof(overflow) / sizeof(overflow[0]))) {
+        return 1;
+    }
+    if (strchr(line, '\n') != line + n - 1) {
+        printf("FAIL: expected exactly one line\n");
+        return 1;
+    }
+
+    // 第一行是那一次越界的完整报告，汇总在最后一行
+    n = run_child(overflow_three_times, buf);
+    const char *summary = n > 0 ? strstr(line, "{\"error\":\"error-summary\"") : NULL;
+    const char *summary_fields[] = {"\"distinct\":1", "\"occurrences\":3", "\"sites\":[",
+                                    "\"hits\":3", "\"reported\":true"};
+    if (!summary) {
+        printf("FAIL: no error-summary line\n");
+        return 1;
+    }
+    memmove(line, summary, strlen(summary) + 1);
+    if (!expect_fields(summary_fields, sizeof(summary_fields) / sizeof(summary_fields[0]))) {
+        return 1;
+    }
+
+    n = run_child(leak_and_check, buf);
+    const char *leak[] = {
+        "{\"error\":\"memory-leak\"", "\"bytes\":64", "\"leaks\":[{\"kind\":\"direct\"",
+        "\"allocated\":[{\"pc\":", "lose_block", "\"modules\":[",
+    };
+    if (n <= 0 || !expect_fields(leak, sizeof(leak) / sizeof(leak[0]))) {
+        return 1;
+    }
+
+    char path[96];
+    snprintf(path, sizeof(path), "%s.%d", log_path, (int)getpid());
+    unlink(path);
+    printf("Structured reports OK\n");
+    toy_free(buf);
+    return 0;
+}
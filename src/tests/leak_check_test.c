@@ -0,0 +1,66 @@
+/**
+ * @file leak_check_test.c
+ * @brief 退出时泄漏检测测试
+ *
+ * 构造四种情况（detect_leaks默认关闭，这里显式打开）：
+ * - 全局变量引用的块：可达，不报告
+ * - 只被超预算标签的回退分配（libc堆上）引用的块：可达，不报告
+ * - 只被局部变量引用、函数返回后丢失的块：直接泄漏
+ * - 只被泄漏块引用的块：间接泄漏
+ *
+ * 期望输出一个Direct leak和一个Indirect leak，退出码为23。
+ */
+
+#include "../toy_asan/toy_asan.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct node {
+    struct node *next;
+    char payload[56];
+};
+
+static struct node *global_list;
+static struct node *global_fallback;  // 超预算分配：实际在libc堆上
+
+static void make_reachable(void) {
+    global_list = toy_malloc(sizeof(struct node));
+    global_list->next = toy_malloc(sizeof(struct node));
+    global_list->next->next = NULL;
+}
+
+// 受保护块只存在回退分配里；标签预算为1字节，之后的标签分配都回退
+static void __attribute__((noinline)) make_reachable_from_fallback(void) {
+    int tag = toy_asan_tag_register("over-budget", 1);
+    global_fallback = toy_malloc_tagged(sizeof(struct node), tag);
+    global_fallback->next = toy_malloc(sizeof(struct node));
+    global_fallback->next->next = NULL;
+}
+
+static void __attribute__((noinline)) make_leak(void) {
+    struct node *head = toy_malloc(sizeof(struct node));
+    head->next = toy_malloc(sizeof(struct node));
+    head->next->next = NULL;
+    // head离开作用域后不再可达
+    memset(&head, 0, sizeof(head));
+}
+
+// 清掉make_leak及其调用链留在更深栈区的残留指针
+static void __attribute__((noinline)) scrub_stack(void) {
+    volatile char scrub[16384];
+    memset((char *)scrub, 0, sizeof(scrub));
+}
+
+int main() {
+    setenv("TOY_ASAN_OPTIONS", "detect_leaks=1", 1);
+    printf("=== Leak Check Test ===\n");
+    make_reachable();
+    make_reachable_from_fallback();
+    make_leak();
+
+    scrub_stack();
+
+    printf("Exiting, leak check runs at exit...\n");
+    return 0;
+}
@@ -0,0 +1,40 @@
+/**
+ * @file recover_mode_test.c
+ * @brief 恢复模式（halt_on_error=0）测试
+ *
+ * 热循环中同一条指令反复越界写右保护页，另一处越界读左保护页。
+ * 期望：
+ * - 两个调用点各报告一次，进程不退出
+ * - 热循环的调用点超过recover_site_budget后保护页保持打开，
+ *   之后的迭代不再产生信号
+ * - 越界写入的数据确实写进了保护页（单步执行了原指令）
+ * - 最后打印"Still running"并以0退出
+ */
+
+#include "../toy_asan/toy_asan.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static void __attribute__((noinline)) hot_overflow(char *buf, int size, int rounds) {
+    for (int i = 0; i < rounds; i++) {
+        buf[size] = (char)i;  // 右保护页的第一个字节
+    }
+}
+
+int main() {
+    // 选项在首次分配时解析，这里先于toy_asan_init设置
+    setenv("TOY_ASAN_OPTIONS", "halt_on_error=0:recover_site_budget=10:detect_leaks=0", 1);
+    toy_asan_init();
+
+    int size = (int)get_system_page_size();
+    char *buf = toy_malloc(size);
+    hot_overflow(buf, size, 100000);
+    printf("Last value written past the end: %d\n", buf[size]);
+
+    volatile char c = buf[-1];  // 左保护页
+    (void)c;
+
+    toy_free(buf);
+    printf("Still running\n");
+    return 0;
+}
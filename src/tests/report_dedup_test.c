@@ -0,0 +1,41 @@
+/**
+ * @file report_dedup_test.c
+ * @brief 报告去重与限流测试
+ *
+ * 恢复模式下同一条越界写指令作用于三个不同调用点分配的块，每块20次。
+ * 期望（max_reports=2）：
+ * - 前两个（PC，分配栈）组合各一份完整报告，之后只计数
+ * - 第三个组合超出总数上限，不写完整报告
+ * - 退出时汇总：3个组合、60次出现、第三个标记为[not reported]
+ */
+
+#include "../toy_asan/toy_asan.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static void __attribute__((noinline)) write_past_end(char *buf, int size) {
+    buf[size] = 'x';
+}
+
+int main() {
+    setenv("TOY_ASAN_OPTIONS", "halt_on_error=0:max_reports=2:detect_leaks=0", 1);
+    toy_asan_init();
+
+    int size = (int)get_system_page_size();
+    char *a = toy_malloc(size);
+    char *b = toy_malloc(size);
+    char *c = toy_malloc(size);
+    char *bufs[3] = {a, b, c};
+
+    for (int round = 0; round < 20; round++) {
+        for (int i = 0; i < 3; i++) {
+            write_past_end(bufs[i], size);
+        }
+    }
+
+    toy_free(a);
+    toy_free(b);
+    toy_free(c);
+    printf("Still running\n");
+    return 0;
+}
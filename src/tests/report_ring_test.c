@@ -0,0 +1,143 @@
+/**
+ * @file report_ring_test.c
+ * @brief 共享内存报告环测试
+ *
+ * 模拟prefork服务：初始化时创建报告环，然后fork 5个worker，
+ * 其中4个在同一处越界写同一个块，1个越界写另一个块；
+ * 再exec一个新进程（另一套ASLR加载地址），经同一路径打开环，
+ * 走同样的代码路径在同一处越界。
+ * 父进程直接读取环（report_ring.h），检查记录数、签名合并和各字段。
+ * 期望：6条记录、2个不同签名（exec出的进程与fork出的worker合并），以0退出。
+ * 用tools/toy_asan_collect <ring>查看同样的合并结果。
+ */
+
+#include "../toy_asan/toy_asan.h"
+#include "../toy_asan/report_ring.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define SAME_SITE_WORKERS 4
+#define EXEC_WORKER_ARG "--exec-worker"
+
+__attribute__((noinline)) static void worker_overflow(char *buf) {
+    buf[get_system_page_size()] = 'x';  // 用户页之后的右保护页
+}
+
+// fork_first为false时在当前进程里越界（exec出的worker），调用链与fork出的worker相同
+__attribute__((noinline)) static pid_t spawn_worker(char *buf, bool fork_first) {
+    pid_t pid = fork_first ? fork() : 0;
+    if (pid == 0) {
+        worker_overflow(buf);
+        _exit(0);
+    }
+    return pid;
+}
+
+static void wait_worker(pid_t pid) {
+    int status;
+    waitpid(pid, &status, 0);
+    printf("Worker %d exited with %d\n", (int)pid,
+           WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+}
+
+// 两种进程都从这里分配、派生worker，分配栈和出错栈的模块偏移一致
+__attribute__((noinline)) static void run_workers(bool exec_worker) {
+    char *shared = toy_malloc(100);
+    char *other = toy_malloc(200);
+    for (int i = 0; i < SAME_SITE_WORKERS + 1; i++) {
+        pid_t pid = spawn_worker(i < SAME_SITE_WORKERS ? shared : other, !exec_worker);
+        wait_worker(pid);
+    }
+    toy_free(shared);
+    toy_free(other);
+}
+
+static int check_ring(const char *ring_path) {
+    int fd = open(ring_path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        printf("FAIL: cannot open %s\n", ring_path);
+        return 1;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED || !report_ring_valid(map, (size_t)st.st_size)) {
+        printf("FAIL: invalid report ring\n");
+        return 1;
+    }
+    struct report_ring_header *h = map;
+    const struct report_ring_record *records = report_ring_records(h);
+
+    printf("Ring: head=%lu dropped=%lu\n", (unsigned long)h->head, (unsigned long)h->dropped);
+    if (h->head != SAME_SITE_WORKERS + 2 || h->dropped != 0) {
+        printf("FAIL: expected %d records\n", SAME_SITE_WORKERS + 2);
+        return 1;
+    }
+
+    // 最后一条来自exec出的进程，与前4条fork出的worker同一处
+    uint64_t first_signature = records[0].signature;
+    int same = 0;
+    for (uint64_t i = 0; i < h->head; i++) {
+        const struct report_ring_record *r = &records[i];
+        const char *module = r->frame_modules[0] < REPORT_RING_MODULES
+                                 ? r->modules[r->frame_modules[0]] : "??";
+        printf("  seq=%lu pid=%u %s in %s (%s+0x%lx), %s of size %u, region size %lu, "
+               "signature=%lx\n",
+               (unsigned long)r->seq, r->pid, report_ring_error_name(r->error), r->symbol,
+               module, (unsigned long)r->frame_offsets[0], r->is_write ? "WRITE" : "READ",
+               r->access_size, (unsigned long)r->region_size, (unsigned long)r->signature);
+        if (r->seq != i + 1 || r->error != REPORT_RING_HEAP_BUFFER_OVERFLOW || !r->is_write ||
+            r->access_size != 1 || r->frame_count == 0 || r->alloc_frame_count == 0 ||
+            !strstr(module, "report_ring_test")) {
+            printf("FAIL: unexpected record %lu\n", (unsigned long)i);
+            return 1;
+        }
+        same += r->signature == first_signature;
+    }
+    if (same != SAME_SITE_WORKERS + 1 ||
+        records[h->head - 1].signature != first_signature ||
+        records[h->head - 1].frames[0] == records[0].frames[0]) {
+        printf("FAIL: expected %d records with the same signature from two address layouts, "
+               "got %d\n", SAME_SITE_WORKERS + 1, same);
+        return 1;
+    }
+    printf("Report ring OK: %d workers (one exec'd) merged into 1 site, 1 other site\n",
+           SAME_SITE_WORKERS + 1);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    bool exec_worker = argc > 1 && strcmp(argv[1], EXEC_WORKER_ARG) == 0;
+    char ring_path[64];
+    if (exec_worker) {
+        snprintf(ring_path, sizeof(ring_path), "%s", argv[2]);
+    } else {
+        snprintf(ring_path, sizeof(ring_path), "/dev/shm/toy_asan_ring_test_%d", (int)getpid());
+    }
+    char options[128];
+    snprintf(options, sizeof(options), "report_ring=%s:detect_leaks=0", ring_path);
+    setenv("TOY_ASAN_OPTIONS", options, 1);
+    toy_asan_init();
+
+    run_workers(exec_worker);
+    if (exec_worker) {
+        return 0;  // 不会到这里：worker越界后退出
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        execl("/proc/self/exe", argv[0], EXEC_WORKER_ARG, ring_path, (char *)NULL);
+        _exit(127);
+    }
+    wait_worker(pid);
+
+    int result = check_ring(ring_path);
+    unlink(ring_path);
+    return result;
+}
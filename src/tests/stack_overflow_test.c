@@ -0,0 +1,59 @@
+/**
+ * @file stack_overflow_test.c
+ * @brief 备用信号栈测试
+ *
+ * 先让一批线程各分配一次后退出（备用栈放回空闲表、被后面的线程复用），
+ * 再在一个子线程里无限递归耗尽线程栈。
+ * 期望：SIGSEGV处理器在备用栈上运行，报告stack-overflow后以1退出，
+ * 而不是在处理器里再次出错被内核直接杀死。
+ */
+
+#include "../toy_asan/toy_asan.h"
+#include <pthread.h>
+#include <stdio.h>
+
+static void *short_lived(void *arg) {
+    (void)arg;
+    toy_free(toy_malloc(16));  // 首次分配时登记线程并安装备用栈
+    return NULL;
+}
+
+static volatile int max_depth = 1 << 30;  // 实际上永远到不了
+
+static int __attribute__((noinline)) recurse(int depth) {
+    volatile char frame[256];
+    frame[0] = (char)depth;
+    if (depth >= max_depth) {
+        return frame[0];
+    }
+    return recurse(depth + 1) + frame[0];
+}
+
+static void *overflow(void *arg) {
+    (void)arg;
+    toy_free(toy_malloc(16));
+    printf("Recursing until the thread stack runs out\n");
+    fflush(stdout);
+    return (void *)(long)recurse(0);
+}
+
+int main() {
+    toy_asan_init();
+
+    for (int round = 0; round < 10; round++) {
+        pthread_t threads[8];
+        for (int i = 0; i < 8; i++) {
+            pthread_create(&threads[i], NULL, short_lived, NULL);
+        }
+        for (int i = 0; i < 8; i++) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+    printf("80 short-lived threads done\n");
+
+    pthread_t t;
+    pthread_create(&t, NULL, overflow, NULL);
+    pthread_join(t, NULL);
+    printf("Should not reach here\n");
+    return 0;
+}
@@ -0,0 +1,49 @@
+/**
+ * @file uffd_monitor_test.c
+ * @brief userfaultfd保护页监控测试
+ *
+ * fault_monitor=userfaultfd初始化后，程序安装自己的SIGSEGV处理器
+ * （覆盖了toy_asan的处理器），再越界写右保护页。
+ * 保护页访问由监控线程报告，不经过SIGSEGV：
+ * 期望：heap-buffer-overflow报告（WRITE of size 4，调用栈含
+ * overflow_by_one_int和main），以1退出；程序的处理器没有运行。
+ * 内核不支持userfaultfd时打印原因后以0退出。
+ */
+
+#include "../toy_asan/toy_asan.h"
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static void application_sigsegv(int sig) {
+    (void)sig;
+    static const char msg[] = "FAIL: guard page access reached the application's SIGSEGV handler\n";
+    write(STDOUT_FILENO, msg, sizeof(msg) - 1);
+    _exit(2);
+}
+
+__attribute__((noinline)) static void overflow_by_one_int(int *values, int count) {
+    values[count] = 42;  // 100个int之后：落在右保护页上
+}
+
+int main() {
+    setenv("TOY_ASAN_OPTIONS", "fault_monitor=userfaultfd:detect_leaks=0", 1);
+    toy_asan_init();
+    if (!uffd_monitor_active()) {
+        printf("userfaultfd not available here, nothing to test\n");
+        return 0;
+    }
+
+    signal(SIGSEGV, application_sigsegv);
+
+    int page_ints = (int)(get_system_page_size() / sizeof(int));
+    int *values = toy_malloc(page_ints * sizeof(int));
+    values[0] = 1;
+    printf("Writing one int past a %d-int block...\n", page_ints);
+    fflush(stdout);
+    overflow_by_one_int(values, page_ints);
+
+    printf("FAIL: overflow was not reported\n");
+    return 1;
+}
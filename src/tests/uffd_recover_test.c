@@ -0,0 +1,68 @@
+/**
+ * @file uffd_recover_test.c
+ * @brief userfaultfd监控下的恢复模式测试
+ *
+ * fault_monitor=userfaultfd:halt_on_error=0:recover_site_budget=3时，
+ * 同一处反复越界写右保护页，每次之间等待保护页重新监控。
+ * 用mincore观察保护页是否驻留（放开时由UFFDIO_ZEROPAGE填入，
+ * 重新监控时被MADV_DONTNEED丢掉）。期望：
+ * - 第一次越界报告一次，进程不退出，稍后保护页重新监控（不驻留）
+ * - 超过预算后打印"leaving them open"，保护页保持驻留
+ * - 释放块后进程继续运行，打印"Still running"并以0退出
+ * 内核不支持userfaultfd时打印原因后以0退出。
+ */
+
+#include "../toy_asan/toy_asan.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define BUDGET 3
+
+static void __attribute__((noinline)) overflow_once(char *buf, size_t size, char value) {
+    buf[size] = value;  // 右保护页的第一个字节
+}
+
+static bool guard_resident(char *guard) {
+    unsigned char vec = 0;
+    mincore(guard, get_system_page_size(), &vec);
+    return vec & 1;
+}
+
+int main() {
+    setenv("TOY_ASAN_OPTIONS",
+           "fault_monitor=userfaultfd:halt_on_error=0:recover_site_budget=3:detect_leaks=0", 1);
+    toy_asan_init();
+    if (!uffd_monitor_active()) {
+        printf("userfaultfd not available here, nothing to test\n");
+        return 0;
+    }
+
+    size_t size = get_system_page_size();
+    char *buf = toy_malloc(size);
+    char *guard = buf + size;
+
+    overflow_once(buf, size, 1);
+    usleep(100 * 1000);  // 远大于重新监控的延迟
+    if (guard_resident(guard)) {
+        printf("FAIL: guard page was not re-armed after the first overflow\n");
+        return 1;
+    }
+    printf("Guard page re-armed after the first overflow\n");
+
+    for (int i = 0; i < BUDGET + 2; i++) {
+        overflow_once(buf, size, (char)(i + 2));
+        usleep(50 * 1000);
+    }
+    if (!guard_resident(guard)) {
+        printf("FAIL: guard page still monitored after the site budget was used up\n");
+        return 1;
+    }
+    printf("Guard page left open after %d hits, last value written past the end: %d\n",
+           BUDGET, guard[0]);
+
+    toy_free(buf);
+    printf("Still running\n");
+    return 0;
+}
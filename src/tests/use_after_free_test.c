@@ -0,0 +1,39 @@
+/**
+ * @file use_after_free_test.c
+ * @brief 释放栈采集与use-after-free报告测试
+ *
+ * 打开free_context后，toy_free会记录释放栈；随后读取已释放的块，
+ * 期望报告heap-use-after-free，并同时给出释放栈和分配栈。
+ * 顺带用sample_every=4演示同一调用点的采样：8次分配只完整回溯2次，
+ * 其余沿用该调用点的栈，调用点统计中仍只有一个调用点。
+ */
+
+#include "../toy_asan/toy_asan.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static void __attribute__((noinline)) churn(void) {
+    for (int i = 0; i < 8; i++) {
+        toy_free(toy_malloc(32));
+    }
+}
+
+int main() {
+    // 选项在首次分配时解析，这里先于toy_asan_init设置
+    setenv("TOY_ASAN_OPTIONS", "free_context=1:sample_every=4:malloc_context_size=16", 1);
+    toy_asan_init();
+
+    churn();
+    toy_asan_print_top_sites(4);
+
+    char *buf = toy_malloc(100);
+    buf[0] = 'A';
+    toy_free(buf);
+
+    printf("Reading freed buffer %p...\n", buf);
+    volatile char c = buf[10];
+    (void)c;
+
+    printf("No SIGSEGV triggered!\n");
+    return 0;
+}
@@ -0,0 +1,234 @@
+/**
+ * @file snapshot_reader.c
+ * @brief 离线工具共用的堆快照读取实现
+ *
+ * @author Toy ASan Project
+ * @version 1.0
+ */
+
+#include "snapshot_reader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// 顺序读取游标
+struct cursor {
+  const char *data;
+  size_t size;
+  size_t pos;
+};
+
+static int cursor_read(struct cursor *c, void *out, size_t len) {
+  if (c->size - c->pos < len) {
+    return -1;
+  }
+  memcpy(out, c->data + c->pos, len);
+  c->pos += len;
+  return 0;
+}
+
+const char *snapshot_tag_name(const struct snapshot *snap, uint32_t tag) {
+  if (tag < snap->header.tag_count && snap->tag_names[tag]) {
+    return snap->tag_names[tag];
+  }
+  return "untagged";
+}
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ull
+#define FNV_PRIME 0x100000001b3ull
+
+static uint64_t fnv1a(uint64_t h, const void *data, size_t len) {
+  const unsigned char *p = data;
+  for (size_t i = 0; i < len; i++) {
+    h ^= p[i];
+    h *= FNV_PRIME;
+  }
+  return h;
+}
+
+static char *read_file(const char *path, size_t *size) {
+  FILE *fp = fopen(path, "rb");
+  if (!fp) {
+    perror(path);
+    return NULL;
+  }
+
+  size_t cap = 1 << 20;
+  size_t len = 0;
+  char *buf = malloc(cap);
+  size_t n;
+  while (buf && (n = fread(buf + len, 1, cap - len, fp)) > 0) {
+    len += n;
+    if (len == cap) {
+      cap *= 2;
+      char *grown = realloc(buf, cap);
+      if (!grown) {
+        free(buf);
+      }
+      buf = grown;
+    }
+  }
+  fclose(fp);
+  *size = len;
+  return buf;
+}
+
+int snapshot_load(const char *path, struct snapshot *snap) {
+  memset(snap, 0, sizeof(*snap));
+
+  size_t size = 0;
+  char *data = read_file(path, &size);
+  if (!data) {
+    return -1;
+  }
+
+  struct cursor c = {data, size, 0};
+  if (cursor_read(&c, &snap->header, sizeof(snap->header)) != 0 ||
+      memcmp(snap->header.magic, HEAP_SNAPSHOT_MAGIC,
+             sizeof(HEAP_SNAPSHOT_MAGIC)) != 0) {
+    fprintf(stderr, "%s: not a toy_asan heap snapshot\n", path);
+    free(data);
+    return -1;
+  }
+  if (snap->header.version != HEAP_SNAPSHOT_VERSION) {
+    fprintf(stderr, "%s: unsupported snapshot version %u\n", path,
+            snap->header.version);
+    free(data);
+    return -1;
+  }
+
+  snap->modules = calloc(snap->header.module_count + 1, sizeof(*snap->modules));
+  snap->records = calloc(snap->header.record_count + 1, sizeof(*snap->records));
+  if (!snap->modules || !snap->records) {
+    goto truncated;
+  }
+
+  for (uint32_t i = 0; i < snap->header.module_count; i++) {
+    struct heap_snapshot_module m;
+    struct snapshot_module *mod = &snap->modules[i];
+    if (cursor_read(&c, &m, sizeof(m)) != 0) {
+      goto truncated;
+    }
+    mod->load_base = m.load_base;
+    mod->start = m.start;
+    mod->end = m.end;
+    mod->build_id_size = m.build_id_size;
+    mod->path = calloc(1, m.path_len + 1);
+    mod->build_id = calloc(1, m.build_id_size + 1);
+    if (!mod->path || !mod->build_id ||
+        cursor_read(&c, mod->path, m.path_len) != 0 ||
+        cursor_read(&c, mod->build_id, m.build_id_size) != 0) {
+      goto truncated;
+    }
+    mod->path_hash = fnv1a(FNV_OFFSET_BASIS, mod->path, m.path_len);
+  }
+
+  snap->tag_names = calloc(snap->header.tag_count + 1, sizeof(char *));
+  if (!snap->tag_names) {
+    goto truncated;
+  }
+  for (uint32_t i = 0; i < snap->header.tag_count; i++) {
+    struct heap_snapshot_tag t;
+    if (cursor_read(&c, &t, sizeof(t)) != 0 || t.tag != i) {
+      goto truncated;
+    }
+    snap->tag_names[i] = calloc(1, t.name_len + 1);
+    if (!snap->tag_names[i] ||
+        cursor_read(&c, snap->tag_names[i], t.name_len) != 0) {
+      goto truncated;
+    }
+  }
+
+  // 帧总数未知，先按剩余字节估算上限一次性分配
+  size_t max_frames = (size - c.pos) / sizeof(uint64_t) + 1;
+  snap->frames = malloc(max_frames * sizeof(uint64_t));
+  if (!snap->frames) {
+    goto truncated;
+  }
+
+  size_t frame_pos = 0;
+  for (uint32_t i = 0; i < snap->header.record_count; i++) {
+    struct heap_snapshot_record r;
+    struct snapshot_record *rec = &snap->records[i];
+    if (cursor_read(&c, &r, sizeof(r)) != 0) {
+      goto truncated;
+    }
+    rec->user_addr = r.user_addr;
+    rec->user_size = r.user_size;
+    rec->slot = r.slot;
+    rec->frame_count = r.frame_count;
+    rec->tag = r.tag;
+    rec->frames = snap->frames + frame_pos;
+    if (frame_pos + r.frame_count > max_frames ||
+        cursor_read(&c, rec->frames, r.frame_count * sizeof(uint64_t)) != 0) {
+      goto truncated;
+    }
+    frame_pos += r.frame_count;
+  }
+
+  free(data);
+  return 0;
+
+truncated:
+  fprintf(stderr, "%s: truncated or corrupt snapshot\n", path);
+  free(data);
+  snapshot_free(snap);
+  return -1;
+}
+
+void snapshot_free(struct snapshot *snap) {
+  if (snap->modules) {
+    for (uint32_t i = 0; i < snap->header.module_count; i++) {
+      free(snap->modules[i].path);
+      free(snap->modules[i].build_id);
+    }
+  }
+  if (snap->tag_names) {
+    for (uint32_t i = 0; i < snap->header.tag_count; i++) {
+      free(snap->tag_names[i]);
+    }
+  }
+  free(snap->tag_names);
+  free(snap->modules);
+  free(snap->records);
+  free(snap->frames);
+  memset(snap, 0, sizeof(*snap));
+}
+
+const struct snapshot_module *snapshot_find_module(const struct snapshot *snap,
+                                                   uint64_t pc) {
+  for (uint32_t i = 0; i < snap->header.module_count; i++) {
+    const struct snapshot_module *mod = &snap->modules[i];
+    if (pc >= mod->start && pc < mod->end) {
+      return mod;
+    }
+  }
+  return NULL;
+}
+
+uint64_t snapshot_stack_hash(const struct snapshot *snap,
+                             const struct snapshot_record *rec) {
+  uint64_t h = FNV_OFFSET_BASIS;
+  for (uint32_t f = 0; f < rec->frame_count; f++) {
+    uint64_t pc = rec->frames[f];
+    const struct snapshot_module *mod = snapshot_find_module(snap, pc);
+    if (mod) {
+      // 模块按路径区分，偏移相对加载基址，两次运行之间也能对齐
+      uint64_t offset = pc - mod->load_base;
+      h = fnv1a(h, &mod->path_hash, sizeof(mod->path_hash));
+      h = fnv1a(h, &offset, sizeof(offset));
+    } else {
+      h = fnv1a(h, &pc, sizeof(pc));
+    }
+  }
+  return h;
+}
+
+void snapshot_format_build_id(const struct snapshot_module *mod, char *out,
+                              size_t out_size) {
+  size_t pos = 0;
+  out[0] = '\0';
+  for (uint32_t i = 0; i < mod->build_id_size && pos + 3 <= out_size; i++) {
+    pos += snprintf(out + pos, out_size - pos, "%02x", mod->build_id[i]);
+  }
+}
@@ -0,0 +1,65 @@
+/**
+ * @file snapshot_reader.h
+ * @brief 离线工具共用的堆快照读取接口
+ *
+ * 把heap_snapshot.h格式的文件整体读入内存，供
+ * toy_asan_heapdump等离线工具使用。
+ *
+ * @author Toy ASan Project
+ * @version 1.0
+ */
+
+#ifndef TOY_ASAN_SNAPSHOT_READER_H
+#define TOY_ASAN_SNAPSHOT_READER_H
+
+#include "../toy_asan/heap_snapshot.h"
+#include <stddef.h>
+#include <stdint.h>
+
+struct snapshot_module {
+  uint64_t load_base;
+  uint64_t start;
+  uint64_t end;
+  char *path;
+  uint8_t *build_id;
+  uint32_t build_id_size;
+  uint64_t path_hash;        // 路径哈希，供调用栈哈希使用
+};
+
+struct snapshot_record {
+  uint64_t user_addr;
+  uint64_t user_size;
+  uint32_t slot;
+  uint32_t frame_count;
+  uint32_t tag;
+  uint64_t *frames;          // 指向snapshot.frames中的一段
+};
+
+struct snapshot {
+  struct heap_snapshot_header header;
+  struct snapshot_module *modules;
+  char **tag_names;          // 按标签编号索引
+  struct snapshot_record *records;
+  uint64_t *frames;          // 所有记录的帧连续存放
+};
+
+// 读取快照文件，成功返回0，失败打印原因并返回-1
+int snapshot_load(const char *path, struct snapshot *snap);
+void snapshot_free(struct snapshot *snap);
+
+// 查找pc所在模块，没找到返回NULL
+const struct snapshot_module *snapshot_find_module(const struct snapshot *snap,
+                                                   uint64_t pc);
+
+// 计算分配调用栈的哈希（基于模块路径+偏移，不受ASLR影响）
+uint64_t snapshot_stack_hash(const struct snapshot *snap,
+                             const struct snapshot_record *rec);
+
+// 标签编号 → 标签名（未知编号返回"untagged"）
+const char *snapshot_tag_name(const struct snapshot *snap, uint32_t tag);
+
+// 把build-id格式化为十六进制字符串
+void snapshot_format_build_id(const struct snapshot_module *mod, char *out,
+                              size_t out_size);
+
+#endif // TOY_ASAN_SNAPSHOT_READER_H
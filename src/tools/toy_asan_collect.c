@@ -0,0 +1,218 @@
+/**
+ * @file toy_asan_collect.c
+ * @brief 共享内存报告环收集工具
+ *
+ * 读出report_ring选项指定的环（见report_ring.h）中的全部记录，
+ * 按栈签名合并各进程报告的同一处错误，按出现次数从多到少打印。
+ * 签名与加载地址无关，各帧打印为模块+偏移；PC只是样本进程中的地址。
+ *
+ * 用法：
+ * ```
+ * toy_asan_collect [-k] <ring>
+ * ```
+ * - ring：tmpfs上的文件，或memfd的/proc/<pid>/fd/<n>
+ * - -k：只读取，不清空（默认取走后清空，下次只看到新记录）
+ *
+ * 与写者并发运行是安全的：复制前后seq不一致的记录视为正在写，跳过，
+ * 下次收集时再取。
+ *
+ * @author Toy ASan Project
+ * @version 1.0
+ */
+
+#include "report_ring.h"
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// 一个错误点（同一签名）的合并结果
+struct site {
+  const struct report_ring_record *sample;
+  uint64_t count;
+  uint32_t processes;          // 报告过它的不同进程数
+};
+
+/**
+ * @brief 取出环中已发布的记录
+ * @param keep true时不清空
+ * @return 复制出的记录数
+ */
+static size_t drain(struct report_ring_header *h, struct report_ring_record *out, bool keep) {
+  struct report_ring_record *slots = report_ring_records(h);
+  uint64_t head = __atomic_load_n(&h->head, __ATOMIC_ACQUIRE);
+  size_t n = 0;
+  for (uint32_t i = 0; i < h->capacity; i++) {
+    uint64_t seq = __atomic_load_n(&slots[i].seq, __ATOMIC_ACQUIRE);
+    if (seq == 0) {
+      continue;
+    }
+    memcpy(&out[n], &slots[i], sizeof(out[n]));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&slots[i].seq, __ATOMIC_RELAXED) != seq) {
+      continue;                // 复制期间被覆盖
+    }
+    n++;
+    if (!keep) {
+      // 失败说明写者已开始覆盖，新记录留给下次
+      __atomic_compare_exchange_n(&slots[i].seq, &seq, 0, false, __ATOMIC_ACQ_REL,
+                                  __ATOMIC_RELAXED);
+    }
+  }
+  if (!keep) {
+    uint64_t tail = __atomic_load_n(&h->tail, __ATOMIC_RELAXED);
+    if (head > tail) {
+      __atomic_store_n(&h->tail, head, __ATOMIC_RELEASE);
+    }
+  }
+  return n;
+}
+
+// 按（签名，pid）排序，相同签名的记录相邻
+static int compare_signature(const void *a, const void *b) {
+  const struct report_ring_record *ra = a;
+  const struct report_ring_record *rb = b;
+  if (ra->signature != rb->signature) {
+    return ra->signature < rb->signature ? -1 : 1;
+  }
+  if (ra->pid != rb->pid) {
+    return ra->pid < rb->pid ? -1 : 1;
+  }
+  return ra->seq < rb->seq ? -1 : ra->seq > rb->seq;
+}
+
+static int compare_pid(const void *a, const void *b) {
+  uint32_t pa = *(const uint32_t *)a;
+  uint32_t pb = *(const uint32_t *)b;
+  return pa < pb ? -1 : pa > pb;
+}
+
+static int compare_count(const void *a, const void *b) {
+  const struct site *sa = a;
+  const struct site *sb = b;
+  if (sa->count != sb->count) {
+    return sa->count > sb->count ? -1 : 1;
+  }
+  return sa->sample->seq < sb->sample->seq ? -1 : sa->sample->seq > sb->sample->seq;
+}
+
+// 各帧打印为 模块+偏移（与进程的加载地址无关，可以直接交给addr2line）
+static void print_frames(const char *title, const struct report_ring_record *r,
+                         const uint64_t *frames, const uint64_t *offsets,
+                         const uint8_t *module_ids, uint8_t count) {
+  if (count == 0) {
+    return;
+  }
+  printf("  %s:\n", title);
+  for (uint8_t f = 0; f < count; f++) {
+    if (module_ids[f] < REPORT_RING_MODULES) {
+      printf("    #%u 0x%" PRIx64 " (%s+0x%" PRIx64 ")\n", f, frames[f],
+             r->modules[module_ids[f]], offsets[f]);
+    } else {
+      printf("    #%u 0x%" PRIx64 "\n", f, frames[f]);
+    }
+  }
+}
+
+static void print_site(const struct site *s) {
+  const struct report_ring_record *r = s->sample;
+  printf("%" PRIu64 " x %s in %s (%u processes) signature=%016" PRIx64 "\n", s->count,
+         report_ring_error_name(r->error), r->symbol, s->processes, r->signature);
+  if (r->error != REPORT_RING_STACK_OVERFLOW) {
+    if (r->access_size > 0) {
+      printf("  %s of size %u at 0x%" PRIx64 ", region [0x%" PRIx64 ", +%" PRIu64 ")\n",
+             r->is_write ? "WRITE" : "READ", r->access_size, r->fault_addr, r->region_start,
+             r->region_size);
+    } else {
+      printf("  %s of unknown size at 0x%" PRIx64 ", region [0x%" PRIx64 ", +%" PRIu64 ")\n",
+             r->is_write ? "WRITE" : "READ", r->fault_addr, r->region_start, r->region_size);
+    }
+  }
+  print_frames("current", r, r->frames, r->frame_offsets, r->frame_modules, r->frame_count);
+  print_frames("allocated", r, r->alloc_frames, r->alloc_frame_offsets, r->alloc_frame_modules,
+               r->alloc_frame_count);
+}
+
+int main(int argc, char **argv) {
+  bool keep = false;
+  const char *path = NULL;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-k") == 0) {
+      keep = true;
+    } else {
+      path = argv[i];
+    }
+  }
+  if (!path) {
+    fprintf(stderr, "usage: %s [-k] <ring>\n", argv[0]);
+    return 2;
+  }
+
+  int fd = open(path, keep ? O_RDONLY : O_RDWR);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    perror(path);
+    return 1;
+  }
+  size_t size = (size_t)st.st_size;
+  void *map = size >= sizeof(struct report_ring_header)
+                  ? mmap(NULL, size, keep ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+                  : MAP_FAILED;
+  close(fd);
+  if (map == MAP_FAILED || !report_ring_valid(map, size)) {
+    fprintf(stderr, "%s: not a Toy ASan report ring\n", path);
+    return 1;
+  }
+  struct report_ring_header *h = map;
+
+  struct report_ring_record *records = malloc((size_t)h->capacity * sizeof(*records));
+  struct site *sites = malloc((size_t)h->capacity * sizeof(*sites));
+  if (!records || !sites) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  size_t n = drain(h, records, keep);
+  uint64_t dropped = __atomic_load_n(&h->dropped, __ATOMIC_RELAXED);
+
+  // 合并：排序后同签名相邻，同一签名内同pid相邻
+  qsort(records, n, sizeof(*records), compare_signature);
+  size_t site_count = 0;
+  for (size_t i = 0; i < n; i++) {
+    bool new_site = i == 0 || records[i].signature != records[i - 1].signature;
+    if (new_site) {
+      sites[site_count++] = (struct site){&records[i], 0, 0};
+    }
+    sites[site_count - 1].count++;
+    sites[site_count - 1].processes += new_site || records[i].pid != records[i - 1].pid;
+  }
+  qsort(sites, site_count, sizeof(*sites), compare_count);
+
+  // 报告过错误的不同进程总数
+  uint32_t *pids = malloc((n + 1) * sizeof(*pids));
+  uint32_t processes = 0;
+  for (size_t i = 0; pids && i < n; i++) {
+    pids[i] = records[i].pid;
+  }
+  if (pids) {
+    qsort(pids, n, sizeof(*pids), compare_pid);
+    for (size_t i = 0; i < n; i++) {
+      processes += i == 0 || pids[i] != pids[i - 1];
+    }
+  }
+
+  printf("=== Toy ASan report ring: %zu reports, %zu distinct, %u processes, %" PRIu64
+         " dropped ===\n",
+         n, site_count, processes, dropped);
+  for (size_t i = 0; i < site_count; i++) {
+    print_site(&sites[i]);
+  }
+
+  free(pids);
+  free(sites);
+  free(records);
+  munmap(map, size);
+  return 0;
+}
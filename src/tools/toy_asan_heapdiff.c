@@ -0,0 +1,171 @@
+/**
+ * @file toy_asan_heapdiff.c
+ * @brief 堆快照差异分析工具
+ *
+ * 比较两个堆快照（toy_asan_dump_heap()输出），按分配调用栈
+ * 聚合，报告每个调用点新增/减少的字节数和块数，按增长量排序。
+ *
+ * 用法：
+ * ```
+ * toy_asan_heapdiff before.snap after.snap [--top N]
+ * ```
+ *
+ * 算法：
+ * - 每条记录计算调用栈哈希（模块路径+偏移，见snapshot_stack_hash）
+ * - 两个快照的记录都累加进同一张开放寻址哈希表
+ * - 整体 O(记录数)，而不是逐条两两比较
+ *
+ * @author Toy ASan Project
+ * @version 1.0
+ */
+
+#include "snapshot_reader.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// 每个调用点的聚合结果
+struct site_delta {
+  uint64_t stack_hash;
+  uint64_t count[2];         // [0]=旧快照，[1]=新快照
+  uint64_t bytes[2];
+  const struct snapshot *snap;                // 用于打印代表性调用栈
+  const struct snapshot_record *sample;
+  int used;
+};
+
+struct site_table {
+  struct site_delta *slots;
+  size_t mask;
+  size_t used;
+};
+
+static int site_table_init(struct site_table *t, size_t expected) {
+  size_t cap = 16;
+  while (cap < expected * 2) {
+    cap <<= 1;
+  }
+  t->slots = calloc(cap, sizeof(*t->slots));
+  t->mask = cap - 1;
+  t->used = 0;
+  return t->slots ? 0 : -1;
+}
+
+static struct site_delta *site_table_get(struct site_table *t, uint64_t hash) {
+  size_t i = (size_t)(hash ^ (hash >> 29)) & t->mask;
+  while (t->slots[i].used && t->slots[i].stack_hash != hash) {
+    i = (i + 1) & t->mask;
+  }
+  if (!t->slots[i].used) {
+    t->slots[i].used = 1;
+    t->slots[i].stack_hash = hash;
+    t->used++;
+  }
+  return &t->slots[i];
+}
+
+static void accumulate(struct site_table *t, const struct snapshot *snap,
+                       int which) {
+  for (uint32_t i = 0; i < snap->header.record_count; i++) {
+    const struct snapshot_record *rec = &snap->records[i];
+    struct site_delta *d = site_table_get(t, snapshot_stack_hash(snap, rec));
+    d->count[which]++;
+    d->bytes[which] += rec->user_size;
+    if (!d->sample || which == 1) {
+      d->snap = snap;
+      d->sample = rec;
+    }
+  }
+}
+
+static int64_t byte_growth(const struct site_delta *d) {
+  return (int64_t)d->bytes[1] - (int64_t)d->bytes[0];
+}
+
+static int compare_growth(const void *a, const void *b) {
+  int64_t ga = byte_growth(a);
+  int64_t gb = byte_growth(b);
+  if (ga != gb) {
+    return ga > gb ? -1 : 1;
+  }
+  const struct site_delta *da = a;
+  const struct site_delta *db = b;
+  return da->stack_hash < db->stack_hash ? -1 : da->stack_hash > db->stack_hash;
+}
+
+static void print_site(const struct site_delta *d) {
+  printf("%+" PRId64 " bytes (%" PRIu64 " -> %" PRIu64 "), %+" PRId64
+         " blocks (%" PRIu64 " -> %" PRIu64 ") stack=%016" PRIx64 "\n",
+         byte_growth(d), d->bytes[0], d->bytes[1],
+         (int64_t)d->count[1] - (int64_t)d->count[0], d->count[0], d->count[1],
+         d->stack_hash);
+  for (uint32_t f = 0; f < d->sample->frame_count; f++) {
+    uint64_t pc = d->sample->frames[f];
+    const struct snapshot_module *mod = snapshot_find_module(d->snap, pc);
+    if (mod) {
+      printf("    #%u %s+0x%" PRIx64 "\n", f, mod->path, pc - mod->load_base);
+    } else {
+      printf("    #%u 0x%" PRIx64 "\n", f, pc);
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    fprintf(stderr, "usage: %s <before.snap> <after.snap> [--top N]\n", argv[0]);
+    return 2;
+  }
+
+  size_t top = 20;
+  if (argc > 4 && strcmp(argv[3], "--top") == 0) {
+    top = strtoul(argv[4], NULL, 10);
+  }
+
+  struct snapshot before, after;
+  if (snapshot_load(argv[1], &before) != 0) {
+    return 1;
+  }
+  if (snapshot_load(argv[2], &after) != 0) {
+    snapshot_free(&before);
+    return 1;
+  }
+
+  struct site_table table;
+  if (site_table_init(&table, (size_t)before.header.record_count +
+                                  after.header.record_count) != 0) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  accumulate(&table, &before, 0);
+  accumulate(&table, &after, 1);
+
+  // 压缩出已使用的槽位并排序
+  struct site_delta *sites = malloc((table.used + 1) * sizeof(*sites));
+  size_t n = 0;
+  int64_t total_bytes = 0;
+  int64_t total_blocks = 0;
+  for (size_t i = 0; sites && i <= table.mask; i++) {
+    if (table.slots[i].used) {
+      sites[n++] = table.slots[i];
+      total_bytes += byte_growth(&table.slots[i]);
+      total_blocks +=
+          (int64_t)table.slots[i].count[1] - (int64_t)table.slots[i].count[0];
+    }
+  }
+  qsort(sites, n, sizeof(*sites), compare_growth);
+
+  printf("=== Heap diff: %u -> %u allocations, %zu call sites ===\n",
+         before.header.record_count, after.header.record_count, n);
+  for (size_t i = 0; i < n && i < top; i++) {
+    print_site(&sites[i]);
+  }
+  printf("=== Total: %+" PRId64 " bytes, %+" PRId64 " blocks ===\n", total_bytes,
+         total_blocks);
+
+  free(sites);
+  free(table.slots);
+  snapshot_free(&before);
+  snapshot_free(&after);
+  return 0;
+}
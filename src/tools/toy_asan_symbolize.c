@@ -0,0 +1,333 @@
+/**
+ * @file toy_asan_symbolize.c
+ * @brief 报告离线符号化工具
+ *
+ * TOY_ASAN_OPTIONS=symbolize=0时，出错进程只输出原始帧：
+ * ```
+ *     #0 0x55a0a5cdd242 in ?? (/path/to/prog+0x1242)
+ * Module map:
+ *     0x55a0a5cdc000-0x55a0a5ce0038 /path/to/prog (BuildId: e09f76de...)
+ * ```
+ * 本工具把这些帧还原成与在线符号化相同的"函数 (文件:行)"，
+ * 其余行原样输出。在线报告中没能符号化的帧（同样是"?? (模块+0x偏移)"）
+ * 也会被处理，因此可以在装有调试文件的机器上补全任意报告。
+ *
+ * 用法：
+ * ```
+ * toy_asan_symbolize report.txt              # 结果写到stdout
+ * ./prog 2>&1 | toy_asan_symbolize           # 从stdin读取
+ * toy_asan_symbolize -s /sysroot report.txt  # 在另一台机器上按sysroot找模块
+ * toy_asan_symbolize -c /var/cache/toy_asan report.txt  # 使用持久化符号缓存
+ * ```
+ *
+ * 模块文件按以下顺序查找，报告给出build-id时只接受build-id一致的文件：
+ * 1. sysroot + 报告中的路径
+ * 2. sysroot/模块文件名
+ * 3. 报告中的路径
+ * 4. /usr/lib/debug/.build-id/xx/yyyy.debug（只有调试文件时）
+ *
+ * 符号化使用与运行时相同的elf_symbolizer.c，不依赖外部工具。
+ * -c与运行时的symbol_cache_dir共用同一种缓存文件（symbol_disk_cache.h），
+ * 报告给出build-id的模块先查缓存，命中时不打开模块文件，新结果追加到缓存。
+ *
+ * @author Toy ASan Project
+ * @version 1.0
+ */
+
+#include "elf_symbolizer.h"
+#include "symbol_disk_cache.h"
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_REPORT_MODULES 256
+#define MAX_BUILD_ID_HEX 64
+
+// 报告中出现的一个模块
+struct report_module {
+  char *path;                        // 报告中的路径
+  char build_id[MAX_BUILD_ID_HEX + 1];  // 来自"Module map:"，空串表示未知
+  struct elf_symbolizer *sym;        // 打开的文件，NULL表示找不到
+  bool opened;                       // 已尝试打开
+  struct symbol_disk_cache *disk_cache;  // 持久化缓存，NULL表示不可用
+  bool cache_opened;
+};
+
+static struct report_module modules[MAX_REPORT_MODULES];
+static int module_count;
+static const char *sysroot;
+static const char *cache_dir;
+
+static struct report_module *get_module(const char *path, size_t len) {
+  for (int i = 0; i < module_count; i++) {
+    if (strlen(modules[i].path) == len && strncmp(modules[i].path, path, len) == 0) {
+      return &modules[i];
+    }
+  }
+  if (module_count >= MAX_REPORT_MODULES) {
+    return NULL;
+  }
+  struct report_module *m = &modules[module_count++];
+  m->path = strndup(path, len);
+  return m;
+}
+
+static void format_build_id(const struct elf_symbolizer *sym, char *out, size_t out_size) {
+  const uint8_t *id;
+  size_t size = elf_symbolizer_build_id(sym, &id);
+  out[0] = '\0';
+  for (size_t i = 0; i < size && 2 * i + 2 < out_size; i++) {
+    snprintf(out + 2 * i, 3, "%02x", id[i]);
+  }
+}
+
+// 打开候选文件；报告给出build-id时校验
+static struct elf_symbolizer *try_open(struct report_module *m, const char *path) {
+  if (access(path, R_OK) != 0) {
+    return NULL;
+  }
+  struct elf_symbolizer *sym = elf_symbolizer_open(path, NULL);
+  if (!sym || m->build_id[0] == '\0') {
+    return sym;
+  }
+  char actual[MAX_BUILD_ID_HEX + 1];
+  format_build_id(sym, actual, sizeof(actual));
+  if (strcmp(actual, m->build_id) != 0) {
+    fprintf(stderr, "toy_asan_symbolize: %s: build-id %s does not match report (%s), skipped\n",
+            path, actual[0] ? actual : "none", m->build_id);
+    elf_symbolizer_close(sym);
+    return NULL;
+  }
+  return sym;
+}
+
+static struct elf_symbolizer *open_module(struct report_module *m) {
+  if (m->opened) {
+    return m->sym;
+  }
+  m->opened = true;
+
+  char path[4096];
+  if (sysroot) {
+    snprintf(path, sizeof(path), "%s%s", sysroot, m->path);
+    if ((m->sym = try_open(m, path))) {
+      return m->sym;
+    }
+    const char *base = strrchr(m->path, '/');
+    snprintf(path, sizeof(path), "%s/%s", sysroot, base ? base + 1 : m->path);
+    if ((m->sym = try_open(m, path))) {
+      return m->sym;
+    }
+  }
+  if ((m->sym = try_open(m, m->path))) {
+    return m->sym;
+  }
+  if (strlen(m->build_id) > 2) {
+    snprintf(path, sizeof(path), "%s/.build-id/%.2s/%s.debug", ELF_DEBUG_ROOT,
+             m->build_id, m->build_id + 2);
+    m->sym = try_open(m, path);
+  }
+  if (!m->sym) {
+    fprintf(stderr, "toy_asan_symbolize: cannot find %s\n", m->path);
+  }
+  return m->sym;
+}
+
+// 按报告中的build-id打开持久化缓存；没有build-id的模块不缓存
+static struct symbol_disk_cache *open_disk_cache(struct report_module *m) {
+  if (m->cache_opened) {
+    return m->disk_cache;
+  }
+  m->cache_opened = true;
+  size_t len = strlen(m->build_id);
+  if (!cache_dir || len == 0 || len % 2 != 0) {
+    return NULL;
+  }
+  uint8_t id[MAX_BUILD_ID_HEX / 2];
+  for (size_t i = 0; i < len / 2; i++) {
+    unsigned byte;
+    if (sscanf(m->build_id + 2 * i, "%2x", &byte) != 1) {
+      return NULL;
+    }
+    id[i] = (uint8_t)byte;
+  }
+  m->disk_cache = symbol_disk_cache_open(cache_dir, id, len / 2, NULL);
+  if (!m->disk_cache) {
+    fprintf(stderr, "toy_asan_symbolize: cannot use symbol cache in %s for %s\n", cache_dir,
+            m->path);
+  }
+  return m->disk_cache;
+}
+
+static void print_symbol(FILE *out, const char *prefix, int prefix_len, const char *function,
+                         const char *file, unsigned line, const char *module, uint64_t offset) {
+  fprintf(out, "%.*s in ", prefix_len, prefix);
+  if (file) {
+    fprintf(out, "%s (%s:%u)\n", function, file, line);
+  } else {
+    fprintf(out, "%s (%s+0x%" PRIx64 ")\n", function, module, offset);
+  }
+}
+
+/**
+ * @brief 解析"Module map:"中的一行
+ *
+ * 格式："    0xSTART-0xEND 路径 (BuildId: 十六进制|none)"
+ */
+static void parse_module_line(const char *line) {
+  const char *p = line + strspn(line, " \t");
+  if (strncmp(p, "0x", 2) != 0) {
+    return;
+  }
+  p = strchr(p, ' ');
+  const char *tag = strstr(line, " (BuildId: ");
+  if (!p || !tag || tag <= p) {
+    return;
+  }
+  p++;
+  struct report_module *m = get_module(p, tag - p);
+  if (!m) {
+    return;
+  }
+  const char *id = tag + strlen(" (BuildId: ");
+  size_t len = strcspn(id, ")");
+  if (len > MAX_BUILD_ID_HEX || strncmp(id, "none", len) == 0) {
+    len = 0;
+  }
+  memcpy(m->build_id, id, len);
+  m->build_id[len] = '\0';
+}
+
+/**
+ * @brief 符号化一行帧
+ * @return true已输出替换后的行
+ *
+ * 识别"    #N 0xPC in ?? (模块+0x偏移)"，其他行返回false。
+ */
+static bool symbolize_frame_line(const char *line, FILE *out) {
+  const char *p = line + strspn(line, " \t");
+  if (*p != '#') {
+    return false;
+  }
+  const char *marker = strstr(p, " in ?? (");
+  if (!marker) {
+    return false;
+  }
+  const char *module = marker + strlen(" in ?? (");
+  const char *close = strrchr(module, ')');
+  if (!close) {
+    return false;
+  }
+  // 路径中可能含"+"，以最后一个"+0x"为准
+  const char *plus = NULL;
+  for (const char *q = module; q + 3 <= close; q++) {
+    if (strncmp(q, "+0x", 3) == 0) {
+      plus = q;
+    }
+  }
+  if (!plus) {
+    return false;
+  }
+
+  struct report_module *m = get_module(module, plus - module);
+  if (!m) {
+    return false;
+  }
+  uint64_t offset = strtoull(plus + 3, NULL, 16);
+  struct symbol_disk_cache *cache = open_disk_cache(m);
+  struct symbol_disk_cache_entry e;
+  if (cache && symbol_disk_cache_lookup(cache, offset, &e)) {
+    print_symbol(out, line, (int)(marker - line), e.function, e.file, e.line, m->path, offset);
+    return true;
+  }
+
+  struct elf_symbolizer *sym = open_module(m);
+  struct elf_symbol_info si;
+  if (!sym || elf_symbolize(sym, offset, &si) != 0) {
+    return false;
+  }
+  print_symbol(out, line, (int)(marker - line), si.function, si.file, si.line, m->path, offset);
+  if (cache) {
+    symbol_disk_cache_add(cache, offset, si.function, si.file, si.line);
+  }
+  return true;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr, "Usage: %s [-s sysroot] [-c cache_dir] [report.txt]\n", prog);
+}
+
+int main(int argc, char **argv) {
+  const char *input_path = NULL;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+      sysroot = argv[++i];
+    } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+      cache_dir = argv[++i];
+    } else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+      usage(argv[0]);
+      return 2;
+    } else {
+      input_path = argv[i];
+    }
+  }
+
+  FILE *in = stdin;
+  if (input_path && strcmp(input_path, "-") != 0) {
+    in = fopen(input_path, "r");
+    if (!in) {
+      perror(input_path);
+      return 1;
+    }
+  }
+
+  // 模块表在报告末尾，先读入全部行
+  char **lines = NULL;
+  size_t line_count = 0, line_cap = 0;
+  char *line = NULL;
+  size_t cap = 0;
+  bool in_module_map = false;
+  while (getline(&line, &cap, in) >= 0) {
+    line[strcspn(line, "\n")] = '\0';
+    if (strcmp(line, "Module map:") == 0) {
+      in_module_map = true;
+    } else if (in_module_map && (line[0] == ' ' || line[0] == '\t')) {
+      parse_module_line(line);
+    } else {
+      in_module_map = false;
+    }
+    if (line_count == line_cap) {
+      line_cap = line_cap ? 2 * line_cap : 256;
+      lines = realloc(lines, line_cap * sizeof(*lines));
+      if (!lines) {
+        perror("realloc");
+        return 1;
+      }
+    }
+    lines[line_count++] = strdup(line);
+  }
+  free(line);
+  if (in != stdin) {
+    fclose(in);
+  }
+
+  for (size_t i = 0; i < line_count; i++) {
+    if (!symbolize_frame_line(lines[i], stdout)) {
+      printf("%s\n", lines[i]);
+    }
+    free(lines[i]);
+  }
+  free(lines);
+
+  for (int i = 0; i < module_count; i++) {
+    symbol_disk_cache_close(modules[i].disk_cache);  // 追加本次新解析的结果
+    if (modules[i].sym) {
+      elf_symbolizer_close(modules[i].sym);
+    }
+    free(modules[i].path);
+  }
+  return 0;
+}
@@ -0,0 +1,201 @@
+/**
+ * @file toy_asan_symindex.c
+ * @brief 构建期符号索引生成与校验工具
+ *
+ * 从未strip的可执行文件（或共享库）提取函数表，写成运行时
+ * 直接mmap的旁路文件（格式见symbol_index.h）。之后即使发布的
+ * 二进制被strip，报告中的帧也能按"<模块>.symidx"还原函数名。
+ *
+ * 用法：
+ * ```
+ * toy_asan_symindex prog                  # 生成 prog.symidx
+ * toy_asan_symindex prog -o out.symidx    # 指定输出文件
+ * toy_asan_symindex --verify prog         # 校验 prog.symidx 与 prog 的build-id一致
+ * ```
+ *
+ * CMake中由toy_asan_add_symbol_index()在链接后依次执行生成和校验，
+ * 二进制没有build-id、索引缺失或不匹配时构建失败。
+ *
+ * @author Toy ASan Project
+ * @version 1.0
+ */
+
+#include "elf_symbolizer.h"
+#include "symbol_index.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void format_build_id(const uint8_t *id, size_t size, char *out) {
+  out[0] = '\0';
+  for (size_t i = 0; i < size; i++) {
+    sprintf(out + 2 * i, "%02x", id[i]);
+  }
+}
+
+/**
+ * @brief 生成符号索引
+ * @return 0成功，1失败
+ */
+static int build_index(const char *elf_path, const char *out_path) {
+  struct elf_symbolizer *sym = elf_symbolizer_open(elf_path, NULL);
+  if (!sym) {
+    fprintf(stderr, "toy_asan_symindex: error: %s is not an ELF64 file\n", elf_path);
+    return 1;
+  }
+
+  struct symbol_index_header hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, SYMBOL_INDEX_MAGIC, sizeof(SYMBOL_INDEX_MAGIC));
+  hdr.version = SYMBOL_INDEX_VERSION;
+
+  const uint8_t *build_id;
+  size_t build_id_size = elf_symbolizer_build_id(sym, &build_id);
+  if (build_id_size == 0 || build_id_size > SYMBOL_INDEX_MAX_BUILD_ID) {
+    fprintf(stderr, "toy_asan_symindex: error: %s has no usable GNU build-id "
+                    "(link with -Wl,--build-id)\n", elf_path);
+    elf_symbolizer_close(sym);
+    return 1;
+  }
+  hdr.build_id_size = (uint32_t)build_id_size;
+  memcpy(hdr.build_id, build_id, build_id_size);
+
+  // 函数索引已按地址排序去重，逐项复制并拼接字符串表
+  size_t count = elf_symbolizer_function_count(sym);
+  struct symbol_index_entry *entries = calloc(count ? count : 1, sizeof(*entries));
+  size_t strtab_cap = 4096, strtab_size = 0;
+  char *strtab = malloc(strtab_cap);
+  if (!entries || !strtab) {
+    fprintf(stderr, "toy_asan_symindex: error: out of memory\n");
+    return 1;
+  }
+  for (size_t i = 0; i < count; i++) {
+    struct elf_function_info f;
+    elf_symbolizer_function(sym, i, &f);
+    size_t len = strlen(f.name) + 1;
+    while (strtab_size + len > strtab_cap) {
+      strtab_cap *= 2;
+      strtab = realloc(strtab, strtab_cap);
+      if (!strtab) {
+        fprintf(stderr, "toy_asan_symindex: error: out of memory\n");
+        return 1;
+      }
+    }
+    memcpy(strtab + strtab_size, f.name, len);
+    entries[i].addr = f.addr;
+    entries[i].size = f.size > UINT32_MAX ? 0 : (uint32_t)f.size;
+    entries[i].name_offset = (uint32_t)strtab_size;
+    strtab_size += len;
+  }
+  hdr.entry_count = count;
+  hdr.strtab_size = strtab_size;
+
+  int ret = 0;
+  FILE *out = fopen(out_path, "wb");
+  if (!out || fwrite(&hdr, sizeof(hdr), 1, out) != 1 ||
+      fwrite(entries, sizeof(*entries), count, out) != count ||
+      fwrite(strtab, 1, strtab_size, out) != strtab_size) {
+    perror(out_path);
+    ret = 1;
+  }
+  if (out && fclose(out) != 0) {
+    perror(out_path);
+    ret = 1;
+  }
+  if (ret == 0) {
+    printf("toy_asan_symindex: %s: %zu functions, %zu bytes of names\n", out_path, count,
+           strtab_size);
+  }
+
+  free(strtab);
+  free(entries);
+  elf_symbolizer_close(sym);
+  return ret;
+}
+
+/**
+ * @brief 校验符号索引与二进制的build-id一致
+ * @return 0一致，1缺失、损坏或不一致
+ */
+static int verify_index(const char *elf_path, const char *index_path) {
+  struct elf_symbolizer *sym = elf_symbolizer_open(elf_path, NULL);
+  if (!sym) {
+    fprintf(stderr, "toy_asan_symindex: error: %s is not an ELF64 file\n", elf_path);
+    return 1;
+  }
+  const uint8_t *build_id;
+  size_t build_id_size = elf_symbolizer_build_id(sym, &build_id);
+  char expected[2 * SYMBOL_INDEX_MAX_BUILD_ID + 1];
+  format_build_id(build_id, build_id_size < SYMBOL_INDEX_MAX_BUILD_ID
+                                ? build_id_size : SYMBOL_INDEX_MAX_BUILD_ID, expected);
+
+  int ret = 1;
+  struct symbol_index_header hdr;
+  FILE *in = fopen(index_path, "rb");
+  if (!in) {
+    fprintf(stderr, "toy_asan_symindex: error: symbol index %s is missing\n", index_path);
+  } else if (fread(&hdr, sizeof(hdr), 1, in) != 1 ||
+             memcmp(hdr.magic, SYMBOL_INDEX_MAGIC, sizeof(SYMBOL_INDEX_MAGIC)) != 0 ||
+             hdr.version != SYMBOL_INDEX_VERSION ||
+             hdr.build_id_size > SYMBOL_INDEX_MAX_BUILD_ID) {
+    fprintf(stderr, "toy_asan_symindex: error: %s is not a valid symbol index\n", index_path);
+  } else {
+    char actual[2 * SYMBOL_INDEX_MAX_BUILD_ID + 1];
+    format_build_id(hdr.build_id, hdr.build_id_size, actual);
+    if (build_id_size == 0 || strcmp(actual, expected) != 0) {
+      fprintf(stderr,
+              "toy_asan_symindex: error: symbol index %s does not match %s\n"
+              "  index build-id:  %s\n  binary build-id: %s\n",
+              index_path, elf_path, actual, expected[0] ? expected : "none");
+    } else {
+      ret = 0;
+    }
+  }
+  if (in) {
+    fclose(in);
+  }
+  elf_symbolizer_close(sym);
+  return ret;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s <elf> [-o index]\n"
+          "       %s --verify <elf> [index]\n",
+          prog, prog);
+}
+
+int main(int argc, char **argv) {
+  bool verify = false;
+  const char *elf_path = NULL;
+  const char *index_path = NULL;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--verify") == 0) {
+      verify = true;
+    } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      index_path = argv[++i];
+    } else if (argv[i][0] == '-') {
+      usage(argv[0]);
+      return 2;
+    } else if (!elf_path) {
+      elf_path = argv[i];
+    } else if (verify && !index_path) {
+      index_path = argv[i];
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (!elf_path) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  char default_path[4096];
+  if (!index_path) {
+    snprintf(default_path, sizeof(default_path), "%s%s", elf_path, SYMBOL_INDEX_SUFFIX);
+    index_path = default_path;
+  }
+  return verify ? verify_index(elf_path, index_path) : build_index(elf_path, index_path);
+}
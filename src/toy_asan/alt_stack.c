@@ -0,0 +1,143 @@
+/**
+ * @file alt_stack.c
+ * @brief Toy AddressSanitizer 每线程的备用信号栈
+ *
+ * SIGSEGV处理器默认运行在出错线程自己的栈上。线程栈快用完时，
+ * 或者出错本身就是栈溢出，处理器一进入就再次出错，进程被内核杀死，
+ * 没有任何报告。因此每个线程在登记时安装一块备用信号栈
+ * （sigaltstack），处理器以SA_ONSTACK注册：
+ *
+ * - 大小ALT_STACK_SIZE，足够报告路径（回溯、符号化、格式化）使用
+ * - 栈底下方一页PROT_NONE：处理器自己栈溢出时立即出错，不会踩坏相邻内存
+ * - 线程退出时注销并放回空闲表，下一个线程直接复用，
+ *   线程频繁创建销毁的服务不必反复mmap/munmap
+ * - 线程已自行安装备用栈（例如其他运行时）时保持不动
+ *
+ * @author Toy ASan Project
+ * @version 1.0
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE      // REG_RSP
+#endif
+
+#include "toy_asan.h"
+#include <signal.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+
+#define ALT_STACK_SIZE (64 * 1024)
+#define STACK_OVERFLOW_SLACK (64 * 1024)  // 一个栈帧最多跨过的距离
+
+// 已退出线程留下的备用栈（映射基址，含保护页）
+static void *free_stacks[MAX_THREADS];
+static int free_stack_count;
+static pthread_mutex_t free_stacks_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *map_alt_stack(void) {
+  size_t ps = get_system_page_size();
+  void *base = mmap(NULL, ps + ALT_STACK_SIZE, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (base == MAP_FAILED) {
+    return NULL;
+  }
+  if (mprotect(base, ps, PROT_NONE) != 0) {  // 栈向下增长，保护页在最低处
+    munmap(base, ps + ALT_STACK_SIZE);
+    return NULL;
+  }
+  return base;
+}
+
+static void put_alt_stack(void *base) {
+  pthread_mutex_lock(&free_stacks_lock);
+  if (free_stack_count < MAX_THREADS) {
+    free_stacks[free_stack_count++] = base;
+    base = NULL;
+  }
+  pthread_mutex_unlock(&free_stacks_lock);
+  if (base) {
+    munmap(base, get_system_page_size() + ALT_STACK_SIZE);
+  }
+}
+
+/**
+ * @brief 为当前线程安装备用信号栈
+ * @return 映射基址（线程退出时交给release_alt_stack），
+ *         线程已有备用栈或安装失败时返回NULL
+ */
+void *install_alt_stack(void) {
+  stack_t old;
+  if (sigaltstack(NULL, &old) == 0 && !(old.ss_flags & SS_DISABLE)) {
+    return NULL;
+  }
+
+  void *base = NULL;
+  pthread_mutex_lock(&free_stacks_lock);
+  if (free_stack_count > 0) {
+    base = free_stacks[--free_stack_count];
+  }
+  pthread_mutex_unlock(&free_stacks_lock);
+  if (!base) {
+    base = map_alt_stack();
+    if (!base) {
+      return NULL;
+    }
+  }
+
+  stack_t ss;
+  ss.ss_sp = (char *)base + get_system_page_size();
+  ss.ss_size = ALT_STACK_SIZE;
+  ss.ss_flags = 0;
+  if (sigaltstack(&ss, NULL) != 0) {
+    put_alt_stack(base);
+    return NULL;
+  }
+  return base;
+}
+
+/**
+ * @brief 注销当前线程的备用信号栈并放回空闲表
+ * @param base install_alt_stack()的返回值
+ *
+ * 必须在拥有该栈的线程上调用（pthread key析构函数中）。
+ */
+void release_alt_stack(void *base) {
+  if (!base) {
+    return;
+  }
+  stack_t ss;
+  ss.ss_sp = NULL;
+  ss.ss_size = 0;
+  ss.ss_flags = SS_DISABLE;
+  sigaltstack(&ss, NULL);
+  put_alt_stack(base);
+}
+
+/**
+ * @brief 判断一次SIGSEGV是否是线程栈溢出
+ * @param fault_addr 故障地址
+ * @param context 信号处理器上下文
+ *
+ * 故障地址紧挨着出错时的栈指针（push/call或刚分配的大栈帧），
+ * 并且在已登记线程的栈底附近（未登记时只看栈指针）。
+ */
+bool is_stack_overflow(void *fault_addr, const void *context) {
+#if defined(__x86_64__)
+  const ucontext_t *uc = context;
+  uintptr_t sp = (uintptr_t)uc->uc_mcontext.gregs[REG_RSP];
+  uintptr_t addr = (uintptr_t)fault_addr;
+  if (addr + 128 < sp || addr >= sp + STACK_OVERFLOW_SLACK) {
+    return false;
+  }
+  struct thread_info *t = current_thread_info();
+  if (t && t->stack_lo != 0) {
+    return addr < t->stack_lo + get_system_page_size() &&
+           addr + STACK_OVERFLOW_SLACK >= t->stack_lo;
+  }
+  return true;
+#else
+  (void)fault_addr;
+  (void)context;
+  return false;
+#endif
+}
@@ -0,0 +1,1018 @@
+/**
+ * @file elf_symbolizer.c
+ * @brief 进程内ELF/DWARF符号化实现
+ *
+ * 打开时：
+ * 1. mmap整个模块文件，定位节区头和各个所需的节
+ * 2. 缺少.symtab或.debug_line时，按build-id/.gnu_debuglink找分离调试文件
+ * 3. 收集所有函数符号，按地址排序得到函数索引
+ *
+ * 首次需要行号时解码.debug_line的全部行号程序，得到按地址排序的
+ * 行表（每个序列末尾的end_sequence行标记地址区间结束）。
+ *
+ * 不支持的情况按"没有该信息"处理而不是报错：SHF_COMPRESSED的
+ * 压缩调试节、DW_FORM_strx等需要.debug_str_offsets的文件名形式。
+ *
+ * @author Toy ASan Project
+ * @version 1.0
+ */
+
+#include "elf_symbolizer.h"
+#include "symbolizer_alloc.h"
+#include <elf.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MAX_ELF_BUILD_ID 32
+
+// DWARF常量（不依赖libdw的<dwarf.h>）
+#define DW_LNS_copy 1
+#define DW_LNS_advance_pc 2
+#define DW_LNS_advance_line 3
+#define DW_LNS_set_file 4
+#define DW_LNS_const_add_pc 8
+#define DW_LNS_fixed_advance_pc 9
+#define DW_LNE_end_sequence 1
+#define DW_LNE_set_address 2
+#define DW_LNCT_path 1
+#define DW_LNCT_directory_index 2
+#define DW_FORM_data2 0x05
+#define DW_FORM_data4 0x06
+#define DW_FORM_data8 0x07
+#define DW_FORM_string 0x08
+#define DW_FORM_block 0x09
+#define DW_FORM_data1 0x0b
+#define DW_FORM_strp 0x0e
+#define DW_FORM_udata 0x0f
+#define DW_FORM_data16 0x1e
+#define DW_FORM_line_strp 0x1f
+#define MAX_ENTRY_FORMATS 16
+
+// 一个mmap进来的ELF文件
+struct elf_image {
+  const uint8_t *map;
+  size_t size;
+  const Elf64_Shdr *shdrs;
+  uint16_t shnum;
+  const char *shstrtab;
+};
+
+// 节内容（指向mmap区域）
+struct section {
+  const uint8_t *data;
+  size_t size;
+};
+
+struct func_symbol {
+  uint64_t addr;
+  uint64_t size;
+  const char *name;          // 指向mmap的字符串表
+};
+
+struct line_row {
+  uint64_t addr;
+  uint32_t file;             // files[]下标
+  uint32_t line;             // end_sequence行为0
+};
+
+struct elf_symbolizer {
+  const struct symbolizer_allocator *alloc;  // NULL表示malloc
+  struct elf_image image;
+  struct elf_image debug;    // 分离调试文件，map为NULL表示没有
+  char *debug_path;
+
+  struct func_symbol *funcs;
+  size_t func_count;
+
+  bool lines_decoded;
+  struct line_row *rows;
+  size_t row_count;
+  size_t row_capacity;
+  char **files;
+  size_t file_count;
+  size_t file_capacity;
+
+  uint8_t build_id[MAX_ELF_BUILD_ID];
+  size_t build_id_size;
+};
+
+// ======================= ELF基础 =======================
+
+static int image_open(const char *path, struct elf_image *img) {
+  memset(img, 0, sizeof(*img));
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Elf64_Ehdr)) {
+    close(fd);
+    return -1;
+  }
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return -1;
+  }
+  img->map = map;
+  img->size = st.st_size;
+
+  const Elf64_Ehdr *eh = map;
+  if (memcmp(eh->e_ident, ELFMAG, SELFMAG) != 0 ||
+      eh->e_ident[EI_CLASS] != ELFCLASS64 || eh->e_shentsize != sizeof(Elf64_Shdr) ||
+      eh->e_shoff == 0 || eh->e_shoff + (uint64_t)eh->e_shnum * sizeof(Elf64_Shdr) > img->size ||
+      eh->e_shstrndx >= eh->e_shnum) {
+    munmap(map, img->size);
+    memset(img, 0, sizeof(*img));
+    return -1;
+  }
+  img->shdrs = (const Elf64_Shdr *)(img->map + eh->e_shoff);
+  img->shnum = eh->e_shnum;
+  const Elf64_Shdr *strsh = &img->shdrs[eh->e_shstrndx];
+  if (strsh->sh_offset + strsh->sh_size > img->size) {
+    munmap(map, img->size);
+    memset(img, 0, sizeof(*img));
+    return -1;
+  }
+  img->shstrtab = (const char *)img->map + strsh->sh_offset;
+  return 0;
+}
+
+static void image_close(struct elf_image *img) {
+  if (img->map) {
+    munmap((void *)img->map, img->size);
+  }
+  memset(img, 0, sizeof(*img));
+}
+
+// 取节内容；NOBITS、压缩或越界的节视为不存在
+static bool section_data(const struct elf_image *img, const Elf64_Shdr *sh,
+                         struct section *out) {
+  if (sh->sh_type == SHT_NOBITS || (sh->sh_flags & SHF_COMPRESSED) ||
+      sh->sh_offset + sh->sh_size > img->size) {
+    return false;
+  }
+  out->data = img->map + sh->sh_offset;
+  out->size = sh->sh_size;
+  return true;
+}
+
+static const Elf64_Shdr *find_section(const struct elf_image *img, const char *name) {
+  if (!img->map) {
+    return NULL;
+  }
+  for (uint16_t i = 0; i < img->shnum; i++) {
+    if (strcmp(img->shstrtab + img->shdrs[i].sh_name, name) == 0) {
+      return &img->shdrs[i];
+    }
+  }
+  return NULL;
+}
+
+static bool get_section(const struct elf_image *img, const char *name,
+                        struct section *out) {
+  const Elf64_Shdr *sh = find_section(img, name);
+  return sh && section_data(img, sh, out);
+}
+
+// 在SHT_NOTE节中找NT_GNU_BUILD_ID
+static size_t read_build_id(const struct elf_image *img, uint8_t *out) {
+  for (uint16_t i = 0; i < img->shnum; i++) {
+    struct section s;
+    if (img->shdrs[i].sh_type != SHT_NOTE || !section_data(img, &img->shdrs[i], &s)) {
+      continue;
+    }
+    const uint8_t *p = s.data;
+    const uint8_t *end = s.data + s.size;
+    while (p + sizeof(Elf64_Nhdr) <= end) {
+      const Elf64_Nhdr *nh = (const Elf64_Nhdr *)p;
+      const uint8_t *name = p + sizeof(Elf64_Nhdr);
+      const uint8_t *desc = name + ((nh->n_namesz + 3) & ~3u);
+      const uint8_t *next = desc + ((nh->n_descsz + 3) & ~3u);
+      if (next > end) {
+        break;
+      }
+      if (nh->n_type == NT_GNU_BUILD_ID && nh->n_namesz == 4 &&
+          memcmp(name, "GNU", 4) == 0) {
+        size_t size = nh->n_descsz < MAX_ELF_BUILD_ID ? nh->n_descsz : MAX_ELF_BUILD_ID;
+        memcpy(out, desc, size);
+        return size;
+      }
+      p = next;
+    }
+  }
+  return 0;
+}
+
+// ======================= 分离调试文件 =======================
+
+static bool has_debug_info(const struct elf_image *img) {
+  struct section s;
+  return get_section(img, ".symtab", &s) && get_section(img, ".debug_line", &s);
+}
+
+// 候选调试文件可用：能打开、带调试信息、build-id一致（双方都有时）
+static bool try_debug_file(struct elf_symbolizer *sym, const char *path) {
+  struct elf_image img;
+  if (image_open(path, &img) != 0) {
+    return false;
+  }
+  uint8_t id[MAX_ELF_BUILD_ID];
+  size_t id_size = read_build_id(&img, id);
+  bool id_ok = sym->build_id_size == 0 || id_size == 0 ||
+               (id_size == sym->build_id_size && memcmp(id, sym->build_id, id_size) == 0);
+  struct section s;
+  if (!id_ok || !(get_section(&img, ".symtab", &s) || get_section(&img, ".debug_line", &s))) {
+    image_close(&img);
+    return false;
+  }
+  sym->debug = img;
+  sym->debug_path = symbolizer_strdup(sym->alloc, path);
+  return true;
+}
+
+static void find_debug_file(struct elf_symbolizer *sym, const char *path) {
+  char candidate[4096];
+
+  // 1. build-id：/usr/lib/debug/.build-id/ab/cdef....debug
+  if (sym->build_id_size > 1) {
+    char first[3], rest[2 * MAX_ELF_BUILD_ID + 1];
+    symbolizer_hex(first, sizeof(first), sym->build_id, 1);
+    symbolizer_hex(rest, sizeof(rest), sym->build_id + 1, sym->build_id_size - 1);
+    const char *parts[] = {ELF_DEBUG_ROOT "/.build-id/", first, "/", rest, ".debug", NULL};
+    if (symbolizer_concat(candidate, sizeof(candidate), parts) &&
+        try_debug_file(sym, candidate)) {
+      return;
+    }
+  }
+
+  // 2. .gnu_debuglink：模块目录、模块目录/.debug、/usr/lib/debug/模块目录
+  struct section link;
+  if (!get_section(&sym->image, ".gnu_debuglink", &link) ||
+      memchr(link.data, '\0', link.size) == NULL) {
+    return;
+  }
+  const char *name = (const char *)link.data;
+
+  char dir[4096];
+  const char *path_parts[] = {path, NULL};
+  symbolizer_concat(dir, sizeof(dir), path_parts);
+  char *slash = strrchr(dir, '/');
+  if (slash) {
+    *slash = '\0';
+  } else {
+    dir[0] = '.';
+    dir[1] = '\0';
+  }
+
+  const char *prefixes[] = {"", "", ELF_DEBUG_ROOT};
+  const char *infixes[] = {"/", "/.debug/", "/"};
+  for (size_t i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); i++) {
+    const char *parts[] = {prefixes[i], dir, infixes[i], name, NULL};
+    if (symbolizer_concat(candidate, sizeof(candidate), parts) &&
+        strcmp(candidate, path) != 0 && try_debug_file(sym, candidate)) {
+      return;
+    }
+  }
+}
+
+// ======================= 函数索引 =======================
+
+static void collect_symbols(struct elf_symbolizer *sym, const struct elf_image *img,
+                            const char *symtab_name, size_t *capacity) {
+  const Elf64_Shdr *sh = find_section(img, symtab_name);
+  struct section syms, strs;
+  if (!sh || sh->sh_link >= img->shnum || !section_data(img, sh, &syms) ||
+      !section_data(img, &img->shdrs[sh->sh_link], &strs)) {
+    return;
+  }
+
+  size_t count = syms.size / sizeof(Elf64_Sym);
+  const Elf64_Sym *table = (const Elf64_Sym *)syms.data;
+  for (size_t i = 0; i < count; i++) {
+    const Elf64_Sym *s = &table[i];
+    int type = ELF64_ST_TYPE(s->st_info);
+    if ((type != STT_FUNC && type != STT_GNU_IFUNC) || s->st_value == 0 ||
+        s->st_shndx == SHN_UNDEF || s->st_name >= strs.size) {
+      continue;
+    }
+    if (sym->func_count == *capacity) {
+      size_t cap = *capacity ? *capacity * 2 : 256;
+      struct func_symbol *grown = symbolizer_realloc(sym->alloc, sym->funcs,
+                                                     *capacity * sizeof(*grown),
+                                                     cap * sizeof(*grown));
+      if (!grown) {
+        return;
+      }
+      sym->funcs = grown;
+      *capacity = cap;
+    }
+    struct func_symbol *f = &sym->funcs[sym->func_count++];
+    f->addr = s->st_value;
+    f->size = s->st_size;
+    f->name = (const char *)strs.data + s->st_name;
+  }
+}
+
+static int compare_funcs(const void *a, const void *b) {
+  const struct func_symbol *fa = a;
+  const struct func_symbol *fb = b;
+  if (fa->addr != fb->addr) {
+    return fa->addr < fb->addr ? -1 : 1;
+  }
+  // 同一地址有多个名字时优先带大小的
+  return (fa->size == 0) - (fb->size == 0);
+}
+
+static void build_function_index(struct elf_symbolizer *sym) {
+  size_t capacity = 0;
+  collect_symbols(sym, &sym->debug, ".symtab", &capacity);
+  collect_symbols(sym, &sym->image, ".symtab", &capacity);
+  collect_symbols(sym, &sym->image, ".dynsym", &capacity);
+  if (sym->func_count == 0) {
+    return;
+  }
+
+  symbolizer_sort(sym->alloc, sym->funcs, sym->func_count, sizeof(*sym->funcs),
+                  compare_funcs);
+
+  // 同一地址只保留一项（.symtab与.dynsym有大量重复）
+  size_t out = 1;
+  for (size_t i = 1; i < sym->func_count; i++) {
+    if (sym->funcs[i].addr != sym->funcs[out - 1].addr) {
+      sym->funcs[out++] = sym->funcs[i];
+    }
+  }
+  sym->func_count = out;
+}
+
+// funcs[upper - 1]是最后一个起点 <= vaddr的函数；检查它是否覆盖vaddr
+static const struct func_symbol *function_before(const struct elf_symbolizer *sym,
+                                                 size_t upper, uint64_t vaddr) {
+  if (upper == 0) {
+    return NULL;
+  }
+  const struct func_symbol *f = &sym->funcs[upper - 1];
+  // 有大小的符号必须覆盖该地址，避免把无符号的静态函数算到前一个函数头上
+  if (f->size != 0 && vaddr >= f->addr + f->size) {
+    return NULL;
+  }
+  return f;
+}
+
+static const struct func_symbol *lookup_function(const struct elf_symbolizer *sym,
+                                                 uint64_t vaddr) {
+  size_t lo = 0, hi = sym->func_count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (sym->funcs[mid].addr <= vaddr) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return function_before(sym, lo, vaddr);
+}
+
+// ======================= .debug_line解码 =======================
+
+struct reader {
+  const uint8_t *p;
+  const uint8_t *end;
+  bool error;
+};
+
+static uint64_t read_fixed(struct reader *r, size_t n) {
+  if ((size_t)(r->end - r->p) < n) {
+    r->error = true;
+    r->p = r->end;
+    return 0;
+  }
+  uint64_t v = 0;
+  for (size_t i = 0; i < n; i++) {
+    v |= (uint64_t)r->p[i] << (8 * i); // DWARF按目标字节序，这里只支持小端
+  }
+  r->p += n;
+  return v;
+}
+
+static uint64_t read_uleb(struct reader *r) {
+  uint64_t v = 0;
+  unsigned shift = 0;
+  while (r->p < r->end) {
+    uint8_t b = *r->p++;
+    if (shift < 64) {
+      v |= (uint64_t)(b & 0x7f) << shift;
+    }
+    shift += 7;
+    if (!(b & 0x80)) {
+      return v;
+    }
+  }
+  r->error = true;
+  return v;
+}
+
+static int64_t read_sleb(struct reader *r) {
+  int64_t v = 0;
+  unsigned shift = 0;
+  uint8_t b = 0;
+  while (r->p < r->end) {
+    b = *r->p++;
+    if (shift < 64) {
+      v |= (int64_t)(b & 0x7f) << shift;
+    }
+    shift += 7;
+    if (!(b & 0x80)) {
+      if (shift < 64 && (b & 0x40)) {
+        v |= -((int64_t)1 << shift);
+      }
+      return v;
+    }
+  }
+  r->error = true;
+  return v;
+}
+
+static const char *read_cstr(struct reader *r) {
+  const uint8_t *nul = memchr(r->p, '\0', r->end - r->p);
+  if (!nul) {
+    r->error = true;
+    r->p = r->end;
+    return "";
+  }
+  const char *s = (const char *)r->p;
+  r->p = nul + 1;
+  return s;
+}
+
+// 字符串节中的偏移 → 字符串
+static const char *section_str(const struct section *s, uint64_t off) {
+  if (!s->data || off >= s->size || !memchr(s->data + off, '\0', s->size - off)) {
+    return NULL;
+  }
+  return (const char *)s->data + off;
+}
+
+static uint32_t add_file(struct elf_symbolizer *sym, const char *dir, const char *name) {
+  if (sym->file_count == sym->file_capacity) {
+    size_t cap = sym->file_capacity ? sym->file_capacity * 2 : 64;
+    char **grown = symbolizer_realloc(sym->alloc, sym->files,
+                                      sym->file_capacity * sizeof(*grown), cap * sizeof(*grown));
+    if (!grown) {
+      return UINT32_MAX;
+    }
+    sym->files = grown;
+    sym->file_capacity = cap;
+  }
+  char *path;
+  if (name[0] == '/' || !dir || !dir[0]) {
+    path = symbolizer_strdup(sym->alloc, name);
+  } else {
+    size_t len = strlen(dir) + 1 + strlen(name) + 1;
+    path = symbolizer_malloc(sym->alloc, len);
+    if (path) {
+      const char *parts[] = {dir, "/", name, NULL};
+      symbolizer_concat(path, len, parts);
+    }
+  }
+  if (!path) {
+    return UINT32_MAX;
+  }
+  sym->files[sym->file_count] = path;
+  return (uint32_t)sym->file_count++;
+}
+
+static void add_row(struct elf_symbolizer *sym, uint64_t addr, uint32_t file,
+                    uint32_t line) {
+  if (sym->row_count == sym->row_capacity) {
+    size_t cap = sym->row_capacity ? sym->row_capacity * 2 : 1024;
+    struct line_row *grown = symbolizer_realloc(sym->alloc, sym->rows,
+                                                sym->row_capacity * sizeof(*grown),
+                                                cap * sizeof(*grown));
+    if (!grown) {
+      return;
+    }
+    sym->rows = grown;
+    sym->row_capacity = cap;
+  }
+  struct line_row *row = &sym->rows[sym->row_count++];
+  row->addr = addr;
+  row->file = file;
+  row->line = line;
+}
+
+struct line_strings {
+  struct section line_str;   // .debug_line_str（DWARF 5）
+  struct section str;        // .debug_str
+};
+
+// DWARF 5 目录/文件表的一个条目格式
+struct entry_format {
+  uint64_t content;
+  uint64_t form;
+};
+
+/**
+ * @brief 按form读取一个属性值；字符串类返回指针，其余返回数值
+ * @return false表示不支持的form，当前单元无法继续解码
+ */
+static bool read_form(struct reader *r, uint64_t form, bool dwarf64,
+                      const struct line_strings *strs, const char **str, uint64_t *num) {
+  *str = NULL;
+  *num = 0;
+  switch (form) {
+    case DW_FORM_string:
+      *str = read_cstr(r);
+      return true;
+    case DW_FORM_line_strp:
+      *str = section_str(&strs->line_str, read_fixed(r, dwarf64 ? 8 : 4));
+      return true;
+    case DW_FORM_strp:
+      *str = section_str(&strs->str, read_fixed(r, dwarf64 ? 8 : 4));
+      return true;
+    case DW_FORM_udata:
+      *num = read_uleb(r);
+      return true;
+    case DW_FORM_data1:
+      *num = read_fixed(r, 1);
+      return true;
+    case DW_FORM_data2:
+      *num = read_fixed(r, 2);
+      return true;
+    case DW_FORM_data4:
+      *num = read_fixed(r, 4);
+      return true;
+    case DW_FORM_data8:
+      *num = read_fixed(r, 8);
+      return true;
+    case DW_FORM_data16:
+      read_fixed(r, 8);
+      read_fixed(r, 8);
+      return true;
+    case DW_FORM_block: {
+      uint64_t len = read_uleb(r);
+      if (len > (uint64_t)(r->end - r->p)) {
+        r->error = true;
+        return false;
+      }
+      r->p += len;
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+// 读DWARF 5目录表/文件表的条目格式描述
+static bool read_v5_formats(struct reader *r, struct entry_format *formats,
+                            uint8_t *count) {
+  *count = (uint8_t)read_fixed(r, 1);
+  if (*count > MAX_ENTRY_FORMATS) {
+    return false;
+  }
+  for (uint8_t i = 0; i < *count; i++) {
+    formats[i].content = read_uleb(r);
+    formats[i].form = read_uleb(r);
+  }
+  return !r->error;
+}
+
+// 按格式描述读一个条目，只取路径和目录编号
+static bool read_v5_entry(struct reader *r, const struct entry_format *formats,
+                          uint8_t count, bool dwarf64, const struct line_strings *strs,
+                          const char **path, uint64_t *dir_index) {
+  *path = "??";
+  *dir_index = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    const char *s;
+    uint64_t v;
+    if (!read_form(r, formats[i].form, dwarf64, strs, &s, &v)) {
+      return false;
+    }
+    if (formats[i].content == DW_LNCT_path && s) {
+      *path = s;
+    } else if (formats[i].content == DW_LNCT_directory_index) {
+      *dir_index = v;
+    }
+  }
+  return !r->error;
+}
+
+// DWARF 5：目录表和文件表都由格式描述驱动，编号从0开始
+static bool read_v5_file_table(struct elf_symbolizer *sym, struct reader *r, bool dwarf64,
+                               const struct line_strings *strs, uint32_t **file_map,
+                               size_t *file_map_count) {
+  struct entry_format formats[MAX_ENTRY_FORMATS];
+  uint8_t format_count;
+  const char *path;
+  uint64_t dir_index;
+
+  if (!read_v5_formats(r, formats, &format_count)) {
+    return false;
+  }
+  uint64_t dir_count = read_uleb(r);
+  if (r->error || dir_count > 1u << 16) {
+    return false;
+  }
+  const char **dirs = symbolizer_calloc(sym->alloc, dir_count ? dir_count : 1, sizeof(*dirs));
+  if (!dirs) {
+    return false;
+  }
+  for (uint64_t i = 0; i < dir_count; i++) {
+    if (!read_v5_entry(r, formats, format_count, dwarf64, strs, &path, &dir_index)) {
+      symbolizer_free(sym->alloc, dirs);
+      return false;
+    }
+    dirs[i] = path;
+  }
+
+  uint64_t file_count = 0;
+  uint32_t *map = NULL;
+  bool ok = read_v5_formats(r, formats, &format_count);
+  if (ok) {
+    file_count = read_uleb(r);
+    ok = !r->error && file_count <= 1u << 20;
+  }
+  if (ok) {
+    map = symbolizer_calloc(sym->alloc, file_count ? file_count : 1, sizeof(*map));
+    ok = map != NULL;
+  }
+  for (uint64_t i = 0; ok && i < file_count; i++) {
+    ok = read_v5_entry(r, formats, format_count, dwarf64, strs, &path, &dir_index);
+    if (ok) {
+      map[i] = add_file(sym, dir_index < dir_count ? dirs[dir_index] : NULL, path);
+    }
+  }
+  symbolizer_free(sym->alloc, dirs);
+  if (!ok) {
+    symbolizer_free(sym->alloc, map);
+    return false;
+  }
+  *file_map = map;
+  *file_map_count = file_count;
+  return true;
+}
+
+/**
+ * @brief 解码一个行号程序单元
+ * @return 下一个单元的起点，出错返回NULL
+ */
+static const uint8_t *decode_line_unit(struct elf_symbolizer *sym, const uint8_t *p,
+                                       const uint8_t *end,
+                                       const struct line_strings *strs) {
+  struct reader r = {p, end, false};
+  uint64_t unit_length = read_fixed(&r, 4);
+  bool dwarf64 = false;
+  if (unit_length == 0xffffffffu) {
+    unit_length = read_fixed(&r, 8);
+    dwarf64 = true;
+  }
+  if (r.error || unit_length > (uint64_t)(end - r.p)) {
+    return NULL;
+  }
+  const uint8_t *unit_end = r.p + unit_length;
+  r.end = unit_end;
+
+  uint16_t version = (uint16_t)read_fixed(&r, 2);
+  if (version < 2 || version > 5) {
+    return unit_end;
+  }
+  if (version >= 5) {
+    read_fixed(&r, 1); // address_size
+    read_fixed(&r, 1); // segment_selector_size
+  }
+  uint64_t header_length = read_fixed(&r, dwarf64 ? 8 : 4);
+  if (header_length > (uint64_t)(unit_end - r.p)) {
+    return unit_end;
+  }
+  const uint8_t *program = r.p + header_length;
+
+  uint8_t min_inst_length = (uint8_t)read_fixed(&r, 1);
+  if (version >= 4) {
+    read_fixed(&r, 1); // maximum_operations_per_instruction（只支持1）
+  }
+  read_fixed(&r, 1); // default_is_stmt（不区分语句边界）
+  int8_t line_base = (int8_t)read_fixed(&r, 1);
+  uint8_t line_range = (uint8_t)read_fixed(&r, 1);
+  uint8_t opcode_base = (uint8_t)read_fixed(&r, 1);
+  if (r.error || line_range == 0 || opcode_base == 0) {
+    return unit_end;
+  }
+  uint8_t opcode_lengths[256] = {0};
+  for (int i = 1; i < opcode_base; i++) {
+    opcode_lengths[i] = (uint8_t)read_fixed(&r, 1);
+  }
+
+  // 文件表：本单元文件编号 → 全局files[]下标
+  uint32_t *file_map = NULL;
+  size_t file_map_count = 0;
+  uint32_t file_bias; // DWARF 5文件编号从0开始，之前从1开始
+
+  if (version >= 5) {
+    if (!read_v5_file_table(sym, &r, dwarf64, strs, &file_map, &file_map_count)) {
+      return unit_end;
+    }
+    file_bias = 0;
+  } else {
+    const char *dirs[256];
+    size_t dir_count = 0;
+    for (;;) {
+      const char *dir = read_cstr(&r);
+      if (r.error || dir[0] == '\0') {
+        break;
+      }
+      if (dir_count < 256) {
+        dirs[dir_count++] = dir;
+      }
+    }
+    size_t capacity = 0;
+    for (;;) {
+      const char *name = read_cstr(&r);
+      if (r.error || name[0] == '\0') {
+        break;
+      }
+      uint64_t dir_index = read_uleb(&r);
+      read_uleb(&r); // mtime
+      read_uleb(&r); // length
+      // 目录编号0表示编译目录，行号表里拿不到，只保留文件名本身
+      const char *dir = dir_index >= 1 && dir_index <= dir_count ? dirs[dir_index - 1] : NULL;
+      if (file_map_count == capacity) {
+        size_t cap = capacity ? capacity * 2 : 16;
+        uint32_t *grown = symbolizer_realloc(sym->alloc, file_map, capacity * sizeof(*grown),
+                                             cap * sizeof(*grown));
+        if (!grown) {
+          symbolizer_free(sym->alloc, file_map);
+          return unit_end;
+        }
+        file_map = grown;
+        capacity = cap;
+      }
+      file_map[file_map_count++] = add_file(sym, dir, name);
+    }
+    file_bias = 1;
+  }
+
+  // 行号状态机
+  r.p = program;
+  uint64_t address = 0;
+  uint64_t file = 1;
+  int64_t line = 1;
+  size_t seq_start = sym->row_count;
+
+#define EMIT_ROW()                                                              \
+  do {                                                                          \
+    uint64_t idx = file - file_bias;                                            \
+    uint32_t global = idx < file_map_count ? file_map[idx] : UINT32_MAX;        \
+    add_row(sym, address, global, line > 0 ? (uint32_t)line : 0);               \
+  } while (0)
+
+  while (r.p < unit_end && !r.error) {
+    uint8_t op = (uint8_t)read_fixed(&r, 1);
+    if (op >= opcode_base) {
+      uint8_t adj = op - opcode_base;
+      address += (uint64_t)(adj / line_range) * min_inst_length;
+      line += line_base + adj % line_range;
+      EMIT_ROW();
+      continue;
+    }
+    switch (op) {
+      case 0: { // 扩展操作码
+        uint64_t len = read_uleb(&r);
+        if (len == 0 || len > (uint64_t)(unit_end - r.p)) {
+          r.error = true;
+          break;
+        }
+        const uint8_t *next = r.p + len;
+        uint8_t sub = (uint8_t)read_fixed(&r, 1);
+        if (sub == DW_LNE_end_sequence) {
+          // 起点为0的序列来自被--gc-sections丢弃的函数，整段丢掉
+          if (seq_start < sym->row_count && sym->rows[seq_start].addr == 0) {
+            sym->row_count = seq_start;
+          } else {
+            add_row(sym, address, UINT32_MAX, 0);
+          }
+          seq_start = sym->row_count;
+          address = 0;
+          file = 1;
+          line = 1;
+        } else if (sub == DW_LNE_set_address) {
+          address = read_fixed(&r, len - 1 < 8 ? len - 1 : 8);
+        }
+        r.p = next;
+        break;
+      }
+      case DW_LNS_copy:
+        EMIT_ROW();
+        break;
+      case DW_LNS_advance_pc:
+        address += read_uleb(&r) * min_inst_length;
+        break;
+      case DW_LNS_advance_line:
+        line += read_sleb(&r);
+        break;
+      case DW_LNS_set_file:
+        file = read_uleb(&r);
+        break;
+      case DW_LNS_const_add_pc:
+        address += (uint64_t)((255 - opcode_base) / line_range) * min_inst_length;
+        break;
+      case DW_LNS_fixed_advance_pc:
+        address += read_fixed(&r, 2);
+        break;
+      default:
+        // 其余标准操作码（set_column、negate_stmt等）不影响地址/行号
+        for (int i = 0; i < opcode_lengths[op]; i++) {
+          read_uleb(&r);
+        }
+        break;
+    }
+  }
+#undef EMIT_ROW
+
+  sym->row_count = seq_start; // 没有end_sequence收尾的残缺序列不要
+  symbolizer_free(sym->alloc, file_map);
+  return unit_end;
+}
+
+static int compare_rows(const void *a, const void *b) {
+  const struct line_row *ra = a;
+  const struct line_row *rb = b;
+  if (ra->addr != rb->addr) {
+    return ra->addr < rb->addr ? -1 : 1;
+  }
+  // 同一地址上，前一序列的结束行排在后一序列的起始行之前
+  return (ra->file != UINT32_MAX) - (rb->file != UINT32_MAX);
+}
+
+static void decode_debug_line(struct elf_symbolizer *sym) {
+  sym->lines_decoded = true;
+
+  const struct elf_image *img = &sym->image;
+  struct section line;
+  if (!get_section(img, ".debug_line", &line)) {
+    img = &sym->debug;
+    if (!get_section(img, ".debug_line", &line)) {
+      return;
+    }
+  }
+  struct line_strings strs;
+  memset(&strs, 0, sizeof(strs));
+  get_section(img, ".debug_line_str", &strs.line_str);
+  get_section(img, ".debug_str", &strs.str);
+
+  const uint8_t *p = line.data;
+  const uint8_t *end = line.data + line.size;
+  while (p && p < end) {
+    p = decode_line_unit(sym, p, end, &strs);
+  }
+
+  if (sym->row_count > 1) {
+    symbolizer_sort(sym->alloc, sym->rows, sym->row_count, sizeof(*sym->rows), compare_rows);
+  }
+}
+
+// rows[upper - 1]是最后一个地址 <= vaddr的行
+static const struct line_row *line_before(const struct elf_symbolizer *sym, size_t upper) {
+  if (upper == 0) {
+    return NULL;
+  }
+  const struct line_row *row = &sym->rows[upper - 1];
+  // 落在序列结束行之后：不属于任何序列
+  if (row->file == UINT32_MAX || row->line == 0) {
+    return NULL;
+  }
+  return row;
+}
+
+static const struct line_row *lookup_line(const struct elf_symbolizer *sym,
+                                          uint64_t vaddr) {
+  size_t lo = 0, hi = sym->row_count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (sym->rows[mid].addr <= vaddr) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return line_before(sym, lo);
+}
+
+static void fill_symbol_info(const struct elf_symbolizer *sym, const struct func_symbol *f,
+                             const struct line_row *row, uint64_t vaddr,
+                             struct elf_symbol_info *out) {
+  memset(out, 0, sizeof(*out));
+  if (f) {
+    out->function = f->name;
+    out->function_offset = vaddr - f->addr;
+  }
+  if (row && row->file < sym->file_count) {
+    out->file = sym->files[row->file];
+    out->line = row->line;
+  }
+}
+
+// ======================= 对外接口 =======================
+
+struct elf_symbolizer *elf_symbolizer_open(const char *path,
+                                           const struct symbolizer_allocator *alloc) {
+  struct elf_symbolizer *sym = symbolizer_calloc(alloc, 1, sizeof(*sym));
+  if (!sym) {
+    return NULL;
+  }
+  sym->alloc = alloc;
+  if (image_open(path, &sym->image) != 0) {
+    symbolizer_free(alloc, sym);
+    return NULL;
+  }
+  sym->build_id_size = read_build_id(&sym->image, sym->build_id);
+  if (!has_debug_info(&sym->image)) {
+    find_debug_file(sym, path);
+  }
+  build_function_index(sym);
+  return sym;
+}
+
+void elf_symbolizer_close(struct elf_symbolizer *sym) {
+  if (!sym) {
+    return;
+  }
+  const struct symbolizer_allocator *alloc = sym->alloc;
+  for (size_t i = 0; i < sym->file_count; i++) {
+    symbolizer_free(alloc, sym->files[i]);
+  }
+  symbolizer_free(alloc, sym->files);
+  symbolizer_free(alloc, sym->rows);
+  symbolizer_free(alloc, sym->funcs);
+  symbolizer_free(alloc, sym->debug_path);
+  image_close(&sym->debug);
+  image_close(&sym->image);
+  symbolizer_free(alloc, sym);
+}
+
+void elf_symbolizer_prepare(struct elf_symbolizer *sym) {
+  if (!sym->lines_decoded) {
+    decode_debug_line(sym);
+  }
+}
+
+int elf_symbolize(struct elf_symbolizer *sym, uint64_t vaddr,
+                  struct elf_symbol_info *out) {
+  if (!sym->lines_decoded) {
+    decode_debug_line(sym);
+  }
+  const struct func_symbol *f = lookup_function(sym, vaddr);
+  fill_symbol_info(sym, f, lookup_line(sym, vaddr), vaddr, out);
+  return f ? 0 : -1;
+}
+
+size_t elf_symbolize_sorted(struct elf_symbolizer *sym, const uint64_t *vaddrs,
+                            size_t count, struct elf_symbol_info *out) {
+  if (!sym->lines_decoded) {
+    decode_debug_line(sym);
+  }
+  // 地址升序，函数表和行表各一个游标单调前进：总代价O(n + 函数数 + 行数)
+  size_t func_upper = 0, row_upper = 0, found = 0;
+  for (size_t i = 0; i < count; i++) {
+    uint64_t vaddr = vaddrs[i];
+    while (func_upper < sym->func_count && sym->funcs[func_upper].addr <= vaddr) {
+      func_upper++;
+    }
+    while (row_upper < sym->row_count && sym->rows[row_upper].addr <= vaddr) {
+      row_upper++;
+    }
+    const struct func_symbol *f = function_before(sym, func_upper, vaddr);
+    fill_symbol_info(sym, f, line_before(sym, row_upper), vaddr, &out[i]);
+    found += f != NULL;
+  }
+  return found;
+}
+
+size_t elf_symbolizer_build_id(const struct elf_symbolizer *sym,
+                               const uint8_t **build_id) {
+  *build_id = sym->build_id;
+  return sym->build_id_size;
+}
+
+const char *elf_symbolizer_debug_file(const struct elf_symbolizer *sym) {
+  return sym->debug_path;
+}
+
+size_t elf_symbolizer_function_count(const struct elf_symbolizer *sym) {
+  return sym->func_count;
+}
+
+void elf_symbolizer_function(const struct elf_symbolizer *sym, size_t index,
+                             struct elf_function_info *out) {
+  const struct func_symbol *f = &sym->funcs[index];
+  out->addr = f->addr;
+  out->size = f->size;
+  out->name = f->name;
+}
@@ -0,0 +1,95 @@
+/**
+ * @file elf_symbolizer.h
+ * @brief 进程内ELF/DWARF符号化接口
+ *
+ * 直接mmap模块文件解析符号，不再为每一帧popen一次addr2line：
+ * - 函数名：.symtab与.dynsym中的STT_FUNC符号，按地址排序后二分查找
+ * - 文件名:行号：解码.debug_line（DWARF 2~5），首次查询行号时才解码
+ * - 分离调试文件：模块本身缺少.symtab或.debug_line时，按build-id
+ *   （/usr/lib/debug/.build-id/xx/yyyy.debug）和.gnu_debuglink查找
+ *
+ * 只依赖libc和<elf.h>，运行时库与离线工具共用。
+ *
+ * @author Toy ASan Project
+ * @version 1.0
+ */
+
+#ifndef TOY_ASAN_ELF_SYMBOLIZER_H
+#define TOY_ASAN_ELF_SYMBOLIZER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ELF_DEBUG_ROOT "/usr/lib/debug"
+
+struct elf_symbolizer;
+struct symbolizer_allocator;
+
+// 符号化结果，字符串指向符号化器内部，随elf_symbolizer_close失效
+struct elf_symbol_info {
+  const char *function;      // 函数名，未找到为NULL
+  uint64_t function_offset;  // 地址相对函数起点的偏移
+  const char *file;          // 源文件，无行号信息为NULL
+  unsigned line;             // 行号，0表示未知
+};
+
+/**
+ * @brief 打开模块文件并建立函数地址索引
+ * @param path ELF文件路径
+ * @param alloc 之后所有内存的来源，NULL表示malloc（见symbolizer_alloc.h）
+ * @return 符号化器，文件不存在或不是ELF64时返回NULL
+ *
+ * alloc不调用malloc时，打开和elf_symbolizer_prepare()都可以在信号处理器中进行。
+ */
+struct elf_symbolizer *elf_symbolizer_open(const char *path,
+                                           const struct symbolizer_allocator *alloc);
+void elf_symbolizer_close(struct elf_symbolizer *sym);
+
+/**
+ * @brief 立即解码行号表（默认在首次查询时解码）
+ *
+ * 之后的elf_symbolize()/elf_symbolize_sorted()不再分配内存、只读访问，
+ * 可以在信号处理器中调用，也可以被多个线程同时调用。
+ */
+void elf_symbolizer_prepare(struct elf_symbolizer *sym);
+
+/**
+ * @brief 符号化一个链接时虚拟地址（运行时PC - 模块加载偏移）
+ * @return 0找到函数名，-1未找到（out->file/line仍可能有值）
+ */
+int elf_symbolize(struct elf_symbolizer *sym, uint64_t vaddr,
+                  struct elf_symbol_info *out);
+
+/**
+ * @brief 批量符号化一组升序排列的链接时地址
+ * @param vaddrs 地址数组，必须升序
+ * @param count 地址数量
+ * @param out 输出，与vaddrs一一对应
+ * @return 找到函数名的数量
+ *
+ * 与函数表、行表做一次线性归并，地址很多时比逐个elf_symbolize()的
+ * 二分查找更快。
+ */
+size_t elf_symbolize_sorted(struct elf_symbolizer *sym, const uint64_t *vaddrs,
+                            size_t count, struct elf_symbol_info *out);
+
+// 模块的GNU build-id，没有返回0
+size_t elf_symbolizer_build_id(const struct elf_symbolizer *sym,
+                               const uint8_t **build_id);
+
+// 实际使用的分离调试文件路径，没有返回NULL
+const char *elf_symbolizer_debug_file(const struct elf_symbolizer *sym);
+
+// 函数索引中的一项（按地址升序，同一地址只有一项）
+struct elf_function_info {
+  uint64_t addr;             // 链接时地址
+  uint64_t size;             // 0表示未知
+  const char *name;          // 随elf_symbolizer_close失效
+};
+
+// 遍历函数索引（生成符号索引等离线工具用）
+size_t elf_symbolizer_function_count(const struct elf_symbolizer *sym);
+void elf_symbolizer_function(const struct elf_symbolizer *sym, size_t index,
+                             struct elf_function_info *out);
+
+#endif // TOY_ASAN_ELF_SYMBOLIZER_H
@@ -0,0 +1,593 @@
+/**
+ * @file fault_access.c
+ * @brief Toy AddressSanitizer 故障访问的方向、宽度与起始地址
+ *
+ * si_code只能区分"未映射"和"权限不足"（SEGV_MAPERR / SEGV_ACCERR），
+ * 与读写方向无关；si_addr是第一个不可访问的字节，不一定是访问的起点。
+ * 报告需要的信息从信号上下文中取：
+ * - 读/写：页错误码uc_mcontext.gregs[REG_ERR]的第1位（1表示写）；
+ *   第4位表示取指令出错（跳到保护页上），这时不解码，RIP处本身不可读
+ * - 宽度和起始地址：解码REG_RIP处的出错指令，按ModRM/SIB/位移和
+ *   上下文中的寄存器值算出内存操作数的有效地址
+ *
+ * 解码器只覆盖常见形式：
+ * - 单字节操作码表中的mov/ALU/test/xchg/移位/inc/dec/push/pop、
+ *   moffs形式的mov、串操作（movs/stos/lods/cmps/scas）
+ * - 0F表中的movzx/movsx/cmov/cmpxchg/xadd/movbe与SSE的
+ *   mov/算术/逻辑/整数指令（按66/F3/F2前缀区分ps/pd/ss/sd宽度）
+ * - VEX编码（C4/C5）的AVX/AVX2同类指令，按VEX.L区分128/256位
+ * - EVEX编码（62）的整向量mov（无广播）
+ * 其余指令（x87、gather、掩码mov、FS/GS段前缀等）只给出读写方向，
+ * 宽度未知，起始地址取si_addr。算出的访问区间不包含si_addr时
+ * 视为解码错误，同样退回si_addr。
+ *
+ * userfaultfd监控线程（uffd_monitor.c）拿不到出错线程的寄存器，只有PC：
+ * decode_fault_access_at()按指令给出宽度，起始地址一般只能取出错地址。
+ *
+ * 只读取出错指令本身的字节（CPU刚取过指令，必然可读），
+ * 不分配内存，信号处理器中可用。
+ *
+ * @author Toy ASan Project
+ * @version 1.0
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE      // REG_RIP、REG_ERR等寄存器下标
+#endif
+
+#include "toy_asan.h"
+#include <string.h>
+#include <ucontext.h>
+
+#define PF_WRITE 0x2     // 页错误码：写访问
+#define PF_INSTR 0x10    // 页错误码：取指令
+
+#if defined(__x86_64__)
+
+// 解码出的指令
+struct insn {
+  const uint8_t *p;      // 当前读取位置
+  bool opsize16;         // 66前缀
+  bool rep;              // F3前缀
+  bool repne;            // F2前缀
+  bool addr32;           // 67前缀
+  bool segment;          // FS/GS前缀：段基址不在ucontext中，无法算地址
+  bool rex_w, rex_r, rex_x, rex_b;
+  int map;               // 0: 单字节 1: 0F 2: 0F38 3: 0F3A
+  uint8_t opcode;
+  bool vex;              // VEX或EVEX编码
+  bool evex;
+  int vex_l;             // 向量长度：0=128 1=256 2=512
+  int vex_pp;            // VEX隐含前缀：0无 1=66 2=F3 3=F2
+  bool evex_broadcast;
+};
+
+// ModRM中的寄存器编号 → gregs下标
+static const int greg_index[16] = {
+    REG_RAX, REG_RCX, REG_RDX, REG_RBX, REG_RSP, REG_RBP, REG_RSI, REG_RDI,
+    REG_R8,  REG_R9,  REG_R10, REG_R11, REG_R12, REG_R13, REG_R14, REG_R15,
+};
+
+static int operand_size(const struct insn *in) {
+  if (in->rex_w) {
+    return 8;
+  }
+  return in->opsize16 ? 2 : 4;
+}
+
+// SSE指令的"有效前缀"：VEX/EVEX中的pp，否则66/F3/F2
+static int simd_prefix(const struct insn *in) {
+  if (in->vex) {
+    return in->vex_pp;
+  }
+  if (in->rep) {
+    return 2;
+  }
+  if (in->repne) {
+    return 3;
+  }
+  return in->opsize16 ? 1 : 0;
+}
+
+static int vector_size(const struct insn *in) {
+  return in->vex ? 16 << in->vex_l : 16;
+}
+
+// ps/pd打包为整向量，ss为4字节，sd为8字节
+static int packed_or_scalar(const struct insn *in) {
+  switch (simd_prefix(in)) {
+    case 2:
+      return 4;
+    case 3:
+      return 8;
+    default:
+      return vector_size(in);
+  }
+}
+
+/**
+ * @brief 前缀、REX、VEX/EVEX和操作码
+ * @return false遇到不支持的编码
+ */
+static bool decode_opcode(struct insn *in) {
+  for (int i = 0; i < 14; i++) {
+    uint8_t b = *in->p;
+    if (b == 0x66) {
+      in->opsize16 = true;
+    } else if (b == 0xf3) {
+      in->rep = true;
+    } else if (b == 0xf2) {
+      in->repne = true;
+    } else if (b == 0x67) {
+      in->addr32 = true;
+    } else if (b == 0x64 || b == 0x65) {
+      in->segment = true;
+    } else if (b == 0xf0 || b == 0x2e || b == 0x36 || b == 0x3e || b == 0x26) {
+      // lock与64位下无效的段前缀
+    } else {
+      break;
+    }
+    in->p++;
+  }
+
+  uint8_t b = *in->p;
+  if ((b & 0xf0) == 0x40) {  // REX必须紧贴操作码
+    in->rex_w = b & 8;
+    in->rex_r = b & 4;
+    in->rex_x = b & 2;
+    in->rex_b = b & 1;
+    b = *++in->p;
+  }
+
+  if (b == 0xc5) {  // 两字节VEX：R vvvv L pp，隐含0F表
+    uint8_t v = in->p[1];
+    in->vex = true;
+    in->rex_r = !(v & 0x80);
+    in->vex_l = (v >> 2) & 1;
+    in->vex_pp = v & 3;
+    in->map = 1;
+    in->opcode = in->p[2];
+    in->p += 3;
+    return true;
+  }
+  if (b == 0xc4) {  // 三字节VEX：RXB mmmmm / W vvvv L pp
+    uint8_t v1 = in->p[1], v2 = in->p[2];
+    in->vex = true;
+    in->rex_r = !(v1 & 0x80);
+    in->rex_x = !(v1 & 0x40);
+    in->rex_b = !(v1 & 0x20);
+    in->map = v1 & 0x1f;
+    in->rex_w = v2 & 0x80;
+    in->vex_l = (v2 >> 2) & 1;
+    in->vex_pp = v2 & 3;
+    in->opcode = in->p[3];
+    in->p += 4;
+    return in->map >= 1 && in->map <= 3;
+  }
+  if (b == 0x62) {  // EVEX：RXBR' 0mmm / W vvvv 1 pp / z L'L b V' aaa
+    uint8_t p0 = in->p[1], p1 = in->p[2], p2 = in->p[3];
+    in->vex = true;
+    in->evex = true;
+    in->rex_r = !(p0 & 0x80);
+    in->rex_x = !(p0 & 0x40);
+    in->rex_b = !(p0 & 0x20);
+    in->map = p0 & 7;
+    in->rex_w = p1 & 0x80;
+    in->vex_pp = p1 & 3;
+    in->vex_l = (p2 >> 5) & 3;
+    in->evex_broadcast = p2 & 0x10;
+    in->opcode = in->p[4];
+    in->p += 5;
+    return in->map >= 1 && in->map <= 3;
+  }
+
+  if (b == 0x0f) {
+    b = *++in->p;
+    if (b == 0x38 || b == 0x3a) {
+      in->map = b == 0x38 ? 2 : 3;
+      b = *++in->p;
+    } else {
+      in->map = 1;
+    }
+  }
+  in->opcode = b;
+  in->p++;
+  return true;
+}
+
+/**
+ * @brief 内存操作数的宽度和紧跟在ModRM之后的立即数字节数
+ * @param reg ModRM.reg（组指令的子操作码）
+ * @return 宽度，0表示不支持
+ */
+static int operand_width(const struct insn *in, int reg, int *imm) {
+  uint8_t op = in->opcode;
+  int osz = operand_size(in);
+  int imm_z = osz == 2 ? 2 : 4;  // imm16/imm32
+  *imm = 0;
+
+  if (in->evex) {
+    // 只支持整向量mov；disp8按向量宽度压缩，广播形式的宽度不同
+    if (in->map != 1 || in->evex_broadcast) {
+      return 0;
+    }
+    switch (op) {
+      case 0x10: case 0x11:
+        return packed_or_scalar(in);
+      case 0x28: case 0x29: case 0x6f: case 0x7f: case 0x2b: case 0xe7:
+        return vector_size(in);
+      default:
+        return 0;
+    }
+  }
+
+  if (in->map == 0) {
+    if (op < 0x40 && (op & 7) <= 3) {  // add/or/adc/sbb/and/sub/xor/cmp
+      return (op & 1) ? osz : 1;
+    }
+    switch (op) {
+      case 0x63:                       // movsxd
+        return in->opsize16 ? 2 : 4;
+      case 0x69:
+        *imm = imm_z;
+        return osz;
+      case 0x6b:
+        *imm = 1;
+        return osz;
+      case 0x80: case 0x82:
+        *imm = 1;
+        return 1;
+      case 0x81:
+        *imm = imm_z;
+        return osz;
+      case 0x83:
+        *imm = 1;
+        return osz;
+      case 0x84: case 0x86: case 0x88: case 0x8a:
+        return 1;
+      case 0x85: case 0x87: case 0x89: case 0x8b:
+        return osz;
+      case 0x8c: case 0x8e:            // mov段寄存器
+        return 2;
+      case 0x8f:                       // pop r/m（64位下默认8字节）
+        return in->opsize16 ? 2 : 8;
+      case 0xc0:
+        *imm = 1;
+        return 1;
+      case 0xc1:
+        *imm = 1;
+        return osz;
+      case 0xc6:
+        *imm = 1;
+        return 1;
+      case 0xc7:
+        *imm = imm_z;
+        return osz;
+      case 0xd0: case 0xd2:
+        return 1;
+      case 0xd1: case 0xd3:
+        return osz;
+      case 0xf6:
+        *imm = reg <= 1 ? 1 : 0;       // test r/m8, imm8
+        return 1;
+      case 0xf7:
+        *imm = reg <= 1 ? imm_z : 0;
+        return osz;
+      case 0xfe:
+        return reg <= 1 ? 1 : 0;
+      case 0xff:
+        if (reg <= 1) {
+          return osz;                  // inc/dec
+        }
+        if (reg == 2 || reg == 4 || reg == 6) {
+          return in->opsize16 ? 2 : 8; // call/jmp/push间接操作数
+        }
+        return 0;
+      default:
+        return 0;
+    }
+  }
+
+  if (in->map == 1) {
+    if (op >= 0x40 && op <= 0x4f) {    // cmovcc
+      return osz;
+    }
+    if (op >= 0x51 && op <= 0x5f) {    // SSE算术、逻辑、转换
+      if (op >= 0x54 && op <= 0x57) {
+        return vector_size(in);
+      }
+      return packed_or_scalar(in);
+    }
+    switch (op) {
+      case 0x10: case 0x11:            // movups/movupd/movss/movsd
+        return packed_or_scalar(in);
+      case 0x12: case 0x13: case 0x16: case 0x17:  // movlps/movhps/movlpd/movhpd
+        return 8;
+      case 0x14: case 0x15:            // unpcklps/unpckhps
+      case 0x28: case 0x29: case 0x2b: // movaps/movapd/movntps
+        return vector_size(in);
+      case 0x2e: case 0x2f:            // ucomiss/comiss
+        return simd_prefix(in) == 1 ? 8 : 4;
+      case 0x6e:                       // movd/movq到xmm
+        return in->rex_w ? 8 : 4;
+      case 0x7e:                       // movd/movq从xmm；F3为movq xmm, m64
+        return simd_prefix(in) == 2 || in->rex_w ? 8 : 4;
+      case 0x6f: case 0x7f:            // movq(mmx)/movdqa/movdqu
+        return simd_prefix(in) == 0 && !in->vex ? 8 : vector_size(in);
+      case 0x70:                       // pshufd等
+        *imm = 1;
+        return simd_prefix(in) == 0 && !in->vex ? 8 : vector_size(in);
+      case 0xa3: case 0xab: case 0xb3: case 0xbb:  // bt/bts/btr/btc
+        return osz;
+      case 0xaf:                       // imul r, r/m
+        return osz;
+      case 0xb0: case 0xc0:            // cmpxchg/xadd r/m8
+        return 1;
+      case 0xb1: case 0xc1:
+        return osz;
+      case 0xb6: case 0xbe:            // movzx/movsx r, r/m8
+        return 1;
+      case 0xb7: case 0xbf:
+        return 2;
+      case 0xc2:                       // cmpps/cmpss...
+        *imm = 1;
+        return packed_or_scalar(in);
+      case 0xc3:                       // movnti
+        return osz;
+      case 0xc6:                       // shufps
+        *imm = 1;
+        return vector_size(in);
+      case 0xd6:                       // movq xmm到m64
+        return 8;
+      case 0xe7:                       // movntq / movntdq
+        return simd_prefix(in) == 0 && !in->vex ? 8 : vector_size(in);
+      default:
+        if ((op >= 0x60 && op <= 0x6d) || (op >= 0x74 && op <= 0x76) || op >= 0xd0) {
+          // SSE2整数指令：无前缀为MMX（8字节），66为xmm
+          return simd_prefix(in) == 0 && !in->vex ? 8 : vector_size(in);
+        }
+        return 0;
+    }
+  }
+
+  if (in->map == 2) {
+    switch (op) {
+      case 0xf0: case 0xf1:            // movbe / crc32
+        return in->vex ? 0 : (in->repne ? (op == 0xf0 ? 1 : osz) : osz);
+      case 0x18:                       // vbroadcastss
+        return 4;
+      case 0x19:                       // vbroadcastsd
+        return 8;
+      case 0x1a: case 0x5a:            // vbroadcastf128 / vbroadcasti128
+        return 16;
+      case 0x58:                       // vpbroadcastd
+        return 4;
+      case 0x59:                       // vpbroadcastq
+        return 8;
+      case 0x78:
+        return 1;
+      case 0x79:
+        return 2;
+      case 0x2c: case 0x2d: case 0x2e: case 0x2f: case 0x8c: case 0x8e:  // 掩码mov
+      case 0x90: case 0x91: case 0x92: case 0x93:                        // gather
+        return 0;
+      default:
+        return simd_prefix(in) == 0 && !in->vex ? 8 : vector_size(in);
+    }
+  }
+
+  // map == 3：全部带imm8
+  *imm = 1;
+  switch (op) {
+    case 0x14: case 0x20:              // pextrb / pinsrb
+      return 1;
+    case 0x15:                         // pextrw
+      return 2;
+    case 0x16: case 0x22:              // pextrd/q / pinsrd/q
+      return in->rex_w ? 8 : 4;
+    case 0x17: case 0x21:              // extractps / insertps
+      return 4;
+    case 0x18: case 0x19: case 0x38: case 0x39:  // vinsert/vextract 128
+      return 16;
+    default:
+      return vector_size(in);
+  }
+}
+
+/**
+ * @brief ModRM/SIB/位移 → 有效地址
+ * @return false不是内存操作数或无法计算
+ */
+static bool effective_address(struct insn *in, const ucontext_t *uc, int *reg,
+                              int *width, uintptr_t *addr) {
+  uint8_t modrm = *in->p++;
+  int mod = modrm >> 6;
+  int rm = modrm & 7;
+  *reg = (modrm >> 3) & 7;
+  if (mod == 3) {
+    return false;  // 寄存器操作数，不访问内存
+  }
+
+  const greg_t *gregs = uc->uc_mcontext.gregs;
+  uintptr_t ea = 0;
+  bool rip_relative = false;
+  if (rm == 4) {
+    uint8_t sib = *in->p++;
+    int scale = 1 << (sib >> 6);
+    int index = ((sib >> 3) & 7) | (in->rex_x ? 8 : 0);
+    int base = (sib & 7) | (in->rex_b ? 8 : 0);
+    if (index != 4) {
+      ea += (uintptr_t)gregs[greg_index[index]] * scale;
+    }
+    if ((sib & 7) == 5 && mod == 0) {
+      ea += (uintptr_t)(int64_t)(int32_t)(in->p[0] | in->p[1] << 8 | in->p[2] << 16 |
+                                          (uint32_t)in->p[3] << 24);
+      in->p += 4;
+    } else {
+      ea += (uintptr_t)gregs[greg_index[base]];
+    }
+  } else if (mod == 0 && rm == 5) {
+    rip_relative = true;
+  } else {
+    ea += (uintptr_t)gregs[greg_index[rm | (in->rex_b ? 8 : 0)]];
+  }
+
+  int32_t disp = 0;
+  if (mod == 1) {
+    disp = (int8_t)*in->p++;
+  } else if (mod == 2 || rip_relative) {
+    disp = (int32_t)(in->p[0] | in->p[1] << 8 | in->p[2] << 16 | (uint32_t)in->p[3] << 24);
+    in->p += 4;
+  }
+
+  int imm;
+  *width = operand_width(in, *reg, &imm);
+  if (*width == 0) {
+    return false;
+  }
+  if (in->evex && mod == 1) {
+    disp *= *width;  // EVEX的disp8按操作数宽度压缩
+  }
+  if (rip_relative) {
+    ea = (uintptr_t)(in->p + imm);  // RIP相对：下一条指令的地址
+  }
+  ea += (uintptr_t)(intptr_t)disp;
+  if (in->addr32) {
+    ea = (uint32_t)ea;
+  }
+  *addr = ea;
+  return !in->segment;
+}
+
+/**
+ * @brief 不带ModRM的访存指令：moffs形式的mov和串操作
+ * @return false不是这类指令
+ */
+static bool implicit_operand(const struct insn *in, const ucontext_t *uc,
+                             uintptr_t fault_addr, int *width, uintptr_t *addr) {
+  if (in->map != 0 || in->vex) {
+    return false;
+  }
+  uint8_t op = in->opcode;
+  const greg_t *gregs = uc->uc_mcontext.gregs;
+  if (op >= 0xa0 && op <= 0xa3) {  // mov al/eax, moffs；mov moffs, al/eax
+    uint64_t moffs = 0;
+    memcpy(&moffs, in->p, in->addr32 ? 4 : 8);
+    *width = (op & 1) ? operand_size(in) : 1;
+    *addr = (uintptr_t)moffs;
+    return !in->segment;
+  }
+
+  bool uses_rsi, uses_rdi;
+  switch (op & 0xfe) {
+    case 0xa4:  // movs
+    case 0xa6:  // cmps
+      uses_rsi = uses_rdi = true;
+      break;
+    case 0xaa:  // stos
+    case 0xae:  // scas
+      uses_rsi = false;
+      uses_rdi = true;
+      break;
+    case 0xac:  // lods
+      uses_rsi = true;
+      uses_rdi = false;
+      break;
+    default:
+      return false;
+  }
+  *width = (op & 1) ? operand_size(in) : 1;
+  uintptr_t rsi = (uintptr_t)gregs[REG_RSI];
+  uintptr_t rdi = (uintptr_t)gregs[REG_RDI];
+  // movs/cmps同时访问两处：取包含故障地址的那一个
+  if (uses_rsi && (!uses_rdi || (fault_addr >= rsi && fault_addr < rsi + *width))) {
+    *addr = rsi;
+  } else {
+    *addr = rdi;
+  }
+  return !in->segment;
+}
+
+/**
+ * @brief 解码uc中RIP处的指令
+ * @param regs_known false时通用寄存器未知（只有RIP/REG_ERR有效）：
+ *        只信任宽度，起始地址取fault_addr
+ */
+static void decode_access(const ucontext_t *uc, void *fault_addr, bool regs_known,
+                          struct fault_access *out) {
+  out->is_write = (uc->uc_mcontext.gregs[REG_ERR] & PF_WRITE) != 0;
+  out->is_exec = (uc->uc_mcontext.gregs[REG_ERR] & PF_INSTR) != 0;
+  out->size = 0;
+  out->addr = fault_addr;
+  if (out->is_exec) {
+    return;  // RIP本身不可读：信号处理器中SIGSEGV被阻塞，再读就会被内核杀掉
+  }
+
+  struct insn in;
+  memset(&in, 0, sizeof(in));
+  in.p = (const uint8_t *)uc->uc_mcontext.gregs[REG_RIP];
+  if (!decode_opcode(&in)) {
+    return;
+  }
+
+  int width = 0;
+  uintptr_t addr = 0;
+  bool known;
+  if (implicit_operand(&in, uc, (uintptr_t)fault_addr, &width, &addr)) {
+    known = true;
+  } else {
+    int reg;
+    known = effective_address(&in, uc, &reg, &width, &addr);
+  }
+
+  // 访问区间必须覆盖第一个出错字节，否则视为解码错误
+  uintptr_t fault = (uintptr_t)fault_addr;
+  if (known && width > 0 && fault >= addr && fault - addr < (uintptr_t)width) {
+    out->size = (size_t)width;
+    out->addr = (void *)addr;
+  } else if (width > 0 && (!known || !regs_known)) {
+    out->size = (size_t)width;  // 宽度已知但地址算不出（段前缀、寄存器未知）
+  }
+}
+
+void decode_fault_access(void *fault_addr, const void *context, struct fault_access *out) {
+  decode_access(context, fault_addr, true, out);
+}
+
+/**
+ * @brief 没有寄存器上下文时解码（userfaultfd监控线程只知道出错线程的PC）
+ * @param pc 出错指令地址
+ * @param is_write 写访问
+ * @param fault_addr 出错地址
+ * @param out 输出：宽度来自指令；起始地址只有RIP相对和moffs形式能算出，
+ *        其余取fault_addr
+ */
+void decode_fault_access_at(const void *pc, bool is_write, void *fault_addr,
+                            struct fault_access *out) {
+  ucontext_t uc;
+  memset(&uc, 0, sizeof(uc));
+  uc.uc_mcontext.gregs[REG_RIP] = (greg_t)(uintptr_t)pc;
+  uc.uc_mcontext.gregs[REG_ERR] = is_write ? PF_WRITE : 0;
+  decode_access(&uc, fault_addr, false, out);
+}
+
+#else
+
+void decode_fault_access(void *fault_addr, const void *context, struct fault_access *out) {
+  (void)context;
+  out->is_write = true;   // 其他架构上无法从上下文得知方向，按写报告
+  out->is_exec = false;
+  out->size = 0;
+  out->addr = fault_addr;
+}
+
+void decode_fault_access_at(const void *pc, bool is_write, void *fault_addr,
+                            struct fault_access *out) {
+  (void)pc;
+  out->is_write = is_write;
+  out->is_exec = false;
+  out->size = 0;
+  out->addr = fault_addr;
+}
+
+#endif
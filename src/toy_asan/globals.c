@@ -7,6 +7,8 @@
  * - alloc_count: 当前分配数量计数器
  * - page_size: 系统页面大小缓存
  * - toy_asan_initialized: 系统初始化标志
+ * - alloc_table_lock: 保护alloc_table写入与快照复制的互斥锁
+ * - toy_asan_error_reported: 已输出错误报告（退出时跳过泄漏检测）
  * 
  * 同时提供辅助函数：
  * - get_page_size(): 获取并缓存系统页面大小
@@ -29,6 +31,8 @@ struct allocation_record alloc_table[MAX_ALLOCATIONS];
 int alloc_count = 0;
 size_t page_size = 0;
 bool toy_asan_initialized = false;
+pthread_mutex_t alloc_table_lock = PTHREAD_MUTEX_INITIALIZER;
+bool toy_asan_error_reported = false;
 
 // 获取页面大小的辅助函数
 size_t get_system_page_size(void) {
@@ -0,0 +1,203 @@
+/**
+ * @file heap_dump.c
+ * @brief Toy AddressSanitizer 二进制堆快照导出
+ *
+ * print_allocations()逐条printf，大堆上既慢又产生海量文本。
+ * 本文件提供toy_asan_dump_heap(fd)，把当前存活的分配记录以
+ * 紧凑的二进制格式（见heap_snapshot.h）流式写入文件描述符，
+ * 包括分配标签名，离线工具可以按子系统归类。
+ *
+ * 导出分两个阶段：
+ * 1. 持有alloc_table_lock，仅把存活记录复制到私有缓冲区
+ * 2. 释放锁后再收集模块信息、编码并写出
+ * 因此分配线程最多只被阻塞"复制元数据"那么长的时间。
+ *
+ * 离线工具：
+ * - src/tools/toy_asan_heapdump.c: 快照 → 文本/CSV
+ * - src/tools/toy_asan_heapdiff.c: 两个快照按调用栈做增长对比
+ *
+ * @author Toy ASan Project
+ * @version 1.0
+ */
+
+#include "toy_asan.h"
+#include "heap_snapshot.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DUMP_BUFFER_SIZE (64 * 1024)
+
+// 带缓冲的写出器：攒满后一次write，减少系统调用次数
+struct dump_writer {
+  int fd;
+  size_t used;
+  int error;
+  char buf[DUMP_BUFFER_SIZE];
+};
+
+static void writer_flush(struct dump_writer *w) {
+  size_t off = 0;
+  while (off < w->used && !w->error) {
+    ssize_t n = write(w->fd, w->buf + off, w->used - off);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      w->error = errno;
+      break;
+    }
+    off += (size_t)n;
+  }
+  w->used = 0;
+}
+
+static void writer_put(struct dump_writer *w, const void *data, size_t len) {
+  const char *p = data;
+  while (len > 0 && !w->error) {
+    size_t room = DUMP_BUFFER_SIZE - w->used;
+    size_t chunk = len < room ? len : room;
+    memcpy(w->buf + w->used, p, chunk);
+    w->used += chunk;
+    p += chunk;
+    len -= chunk;
+    if (w->used == DUMP_BUFFER_SIZE) {
+      writer_flush(w);
+    }
+  }
+}
+
+/**
+ * @brief 将当前堆状态导出为二进制快照
+ * @param fd 已打开的可写文件描述符（文件、管道、socket均可）
+ * @return 0成功，-1失败（errno保存写失败原因）
+ *
+ * @example
+ * ```c
+ * int fd = open("heap.snap", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+ * toy_asan_dump_heap(fd);
+ * close(fd);
+ * // 离线：toy_asan_heapdump heap.snap --csv
+ * ```
+ */
+int toy_asan_dump_heap(int fd) {
+  struct allocation_record *copy =
+      malloc(MAX_ALLOCATIONS * sizeof(struct allocation_record));
+  struct module_info *modules = malloc(MAX_MODULES * sizeof(struct module_info));
+  struct dump_writer *w = malloc(sizeof(struct dump_writer));
+  int slots[MAX_ALLOCATIONS];
+  int ret = -1;
+
+  if (!copy || !modules || !w) {
+    goto out;
+  }
+
+  // 阶段1：锁内只做复制
+  int record_count = 0;
+  pthread_mutex_lock(&alloc_table_lock);
+  for (int i = 0; i < MAX_ALLOCATIONS; i++) {
+    if (alloc_table[i].in_use) {
+      copy[record_count] = alloc_table[i];
+      slots[record_count] = i;
+      record_count++;
+    }
+  }
+  pthread_mutex_unlock(&alloc_table_lock);
+
+  // 阶段2：锁外编码并写出
+  int module_count = collect_module_info(modules, MAX_MODULES);
+
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+
+  struct heap_snapshot_header hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, HEAP_SNAPSHOT_MAGIC, sizeof(HEAP_SNAPSHOT_MAGIC));
+  hdr.version = HEAP_SNAPSHOT_VERSION;
+  hdr.page_size = (uint32_t)get_system_page_size();
+  hdr.pid = (uint64_t)getpid();
+  hdr.timestamp_ns = (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+  hdr.module_count = (uint32_t)module_count;
+  hdr.record_count = (uint32_t)record_count;
+  hdr.tag_count = (uint32_t)toy_asan_tag_count();
+
+  w->fd = fd;
+  w->used = 0;
+  w->error = 0;
+  writer_put(w, &hdr, sizeof(hdr));
+
+  for (int i = 0; i < module_count; i++) {
+    struct heap_snapshot_module m;
+    memset(&m, 0, sizeof(m));
+    m.load_base = modules[i].load_base;
+    m.start = modules[i].start;
+    m.end = modules[i].end;
+    m.path_len = (uint32_t)strlen(modules[i].path);
+    m.build_id_size = (uint32_t)modules[i].build_id_size;
+    writer_put(w, &m, sizeof(m));
+    writer_put(w, modules[i].path, m.path_len);
+    writer_put(w, modules[i].build_id, m.build_id_size);
+  }
+
+  for (uint32_t t = 0; t < hdr.tag_count; t++) {
+    struct heap_snapshot_tag tag;
+    const char *name = toy_asan_tag_name((int)t);
+    tag.tag = t;
+    tag.name_len = (uint32_t)strlen(name);
+    writer_put(w, &tag, sizeof(tag));
+    writer_put(w, name, tag.name_len);
+  }
+
+  for (int i = 0; i < record_count; i++) {
+    struct heap_snapshot_record r;
+    memset(&r, 0, sizeof(r));
+    r.user_addr = (uintptr_t)copy[i].user_addr;
+    r.user_size = copy[i].user_size;
+    r.slot = (uint32_t)slots[i];
+    void *const *frames;
+    r.frame_count = (uint32_t)stack_depot_get(copy[i].alloc_stack_id, &frames);
+    r.tag = (uint32_t)copy[i].tag;
+    writer_put(w, &r, sizeof(r));
+    for (uint32_t f = 0; f < r.frame_count; f++) {
+      uint64_t pc = (uintptr_t)frames[f];
+      writer_put(w, &pc, sizeof(pc));
+    }
+  }
+
+  writer_flush(w);
+  if (w->error) {
+    errno = w->error;
+  } else {
+    ret = 0;
+  }
+
+out:
+  free(w);
+  free(modules);
+  free(copy);
+  return ret;
+}
+
+/**
+ * @brief 将堆快照写入指定文件（覆盖已有文件）
+ * @param path 输出文件路径
+ * @return 0成功，-1失败
+ *
+ * 在两个时间点各调用一次，再用toy_asan_heapdiff对比，
+ * 即可找出期间增长最多的分配调用点。
+ */
+int toy_asan_dump_heap_to_file(const char *path) {
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return -1;
+  }
+  int ret = toy_asan_dump_heap(fd);
+  if (close(fd) != 0) {
+    ret = -1;
+  }
+  return ret;
+}
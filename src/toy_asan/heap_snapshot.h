@@ -0,0 +1,69 @@
+/**
+ * @file heap_snapshot.h
+ * @brief Toy AddressSanitizer 二进制堆快照格式定义
+ *
+ * toy_asan_dump_heap()写出、离线工具读取的文件格式。
+ * 所有字段均为本机字节序（快照只在同架构机器上解析）。
+ *
+ * 文件布局：
+ * ┌──────────────────────────────────────┐
+ * │ heap_snapshot_header                 │
+ * ├──────────────────────────────────────┤
+ * │ heap_snapshot_module × module_count  │ ← 每项后跟 path + build-id
+ * ├──────────────────────────────────────┤
+ * │ heap_snapshot_tag × tag_count        │ ← 每项后跟 name
+ * ├──────────────────────────────────────┤
+ * │ heap_snapshot_record × record_count  │ ← 每项后跟 frame_count 个 uint64_t
+ * └──────────────────────────────────────┘
+ *
+ * @author Toy ASan Project
+ * @version 1.0
+ */
+
+#ifndef TOY_ASAN_HEAP_SNAPSHOT_H
+#define TOY_ASAN_HEAP_SNAPSHOT_H
+
+#include <stdint.h>
+
+#define HEAP_SNAPSHOT_MAGIC "TOYHEAP"
+#define HEAP_SNAPSHOT_VERSION 2
+
+// 文件头
+struct heap_snapshot_header {
+  char magic[8];             // "TOYHEAP\0"
+  uint32_t version;          // HEAP_SNAPSHOT_VERSION
+  uint32_t page_size;        // 进程页面大小
+  uint64_t pid;              // 写出快照的进程
+  uint64_t timestamp_ns;     // CLOCK_REALTIME时间戳
+  uint32_t module_count;     // 模块条目数
+  uint32_t record_count;     // 分配记录条目数
+  uint32_t tag_count;        // 标签条目数
+  uint32_t reserved;
+};
+
+// 模块条目，后跟 path_len 字节路径（不含'\0'）和 build_id_size 字节build-id
+struct heap_snapshot_module {
+  uint64_t load_base;        // 加载偏移（dlpi_addr）
+  uint64_t start;            // 映射范围起点
+  uint64_t end;              // 映射范围终点（不含）
+  uint32_t path_len;
+  uint32_t build_id_size;
+};
+
+// 标签条目，后跟 name_len 字节标签名（不含'\0'）
+struct heap_snapshot_tag {
+  uint32_t tag;
+  uint32_t name_len;
+};
+
+// 分配记录条目，后跟 frame_count 个 uint64_t 原始返回地址
+struct heap_snapshot_record {
+  uint64_t user_addr;        // 用户地址
+  uint64_t user_size;        // 用户请求大小
+  uint32_t slot;             // alloc_table中的槽位
+  uint32_t frame_count;      // 分配调用栈帧数
+  uint32_t tag;              // 分配标签编号
+  uint32_t reserved;
+};
+
+#endif // TOY_ASAN_HEAP_SNAPSHOT_H
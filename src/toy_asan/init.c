@@ -21,8 +21,11 @@
  * @brief 初始化Toy AddressSanitizer系统
  * 
  * 执行系统初始化的必要步骤：
- * 1. 安装SIGSEGV信号处理器
- * 2. 标记系统为已初始化状态
+ * 1. 解析TOY_ASAN_OPTIONS，选择调用栈回溯器和采集策略
+ * 2. 安装SIGSEGV信号处理器，登记初始化线程（同时安装备用信号栈）
+ * 3. 按选项启动后台统计线程
+ * 4. 注册退出时的泄漏检测和报告去重汇总
+ * 5. 标记系统为已初始化状态
  * 
  * 调用时机：
  * - toy_malloc()首次分配时懒加载
@@ -38,9 +41,34 @@ void toy_asan_init(void) {
     }
     
     printf("Toy ASan: Initializing...\n");
+
+    // 解析运行时选项
+    parse_toy_asan_options();
+    report_log_open();
+    report_ring_open();
+    unwind_init();
+    stack_capture_init();
+
+    // 预先建立模块表（信号处理器只读取、不重建），并为信号处理器中的符号化预留内存
+    module_map_refresh();
+    symbolize_prepare();
     
-    // 安装信号处理器
+    // 安装信号处理器（恢复模式另需SIGTRAP处理器）
     setup_signal_handler();
+    setup_recover_handler();
+    register_current_thread();
+
+    // fault_monitor=userfaultfd时保护页改由监控线程处理（不可用时保持SIGSEGV）
+    uffd_monitor_start();
+
+    // 定期打印调用点统计（stats_interval_ms > 0时）
+    start_site_stats_thread();
+
+    // 退出时泄漏检测（detect_leaks=1时）
+    install_leak_check();
+
+    // 恢复模式下退出时（及定期）写出报告去重汇总
+    install_report_summary();
     
     // 标记为已初始化
     toy_asan_initialized = true;
@@ -0,0 +1,622 @@
+/**
+ * @file leak_check.c
+ * @brief Toy AddressSanitizer 退出时泄漏检测（LSan风格）
+ *
+ * 程序退出时仍留在alloc_table中的记录原本不会被报告。
+ * 本文件在atexit阶段做一次保守式可达性分析：
+ *
+ * 1. 收集根集合：
+ *    - 各模块可写PT_LOAD段（.data/.bss），排除toy_asan自身
+ *    - 已登记线程的栈（当前线程从当前栈帧开始）
+ *    - 已登记线程的静态TLS块
+ *    - 当前线程的寄存器（setjmp溢出到栈上）
+ *    - 超预算标签的回退分配（libc malloc的块，见tags.c）
+ * 2. 标记：把根集合与已标记块中每个对齐的机器字当作候选指针，
+ *    通过页索引O(1)查到所指的块并原子标记，多个线程并行
+ * 3. 未标记的块即泄漏；被其他泄漏块引用的记为间接泄漏
+ * 4. 按分配调用点分组报告；log_path非空时另写一行JSON（"error":"memory-leak"）
+ *
+ * 限制：
+ * - 除回退分配外，libc malloc堆中的指针不作为根：只被程序自己的
+ *   malloc块引用的toy_malloc块会被误报。因此默认关闭（detect_leaks=0）
+ * - 其他线程的寄存器无法获取，只能依靠它们的栈
+ * - 检测期间持有alloc_table_lock，其他线程的分配/释放会等待
+ *
+ * @author Toy ASan Project
+ * @version 1.0
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "toy_asan.h"
+#include <dlfcn.h>
+#include <link.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define ROOT_CHUNK_SIZE (64 * 1024)   // 根区间切分粒度，便于并行
+#define SHARE_THRESHOLD 32            // 本地栈超过该深度时分享一半
+#define MAX_LEAK_THREADS 8
+
+struct mem_range {
+  uintptr_t start;
+  uintptr_t end;
+};
+
+struct range_list {
+  struct mem_range *items;
+  int count;
+  int capacity;
+};
+
+// 标记阶段的共享状态
+struct mark_ctx {
+  struct mem_range *chunks;       // 已切分的根区间
+  int chunk_count;
+  int next_chunk;                 // 原子递增的领取下标
+
+  uintptr_t min_user;             // 所有用户页的地址范围，快速过滤
+  uintptr_t max_user;
+  unsigned char marked[MAX_ALLOCATIONS];
+
+  pthread_mutex_t lock;           // 保护下面的共享工作队列
+  pthread_cond_t cond;
+  int shared[MAX_ALLOCATIONS];
+  int shared_count;
+  int idle;
+  int nworkers;
+  bool done;
+};
+
+struct mark_worker {
+  struct mark_ctx *ctx;
+  int stack[MAX_ALLOCATIONS];     // 每块最多入栈一次，容量足够
+  int count;
+};
+
+static int range_list_add(struct range_list *list, uintptr_t start,
+                          uintptr_t end) {
+  if (start >= end) {
+    return 0;
+  }
+  if (list->count == list->capacity) {
+    int cap = list->capacity ? list->capacity * 2 : 64;
+    struct mem_range *grown = realloc(list->items, cap * sizeof(*grown));
+    if (!grown) {
+      return -1;
+    }
+    list->items = grown;
+    list->capacity = cap;
+  }
+  list->items[list->count].start = start;
+  list->items[list->count].end = end;
+  list->count++;
+  return 0;
+}
+
+// ======================= 根集合收集 =======================
+
+/**
+ * @brief 读取/proc/self/maps中所有可读映射
+ *
+ * 根区间在扫描前都要与之求交，避免读到未映射或不可读的页。
+ */
+static void collect_readable_maps(struct range_list *maps) {
+  FILE *fp = fopen("/proc/self/maps", "r");
+  char line[512];
+  if (!fp) {
+    return;
+  }
+  while (fgets(line, sizeof(line), fp)) {
+    uintptr_t start, end;
+    char perms[5];
+    if (sscanf(line, "%lx-%lx %4s", &start, &end, perms) != 3) {
+      continue;
+    }
+    // [vvar]等内核页读取可能触发SIGBUS
+    if (perms[0] != 'r' || strstr(line, "[vvar") || strstr(line, "[vsyscall]")) {
+      continue;
+    }
+    range_list_add(maps, start, end);
+  }
+  fclose(fp);
+}
+
+static void add_clipped_root(struct range_list *roots,
+                             const struct range_list *maps, uintptr_t start,
+                             uintptr_t end) {
+  for (int i = 0; i < maps->count; i++) {
+    uintptr_t s = start > maps->items[i].start ? start : maps->items[i].start;
+    uintptr_t e = end < maps->items[i].end ? end : maps->items[i].end;
+    if (s < e) {
+      range_list_add(roots, s, e);
+    }
+  }
+}
+
+struct segment_ctx {
+  struct range_list *roots;
+  const struct range_list *maps;
+  uintptr_t self_base;            // toy_asan自身的加载基址，需要排除
+};
+
+static int collect_segments_callback(struct dl_phdr_info *info, size_t size,
+                                     void *data) {
+  (void)size;
+  struct segment_ctx *ctx = data;
+  if (info->dlpi_addr == ctx->self_base) {
+    return 0; // alloc_table等元数据里全是指向用户块的指针
+  }
+  for (int i = 0; i < info->dlpi_phnum; i++) {
+    const ElfW(Phdr) *phdr = &info->dlpi_phdr[i];
+    if (phdr->p_type == PT_LOAD && (phdr->p_flags & PF_W)) {
+      uintptr_t start = info->dlpi_addr + phdr->p_vaddr;
+      add_clipped_root(ctx->roots, ctx->maps, start, start + phdr->p_memsz);
+    }
+  }
+  return 0;
+}
+
+struct fallback_root_ctx {
+  struct range_list *roots;
+  const struct range_list *maps;
+};
+
+static void add_fallback_root(void *ptr, size_t size, void *arg) {
+  struct fallback_root_ctx *ctx = arg;
+  add_clipped_root(ctx->roots, ctx->maps, (uintptr_t)ptr, (uintptr_t)ptr + size);
+}
+
+static void collect_roots(struct range_list *roots, const struct range_list *maps,
+                          uintptr_t current_sp) {
+  // 全局数据段
+  Dl_info self;
+  struct segment_ctx seg = {roots, maps, 0};
+  if (dladdr((void *)toy_asan_check_leaks, &self)) {
+    seg.self_base = (uintptr_t)self.dli_fbase;
+  }
+  dl_iterate_phdr(collect_segments_callback, &seg);
+
+  // 线程栈与TLS
+  struct thread_info *me = current_thread_info();
+  bool scanned_self = false;
+  pthread_mutex_lock(&thread_table_lock);
+  for (int i = 0; i < MAX_THREADS; i++) {
+    struct thread_info *t = &thread_table[i];
+    if (!t->in_use) {
+      continue;
+    }
+    uintptr_t lo = t->stack_lo;
+    if (t == me) {
+      lo = current_sp; // 当前线程只扫描活跃部分
+      scanned_self = true;
+    }
+    add_clipped_root(roots, maps, lo, t->stack_hi);
+    for (int j = 0; j < t->tls_count; j++) {
+      add_clipped_root(roots, maps, t->tls_start[j], t->tls_end[j]);
+    }
+  }
+  pthread_mutex_unlock(&thread_table_lock);
+
+  // 超预算的标签分配在libc堆上，里面的指针同样可以引用受保护块
+  struct fallback_root_ctx fallback = {roots, maps};
+  tag_fallback_for_each(add_fallback_root, &fallback);
+
+  // 当前线程从未分配过（例如只在其他线程分配）：扫描到[stack]顶
+  if (!scanned_self) {
+    for (int i = 0; i < maps->count; i++) {
+      if (current_sp >= maps->items[i].start && current_sp < maps->items[i].end) {
+        range_list_add(roots, current_sp, maps->items[i].end);
+        break;
+      }
+    }
+  }
+}
+
+// ======================= 并行标记 =======================
+
+static void push_local(struct mark_worker *w, int slot) {
+  struct mark_ctx *ctx = w->ctx;
+  w->stack[w->count++] = slot;
+
+  // 本地积压较多且共享队列为空时，分出一半给空闲线程
+  if (w->count > SHARE_THRESHOLD &&
+      __atomic_load_n(&ctx->shared_count, __ATOMIC_RELAXED) == 0) {
+    pthread_mutex_lock(&ctx->lock);
+    int give = w->count / 2;
+    for (int i = 0; i < give; i++) {
+      ctx->shared[ctx->shared_count++] = w->stack[--w->count];
+    }
+    pthread_cond_broadcast(&ctx->cond);
+    pthread_mutex_unlock(&ctx->lock);
+  }
+}
+
+/**
+ * @brief 候选指针 → 所指块的槽位
+ * @return 槽位，不指向任何存活块时返回-1
+ *
+ * 只接受指向[user_addr, user_addr + user_size)的指针，0字节块接受起始地址。
+ */
+static int pointee_slot(const struct mark_ctx *ctx, uintptr_t v) {
+  if (v < ctx->min_user || v >= ctx->max_user) {
+    return -1;
+  }
+  int slot = lookup_user_page((void *)v);
+  if (slot < 0) {
+    return -1;
+  }
+  uintptr_t beg = (uintptr_t)alloc_table[slot].user_addr;
+  size_t size = alloc_table[slot].user_size;
+  if (v < beg || v >= beg + (size ? size : 1)) {
+    return -1;
+  }
+  return slot;
+}
+
+static void scan_range(struct mark_worker *w, uintptr_t start, uintptr_t end) {
+  struct mark_ctx *ctx = w->ctx;
+  start = (start + sizeof(uintptr_t) - 1) & ~(uintptr_t)(sizeof(uintptr_t) - 1);
+
+  for (uintptr_t p = start; p + sizeof(uintptr_t) <= end; p += sizeof(uintptr_t)) {
+    int slot = pointee_slot(ctx, *(const uintptr_t *)p);
+    if (slot >= 0 && !__atomic_exchange_n(&ctx->marked[slot], 1, __ATOMIC_RELAXED)) {
+      push_local(w, slot);
+    }
+  }
+}
+
+static void scan_block(struct mark_worker *w, int slot) {
+  uintptr_t beg = (uintptr_t)alloc_table[slot].user_addr;
+  scan_range(w, beg, beg + alloc_table[slot].user_size);
+}
+
+static void *mark_worker_main(void *arg) {
+  struct mark_worker *w = arg;
+  struct mark_ctx *ctx = w->ctx;
+
+  // 阶段1：领取根区间分片
+  int chunk;
+  while ((chunk = __atomic_fetch_add(&ctx->next_chunk, 1, __ATOMIC_RELAXED)) <
+         ctx->chunk_count) {
+    scan_range(w, ctx->chunks[chunk].start, ctx->chunks[chunk].end);
+  }
+
+  // 阶段2：处理本地栈，空了就从共享队列取，全部空闲时结束
+  for (;;) {
+    while (w->count > 0) {
+      scan_block(w, w->stack[--w->count]);
+    }
+
+    pthread_mutex_lock(&ctx->lock);
+    while (ctx->shared_count == 0 && !ctx->done) {
+      ctx->idle++;
+      if (ctx->idle == ctx->nworkers) {
+        ctx->done = true;
+        pthread_cond_broadcast(&ctx->cond);
+        break;
+      }
+      pthread_cond_wait(&ctx->cond, &ctx->lock);
+      ctx->idle--;
+    }
+    if (ctx->shared_count == 0) {
+      pthread_mutex_unlock(&ctx->lock);
+      break;
+    }
+    int take = ctx->shared_count < SHARE_THRESHOLD ? ctx->shared_count
+                                                   : SHARE_THRESHOLD;
+    for (int i = 0; i < take; i++) {
+      w->stack[w->count++] = ctx->shared[--ctx->shared_count];
+    }
+    pthread_mutex_unlock(&ctx->lock);
+  }
+  return NULL;
+}
+
+static int leak_check_thread_count(void) {
+  int n = toy_asan_flags.leak_check_threads;
+  if (n <= 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    n = cpus > 0 ? (int)cpus : 1;
+  }
+  return n > MAX_LEAK_THREADS ? MAX_LEAK_THREADS : n;
+}
+
+static void run_mark_phase(struct mark_ctx *ctx) {
+  int nthreads = leak_check_thread_count();
+  pthread_t tids[MAX_LEAK_THREADS];
+  struct mark_worker *workers = calloc(nthreads, sizeof(struct mark_worker));
+  if (!workers) {
+    return;
+  }
+
+  // 持锁创建线程：nworkers确定之前，工作线程不会进入空闲计数
+  int created = 0;
+  pthread_mutex_lock(&ctx->lock);
+  for (int i = 1; i < nthreads; i++) {
+    workers[i].ctx = ctx;
+    if (pthread_create(&tids[created], NULL, mark_worker_main, &workers[i]) != 0) {
+      break;
+    }
+    created++;
+  }
+  ctx->nworkers = created + 1;
+  pthread_mutex_unlock(&ctx->lock);
+
+  workers[0].ctx = ctx;
+  mark_worker_main(&workers[0]);
+  for (int i = 0; i < created; i++) {
+    pthread_join(tids[i], NULL);
+  }
+  free(workers);
+}
+
+// ======================= 报告 =======================
+
+struct leak_group {
+  int site_id;
+  bool indirect;
+  int sample_slot;
+  size_t bytes;
+  int count;
+};
+
+static int compare_leak_groups(const void *a, const void *b) {
+  const struct leak_group *ga = a;
+  const struct leak_group *gb = b;
+  if (ga->indirect != gb->indirect) {
+    return ga->indirect ? 1 : -1; // 直接泄漏在前
+  }
+  if (ga->bytes != gb->bytes) {
+    return ga->bytes > gb->bytes ? -1 : 1;
+  }
+  return ga->site_id - gb->site_id;
+}
+
+/**
+ * @brief 泄漏报告的JSON行（log_path为空时什么都不做）
+ * @param pcs 各分组调用栈依次拼接的帧，符号化失败时为NULL
+ * @param symbols 与pcs一一对应的符号
+ *
+ * 调用者持有report_lock()。
+ */
+static void log_leaks(const struct leak_group *groups, int group_count, void **pcs,
+                      char (*symbols)[SYMBOL_MAX], size_t total_bytes, int total_count) {
+  if (!json_report_begin()) {
+    return;
+  }
+  json_string("error", "memory-leak");
+  json_uint("pid", (unsigned long)getpid());
+  json_uint("bytes", total_bytes);
+  json_uint("count", (unsigned long)total_count);
+  json_array_begin("leaks");
+  int next_pc = 0;
+  for (int i = 0; i < group_count; i++) {
+    const struct leak_group *g = &groups[i];
+    void *const *frames;
+    int frame_count = stack_depot_get(alloc_table[g->sample_slot].alloc_stack_id, &frames);
+    json_object_begin(NULL);
+    json_string("kind", g->indirect ? "indirect" : "direct");
+    json_uint("bytes", g->bytes);
+    json_uint("count", (unsigned long)g->count);
+    json_frames("allocated", frames, pcs ? symbols + next_pc : NULL, frame_count);
+    json_object_end();
+    next_pc += frame_count;
+  }
+  json_array_end();
+  json_modules(pcs, pcs ? next_pc : 0);
+  json_report_end();
+}
+
+static int report_leaks(const struct mark_ctx *ctx, const unsigned char *indirect) {
+  struct leak_group *groups = calloc(MAX_ALLOCATIONS, sizeof(*groups));
+  int *group_of_site = malloc(2 * (MAX_ALLOC_SITES + 1) * sizeof(int));
+  int group_count = 0;
+  size_t total_bytes = 0;
+  int total_count = 0;
+
+  if (!groups || !group_of_site) {
+    free(groups);
+    free(group_of_site);
+    return 0;
+  }
+  for (int i = 0; i < 2 * (MAX_ALLOC_SITES + 1); i++) {
+    group_of_site[i] = -1;
+  }
+
+  for (int slot = 0; slot < MAX_ALLOCATIONS; slot++) {
+    if (!alloc_table[slot].in_use || ctx->marked[slot]) {
+      continue;
+    }
+    // 按（调用点, 直接/间接）分组，-1号调用点映射到0
+    int key = (alloc_table[slot].alloc_site_id + 1) * 2 + indirect[slot];
+    if (group_of_site[key] < 0) {
+      group_of_site[key] = group_count;
+      groups[group_count].site_id = alloc_table[slot].alloc_site_id;
+      groups[group_count].indirect = indirect[slot];
+      groups[group_count].sample_slot = slot;
+      group_count++;
+    }
+    struct leak_group *g = &groups[group_of_site[key]];
+    g->bytes += alloc_table[slot].user_size;
+    g->count++;
+    total_bytes += alloc_table[slot].user_size;
+    total_count++;
+  }
+
+  if (total_count > 0) {
+    qsort(groups, group_count, sizeof(*groups), compare_leak_groups);
+
+    // 所有分组的调用栈一批符号化
+    int frame_total = 0;
+    for (int i = 0; i < group_count; i++) {
+      void *const *frames;
+      frame_total += stack_depot_get(alloc_table[groups[i].sample_slot].alloc_stack_id, &frames);
+    }
+    void **pcs = malloc((frame_total + 1) * sizeof(*pcs));
+    char (*symbols)[SYMBOL_MAX] = malloc((frame_total + 1) * sizeof(*symbols));
+    int pc_count = 0;
+    if (pcs && symbols) {
+      for (int i = 0; i < group_count; i++) {
+        void *const *frames;
+        int n = stack_depot_get(alloc_table[groups[i].sample_slot].alloc_stack_id, &frames);
+        memcpy(pcs + pc_count, frames, n * sizeof(*pcs));
+        pc_count += n;
+      }
+      symbolize_report_frames(pcs, pc_count, symbols);
+    }
+
+    // 报告与错误报告一样写到report_fd；先写出程序自己缓冲的stdout，保持先后顺序
+    fflush(stdout);
+    report_lock();
+    report_printf("\n=================================================================\n");
+    report_printf("==%d==ERROR: Toy LeakSanitizer: detected memory leaks\n", getpid());
+    int next_pc = 0;
+    for (int i = 0; i < group_count; i++) {
+      struct leak_group *g = &groups[i];
+      struct allocation_record *rec = &alloc_table[g->sample_slot];
+      report_printf("\n%s leak of %zu byte(s) in %d object(s) allocated from:\n",
+                    g->indirect ? "Indirect" : "Direct", g->bytes, g->count);
+      void *const *frames;
+      int frame_count = stack_depot_get(rec->alloc_stack_id, &frames);
+      for (int f = 0; f < frame_count; f++) {
+        const char *symbol = next_pc < pc_count ? symbols[next_pc++] : "??";
+        report_printf("    #%d %p in %s\n", f, frames[f], symbol);
+      }
+    }
+    if (pc_count > 0 && !toy_asan_flags.symbolize) {
+      report_printf("\n");
+      print_report_modules(pcs, pc_count);
+    }
+    report_printf("\nSUMMARY: Toy AddressSanitizer: %zu byte(s) leaked in %d allocation(s).\n",
+                  total_bytes, total_count);
+    report_flush();
+    log_leaks(groups, group_count, pc_count > 0 ? pcs : NULL, symbols, total_bytes,
+              total_count);
+    free(symbols);
+    free(pcs);
+    report_unlock();
+  }
+
+  free(group_of_site);
+  free(groups);
+  return total_count;
+}
+
+// ======================= 入口 =======================
+
+/**
+ * @brief 执行一次泄漏检测并报告
+ * @return 泄漏块数量
+ *
+ * 可以在任意时刻手动调用；detect_leaks=1时
+ * 也会在进程退出时自动调用。
+ */
+int toy_asan_check_leaks(void) {
+  struct range_list maps = {0};
+  struct range_list roots = {0};
+  struct range_list chunks = {0};
+  int leaks = 0;
+
+  struct mark_ctx *ctx = calloc(1, sizeof(*ctx));
+  unsigned char *indirect = calloc(MAX_ALLOCATIONS, 1);
+  if (!ctx || !indirect) {
+    goto out;
+  }
+  pthread_mutex_init(&ctx->lock, NULL);
+  pthread_cond_init(&ctx->cond, NULL);
+
+  // 把callee-saved寄存器溢出到jmp_buf中单独作为根；
+  // 栈从本函数的栈帧基址开始扫描，跳过本函数未初始化的局部变量
+  jmp_buf regs;
+  memset(&regs, 0, sizeof(regs));
+  setjmp(regs);
+  uintptr_t current_sp = (uintptr_t)__builtin_frame_address(0);
+
+  collect_readable_maps(&maps);
+  range_list_add(&roots, (uintptr_t)&regs, (uintptr_t)(&regs + 1));
+  collect_roots(&roots, &maps, current_sp);
+
+  for (int i = 0; i < roots.count; i++) {
+    for (uintptr_t s = roots.items[i].start; s < roots.items[i].end;
+         s += ROOT_CHUNK_SIZE) {
+      uintptr_t e = s + ROOT_CHUNK_SIZE;
+      range_list_add(&chunks, s, e < roots.items[i].end ? e : roots.items[i].end);
+    }
+  }
+  ctx->chunks = chunks.items;
+  ctx->chunk_count = chunks.count;
+
+  // 检测期间冻结分配表
+  pthread_mutex_lock(&alloc_table_lock);
+
+  ctx->min_user = UINTPTR_MAX;
+  for (int i = 0; i < MAX_ALLOCATIONS; i++) {
+    if (!alloc_table[i].in_use) {
+      continue;
+    }
+    uintptr_t beg = (uintptr_t)alloc_table[i].user_addr;
+    if (beg < ctx->min_user) {
+      ctx->min_user = beg;
+    }
+    if (beg + get_system_page_size() > ctx->max_user) {
+      ctx->max_user = beg + get_system_page_size();
+    }
+  }
+
+  if (ctx->max_user != 0) {
+    run_mark_phase(ctx);
+
+    // 被其他泄漏块引用的泄漏块记为间接泄漏
+    for (int slot = 0; slot < MAX_ALLOCATIONS; slot++) {
+      if (!alloc_table[slot].in_use || ctx->marked[slot]) {
+        continue;
+      }
+      const uintptr_t *words = alloc_table[slot].user_addr;
+      size_t nwords = alloc_table[slot].user_size / sizeof(uintptr_t);
+      for (size_t i = 0; i < nwords; i++) {
+        int target = pointee_slot(ctx, words[i]);
+        if (target >= 0 && target != slot && !ctx->marked[target]) {
+          indirect[target] = 1;
+        }
+      }
+    }
+
+    leaks = report_leaks(ctx, indirect);
+  }
+
+  pthread_mutex_unlock(&alloc_table_lock);
+
+out:
+  free(chunks.items);
+  free(roots.items);
+  free(maps.items);
+  free(indirect);
+  free(ctx);
+  return leaks;
+}
+
+// atexit回调：崩溃报告路径已经退出时不再做泄漏检测
+static void leak_check_at_exit(void) {
+  if (toy_asan_error_reported) {
+    return;
+  }
+  if (toy_asan_check_leaks() > 0 && toy_asan_flags.leak_exitcode != 0) {
+    fflush(NULL);  // _exit不再写出任何stdio流
+    _exit(toy_asan_flags.leak_exitcode);
+  }
+}
+
+/**
+ * @brief 按detect_leaks选项注册退出时的泄漏检测
+ */
+void install_leak_check(void) {
+  if (toy_asan_flags.detect_leaks) {
+    atexit(leak_check_at_exit);
+  }
+}
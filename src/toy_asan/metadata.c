@@ -15,7 +15,23 @@
  * - add_allocation(): 添加新分配记录
  * - find_allocation(): 通过地址查找记录（信号处理器使用）
  * - find_allocation_by_user_addr(): 通过用户地址查找记录（free使用）
- * - remove_allocation(): 标记记录为未使用
+ * - remove_allocation(): 标记记录为未使用（槽位复用前保留释放栈）
+ * - find_freed_allocation(): 查找已释放但槽位尚未复用的记录（use-after-free报告）
+ * - lookup_user_page(): 任意指针 → 所在用户页的槽位，O(1)
+ * - in_toy_asan_region(): 地址是否落在任何toy_asan块内，O(1)、无锁
+ *
+ * 页索引：
+ * - 以用户页地址为键、槽位为值的开放寻址哈希表（线性探测）
+ * - 删除采用反向移位而非墓碑，长期运行不会退化
+ * - 读写都要求持有alloc_table_lock
+ *
+ * 区域表：
+ * - 信号处理器先用它排除其他代码（JIT、GC）的SIGSEGV，不扫描分配表
+ * - 两级表：顶层按1GB（4K页时）分组，叶子是每页一个引用计数，首次用到时mmap
+ * - 覆盖在用的块和带释放栈、槽位尚未复用的已释放块（use-after-free报告需要）；
+ *   后者在槽位复用之前保留为PROT_NONE映射（toy_free），地址不会被其他
+ *   映射占用，区域内的SIGSEGV不会是别人的；计数支持同一页先后属于多个记录
+ * - 修改持有alloc_table_lock，读取只用原子操作
  *
  * @author Toy ASan Project
  * @version 1.0
@@ -23,6 +39,144 @@
 
 #include "toy_asan.h"
 #include <stdio.h>
+#include <sys/mman.h>
+
+#define ADDR_INDEX_MASK (ADDR_INDEX_SIZE - 1)
+
+#define REGION_LEAF_SHIFT 18                      // 每个叶子覆盖的页数（2的幂）
+#define REGION_LEAF_PAGES (1ul << REGION_LEAF_SHIFT)
+#define REGION_TOP_SIZE (1ul << (47 - 12 - REGION_LEAF_SHIFT))  // 47位用户空间、4K页
+
+// 区域表：region_leaves[页号 >> 18][页号 & 0x3ffff] = 覆盖该页的块数
+static uint16_t *region_leaves[REGION_TOP_SIZE];
+
+// 页索引：键为页地址（0表示空），值为alloc_table槽位
+static uintptr_t addr_index_keys[ADDR_INDEX_SIZE];
+static int addr_index_slots[ADDR_INDEX_SIZE];
+
+static size_t addr_index_hash(uintptr_t page) {
+  return (size_t)(((page >> 12) * 0x9e3779b97f4a7c15ull) >> 32) & ADDR_INDEX_MASK;
+}
+
+static void addr_index_insert(uintptr_t page, int slot) {
+  size_t i = addr_index_hash(page);
+  while (addr_index_keys[i] != 0) {
+    i = (i + 1) & ADDR_INDEX_MASK;
+  }
+  addr_index_keys[i] = page;
+  addr_index_slots[i] = slot;
+}
+
+static void addr_index_remove(uintptr_t page) {
+  size_t i = addr_index_hash(page);
+  while (addr_index_keys[i] != page) {
+    if (addr_index_keys[i] == 0) {
+      return; // 不存在
+    }
+    i = (i + 1) & ADDR_INDEX_MASK;
+  }
+
+  // 反向移位：把后续仍可前移的条目补进空洞，保持探测链连续
+  size_t hole = i;
+  size_t j = i;
+  for (;;) {
+    j = (j + 1) & ADDR_INDEX_MASK;
+    if (addr_index_keys[j] == 0) {
+      break;
+    }
+    size_t home = addr_index_hash(addr_index_keys[j]);
+    // home不在(hole, j]区间内时，条目j可以移到hole
+    bool movable = (hole <= j) ? (home <= hole || home > j)
+                               : (home <= hole && home > j);
+    if (movable) {
+      addr_index_keys[hole] = addr_index_keys[j];
+      addr_index_slots[hole] = addr_index_slots[j];
+      hole = j;
+    }
+  }
+  addr_index_keys[hole] = 0;
+}
+
+/**
+ * @brief 查找地址所在用户页对应的分配槽位
+ * @param addr 任意地址
+ * @return 槽位索引，不在任何用户页内返回-1
+ *
+ * 调用者需持有alloc_table_lock。泄漏检测的标记阶段对每个
+ * 候选指针调用一次，因此必须是O(1)。
+ */
+int lookup_user_page(const void *addr) {
+  uintptr_t page = (uintptr_t)addr & ~(uintptr_t)(get_system_page_size() - 1);
+  if (page == 0) {
+    return -1;
+  }
+  size_t i = addr_index_hash(page);
+  while (addr_index_keys[i] != 0) {
+    if (addr_index_keys[i] == page) {
+      return addr_index_slots[i];
+    }
+    i = (i + 1) & ADDR_INDEX_MASK;
+  }
+  return -1;
+}
+
+/**
+ * @brief 把块的三页（左保护页、用户页、右保护页）计入或移出区域表
+ * @param base 块基地址
+ * @param delta +1或-1
+ *
+ * 调用者需持有alloc_table_lock。叶子分配失败时该块不计入，
+ * 其保护页上的出错会被当作外来的SIGSEGV。
+ */
+static void region_map_adjust(void *base, int delta) {
+  size_t ps = get_system_page_size();
+  for (int p = 0; p < 3; p++) {
+    uintptr_t page = (uintptr_t)base / ps + p;
+    size_t top = page >> REGION_LEAF_SHIFT;
+    if (top >= REGION_TOP_SIZE) {
+      continue;
+    }
+    uint16_t *leaf = region_leaves[top];
+    if (!leaf) {
+      if (delta < 0) {
+        continue;
+      }
+      leaf = mmap(NULL, REGION_LEAF_PAGES * sizeof(uint16_t), PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+      if (leaf == MAP_FAILED) {
+        printf("Toy ASan: warning - region map leaf allocation failed\n");
+        continue;
+      }
+      __atomic_store_n(&region_leaves[top], leaf, __ATOMIC_RELEASE);
+    }
+    __atomic_add_fetch(&leaf[page & (REGION_LEAF_PAGES - 1)], (uint16_t)delta, __ATOMIC_RELEASE);
+  }
+}
+
+/**
+ * @brief 判断地址是否落在某个toy_asan块内（含保护页和已释放待报告的块）
+ * @param addr 任意地址
+ *
+ * 不加锁、不分配内存，两次内存读取，信号处理器中使用。
+ */
+bool in_toy_asan_region(const void *addr) {
+  uintptr_t page = (uintptr_t)addr / get_system_page_size();
+  size_t top = page >> REGION_LEAF_SHIFT;
+  if (top >= REGION_TOP_SIZE) {
+    return false;
+  }
+  uint16_t *leaf = __atomic_load_n(&region_leaves[top], __ATOMIC_ACQUIRE);
+  return leaf && __atomic_load_n(&leaf[page & (REGION_LEAF_PAGES - 1)], __ATOMIC_ACQUIRE) != 0;
+}
+
+// 持锁版本：通过用户地址查找记录
+static struct allocation_record *find_by_user_addr_locked(void *user_addr) {
+  int slot = lookup_user_page(user_addr);
+  if (slot >= 0 && alloc_table[slot].user_addr == user_addr) {
+    return &alloc_table[slot];
+  }
+  return NULL;
+}
 
 /**
  * @brief 添加分配记录到表中（用于我们客制化的malloc：toy_malloc）
@@ -32,26 +186,42 @@
  * @return 分配的槽位索引，失败返回-1
  *
  * 将新分配的内存块信息记录到全局分配表中，用于后续的
- * 错误检测和释放操作
+ * 错误检测和释放操作。写入过程持有alloc_table_lock，
+ * 保证堆快照复制到的记录是完整的。
  */
 int add_allocation(void *base, void *user, size_t user_size) {
+  pthread_mutex_lock(&alloc_table_lock);
   // 查找空闲槽位
   for (int i = 0; i < MAX_ALLOCATIONS; i++) {
     if (!alloc_table[i].in_use) {
+      // 槽位上保留的已释放块不再能被报告：移出区域表，归还保留的地址空间
+      if (alloc_table[i].free_stack_id != 0) {
+        region_map_adjust(alloc_table[i].base_addr, -1);
+        munmap(alloc_table[i].base_addr, 3 * get_system_page_size());
+      }
+      region_map_adjust(base, +1);
+
       // 填充记录
       alloc_table[i].base_addr = base;
       alloc_table[i].user_addr = user;
       alloc_table[i].user_size = user_size;
       alloc_table[i].left_guard = base;
       alloc_table[i].right_guard = (char *)base + 2 * get_system_page_size();
+      alloc_table[i].alloc_stack_id = 0; // 槽位复用时清掉旧调用栈
+      alloc_table[i].free_stack_id = 0;
+      alloc_table[i].alloc_site_id = -1;
+      alloc_table[i].tag = 0;
       alloc_table[i].in_use = true;
+      addr_index_insert((uintptr_t)user, i);
 
       alloc_count++;
+      pthread_mutex_unlock(&alloc_table_lock);
       printf("Added allocation at slot %d: base=%p, user=%p, size=%zu\n", i,
              base, user, user_size);
       return i;
     }
   }
+  pthread_mutex_unlock(&alloc_table_lock);
 
   printf("Error: allocation table full\n");
   return -1; // 表满了
@@ -77,16 +247,12 @@ struct allocation_record *find_allocation(void *addr) {
 
     // 检查左保护页范围：[base, base + page_size)
     if (addr >= base && addr < (void *)((char *)base + ps)) {
-      printf("Found left guard access: %p in [%p, %p)\n", addr, base,
-             (char *)base + ps);
       return &alloc_table[i];
     }
 
     // 检查右保护页范围：[base + 2*page_size, base + 3*page_size)
     void *right_start = (char *)base + 2 * ps;
     if (addr >= right_start && addr < (void *)((char *)right_start + ps)) {
-      printf("Found right guard access: %p in [%p, %p)\n", addr, right_start,
-             (char *)right_start + ps);
       return &alloc_table[i];
     }
   }
@@ -99,28 +265,62 @@ struct allocation_record *find_allocation(void *addr) {
  * @return 找到的分配记录指针，如果没找到返回NULL
  *
  * 在free操作中，用户提供的是可见的用户地址，需要找到
- * 对应的分配记录以获取完整的内存块信息
+ * 对应的分配记录以获取完整的内存块信息。通过页索引O(1)查找。
  */
 struct allocation_record *find_allocation_by_user_addr(void *user_addr) {
+  pthread_mutex_lock(&alloc_table_lock);
+  struct allocation_record *rec = find_by_user_addr_locked(user_addr);
+  pthread_mutex_unlock(&alloc_table_lock);
+  return rec;
+}
+
+/**
+ * @brief 通过地址查找已释放的分配记录（用于信号处理器）
+ * @param addr 发生段错误的地址
+ * @return 覆盖该地址、且带有释放栈的已释放记录，没有返回NULL
+ *
+ * 释放后的记录在槽位被复用之前仍保留地址和调用栈。只有
+ * free_context=1时记录才带释放栈，此时块的地址空间保留为PROT_NONE，
+ * 访问它可以报告为heap-use-after-free。
+ */
+struct allocation_record *find_freed_allocation(void *addr) {
+  size_t ps = get_system_page_size();
+
   for (int i = 0; i < MAX_ALLOCATIONS; i++) {
-    if (alloc_table[i].in_use && alloc_table[i].user_addr == user_addr) {
-      return &alloc_table[i];
+    struct allocation_record *rec = &alloc_table[i];
+    if (rec->in_use || rec->free_stack_id == 0)
+      continue;
+
+    char *base = rec->base_addr;
+    if ((char *)addr >= base && (char *)addr < base + 3 * ps) {
+      return rec;
     }
   }
-  return NULL; // 没找到
+  return NULL;
 }
 
 /**
  * @brief 移除分配记录
  * @param user_addr 用户看到的地址
+ * @param free_stack_id 释放时调用栈编号，0表示未采集
  *
  * 将指定分配记录标记为未使用，通常在free操作中调用
  */
-void remove_allocation(void *user_addr) {
-  struct allocation_record *rec = find_allocation_by_user_addr(user_addr);
+void remove_allocation(void *user_addr, uint32_t free_stack_id) {
+  pthread_mutex_lock(&alloc_table_lock);
+  struct allocation_record *rec = find_by_user_addr_locked(user_addr);
   if (rec) {
+    addr_index_remove((uintptr_t)user_addr);
+    if (free_stack_id == 0) {
+      region_map_adjust(rec->base_addr, -1);  // 有释放栈的留到槽位复用时再移出
+    }
+    rec->free_stack_id = free_stack_id;
     rec->in_use = false;
     alloc_count--;
+  }
+  pthread_mutex_unlock(&alloc_table_lock);
+
+  if (rec) {
     printf("Removed allocation: user=%p\n", user_addr);
   } else {
     printf("Warning: tried to remove non-existent allocation: %p\n", user_addr);
@@ -129,6 +329,9 @@ void remove_allocation(void *user_addr) {
 
 // 判断地址是否为我们的保护页
 bool is_our_guard_page(void *addr) {
+  if (!in_toy_asan_region(addr)) {
+    return false;
+  }
   struct allocation_record *rec = find_allocation(addr);
   return rec != NULL;
 }
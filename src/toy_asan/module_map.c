@@ -0,0 +1,304 @@
+/**
+ * @file module_map.c
+ * @brief Toy AddressSanitizer 模块表
+ *
+ * 通过dl_iterate_phdr枚举当前进程加载的所有ELF模块（主程序、
+ * libc、插件.so等），为每个模块记录：
+ * - 模块路径（主程序通过/proc/self/exe解析）
+ * - 加载基址（dlpi_addr）
+ * - 每个PT_LOAD段的地址范围，以及它们覆盖的总范围 [start, end)
+ * - GNU build-id（来自PT_NOTE中的NT_GNU_BUILD_ID）
+ *
+ * 模块表只建立一次并缓存：所有段按起始地址排序，PC到模块是一次
+ * 二分查找。dlopen/dlclose会改变glibc的dlpi_adds/dlpi_subs计数，
+ * module_map_refresh()发现计数变化时才重新枚举。
+ *
+ * 这些信息用于符号化（PC - 加载基址即模块内的链接时地址）和
+ * 堆快照等离线分析场景：拿到原始PC后，可以在另一台机器上
+ * 根据模块名 + 偏移 + build-id 找回符号。
+ *
+ * @author Toy ASan Project
+ * @version 1.0
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "toy_asan.h"
+#include <elf.h>
+#include <link.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// 段索引：所有模块的PT_LOAD段按起始地址排序
+struct segment_index_entry {
+  uintptr_t start;
+  uintptr_t end;
+  int module;                // module_table下标
+};
+
+static struct module_info module_table[MAX_MODULES];
+static int module_count;
+static struct segment_index_entry segment_index[MAX_MODULES * MAX_MODULE_SEGMENTS];
+static int segment_count;
+static bool module_table_valid;
+static unsigned long long loaded_adds;  // 建表时的dlpi_adds
+static unsigned long long loaded_subs;  // 建表时的dlpi_subs
+static pthread_mutex_t module_table_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct collect_ctx {
+  struct module_info *modules;
+  int max_modules;
+  int count;
+  unsigned long long adds;
+  unsigned long long subs;
+};
+
+// dlpi_adds/dlpi_subs是较新glibc追加的字段，须按size判断是否存在
+static bool has_load_counters(size_t size) {
+  return size >= offsetof(struct dl_phdr_info, dlpi_subs) + sizeof(unsigned long long);
+}
+
+/**
+ * @brief 从PT_NOTE段中提取GNU build-id
+ * @param info dl_iterate_phdr提供的模块信息
+ * @param phdr PT_NOTE程序头
+ * @param out 输出缓冲区
+ * @return build-id字节数，未找到返回0
+ */
+static size_t extract_build_id(struct dl_phdr_info *info, const ElfW(Phdr) *phdr,
+                               uint8_t *out) {
+  const char *p = (const char *)(info->dlpi_addr + phdr->p_vaddr);
+  const char *end = p + phdr->p_memsz;
+
+  while (p + sizeof(ElfW(Nhdr)) <= end) {
+    const ElfW(Nhdr) *nhdr = (const ElfW(Nhdr) *)p;
+    const char *name = p + sizeof(ElfW(Nhdr));
+    const char *desc = name + ((nhdr->n_namesz + 3) & ~3u);
+    const char *next = desc + ((nhdr->n_descsz + 3) & ~3u);
+    if (next > end) {
+      break;
+    }
+
+    if (nhdr->n_type == NT_GNU_BUILD_ID && nhdr->n_namesz == 4 &&
+        memcmp(name, "GNU", 4) == 0) {
+      size_t size = nhdr->n_descsz;
+      if (size > MAX_BUILD_ID_SIZE) {
+        size = MAX_BUILD_ID_SIZE;
+      }
+      memcpy(out, desc, size);
+      return size;
+    }
+    p = next;
+  }
+  return 0;
+}
+
+static int collect_module_callback(struct dl_phdr_info *info, size_t size,
+                                   void *data) {
+  struct collect_ctx *ctx = data;
+  if (has_load_counters(size)) {
+    ctx->adds = info->dlpi_adds;
+    ctx->subs = info->dlpi_subs;
+  }
+  if (ctx->count >= ctx->max_modules) {
+    return 1; // 表满，停止枚举
+  }
+
+  struct module_info *mod = &ctx->modules[ctx->count];
+  memset(mod, 0, sizeof(*mod));
+
+  // 主程序的dlpi_name为空串，需要通过/proc/self/exe取得路径
+  if (info->dlpi_name && info->dlpi_name[0]) {
+    snprintf(mod->path, sizeof(mod->path), "%s", info->dlpi_name);
+  } else {
+    ssize_t len = readlink("/proc/self/exe", mod->path, sizeof(mod->path) - 1);
+    if (len < 0) {
+      len = 0;
+    }
+    mod->path[len] = '\0';
+  }
+
+  // 内核提供的vdso没有文件，跳过
+  if (mod->path[0] == '\0' || strncmp(mod->path, "linux-vdso", 10) == 0) {
+    return 0;
+  }
+
+  mod->load_base = info->dlpi_addr;
+  mod->start = UINTPTR_MAX;
+  mod->end = 0;
+
+  for (int i = 0; i < info->dlpi_phnum; i++) {
+    const ElfW(Phdr) *phdr = &info->dlpi_phdr[i];
+    if (phdr->p_type == PT_LOAD) {
+      uintptr_t seg_start = info->dlpi_addr + phdr->p_vaddr;
+      uintptr_t seg_end = seg_start + phdr->p_memsz;
+      if (mod->segment_count < MAX_MODULE_SEGMENTS) {
+        mod->segments[mod->segment_count].start = seg_start;
+        mod->segments[mod->segment_count].end = seg_end;
+        mod->segment_count++;
+      }
+      if (seg_start < mod->start) {
+        mod->start = seg_start;
+      }
+      if (seg_end > mod->end) {
+        mod->end = seg_end;
+      }
+    } else if (phdr->p_type == PT_NOTE && mod->build_id_size == 0) {
+      mod->build_id_size = extract_build_id(info, phdr, mod->build_id);
+    }
+  }
+
+  if (mod->end == 0) {
+    return 0; // 没有可加载段
+  }
+
+  ctx->count++;
+  return 0;
+}
+
+static int compare_segment(const void *a, const void *b) {
+  const struct segment_index_entry *sa = a;
+  const struct segment_index_entry *sb = b;
+  return sa->start < sb->start ? -1 : sa->start > sb->start;
+}
+
+// 重新枚举模块并重建段索引（需持有module_table_lock）
+static void rebuild_module_table(void) {
+  struct collect_ctx ctx = {module_table, MAX_MODULES, 0, 0, 0};
+  dl_iterate_phdr(collect_module_callback, &ctx);
+  module_count = ctx.count;
+  loaded_adds = ctx.adds;
+  loaded_subs = ctx.subs;
+
+  segment_count = 0;
+  for (int m = 0; m < module_count; m++) {
+    for (int i = 0; i < module_table[m].segment_count; i++) {
+      struct segment_index_entry *e = &segment_index[segment_count++];
+      e->start = module_table[m].segments[i].start;
+      e->end = module_table[m].segments[i].end;
+      e->module = m;
+    }
+  }
+  qsort(segment_index, segment_count, sizeof(segment_index[0]), compare_segment);
+  module_table_valid = true;
+}
+
+struct load_counters {
+  bool available;
+  unsigned long long adds;
+  unsigned long long subs;
+};
+
+static int read_counters_callback(struct dl_phdr_info *info, size_t size, void *data) {
+  struct load_counters *c = data;
+  if (has_load_counters(size)) {
+    c->available = true;
+    c->adds = info->dlpi_adds;
+    c->subs = info->dlpi_subs;
+  }
+  return 1; // 计数在每个模块上都相同，看第一个即可
+}
+
+/**
+ * @brief 确保模块表与当前加载状态一致
+ *
+ * 只读取第一个模块的dlpi_adds/dlpi_subs，计数未变时不做任何枚举；
+ * glibc不提供计数时每次都重建。一批地址符号化前调用一次即可。
+ *
+ * @return true表示模块表刚刚重建，按PC缓存的结果需要作废
+ */
+bool module_map_refresh(void) {
+  struct load_counters c = {false, 0, 0};
+  dl_iterate_phdr(read_counters_callback, &c);
+
+  pthread_mutex_lock(&module_table_lock);
+  bool rebuild = !module_table_valid || !c.available || c.adds != loaded_adds ||
+                 c.subs != loaded_subs;
+  if (rebuild) {
+    rebuild_module_table();
+  }
+  pthread_mutex_unlock(&module_table_lock);
+  return rebuild;
+}
+
+// 在段索引上二分查找PC所在模块（需持有module_table_lock）
+static int find_module_locked(uintptr_t pc) {
+  // 找最后一个start <= pc的段
+  int lo = 0, hi = segment_count;
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    if (segment_index[mid].start <= pc) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo > 0 && pc < segment_index[lo - 1].end) {
+    return segment_index[lo - 1].module;
+  }
+  return -1;
+}
+
+/**
+ * @brief 查找PC所在的模块
+ * @param pc 运行时地址
+ * @param out 输出：模块信息副本
+ * @return 0找到，-1不属于任何已加载模块
+ *
+ * 在段索引上二分查找，不访问/proc，也不调用dl_iterate_phdr。
+ * 模块表尚未建立时先建立一次。
+ */
+int module_map_lookup(uintptr_t pc, struct module_info *out) {
+  pthread_mutex_lock(&module_table_lock);
+  if (!module_table_valid) {
+    rebuild_module_table();
+  }
+  int m = find_module_locked(pc);
+  if (m >= 0) {
+    *out = module_table[m];
+  }
+  pthread_mutex_unlock(&module_table_lock);
+  return m >= 0 ? 0 : -1;
+}
+
+/**
+ * @brief 信号处理器中查找PC所在的模块
+ * @return 0找到，-1未找到或模块表正被其他代码持有
+ *
+ * 只读已建立的模块表：不重建、不调用dl_iterate_phdr、不分配内存。
+ * 用trylock而不是lock，出错线程恰好持有锁时不会死锁。
+ * 最近一次刷新之后才dlopen的模块查不到。
+ */
+int module_map_try_lookup(uintptr_t pc, struct module_info *out) {
+  if (pthread_mutex_trylock(&module_table_lock) != 0) {
+    return -1;
+  }
+  int m = module_table_valid ? find_module_locked(pc) : -1;
+  if (m >= 0) {
+    *out = module_table[m];
+  }
+  pthread_mutex_unlock(&module_table_lock);
+  return m >= 0 ? 0 : -1;
+}
+
+/**
+ * @brief 收集当前进程的模块信息
+ * @param modules 输出数组
+ * @param max_modules 数组容量
+ * @return 实际收集到的模块数量
+ *
+ * 返回缓存模块表的副本（必要时先刷新）。
+ */
+int collect_module_info(struct module_info *modules, int max_modules) {
+  module_map_refresh();
+  pthread_mutex_lock(&module_table_lock);
+  int count = module_count < max_modules ? module_count : max_modules;
+  memcpy(modules, module_table, count * sizeof(struct module_info));
+  pthread_mutex_unlock(&module_table_lock);
+  return count;
+}
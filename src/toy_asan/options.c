@@ -0,0 +1,140 @@
+/**
+ * @file options.c
+ * @brief Toy AddressSanitizer 运行时选项解析
+ *
+ * 与真实ASan的ASAN_OPTIONS类似，通过环境变量配置：
+ * ```
+ * TOY_ASAN_OPTIONS="stats_interval_ms=5000:stats_top_n=20" ./program
+ * ```
+ * 选项之间用':'或','分隔，未知选项打印警告后忽略。
+ *
+ * 新增选项只需：
+ * 1. 在toy_asan.h的struct toy_asan_options中加字段
+ * 2. 在下面的option_table中加一行（名字、类型、字段地址）
+ * 3. 在toy_asan_flags的初始化中给出默认值
+ *
+ * @author Toy ASan Project
+ * @version 1.0
+ */
+
+#include "toy_asan.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// 全部选项及其默认值
+struct toy_asan_options toy_asan_flags = {
+    .stats_interval_ms = 0,
+    .stats_top_n = 10,
+    .detect_leaks = 0,
+    .leak_check_threads = 0,
+    .leak_exitcode = 23,
+    .unwinder = "fp",
+    .malloc_context_size = 8,
+    .free_context = 0,
+    .sample_every = 1,
+    .external_symbolizer_path = "",
+    .symbolizer_timeout_ms = 3000,
+    .symbolize = 1,
+    .symbol_cache_dir = "",
+    .report_fd = 2,
+    .halt_on_error = 1,
+    .recover_site_budget = 100,
+    .max_reports = 0,
+    .reports_per_second = 0,
+    .report_summary_interval_ms = 0,
+    .log_path = "",
+    .report_ring = "",
+    .fault_monitor = "signal",
+};
+
+enum option_type { OPTION_INT, OPTION_STRING };
+
+struct option_desc {
+  const char *name;
+  enum option_type type;
+  void *value;
+  size_t size;  // OPTION_STRING的缓冲区大小
+};
+
+static const struct option_desc option_table[] = {
+    {"stats_interval_ms", OPTION_INT, &toy_asan_flags.stats_interval_ms, 0},
+    {"stats_top_n", OPTION_INT, &toy_asan_flags.stats_top_n, 0},
+    {"detect_leaks", OPTION_INT, &toy_asan_flags.detect_leaks, 0},
+    {"leak_check_threads", OPTION_INT, &toy_asan_flags.leak_check_threads, 0},
+    {"leak_exitcode", OPTION_INT, &toy_asan_flags.leak_exitcode, 0},
+    {"unwinder", OPTION_STRING, toy_asan_flags.unwinder, sizeof(toy_asan_flags.unwinder)},
+    {"malloc_context_size", OPTION_INT, &toy_asan_flags.malloc_context_size, 0},
+    {"free_context", OPTION_INT, &toy_asan_flags.free_context, 0},
+    {"sample_every", OPTION_INT, &toy_asan_flags.sample_every, 0},
+    {"external_symbolizer_path", OPTION_STRING, toy_asan_flags.external_symbolizer_path,
+     sizeof(toy_asan_flags.external_symbolizer_path)},
+    {"symbolizer_timeout_ms", OPTION_INT, &toy_asan_flags.symbolizer_timeout_ms, 0},
+    {"symbolize", OPTION_INT, &toy_asan_flags.symbolize, 0},
+    {"symbol_cache_dir", OPTION_STRING, toy_asan_flags.symbol_cache_dir,
+     sizeof(toy_asan_flags.symbol_cache_dir)},
+    {"report_fd", OPTION_INT, &toy_asan_flags.report_fd, 0},
+    {"halt_on_error", OPTION_INT, &toy_asan_flags.halt_on_error, 0},
+    {"recover_site_budget", OPTION_INT, &toy_asan_flags.recover_site_budget, 0},
+    {"max_reports", OPTION_INT, &toy_asan_flags.max_reports, 0},
+    {"reports_per_second", OPTION_INT, &toy_asan_flags.reports_per_second, 0},
+    {"report_summary_interval_ms", OPTION_INT, &toy_asan_flags.report_summary_interval_ms, 0},
+    {"log_path", OPTION_STRING, toy_asan_flags.log_path, sizeof(toy_asan_flags.log_path)},
+    {"report_ring", OPTION_STRING, toy_asan_flags.report_ring, sizeof(toy_asan_flags.report_ring)},
+    {"fault_monitor", OPTION_STRING, toy_asan_flags.fault_monitor,
+     sizeof(toy_asan_flags.fault_monitor)},
+};
+
+#define OPTION_COUNT (sizeof(option_table) / sizeof(option_table[0]))
+
+static void apply_option(const char *name, size_t name_len, const char *value,
+                         size_t value_len) {
+  for (size_t i = 0; i < OPTION_COUNT; i++) {
+    const struct option_desc *opt = &option_table[i];
+    if (strlen(opt->name) != name_len || strncmp(opt->name, name, name_len) != 0) {
+      continue;
+    }
+
+    char buf[256];
+    if (value_len >= sizeof(buf)) {
+      value_len = sizeof(buf) - 1;
+    }
+    memcpy(buf, value, value_len);
+    buf[value_len] = '\0';
+
+    if (opt->type == OPTION_INT) {
+      *(int *)opt->value = atoi(buf);
+    } else {
+      snprintf((char *)opt->value, opt->size, "%s", buf);
+    }
+    return;
+  }
+  printf("Toy ASan: warning - unknown option '%.*s'\n", (int)name_len, name);
+}
+
+/**
+ * @brief 解析TOY_ASAN_OPTIONS环境变量
+ *
+ * 在toy_asan_init()中最先调用，后续模块直接读取toy_asan_flags。
+ */
+void parse_toy_asan_options(void) {
+  const char *env = getenv("TOY_ASAN_OPTIONS");
+  if (!env) {
+    return;
+  }
+
+  const char *p = env;
+  while (*p) {
+    size_t len = strcspn(p, ":,");
+    const char *eq = memchr(p, '=', len);
+    if (eq) {
+      apply_option(p, eq - p, eq + 1, len - (eq + 1 - p));
+    } else if (len > 0) {
+      apply_option(p, len, "1", 1); // "flag" 等价于 "flag=1"
+    }
+    p += len;
+    if (*p) {
+      p++;
+    }
+  }
+}
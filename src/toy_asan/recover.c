@@ -0,0 +1,185 @@
+/**
+ * @file recover.c
+ * @brief Toy AddressSanitizer 恢复模式（halt_on_error=0）
+ *
+ * 默认每次保护页访问都报告后退出。生产环境中非关键路径上的
+ * 溢出只应记录下来，不该让整个服务退出。恢复模式下：
+ *
+ * 1. SIGSEGV处理器按出错指令（PC）计数；是否报告由report_dedup.c决定
+ * 2. 把被访问的保护页临时改为可读写，在ucontext中置位EFLAGS.TF后返回
+ * 3. 出错指令重新执行并完成访问，随后CPU产生单步陷阱（SIGTRAP）
+ * 4. SIGTRAP处理器把保护页恢复为PROT_NONE、清除TF，程序继续运行
+ *
+ * 同一调用点超过recover_site_budget次后保护页保持打开，不再单步，
+ * 热循环中的溢出不会变成数百万次信号。代价是该块之后的越界不再被发现。
+ * 调用点表满时新的调用点照常单步，只是不再计数。
+ *
+ * 单步期间保护页对整个进程打开（pending_guard只记在出错线程里）：
+ * 这段时间内其他线程对同一页的访问不会被发现。
+ *
+ * 只支持x86-64（单步依赖TF标志）；其他架构上按halt_on_error=1处理。
+ *
+ * @author Toy ASan Project
+ * @version 1.0
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE      // REG_RIP、REG_EFL、REG_ERR
+#endif
+
+#include "toy_asan.h"
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+
+#define RECOVER_MAX_SITES 1024   // 2的幂
+#define EFLAGS_TF 0x100          // 单步陷阱标志
+#define PF_INSTR 0x10            // 页错误码：取指令
+
+#if defined(__x86_64__)
+
+// 一个出错调用点
+struct recover_site {
+  uintptr_t pc;                  // 出错指令地址，0表示空
+  uint32_t hits;
+};
+
+static struct recover_site recover_sites[RECOVER_MAX_SITES];
+
+// 当前线程单步结束后要恢复保护的页；initial-exec避免信号处理器中访问TLS时分配
+static __thread __attribute__((tls_model("initial-exec"))) void *pending_guard;
+
+static struct sigaction previous_sigtrap;
+
+/**
+ * @brief 取出错调用点的表项，不存在时插入（无锁，线性探测）
+ * @return 表项，表满时返回NULL
+ */
+static struct recover_site *site_for(uintptr_t pc) {
+  size_t i = (size_t)((pc * 0x9e3779b97f4a7c15ull) >> 32) & (RECOVER_MAX_SITES - 1);
+  for (int probe = 0; probe < RECOVER_MAX_SITES; probe++) {
+    struct recover_site *s = &recover_sites[(i + probe) & (RECOVER_MAX_SITES - 1)];
+    uintptr_t cur = __atomic_load_n(&s->pc, __ATOMIC_ACQUIRE);
+    if (cur == pc) {
+      return s;
+    }
+    if (cur == 0) {
+      uintptr_t expected = 0;
+      if (__atomic_compare_exchange_n(&s->pc, &expected, pc, false, __ATOMIC_ACQ_REL,
+                                      __ATOMIC_ACQUIRE) ||
+          expected == pc) {
+        return s;
+      }
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief 统计一次保护页访问，决定如何处理
+ * @param context 信号处理器上下文
+ */
+enum recover_action recover_classify(void *context) {
+  const ucontext_t *uc = context;
+  if (uc->uc_mcontext.gregs[REG_ERR] & PF_INSTR) {
+    return RECOVER_HALT;  // 跳到保护页上：没有可以越过的指令
+  }
+  uintptr_t pc = (uintptr_t)uc->uc_mcontext.gregs[REG_RIP];
+  struct recover_site *s = site_for(pc);
+  if (!s) {
+    return RECOVER_STEP;  // 调用点表已满：照常单步，不计数
+  }
+  uint32_t hits = __atomic_add_fetch(&s->hits, 1, __ATOMIC_RELAXED);
+  uint32_t budget = (uint32_t)toy_asan_flags.recover_site_budget;
+  if (budget > 0 && hits > budget) {
+    if (hits == budget + 1) {
+      report_printf("Toy ASan: %p hit guard pages %u times, leaving them open from now on\n",
+                    (void *)pc, budget);
+      report_flush();
+    }
+    return RECOVER_OPEN;
+  }
+  return RECOVER_STEP;
+}
+
+/**
+ * @brief 临时打开保护页并单步执行出错指令
+ * @param fault_addr 故障地址
+ * @param context 信号处理器上下文
+ * @param action recover_classify()的结果；RECOVER_OPEN时保护页不再恢复
+ * @return true返回后出错指令可以继续执行
+ */
+bool recover_step_over(void *fault_addr, void *context, enum recover_action action) {
+  size_t ps = get_system_page_size();
+  void *page = (void *)((uintptr_t)fault_addr & ~(uintptr_t)(ps - 1));
+  if (mprotect(page, ps, PROT_READ | PROT_WRITE) != 0) {
+    return false;
+  }
+  if (action == RECOVER_OPEN) {
+    return true;
+  }
+  ucontext_t *uc = context;
+  uc->uc_mcontext.gregs[REG_EFL] |= EFLAGS_TF;
+  pending_guard = page;
+  return true;
+}
+
+// 单步陷阱：出错指令已执行完，恢复保护页
+static void sigtrap_handler(int sig, siginfo_t *info, void *context) {
+  ucontext_t *uc = context;
+  if (pending_guard) {
+    mprotect(pending_guard, get_system_page_size(), PROT_NONE);
+    pending_guard = NULL;
+    uc->uc_mcontext.gregs[REG_EFL] &= ~(greg_t)EFLAGS_TF;
+    return;
+  }
+
+  // 不是我们的单步（断点、raise等）：交给原来的处理方式
+  chain_signal(&previous_sigtrap, sig, info, context);
+}
+
+/**
+ * @brief halt_on_error=0时安装SIGTRAP处理器
+ */
+void setup_recover_handler(void) {
+  if (toy_asan_flags.halt_on_error) {
+    return;
+  }
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_sigaction = sigtrap_handler;
+  sa.sa_flags = SA_SIGINFO | SA_RESTART | SA_ONSTACK;
+  sigemptyset(&sa.sa_mask);
+  if (sigaction(SIGTRAP, &sa, &previous_sigtrap) == -1) {
+    perror("Toy ASan: sigaction(SIGTRAP) failed, recover mode disabled");
+    toy_asan_flags.halt_on_error = 1;
+    return;
+  }
+  printf("Toy ASan: recover mode enabled (budget %d per site)\n",
+         toy_asan_flags.recover_site_budget);
+}
+
+#else
+
+enum recover_action recover_classify(void *context) {
+  (void)context;
+  return RECOVER_HALT;
+}
+
+bool recover_step_over(void *fault_addr, void *context, enum recover_action action) {
+  (void)fault_addr;
+  (void)context;
+  (void)action;
+  return false;
+}
+
+void setup_recover_handler(void) {
+  if (!toy_asan_flags.halt_on_error) {
+    printf("Toy ASan: recover mode needs x86-64 single-stepping, halting on errors\n");
+    toy_asan_flags.halt_on_error = 1;
+  }
+}
+
+#endif
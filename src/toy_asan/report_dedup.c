@@ -0,0 +1,259 @@
+/**
+ * @file report_dedup.c
+ * @brief Toy AddressSanitizer 报告去重与限流
+ *
+ * 恢复模式下同一处溢出可能触发成千上万次，每次都写完整报告会淹没日志。
+ * 报告按（出错指令PC，分配栈编号）的哈希去重：
+ * - 每个组合第一次出现时写完整报告，之后只在无锁表中计数
+ * - 完整报告受两个上限约束：max_reports（总数）和
+ *   reports_per_second（每秒），超出的只计数；
+ *   被限流的组合以后额度恢复时仍会补一份完整报告
+ * - 退出时（以及report_summary_interval_ms > 0时定期）写一份汇总：
+ *   每个组合出现的次数、是否写过完整报告
+ *
+ * report_dedup_admit()在SIGSEGV处理器中调用：计数表无锁（原子操作），
+ * 限流状态由调用者持有的report_lock()保护，不分配内存。
+ *
+ * @author Toy ASan Project
+ * @version 1.0
+ */
+
+#include "toy_asan.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEDUP_TABLE_SIZE 1024    // 2的幂
+
+// 一个（PC，分配栈）组合
+struct dedup_entry {
+  uint64_t key;                  // 组合的哈希，0表示空
+  uintptr_t pc;
+  uint32_t stack_id;
+  uint32_t hits;
+  bool reported;                 // 已写过完整报告
+};
+
+static struct dedup_entry dedup_table[DEDUP_TABLE_SIZE];
+static uint64_t untracked_hits;  // 表满后无法计数的出现次数
+
+// 限流状态：admit由report_lock()串行化，原子操作只为汇总线程读取
+static uint32_t reports_emitted;
+static uint32_t reports_suppressed;
+static int64_t window_second = -1;
+static uint32_t window_reports;
+
+static uint64_t dedup_key(uintptr_t pc, uint32_t stack_id) {
+  uint64_t h = (uint64_t)pc * 0x9e3779b97f4a7c15ull;
+  h ^= ((uint64_t)stack_id + 0x632be59bd9b4e019ull) * 0xbf58476d1ce4e5b9ull;
+  h ^= h >> 31;
+  return h ? h : 1;
+}
+
+/**
+ * @brief 取组合的表项，不存在时插入（无锁，线性探测）
+ * @return 表项，表满时返回NULL
+ */
+static struct dedup_entry *entry_for(uintptr_t pc, uint32_t stack_id) {
+  uint64_t key = dedup_key(pc, stack_id);
+  size_t i = (size_t)(key >> 32) & (DEDUP_TABLE_SIZE - 1);
+  for (int probe = 0; probe < DEDUP_TABLE_SIZE; probe++) {
+    struct dedup_entry *e = &dedup_table[(i + probe) & (DEDUP_TABLE_SIZE - 1)];
+    uint64_t cur = __atomic_load_n(&e->key, __ATOMIC_ACQUIRE);
+    if (cur == key) {
+      return e;
+    }
+    if (cur == 0) {
+      uint64_t expected = 0;
+      if (__atomic_compare_exchange_n(&e->key, &expected, key, false, __ATOMIC_ACQ_REL,
+                                      __ATOMIC_ACQUIRE)) {
+        e->pc = pc;
+        e->stack_id = stack_id;
+        return e;
+      }
+      if (expected == key) {
+        return e;
+      }
+    }
+  }
+  return NULL;
+}
+
+// 总数和每秒上限是否还允许写一份完整报告
+static bool rate_limit_allows(void) {
+  uint32_t emitted = __atomic_load_n(&reports_emitted, __ATOMIC_RELAXED);
+  if (toy_asan_flags.max_reports > 0 && emitted >= (uint32_t)toy_asan_flags.max_reports) {
+    return false;
+  }
+  if (toy_asan_flags.reports_per_second > 0) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (now.tv_sec != window_second) {
+      window_second = now.tv_sec;
+      window_reports = 0;
+    }
+    if (window_reports >= (uint32_t)toy_asan_flags.reports_per_second) {
+      return false;
+    }
+    window_reports++;
+  }
+  __atomic_add_fetch(&reports_emitted, 1, __ATOMIC_RELAXED);
+  return true;
+}
+
+/**
+ * @brief 记录一次出错，决定是否写完整报告
+ * @param pc 出错指令地址
+ * @param stack_id 被越界访问的块的分配栈编号
+ * @return true写完整报告；false只计数
+ *
+ * 调用者须持有report_lock()。
+ */
+bool report_dedup_admit(uintptr_t pc, uint32_t stack_id) {
+  struct dedup_entry *e = entry_for(pc, stack_id);
+  if (!e) {
+    __atomic_add_fetch(&untracked_hits, 1, __ATOMIC_RELAXED);
+    if (rate_limit_allows()) {
+      return true;
+    }
+    __atomic_add_fetch(&reports_suppressed, 1, __ATOMIC_RELAXED);
+    return false;
+  }
+
+  __atomic_add_fetch(&e->hits, 1, __ATOMIC_RELAXED);
+  if (__atomic_load_n(&e->reported, __ATOMIC_RELAXED)) {
+    return false;
+  }
+  if (!rate_limit_allows()) {
+    __atomic_add_fetch(&reports_suppressed, 1, __ATOMIC_RELAXED);
+    return false;
+  }
+  __atomic_store_n(&e->reported, true, __ATOMIC_RELAXED);
+  return true;
+}
+
+/**
+ * @brief 汇总的JSON行（log_path为空时什么都不做），调用者持有report_lock()
+ */
+static void log_summary(int distinct, uint64_t occurrences, uint32_t suppressed,
+                        uint64_t untracked) {
+  if (!json_report_begin()) {
+    return;
+  }
+  json_string("error", "error-summary");
+  json_uint("pid", (unsigned long)getpid());
+  json_uint("distinct", (unsigned long)distinct);
+  json_uint("occurrences", (unsigned long)occurrences);
+  json_uint("reports_written", __atomic_load_n(&reports_emitted, __ATOMIC_RELAXED));
+  json_uint("suppressed", suppressed);
+  json_uint("untracked", (unsigned long)untracked);
+  json_array_begin("sites");
+  for (int i = 0; i < DEDUP_TABLE_SIZE; i++) {
+    const struct dedup_entry *e = &dedup_table[i];
+    uint32_t hits = __atomic_load_n(&e->hits, __ATOMIC_RELAXED);
+    if (hits == 0) {
+      continue;
+    }
+    void *pc = (void *)e->pc;
+    char symbol[1][SYMBOL_MAX];
+    symbolize_frames_async_safe(&pc, 1, symbol);
+    json_object_begin(NULL);
+    json_address("pc", pc);
+    json_string("symbol", symbol[0]);
+    json_uint("alloc_stack", e->stack_id);
+    json_uint("hits", hits);
+    json_bool("reported", __atomic_load_n(&e->reported, __ATOMIC_RELAXED));
+    json_object_end();
+  }
+  json_array_end();
+  json_report_end();
+}
+
+/**
+ * @brief 写出去重汇总（只有去重或限流过时才写）
+ *
+ * log_path非空时另写一行JSON（"error":"error-summary"）。
+ */
+void report_dedup_summary(void) {
+  uint64_t total = 0;
+  int distinct = 0;
+  bool deduplicated = false;
+  for (int i = 0; i < DEDUP_TABLE_SIZE; i++) {
+    uint32_t hits = __atomic_load_n(&dedup_table[i].hits, __ATOMIC_RELAXED);
+    if (hits > 0) {
+      distinct++;
+      total += hits;
+      deduplicated |= hits > 1;
+    }
+  }
+  uint64_t untracked = __atomic_load_n(&untracked_hits, __ATOMIC_RELAXED);
+  uint32_t suppressed = __atomic_load_n(&reports_suppressed, __ATOMIC_RELAXED);
+  if (!deduplicated && suppressed == 0 && untracked == 0) {
+    return;
+  }
+
+  report_lock();
+  report_printf("==%d==Toy ASan: error summary: %d distinct, %lu occurrences, "
+                "%u full reports written, %u suppressed by rate limits\n",
+                getpid(), distinct, (unsigned long)(total + untracked),
+                __atomic_load_n(&reports_emitted, __ATOMIC_RELAXED), suppressed);
+  for (int i = 0; i < DEDUP_TABLE_SIZE; i++) {
+    const struct dedup_entry *e = &dedup_table[i];
+    uint32_t hits = __atomic_load_n(&e->hits, __ATOMIC_RELAXED);
+    if (hits == 0) {
+      continue;
+    }
+    void *pc = (void *)e->pc;
+    char symbol[1][SYMBOL_MAX];
+    symbolize_frames_async_safe(&pc, 1, symbol);
+    report_printf("  %u x %p in %s (alloc stack %u)%s\n", hits, pc, symbol[0], e->stack_id,
+                  __atomic_load_n(&e->reported, __ATOMIC_RELAXED) ? "" : " [not reported]");
+  }
+  if (untracked > 0) {
+    report_printf("  %lu x (table full, not tracked per site)\n", (unsigned long)untracked);
+  }
+  report_flush();
+  log_summary(distinct, total + untracked, suppressed, untracked);
+  report_unlock();
+}
+
+static void report_summary_at_exit(void) {
+  fflush(stdout);  // 程序自己的输出在汇总之前
+  report_dedup_summary();
+}
+
+static void *report_summary_thread(void *arg) {
+  (void)arg;
+  struct timespec interval;
+  interval.tv_sec = toy_asan_flags.report_summary_interval_ms / 1000;
+  interval.tv_nsec = (long)(toy_asan_flags.report_summary_interval_ms % 1000) * 1000000L;
+
+  for (;;) {
+    nanosleep(&interval, NULL);
+    report_dedup_summary();
+  }
+  return NULL;
+}
+
+/**
+ * @brief 注册退出时的汇总，按report_summary_interval_ms启动定期汇总线程
+ *
+ * 只有恢复模式下进程会在出错后继续运行，其他模式不需要汇总。
+ */
+void install_report_summary(void) {
+  if (toy_asan_flags.halt_on_error) {
+    return;
+  }
+  atexit(report_summary_at_exit);
+  if (toy_asan_flags.report_summary_interval_ms <= 0) {
+    return;
+  }
+
+  pthread_t tid;
+  if (pthread_create(&tid, NULL, report_summary_thread, NULL) != 0) {
+    printf("Toy ASan: warning - failed to start report summary thread\n");
+    return;
+  }
+  pthread_detach(tid);
+}
@@ -0,0 +1,267 @@
+/**
+ * @file report_json.c
+ * @brief Toy AddressSanitizer 结构化（JSON）错误报告
+ *
+ * 文本报告给人看，日志系统需要能直接解析的格式。log_path选项非空时，
+ * 每份错误报告另外写一行紧凑的JSON对象到<log_path>.<pid>：
+ *
+ *   {"error":"heap-buffer-overflow","pid":...,"tid":...,"address":"0x...",
+ *    "access":{...},"region":{...},"stacks":{"current":[...],...},"modules":[...]}
+ *
+ * 泄漏报告（leak_check.c，"error":"memory-leak"）和去重汇总
+ * （report_dedup.c，"error":"error-summary"）同样各写一行。
+ *
+ * 与report_writer.c相同，序列化在SIGSEGV处理器中进行：
+ * - 不分配内存：边生成边追加到静态缓冲区，写满时先写出一段（流式）
+ * - 只用open/write等异步信号安全的系统调用
+ * - 逗号和嵌套由一个小的层级栈管理，调用者只按顺序给出键和值
+ *
+ * 日志文件在初始化时打开；fork出的子进程第一次写报告时按新pid重新打开。
+ * 调用者须持有report_lock()。
+ *
+ * @author Toy ASan Project
+ * @version 1.0
+ */
+
+#include "toy_asan.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#define JSON_BUFFER_SIZE (16 * 1024)
+#define JSON_MAX_DEPTH 8
+
+static char json_buffer[JSON_BUFFER_SIZE];
+static size_t json_length;
+
+// 每层是否还没有元素（决定是否先写逗号）；超过JSON_MAX_DEPTH的层
+// 只计数不记录，其中的元素之间不写逗号（输出不再是合法JSON，但不越界）
+static bool json_first[JSON_MAX_DEPTH];
+static int json_depth;
+
+static int log_fd = -1;
+static pid_t log_pid;
+
+/**
+ * @brief 按log_path选项打开<log_path>.<pid>
+ * @return 文件描述符，未设置或打开失败时返回-1
+ *
+ * 只调用open(2)和report_snprintf，信号处理器中可用。
+ */
+static int open_log_file(void) {
+  char path[sizeof(toy_asan_flags.log_path) + 16];
+  pid_t pid = getpid();
+  report_snprintf(path, sizeof(path), "%s.%d", toy_asan_flags.log_path, pid);
+  int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  log_pid = pid;
+  return fd;
+}
+
+/**
+ * @brief 初始化时打开结构化报告文件（log_path为空时什么都不做）
+ */
+void report_log_open(void) {
+  if (toy_asan_flags.log_path[0] == '\0') {
+    return;
+  }
+  log_fd = open_log_file();
+  if (log_fd < 0) {
+    printf("Toy ASan: warning - cannot open %s.%d, structured reports disabled\n",
+           toy_asan_flags.log_path, (int)getpid());
+  }
+}
+
+static void json_write_out(void) {
+  const char *data = json_buffer;
+  size_t size = json_length;
+  while (size > 0) {
+    ssize_t n = write(log_fd, data, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+    data += n;
+    size -= (size_t)n;
+  }
+  json_length = 0;
+}
+
+static void json_put(const char *s, size_t n) {
+  while (n > 0) {
+    if (json_length == JSON_BUFFER_SIZE) {
+      json_write_out();
+    }
+    size_t room = JSON_BUFFER_SIZE - json_length;
+    size_t chunk = n < room ? n : room;
+    for (size_t i = 0; i < chunk; i++) {
+      json_buffer[json_length + i] = s[i];
+    }
+    json_length += chunk;
+    s += chunk;
+    n -= chunk;
+  }
+}
+
+static void json_putc(char c) {
+  json_put(&c, 1);
+}
+
+// 字符串值：转义引号、反斜杠和控制字符
+static void json_put_string(const char *s) {
+  static const char hex[] = "0123456789abcdef";
+  json_putc('"');
+  for (; *s; s++) {
+    unsigned char c = (unsigned char)*s;
+    if (c == '"' || c == '\\') {
+      json_putc('\\');
+      json_putc((char)c);
+    } else if (c < 0x20) {
+      char esc[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+      json_put(esc, sizeof(esc));
+    } else {
+      json_putc((char)c);
+    }
+  }
+  json_putc('"');
+}
+
+// 元素之间的逗号和键；数组中的元素key为NULL
+static void json_key(const char *key) {
+  if (json_depth > 0 && json_depth <= JSON_MAX_DEPTH) {
+    if (!json_first[json_depth - 1]) {
+      json_putc(',');
+    }
+    json_first[json_depth - 1] = false;
+  }
+  if (key) {
+    json_put_string(key);
+    json_putc(':');
+  }
+}
+
+static void json_open(const char *key, char bracket) {
+  json_key(key);
+  json_putc(bracket);
+  if (json_depth < JSON_MAX_DEPTH) {
+    json_first[json_depth] = true;
+  }
+  json_depth++;
+}
+
+static void json_close(char bracket) {
+  if (json_depth > 0) {
+    json_depth--;
+  }
+  json_putc(bracket);
+}
+
+/**
+ * @brief 开始一份结构化报告
+ * @return false未启用log_path或日志文件不可用，调用者跳过整份报告
+ */
+bool json_report_begin(void) {
+  if (toy_asan_flags.log_path[0] == '\0') {
+    return false;
+  }
+  if (log_fd < 0 || log_pid != getpid()) {  // fork之后写到子进程自己的文件
+    if (log_fd >= 0) {
+      close(log_fd);
+    }
+    log_fd = open_log_file();
+  }
+  if (log_fd < 0) {
+    return false;
+  }
+  json_length = 0;
+  json_depth = 0;
+  json_open(NULL, '{');
+  return true;
+}
+
+/**
+ * @brief 结束报告：补上换行（每份报告一行）并写出
+ */
+void json_report_end(void) {
+  json_close('}');
+  json_putc('\n');
+  json_write_out();
+}
+
+void json_object_begin(const char *key) {
+  json_open(key, '{');
+}
+
+void json_object_end(void) {
+  json_close('}');
+}
+
+void json_array_begin(const char *key) {
+  json_open(key, '[');
+}
+
+void json_array_end(void) {
+  json_close(']');
+}
+
+void json_string(const char *key, const char *value) {
+  json_key(key);
+  json_put_string(value ? value : "");
+}
+
+void json_uint(const char *key, unsigned long value) {
+  char buf[24];
+  json_key(key);
+  json_put(buf, (size_t)report_snprintf(buf, sizeof(buf), "%lu", value));
+}
+
+void json_bool(const char *key, bool value) {
+  json_key(key);
+  json_put(value ? "true" : "false", value ? 4 : 5);
+}
+
+/**
+ * @brief 地址写成"0x..."字符串（JSON数字不能无损表示64位地址）
+ */
+void json_address(const char *key, const void *value) {
+  char buf[24];
+  json_key(key);
+  json_put(buf, (size_t)report_snprintf(buf, sizeof(buf), "\"0x%lx\"",
+                                        (unsigned long)(uintptr_t)value));
+}
+
+/**
+ * @brief 调用栈：[{"pc":"0x...","symbol":"..."},...]
+ * @param symbols 与pcs一一对应的符号，NULL时写"??"
+ */
+void json_frames(const char *key, void *const *pcs, char (*symbols)[SYMBOL_MAX], int count) {
+  json_array_begin(key);
+  for (int i = 0; i < count; i++) {
+    json_object_begin(NULL);
+    json_address("pc", pcs[i]);
+    json_string("symbol", symbols ? symbols[i] : "??");
+    json_object_end();
+  }
+  json_array_end();
+}
+
+static void json_module(const struct module_info *mod, const char *build_id, void *arg) {
+  (void)arg;
+  json_object_begin(NULL);
+  json_string("path", mod->path);
+  json_address("start", (void *)mod->start);
+  json_address("end", (void *)mod->end);
+  json_string("build_id", build_id);
+  json_object_end();
+}
+
+/**
+ * @brief 报告中所有帧涉及的模块及其build-id："modules":[...]
+ */
+void json_modules(void *const *pcs, int count) {
+  json_array_begin("modules");
+  for_each_report_module(pcs, count, json_module, NULL);
+  json_array_end();
+}
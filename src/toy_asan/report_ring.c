@@ -0,0 +1,209 @@
+/**
+ * @file report_ring.c
+ * @brief Toy AddressSanitizer 共享内存报告环（写入端）
+ *
+ * report_ring选项：
+ * - 文件路径（通常在tmpfs上，如/dev/shm/app.ring）：不存在时创建，
+ *   已有的有效环继续追加，进程重启不丢失未收集的记录
+ * - "memfd"：匿名memfd，路径/proc/<pid>/fd/<n>在初始化时打印，
+ *   父进程存活期间toy_asan_collect可以读取
+ *
+ * 环在toy_asan_init中以MAP_SHARED映射，之后fork出的worker共享同一映射；
+ * exec不继承memfd（MFD_CLOEXEC），外部符号化进程等子进程拿不到它。
+ * 格式和无锁协议见report_ring.h。追加在SIGSEGV处理器中进行：
+ * 只用原子操作和内存复制，不加锁、不分配内存。
+ *
+ * @author Toy ASan Project
+ * @version 1.0
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE      // memfd_create
+#endif
+
+#include "toy_asan.h"
+#include "report_ring.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static struct report_ring_header *ring;
+
+/**
+ * @brief 映射并（必要时）初始化环
+ * @return 0成功
+ *
+ * 多个互不相关的进程可能同时打开同一路径，用flock串行化初始化。
+ */
+static int map_ring(int fd) {
+  size_t size = report_ring_file_size(REPORT_RING_CAPACITY);
+  flock(fd, LOCK_EX);
+  struct stat st;
+  if (fstat(fd, &st) != 0 || ((size_t)st.st_size < size && ftruncate(fd, (off_t)size) != 0)) {
+    flock(fd, LOCK_UN);
+    return -1;
+  }
+  if ((size_t)st.st_size > size) {
+    size = (size_t)st.st_size;  // 已有的环可能是以更大容量创建的
+  }
+  void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    flock(fd, LOCK_UN);
+    return -1;
+  }
+  struct report_ring_header *h = map;
+  if (!report_ring_valid(h, size)) {
+    memset(map, 0, report_ring_file_size(REPORT_RING_CAPACITY));
+    h->version = REPORT_RING_VERSION;
+    h->capacity = REPORT_RING_CAPACITY;
+    memcpy(h->magic, REPORT_RING_MAGIC, sizeof(h->magic));
+  }
+  flock(fd, LOCK_UN);
+  ring = h;
+  return 0;
+}
+
+/**
+ * @brief 按report_ring选项创建或打开报告环（为空时什么都不做）
+ */
+void report_ring_open(void) {
+  const char *path = toy_asan_flags.report_ring;
+  if (path[0] == '\0') {
+    return;
+  }
+  bool is_memfd = strcmp(path, "memfd") == 0;
+  int fd = is_memfd ? memfd_create("toy_asan_report_ring", MFD_CLOEXEC)
+                    : open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (fd < 0 || map_ring(fd) != 0) {
+    printf("Toy ASan: warning - cannot set up report ring %s, disabled\n", path);
+    if (fd >= 0) {
+      close(fd);
+    }
+    return;
+  }
+  if (is_memfd) {
+    // memfd没有路径，保持打开，由/proc访问
+    printf("Toy ASan: report ring at /proc/%d/fd/%d\n", (int)getpid(), fd);
+  } else {
+    close(fd);
+  }
+}
+
+// 签名只由错误类型和两条栈的（模块，偏移）决定，与pid、加载地址无关
+static uint64_t signature_mix(uint64_t h, uint64_t v) {
+  for (int i = 0; i < 8; i++) {
+    h ^= (v >> (8 * i)) & 0xff;
+    h *= 0x100000001b3ull;  // FNV-1a
+  }
+  return h;
+}
+
+static uint64_t signature_mix_bytes(uint64_t h, const void *data, size_t size) {
+  const unsigned char *p = data;
+  for (size_t i = 0; i < size; i++) {
+    h ^= p[i];
+    h *= 0x100000001b3ull;
+  }
+  return h;
+}
+
+/**
+ * @brief 复制一条栈，记下各帧的模块和偏移并计入签名
+ * @param r 记录（modules表在两条栈之间共用）
+ * @return 更新后的签名
+ *
+ * 模块优先用build-id区分（同一文件换了路径也能合并），没有时用路径。
+ * 查不到模块的帧只能用原始PC。
+ */
+static uint64_t copy_stack(struct report_ring_record *r, uint64_t sig, void *const *frames,
+                           int count, uint64_t *pcs, uint64_t *offsets, uint8_t *module_ids) {
+  static struct module_info mod;
+  for (int i = 0; i < count; i++) {
+    uintptr_t pc = (uintptr_t)frames[i];
+    pcs[i] = pc;
+    offsets[i] = pc;
+    module_ids[i] = REPORT_RING_NO_MODULE;
+    if (module_map_try_lookup(pc, &mod) != 0) {
+      sig = signature_mix(sig, pc);
+      continue;
+    }
+    offsets[i] = pc - mod.load_base;
+    sig = mod.build_id_size > 0 ? signature_mix_bytes(sig, mod.build_id, mod.build_id_size)
+                                : signature_mix_bytes(sig, mod.path, strlen(mod.path));
+    sig = signature_mix(sig, offsets[i]);
+
+    for (int m = 0; m < REPORT_RING_MODULES; m++) {
+      if (r->modules[m][0] == '\0') {
+        report_snprintf(r->modules[m], sizeof(r->modules[m]), "%s", mod.path);
+      }
+      if (strncmp(r->modules[m], mod.path, sizeof(r->modules[m]) - 1) == 0) {
+        module_ids[i] = (uint8_t)m;
+        break;
+      }
+    }
+  }
+  return sig;
+}
+
+/**
+ * @brief 追加一条报告记录
+ * @param error enum report_ring_error
+ * @param fault_addr 出错地址（access为NULL时使用）
+ * @param access 解码出的访问，栈溢出时为NULL
+ * @param rec 被访问的块，栈溢出时为NULL
+ * @param frames 出错时调用栈
+ * @param frame_count 帧数
+ * @param alloc_frames 分配栈
+ * @param alloc_frame_count 帧数
+ * @param symbol 第0帧的符号
+ *
+ * 调用者须持有report_lock()（记录在静态区组装）；跨进程的并发由票号保证。
+ */
+void report_ring_append(int error, const void *fault_addr, const struct fault_access *access,
+                        const struct allocation_record *rec, void *const *frames,
+                        int frame_count, void *const *alloc_frames, int alloc_frame_count,
+                        const char *symbol) {
+  if (!ring) {
+    return;
+  }
+  static struct report_ring_record r;
+  memset(&r, 0, sizeof(r));
+  r.error = (uint8_t)error;
+  r.pid = (uint32_t)getpid();
+  r.tid = (uint32_t)syscall(SYS_gettid);
+  r.fault_addr = (uintptr_t)(access ? access->addr : fault_addr);
+  if (access) {
+    r.access_size = (uint32_t)access->size;
+    r.is_write = access->is_write;
+  }
+  if (rec) {
+    r.region_start = (uintptr_t)rec->user_addr;
+    r.region_size = rec->user_size;
+  }
+
+  uint64_t sig = signature_mix(0xcbf29ce484222325ull, (uint64_t)error);
+  r.frame_count = (uint8_t)(frame_count < REPORT_RING_FRAMES ? frame_count : REPORT_RING_FRAMES);
+  sig = copy_stack(&r, sig, frames, r.frame_count, r.frames, r.frame_offsets, r.frame_modules);
+  sig = signature_mix(sig, 0);  // 分隔两条栈
+  r.alloc_frame_count =
+      (uint8_t)(alloc_frame_count < REPORT_RING_FRAMES ? alloc_frame_count : REPORT_RING_FRAMES);
+  sig = copy_stack(&r, sig, alloc_frames, r.alloc_frame_count, r.alloc_frames,
+                   r.alloc_frame_offsets, r.alloc_frame_modules);
+  r.signature = sig;
+  report_snprintf(r.symbol, sizeof(r.symbol), "%s", symbol ? symbol : "??");
+
+  uint64_t ticket = __atomic_fetch_add(&ring->head, 1, __ATOMIC_ACQ_REL);
+  if (ticket >= __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) + ring->capacity) {
+    __atomic_add_fetch(&ring->dropped, 1, __ATOMIC_RELAXED);
+  }
+  struct report_ring_record *slot = &report_ring_records(ring)[ticket % ring->capacity];
+  __atomic_store_n(&slot->seq, 0, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  memcpy((char *)slot + sizeof(slot->seq), (const char *)&r + sizeof(r.seq),
+         sizeof(r) - sizeof(r.seq));
+  __atomic_store_n(&slot->seq, ticket + 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,124 @@
+/**
+ * @file report_ring.h
+ * @brief 跨进程的共享内存报告环
+ *
+ * prefork服务的几十个worker各自出错、各自写报告，stdout交错在一起很难对应。
+ * report_ring选项非空时，初始化阶段创建（或打开已有的）一个共享映射的环形缓冲区，
+ * fork出的worker继承同一映射；每份错误报告除文本外再追加一条定长记录。
+ * 离线工具toy_asan_collect读出全部记录，按栈签名合并各进程的同一处错误。
+ *
+ * 签名按（模块build-id或路径，模块内偏移）计算，与加载地址无关：
+ * 同一路径的环可以被互不相关、各自ASLR的进程（重启的服务、exec出的子进程）
+ * 共用，同一处错误仍合并为一个签名。
+ *
+ * 文件布局（tmpfs上的普通文件，或memfd经/proc/<pid>/fd/<n>访问）：
+ * ┌──────────────────────────────────────┐
+ * │ report_ring_header                   │
+ * ├──────────────────────────────────────┤
+ * │ report_ring_record × capacity        │ ← 按票号取模循环使用
+ * └──────────────────────────────────────┘
+ *
+ * 无锁追加：
+ * - 写者用原子加法从head领票号，槽位 = 票号 % capacity
+ * - 先把槽位seq清零，写完各字段后以release语义写seq = 票号 + 1（发布）
+ * - 读者复制前后各读一次seq，不一致或为0的记录视为正在写，跳过
+ * - 写者领到的票号超过tail（读者已取走的位置）+ capacity时，覆盖未读记录，
+ *   计入dropped
+ *
+ * 所有字段均为本机字节序。运行时库与离线工具共用，只依赖libc。
+ *
+ * @author Toy ASan Project
+ * @version 1.0
+ */
+
+#ifndef TOY_ASAN_REPORT_RING_H
+#define TOY_ASAN_REPORT_RING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define REPORT_RING_MAGIC "TOYRING"
+#define REPORT_RING_VERSION 2
+#define REPORT_RING_CAPACITY 4096    // 记录数
+#define REPORT_RING_FRAMES 8         // 每条调用栈保存的帧数
+#define REPORT_RING_SYMBOL 112       // 出错帧符号的最大长度（含'\0'）
+#define REPORT_RING_MODULES 4        // 每条记录保存的不同模块数
+#define REPORT_RING_MODULE_PATH 96   // 模块路径的最大长度（含'\0'）
+#define REPORT_RING_NO_MODULE 0xff   // 帧不在任何已知模块中，或模块表已满
+
+// 错误类型
+enum report_ring_error {
+  REPORT_RING_HEAP_BUFFER_OVERFLOW = 1,
+  REPORT_RING_HEAP_USE_AFTER_FREE = 2,
+  REPORT_RING_STACK_OVERFLOW = 3,
+};
+
+// 文件头
+struct report_ring_header {
+  char magic[8];             // "TOYRING\0"
+  uint32_t version;          // REPORT_RING_VERSION
+  uint32_t capacity;         // 记录数
+  uint64_t head;             // 下一个票号（写者原子加）
+  uint64_t tail;             // 读者已取走的票号上界
+  uint64_t dropped;          // 覆盖掉的未读记录数
+  uint64_t reserved[3];
+};
+
+// 一条报告记录（定长）
+struct report_ring_record {
+  uint64_t seq;              // 票号 + 1，0表示空或正在写
+  uint64_t signature;        // 栈签名：错误类型 + 出错栈 + 分配栈的哈希，合并依据
+  uint64_t fault_addr;       // 访问起始地址
+  uint64_t region_start;     // 被访问块的用户地址，栈溢出时为0
+  uint64_t region_size;
+  uint64_t frames[REPORT_RING_FRAMES];        // 出错时调用栈（原始PC）
+  uint64_t alloc_frames[REPORT_RING_FRAMES];  // 分配栈
+  uint64_t frame_offsets[REPORT_RING_FRAMES];        // 模块内偏移（PC - 加载基址）
+  uint64_t alloc_frame_offsets[REPORT_RING_FRAMES];
+  uint32_t pid;
+  uint32_t tid;
+  uint32_t access_size;      // 0表示未知
+  uint8_t error;             // enum report_ring_error
+  uint8_t is_write;
+  uint8_t frame_count;
+  uint8_t alloc_frame_count;
+  uint8_t frame_modules[REPORT_RING_FRAMES];       // modules下标或REPORT_RING_NO_MODULE
+  uint8_t alloc_frame_modules[REPORT_RING_FRAMES];
+  char symbol[REPORT_RING_SYMBOL];  // 第0帧符号化结果
+  char modules[REPORT_RING_MODULES][REPORT_RING_MODULE_PATH];  // 帧所在模块的路径
+};
+
+static inline size_t report_ring_file_size(uint32_t capacity) {
+  return sizeof(struct report_ring_header) + (size_t)capacity * sizeof(struct report_ring_record);
+}
+
+/**
+ * @brief 校验映射的文件头
+ * @param size 文件大小
+ */
+static inline bool report_ring_valid(const struct report_ring_header *h, size_t size) {
+  return size >= sizeof(*h) && memcmp(h->magic, REPORT_RING_MAGIC, 8) == 0 &&
+         h->version == REPORT_RING_VERSION && h->capacity > 0 &&
+         report_ring_file_size(h->capacity) <= size;
+}
+
+static inline struct report_ring_record *report_ring_records(struct report_ring_header *h) {
+  return (struct report_ring_record *)(h + 1);
+}
+
+static inline const char *report_ring_error_name(uint8_t error) {
+  switch (error) {
+    case REPORT_RING_HEAP_BUFFER_OVERFLOW:
+      return "heap-buffer-overflow";
+    case REPORT_RING_HEAP_USE_AFTER_FREE:
+      return "heap-use-after-free";
+    case REPORT_RING_STACK_OVERFLOW:
+      return "stack-overflow";
+    default:
+      return "unknown";
+  }
+}
+
+#endif  // TOY_ASAN_REPORT_RING_H
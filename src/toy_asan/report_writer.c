@@ -0,0 +1,200 @@
+/**
+ * @file report_writer.c
+ * @brief Toy AddressSanitizer 异步信号安全的报告输出
+ *
+ * 错误报告在SIGSEGV处理器中生成。出错的线程可能正持有stdio的锁
+ * （例如printf读到了保护页），此时处理器里再调用printf会死锁。
+ * 报告因此不经过stdio，也不分配内存：
+ * - 格式化由本文件手写，只支持报告用到的转换
+ *   （%s %c %d %u %x %p %%，可带l或z长度修饰）
+ * - 文本追加到预先分配的静态缓冲区，report_flush()用write(2)一次写出
+ *   （缓冲区写满时提前写出一段）
+ * - 输出到report_fd选项指定的文件描述符（默认2，即stderr）
+ *
+ * 恢复模式下进程出错后继续运行，多个线程可能同时生成报告，
+ * 由report_lock()串行化（自旋锁，信号处理器中可用）。
+ *
+ * @author Toy ASan Project
+ * @version 1.0
+ */
+
+#include "toy_asan.h"
+#include <errno.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <unistd.h>
+
+#define REPORT_BUFFER_SIZE (64 * 1024)
+
+static char report_buffer[REPORT_BUFFER_SIZE];
+static size_t report_length;
+static bool report_busy;
+
+// 往buf追加一个字符，超出容量时只计数（与snprintf相同的截断语义）
+struct format_sink {
+  char *buf;
+  size_t size;
+  size_t len;
+};
+
+static void sink_char(struct format_sink *s, char c) {
+  if (s->len + 1 < s->size) {
+    s->buf[s->len] = c;
+  }
+  s->len++;
+}
+
+static void sink_str(struct format_sink *s, const char *str) {
+  while (*str) {
+    sink_char(s, *str++);
+  }
+}
+
+static void sink_unsigned(struct format_sink *s, unsigned long value, unsigned base) {
+  static const char digits[] = "0123456789abcdef";
+  char tmp[24];
+  int n = 0;
+  do {
+    tmp[n++] = digits[value % base];
+    value /= base;
+  } while (value);
+  while (n > 0) {
+    sink_char(s, tmp[--n]);
+  }
+}
+
+static void sink_signed(struct format_sink *s, long value) {
+  if (value < 0) {
+    sink_char(s, '-');
+    sink_unsigned(s, -(unsigned long)value, 10);
+  } else {
+    sink_unsigned(s, (unsigned long)value, 10);
+  }
+}
+
+static void sink_format(struct format_sink *s, const char *fmt, va_list ap) {
+  for (const char *p = fmt; *p; p++) {
+    if (*p != '%') {
+      sink_char(s, *p);
+      continue;
+    }
+    p++;
+    bool is_long = false;
+    if (*p == 'l' || *p == 'z') {  // x86-64上long与size_t同宽
+      is_long = true;
+      p++;
+    }
+    switch (*p) {
+      case 's': {
+        const char *str = va_arg(ap, const char *);
+        sink_str(s, str ? str : "(null)");
+        break;
+      }
+      case 'c':
+        sink_char(s, (char)va_arg(ap, int));
+        break;
+      case 'd':
+        sink_signed(s, is_long ? va_arg(ap, long) : va_arg(ap, int));
+        break;
+      case 'u':
+        sink_unsigned(s, is_long ? va_arg(ap, unsigned long) : va_arg(ap, unsigned), 10);
+        break;
+      case 'x':
+        sink_unsigned(s, is_long ? va_arg(ap, unsigned long) : va_arg(ap, unsigned), 16);
+        break;
+      case 'p': {
+        void *ptr = va_arg(ap, void *);
+        if (ptr) {
+          sink_str(s, "0x");
+          sink_unsigned(s, (unsigned long)(uintptr_t)ptr, 16);
+        } else {
+          sink_str(s, "(nil)");
+        }
+        break;
+      }
+      case '%':
+        sink_char(s, '%');
+        break;
+      case '\0':
+        return;
+      default:  // 不支持的转换原样输出
+        sink_char(s, '%');
+        sink_char(s, *p);
+        break;
+    }
+  }
+}
+
+/**
+ * @brief 异步信号安全的snprintf（只支持上述转换）
+ * @return 不截断时应写入的长度
+ */
+int report_snprintf(char *buf, size_t size, const char *fmt, ...) {
+  struct format_sink s = {buf, size, 0};
+  va_list ap;
+  va_start(ap, fmt);
+  sink_format(&s, fmt, ap);
+  va_end(ap);
+  if (size > 0) {
+    buf[s.len < size ? s.len : size - 1] = '\0';
+  }
+  return (int)s.len;
+}
+
+// write(2)直到写完；EINTR重试，其他错误放弃（报告无处可写）
+static void write_all(const char *data, size_t size) {
+  while (size > 0) {
+    ssize_t n = write(toy_asan_flags.report_fd, data, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return;
+    }
+    data += n;
+    size -= (size_t)n;
+  }
+}
+
+/**
+ * @brief 把格式化的文本追加到报告缓冲区
+ *
+ * 单次追加超过剩余空间时先写出已有内容；单行超过整个缓冲区时截断。
+ */
+void report_printf(const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  struct format_sink s = {report_buffer + report_length, REPORT_BUFFER_SIZE - report_length, 0};
+  va_list retry;
+  va_copy(retry, ap);
+  sink_format(&s, fmt, ap);
+  if (s.len >= s.size && report_length > 0) {
+    report_flush();
+    s = (struct format_sink){report_buffer, REPORT_BUFFER_SIZE, 0};
+    sink_format(&s, fmt, retry);
+  }
+  va_end(retry);
+  va_end(ap);
+  report_length += s.len < s.size ? s.len : s.size - 1;
+}
+
+/**
+ * @brief 用一次write(2)写出报告缓冲区并清空
+ */
+void report_flush(void) {
+  write_all(report_buffer, report_length);
+  report_length = 0;
+}
+
+/**
+ * @brief 独占报告缓冲区（自旋等待，不阻塞在内核锁上）
+ */
+void report_lock(void) {
+  while (__atomic_test_and_set(&report_busy, __ATOMIC_ACQUIRE)) {
+    sched_yield();
+  }
+}
+
+void report_unlock(void) {
+  __atomic_clear(&report_busy, __ATOMIC_RELEASE);
+}
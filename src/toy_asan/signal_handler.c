@@ -13,6 +13,24 @@
  * 关键标志：
  * - SA_SIGINFO: 获取详细的信号信息（包括故障地址）
  * - SA_RESTART: 确保被中断的系统调用自动重启
+ * - SA_ONSTACK: 在备用信号栈（alt_stack.c）上运行，线程栈溢出时也能报告
+ *
+ * 从出错到_exit之间只调用异步信号安全的函数：出错线程可能正持有
+ * stdio或malloc的锁。报告经report_printf()写入静态缓冲区，
+ * report_flush()一次write(2)到report_fd，帧由
+ * symbolize_frames_async_safe()解析（内存取自初始化时预留的区域）。
+ * print_*函数只往报告缓冲区追加，由调用者report_flush()。
+ *
+ * halt_on_error=0时保护页访问不退出，由recover.c单步越过。
+ *
+ * 进程中的其他代码（JIT、GC）可能依赖SIGSEGV：处理器先用区域表O(1)判断
+ * 出错地址是否属于toy_asan，不属于时不加锁、不扫描分配表，直接交给
+ * 安装我们之前的处理器（chain_signal）。
+ *
+ * log_path非空时每份报告另写一行JSON（report_json.c），字段与文本报告对应。
+ *
+ * fault_monitor=userfaultfd时保护页访问改由监控线程（uffd_monitor.c）
+ * 经report_monitored_fault()报告，不再产生SIGSEGV。
  *
  * @author Toy ASan Project
  * @version 1.0
@@ -24,20 +42,21 @@
 #endif
 
 #include "toy_asan.h"
+#include "report_ring.h"
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <unistd.h>      // getpid()
-#include <execinfo.h>    // backtrace, backtrace_symbols
-#include <dlfcn.h>       // dladdr
+#include <sys/syscall.h> // SYS_gettid
+#include <unistd.h>      // getpid(), _exit()
 
 /**
  * @brief 注册SIGSEGV信号处理器
  *
  * 使用sigaction系统调用注册sigsegv_handler作为SIGSEGV的处理器。
  * 配置SA_SIGINFO标志以获取详细的信号信息（包括故障地址），
- * 配置SA_RESTART标志以确保被中断的系统调用自动重启。
+ * 配置SA_RESTART标志以确保被中断的系统调用自动重启，
+ * 配置SA_ONSTACK标志在线程登记时安装的备用信号栈上运行。
  *
  * 调用时机：
  * - toy_asan_init()中调用
@@ -50,7 +69,10 @@
  * @note
  * - 使用静态变量防止重复注册
  * - 清空信号掩码确保处理时不被其他信号干扰
+ * - 保存原来的处理方式，不属于toy_asan的出错交给它
  */
+static struct sigaction previous_sigsegv;
+
 void setup_signal_handler(void) {
   static bool handler_installed = false;
 
@@ -62,11 +84,11 @@ void setup_signal_handler(void) {
 
   // 配置信号处理结构
   sa.sa_sigaction = sigsegv_handler;     // 使用三参数处理器
-  sa.sa_flags = SA_SIGINFO | SA_RESTART; // 获取详细信息 + 自动重启系统调用
+  sa.sa_flags = SA_SIGINFO | SA_RESTART | SA_ONSTACK; // 详细信息 + 自动重启 + 备用栈
   sigemptyset(&sa.sa_mask);              // 清空信号掩码
 
   // 注册SIGSEGV处理器
-  if (sigaction(SIGSEGV, &sa, NULL) == -1) {
+  if (sigaction(SIGSEGV, &sa, &previous_sigsegv) == -1) {
     perror("Toy ASan: sigaction failed");
     exit(1);
   }
@@ -76,39 +98,38 @@ void setup_signal_handler(void) {
 }
 
 /**
- * @brief 从si_code推断访问类型
- * @param si_code 信号的si_code字段
- * @return "READ" 或 "WRITE"
+ * @brief 打印访问方向、宽度和起始地址
+ * @param access decode_fault_access()的结果
  */
-const char *infer_access_type(int si_code) {
-  // 根据信号代码推断访问类型
-  // SEGV_ACCERR (1): 权限错误，通常是写操作
-  // SEGV_ACCADI (2): 地址错误，可能是读或写
-  // 其他情况默认为写操作
-  switch (si_code) {
-    case SEGV_ACCERR:
-      return "WRITE";
-    case SEGV_ACCADI:
-      return "READ";  // 简化处理，实际可能更复杂
-    default:
-      return "WRITE";  // 默认假设为写
+static const char *access_type(const struct fault_access *access) {
+  if (access->is_exec) {
+    return "EXEC";
+  }
+  return access->is_write ? "WRITE" : "READ";
+}
+
+static void print_access(const struct fault_access *access) {
+  const char *type = access_type(access);
+  if (access->is_exec) {
+    report_printf("%s at %p thread T0\n", type, access->addr);
+  } else if (access->size > 0) {
+    report_printf("%s of size %zu at %p thread T0\n", type, access->size, access->addr);
+  } else {
+    report_printf("%s of unknown size at %p thread T0\n", type, access->addr);
   }
 }
 
 /**
- * @brief 打印当前调用栈（错误发生时）
+ * @brief 打印出错线程的调用栈（错误发生时）
+ * @param context 信号处理器上下文，从中取出错时的寄存器
  */
-void print_call_stack(void) {
+void print_call_stack(void *context) {
   void *buffer[MAX_BACKTRACE_FRAMES];
-  int frames = backtrace(buffer, MAX_BACKTRACE_FRAMES);
-  char **symbols = backtrace_symbols(buffer, frames);
-  
-  // 跳过信号处理器本身，从第1帧开始
-  for (int i = 1; i < frames; i++) {
-    printf("    #%d %p\n", i-1, buffer[i]);
+  int frames = unwind_from_context(context, buffer, MAX_BACKTRACE_FRAMES);
+
+  for (int i = 0; i < frames; i++) {
+    report_printf("    #%d %p\n", i, buffer[i]);
   }
-  
-  free(symbols);
 }
 
 /**
@@ -132,8 +153,131 @@ void print_memory_relation(void *fault_addr, struct allocation_record *rec) {
     region_end = (char*)rec->user_addr + rec->user_size;
   }
   
-  printf("%p is located %zu bytes to %s of %zu-byte region [%p,%p)\n",
-         fault_addr, distance, direction, rec->user_size, region_start, region_end);
+  report_printf("%p is located %zu bytes to %s of %zu-byte region [%p,%p)\n",
+                fault_addr, distance, direction, rec->user_size, region_start, region_end);
+}
+
+// 一份报告中要打印的全部调用栈：先收集，再一次性批量符号化
+#define REPORT_MAX_FRAMES (MAX_BACKTRACE_FRAMES + 2 * MAX_STACK_DEPTH)
+
+struct report_stacks {
+  void *pcs[REPORT_MAX_FRAMES];
+  char symbols[REPORT_MAX_FRAMES][SYMBOL_MAX];
+  int count;
+};
+
+// 报告中的一条调用栈：report_stacks中的一段
+struct stack_ref {
+  int start;
+  int count;
+};
+
+// 报告打印完即退出进程，静态缓冲区不需要可重入
+static struct report_stacks report;
+
+static struct stack_ref report_add_stack(struct report_stacks *rs, void *const *frames,
+                                         int frame_count) {
+  struct stack_ref ref = {rs->count, 0};
+  while (ref.count < frame_count && rs->count < REPORT_MAX_FRAMES) {
+    rs->pcs[rs->count++] = frames[ref.count++];
+  }
+  return ref;
+}
+
+static void report_print_stack(const struct report_stacks *rs, struct stack_ref ref) {
+  for (int i = 0; i < ref.count; i++) {
+    report_printf("    #%d %p in %s\n", i, rs->pcs[ref.start + i], rs->symbols[ref.start + i]);
+  }
+}
+
+static struct stack_ref report_add_depot_stack(struct report_stacks *rs, uint32_t stack_id) {
+  void *const *frames;
+  int frame_count = stack_depot_get(stack_id, &frames);
+  return report_add_stack(rs, frames, frame_count);
+}
+
+static struct stack_ref report_add_current_stack(struct report_stacks *rs, void *context) {
+  void *frames[MAX_BACKTRACE_FRAMES];
+  int frame_count = unwind_from_context(context, frames, MAX_BACKTRACE_FRAMES);
+  return report_add_stack(rs, frames, frame_count);
+}
+
+// =================== 结构化报告（log_path） ==================
+
+// 公共字段；log_path未设置时返回false，调用者跳过整份结构化报告
+static bool log_report_begin(const char *error, const void *addr) {
+  if (!json_report_begin()) {
+    return false;
+  }
+  json_string("error", error);
+  json_uint("pid", (unsigned long)getpid());
+  json_uint("tid", (unsigned long)syscall(SYS_gettid));
+  json_address("address", addr);
+  return true;
+}
+
+// size为0表示解码失败、宽度未知
+static void log_access(const struct fault_access *access, const void *fault_addr) {
+  json_object_begin("access");
+  json_string("type", access_type(access));
+  json_uint("size", access->size);
+  json_address("start", access->addr);
+  json_address("fault_address", fault_addr);
+  json_object_end();
+}
+
+static void log_region(const struct allocation_record *rec, const void *fault_addr) {
+  const char *user = rec->user_addr;
+  const char *fault = fault_addr;
+  const char *relation;
+  size_t distance;
+  if (fault < user) {
+    relation = "left";
+    distance = (size_t)(user - fault);
+  } else if (fault < user + rec->user_size) {
+    relation = "inside";
+    distance = (size_t)(fault - user);
+  } else {
+    relation = "right";
+    distance = (size_t)(fault - (user + rec->user_size));
+  }
+  json_object_begin("region");
+  json_address("start", user);
+  json_uint("size", rec->user_size);
+  json_string("relation", relation);
+  json_uint("distance", distance);
+  if (rec->tag != 0) {
+    json_string("tag", toy_asan_tag_name(rec->tag));
+  }
+  json_object_end();
+}
+
+static void log_stack(const char *key, struct report_stacks *rs, struct stack_ref ref) {
+  json_frames(key, rs->pcs + ref.start, rs->symbols + ref.start, ref.count);
+}
+
+// 报告中所有帧涉及的模块及其build-id，然后写出
+static void log_report_end(const struct report_stacks *rs) {
+  json_modules(rs->pcs, rs->count);
+  json_report_end();
+}
+
+// 追加到共享内存报告环（report_ring未设置时什么都不做）
+static void ring_append(int error, const void *fault_addr, const struct fault_access *access,
+                        const struct allocation_record *rec, const struct report_stacks *rs,
+                        struct stack_ref current, struct stack_ref alloc) {
+  report_ring_append(error, fault_addr, access, rec, rs->pcs + current.start, current.count,
+                     rs->pcs + alloc.start, alloc.count,
+                     current.count > 0 ? rs->symbols[current.start] : NULL);
+}
+
+static void print_allocated_by(struct allocation_record *rec, const char *prefix) {
+  if (rec->tag != 0) {
+    report_printf("%sallocated by thread T0 here (tag: %s):\n", prefix,
+                  toy_asan_tag_name(rec->tag));
+  } else {
+    report_printf("%sallocated by thread T0 here:\n", prefix);
+  }
 }
 
 /**
@@ -141,282 +285,372 @@ void print_memory_relation(void *fault_addr, struct allocation_record *rec) {
  * @param rec 分配记录
  */
 void print_allocation_location(struct allocation_record *rec) {
+  static struct report_stacks rs;
+  rs.count = 0;
+  struct stack_ref alloc = report_add_depot_stack(&rs, rec->alloc_stack_id);
+
   // 如果有分配位置信息
-  if (rec->alloc_backtrace_size > 0) {
-    printf("allocated by thread T0 here:\n");
-    
-    for (int i = 0; i < rec->alloc_backtrace_size; i++) {
-      char symbol[512];
-      if (resolve_symbol(rec->alloc_backtrace[i], symbol, sizeof(symbol)) == 0) {
-        printf("    #%d %p in %s\n", i, rec->alloc_backtrace[i], symbol);
-      } else {
-        printf("    #%d %p in ??\n", i, rec->alloc_backtrace[i]);
-      }
-    }
+  if (alloc.count > 0) {
+    symbolize_frames_async_safe(rs.pcs, rs.count, rs.symbols);
+    print_allocated_by(rec, "");
+    report_print_stack(&rs, alloc);
+    print_report_modules(rs.pcs, rs.count);
   }
 }
 
 /**
- * @brief 转发给默认处理器
+ * @brief 报告访问已释放内存（free_context=1时）
+ * @param fault_addr 故障地址
+ * @param rec 已释放、槽位尚未复用的分配记录
+ * @param context 信号处理器上下文
+ */
+static void report_use_after_free(void *fault_addr, struct allocation_record *rec,
+                                  void *context) {
+  toy_asan_error_reported = true;
+
+  // 当前栈、释放栈、分配栈一批符号化（恢复模式下缓冲区里可能还有上一份报告的帧）
+  report.count = 0;
+  struct stack_ref current = report_add_current_stack(&report, context);
+  struct stack_ref freed = report_add_depot_stack(&report, rec->free_stack_id);
+  struct stack_ref alloc = report_add_depot_stack(&report, rec->alloc_stack_id);
+  symbolize_frames_async_safe(report.pcs, report.count, report.symbols);
+
+  report_printf("=================================================================\n");
+  struct fault_access access;
+  decode_fault_access(fault_addr, context, &access);
+  report_printf("==%d==ERROR: Toy AddressSanitizer: heap-use-after-free on address %p\n",
+                getpid(), access.addr);
+  print_access(&access);
+  report_printf("Current call stack:\n");
+  report_print_stack(&report, current);
+  report_printf("\n");
+
+  char *user = rec->user_addr;
+  if ((char *)fault_addr >= user && (char *)fault_addr < user + rec->user_size) {
+    report_printf("%p is located %zu bytes inside of %zu-byte region [%p,%p)\n", fault_addr,
+                  (size_t)((char *)fault_addr - user), rec->user_size, (void *)user,
+                  (void *)(user + rec->user_size));
+  } else {
+    report_printf("%p is located near freed %zu-byte region [%p,%p)\n", fault_addr,
+                  rec->user_size, (void *)user, (void *)(user + rec->user_size));
+  }
+  report_printf("\n");
+
+  report_printf("freed by thread T0 here:\n");
+  report_print_stack(&report, freed);
+  report_printf("\n");
+
+  if (alloc.count > 0) {
+    print_allocated_by(rec, "previously ");
+    report_print_stack(&report, alloc);
+  }
+
+  print_report_modules(report.pcs, report.count);
+  report_printf("SUMMARY: Toy AddressSanitizer: heap-use-after-free\n");
+  report_printf("=================================================================\n");
+  report_flush();
+
+  if (log_report_begin("heap-use-after-free", access.addr)) {
+    log_access(&access, fault_addr);
+    log_region(rec, fault_addr);
+    json_object_begin("stacks");
+    log_stack("current", &report, current);
+    log_stack("freed", &report, freed);
+    log_stack("allocated", &report, alloc);
+    json_object_end();
+    log_report_end(&report);
+  }
+  ring_append(REPORT_RING_HEAP_USE_AFTER_FREE, fault_addr, &access, rec, &report, current, alloc);
+  _exit(1);
+}
+
+/**
+ * @brief 报告线程栈溢出（处理器运行在备用信号栈上）
+ * @param fault_addr 故障地址
+ * @param context 信号处理器上下文
+ */
+static void report_stack_overflow(void *fault_addr, void *context) {
+  toy_asan_error_reported = true;
+
+  report.count = 0;
+  struct stack_ref current = report_add_current_stack(&report, context);
+  symbolize_frames_async_safe(report.pcs, report.count, report.symbols);
+
+  report_printf("=================================================================\n");
+  report_printf("==%d==ERROR: Toy AddressSanitizer: stack-overflow on address %p\n", getpid(),
+                fault_addr);
+  report_printf("Current call stack:\n");
+  report_print_stack(&report, current);
+  report_printf("\n");
+  print_report_modules(report.pcs, report.count);
+  report_printf("SUMMARY: Toy AddressSanitizer: stack-overflow\n");
+  report_printf("=================================================================\n");
+  report_flush();
+
+  if (log_report_begin("stack-overflow", fault_addr)) {
+    json_object_begin("stacks");
+    log_stack("current", &report, current);
+    json_object_end();
+    log_report_end(&report);
+  }
+  struct stack_ref none = {0, 0};
+  ring_append(REPORT_RING_STACK_OVERFLOW, fault_addr, NULL, NULL, &report, current, none);
+  _exit(1);
+}
+
+/**
+ * @brief 把信号交给安装我们之前的处理方式
+ * @param previous sigaction()保存的原处理方式
  * @param sig 信号编号
  * @param info 信号信息
+ * @param context 处理器上下文（原处理器可以修改后返回，例如GC的写屏障）
+ *
+ * 原处理器运行期间按它自己的sa_mask屏蔽信号。原处理方式为SIG_DFL时
+ * 恢复默认并重新发出信号；SIGSEGV/SIGBUS被忽略时返回只会再次出错，
+ * 同样按默认处理。
  */
-void forward_to_default_handler(int sig, siginfo_t *info) {
+void chain_signal(const struct sigaction *previous, int sig, siginfo_t *info, void *context) {
+  // 原sa_mask为空（最常见）时省掉两次系统调用
+  bool mask = !sigisemptyset(&previous->sa_mask);
+  sigset_t saved;
+  if (previous->sa_flags & SA_SIGINFO) {
+    if (mask) {
+      pthread_sigmask(SIG_BLOCK, &previous->sa_mask, &saved);
+    }
+    previous->sa_sigaction(sig, info, context);
+    if (mask) {
+      pthread_sigmask(SIG_SETMASK, &saved, NULL);
+    }
+    return;
+  }
+  if (previous->sa_handler == SIG_IGN && sig != SIGSEGV && sig != SIGBUS) {
+    return;
+  }
+  if (previous->sa_handler != SIG_IGN && previous->sa_handler != SIG_DFL) {
+    if (mask) {
+      pthread_sigmask(SIG_BLOCK, &previous->sa_mask, &saved);
+    }
+    previous->sa_handler(sig);
+    if (mask) {
+      pthread_sigmask(SIG_SETMASK, &saved, NULL);
+    }
+    return;
+  }
   signal(sig, SIG_DFL);
   raise(sig);
 }
 
+static bool has_previous_handler(const struct sigaction *previous) {
+  return (previous->sa_flags & SA_SIGINFO) ||
+         (previous->sa_handler != SIG_DFL && previous->sa_handler != SIG_IGN);
+}
+
 /**
- * @brief SIGSEGV信号处理器
- * @param sig 信号编号（应为SIGSEGV = 11）
- * @param info 包含信号详细信息的结构体
- * @param context 处理器上下文（寄存器状态等）
+ * @brief 不属于toy_asan的SIGSEGV
  *
- * 处理流程：
- * 1. 从siginfo_t获取故障地址
- * 2. 调用find_allocation()检测是否为我们的保护页
- * 3. 如果是保护页访问，报告溢出并退出
- * 4. 如果不是保护页访问，转发给默认处理器
+ * 有原处理器时一律交给它（JIT/GC的预期出错、其他运行时自己的栈溢出检测）；
+ * 没有时线程栈溢出报告stack-overflow，其余按默认处理。
  */
-void sigsegv_handler(int sig, siginfo_t *info, void *context) {
-  if (sig != SIGSEGV) {
-    return;
+static void handle_foreign_fault(int sig, siginfo_t *info, void *context) {
+  if (!has_previous_handler(&previous_sigsegv) && is_stack_overflow(info->si_addr, context)) {
+    report_lock();
+    report_stack_overflow(info->si_addr, context);
   }
+  chain_signal(&previous_sigsegv, sig, info, context);
+}
 
-  void *fault_addr = info->si_addr;
-  struct allocation_record *rec = find_allocation(fault_addr);
-  
-  if (!rec) {
-    // 不是我们的保护页，转发给默认处理器
-    forward_to_default_handler(sig, info);
-    return;
-  }
+/**
+ * @brief 报告越界访问保护页（heap-buffer-overflow）
+ * @param fault_addr 故障地址
+ * @param rec 保护页所属的分配记录
+ * @param context 信号处理器上下文
+ * @param access 解码出的访问
+ * @param symbolize 符号化函数：信号处理器中用symbolize_frames_async_safe，
+ *        监控线程中用symbolize_report_frames
+ *
+ * 只生成并写出报告，是否退出由调用者决定（恢复模式下继续运行）。
+ */
+static void report_heap_buffer_overflow(void *fault_addr, struct allocation_record *rec,
+                                        void *context, const struct fault_access *access,
+                                        int (*symbolize)(void *const *, int,
+                                                         char (*)[SYMBOL_MAX])) {
+  // 当前栈和分配栈一批符号化
+  report.count = 0;
+  struct stack_ref current = report_add_current_stack(&report, context);
+  struct stack_ref alloc = report_add_depot_stack(&report, rec->alloc_stack_id);
+  symbolize(report.pcs, report.count, report.symbols);
 
   // =================== 1. 错误头部信息 ==================
-  printf("=================================================================\n");
-  printf("==%d==ERROR: Toy AddressSanitizer: heap-buffer-overflow on address %p\n", getpid(), fault_addr);
+  // 地址取访问的起始字节；si_addr只是其中第一个落在保护页上的字节
+  report_printf("=================================================================\n");
+  report_printf("==%d==ERROR: Toy AddressSanitizer: heap-buffer-overflow on address %p\n",
+                getpid(), access->addr);
 
   // =================== 2. 访问信息详情 ==================
-  const char *access_type = infer_access_type(info->si_code);
-  printf("%s of size 1 at %p thread T0\n", access_type, fault_addr);
+  print_access(access);
 
   // =================== 3. 当前调用栈 ==================
-  print_call_stack_symbolized();
+  report_printf("Current call stack:\n");
+  report_print_stack(&report, current);
 
-  printf("\n");
+  report_printf("\n");
   
   // =================== 4. 内存位置关系 ==================
   print_memory_relation(fault_addr, rec);
   
-  printf("\n");
+  report_printf("\n");
   
   // =================== 5. 分配位置跟踪 ==================
-  print_allocation_location(rec);
+  if (alloc.count > 0) {
+    print_allocated_by(rec, "");
+    report_print_stack(&report, alloc);
+  }
+
+  print_report_modules(report.pcs, report.count);
 
   // =================== 6. 错误摘要 ==================
-  printf("SUMMARY: Toy AddressSanitizer: heap-buffer-overflow in main\n");
+  report_printf("SUMMARY: Toy AddressSanitizer: heap-buffer-overflow in main\n");
   
-  printf("=================================================================\n");
-  exit(1);
-}
+  report_printf("=================================================================\n");
+  report_flush();
 
-// =================== 符号化解析实现 ===================
-
-/**
- * @brief 获取可执行文件的基址
- * @return 代码段的虚拟基址
- */
-static uintptr_t get_executable_base(void) {
-    FILE *maps = fopen("/proc/self/maps", "r");
-    char line[512];
-    char executable_path[256];
-    
-    // 获取可执行文件路径
-    ssize_t len = readlink("/proc/self/exe", executable_path, sizeof(executable_path) - 1);
-    if (len == -1) {
-        fclose(maps);
-        return 0;
-    }
-    executable_path[len] = '\0';
-    
-    // 查找代码段的基址
-    while (fgets(line, sizeof(line), maps)) {
-        if (strstr(line, executable_path) && strstr(line, "r-xp")) {
-            uintptr_t base_addr;
-            if (sscanf(line, "%lx", &base_addr) == 1) {
-                fclose(maps);
-                return base_addr;
-            }
-        }
-    }
-    fclose(maps);
-    return 0;
+  // =================== 7. 结构化报告 ==================
+  if (log_report_begin("heap-buffer-overflow", access->addr)) {
+    log_access(access, fault_addr);
+    log_region(rec, fault_addr);
+    json_object_begin("stacks");
+    log_stack("current", &report, current);
+    log_stack("allocated", &report, alloc);
+    json_object_end();
+    log_report_end(&report);
+  }
+  ring_append(REPORT_RING_HEAP_BUFFER_OVERFLOW, fault_addr, access, rec, &report, current,
+              alloc);
 }
 
 /**
- * @brief 第1级：dladdr快速解析
- * @param addr 要解析的地址
- * @param output 输出缓冲区
- * @param output_size 输出缓冲区大小
- * @return 0成功，-1失败
+ * @brief SIGSEGV信号处理器
+ * @param sig 信号编号（应为SIGSEGV = 11）
+ * @param info 包含信号详细信息的结构体
+ * @param context 处理器上下文（寄存器状态等）
+ *
+ * 处理流程：
+ * 1. 从siginfo_t获取故障地址
+ * 2. 区域表O(1)判断地址是否在toy_asan的块内，不在时交给原处理器
+ *    （没有原处理器时，线程栈溢出报告stack-overflow）
+ * 3. 调用find_allocation()检测是否为我们的保护页
+ * 4. 如果是保护页访问，报告溢出并退出；恢复模式（halt_on_error=0）下
+ *    按（PC，分配栈）去重、限流后报告，单步越过出错指令后继续运行
+ * 5. 访问已释放的块报告heap-use-after-free，其余交给原处理器
+ *
+ * 多个线程同时出错时由report_lock()串行化，报告不会交错。
  */
-static int resolve_symbol_with_dladdr(void *addr, char *output, size_t output_size) {
-    Dl_info info;
-    
-    if (dladdr(addr, &info)) {
-        if (info.dli_sname) {
-            snprintf(output, output_size, "%s", info.dli_sname);
-            return 0;
-        }
+void sigsegv_handler(int sig, siginfo_t *info, void *context) {
+  if (sig != SIGSEGV) {
+    return;
+  }
+
+  void *fault_addr = info->si_addr;
+  if (!in_toy_asan_region(fault_addr)) {
+    handle_foreign_fault(sig, info, context);
+    return;
+  }
+
+  report_lock();
+  struct allocation_record *rec = find_allocation(fault_addr);
+  
+  if (!rec) {
+    // 访问已释放的块（仅当释放时采集了调用栈）
+    struct allocation_record *freed = find_freed_allocation(fault_addr);
+    if (freed) {
+      report_use_after_free(fault_addr, freed, context);
     }
-    return -1;
-}
 
-/**
- * @brief 解析内存映射获取load_base和file_offset
- * @param load_base 输出：代码段加载基址
- * @param file_offset 输出：代码段文件偏移
- * @return 0成功，-1失败
- */
-static int parse_memory_layout(uintptr_t *load_base, uintptr_t *file_offset) {
-    FILE *maps = fopen("/proc/self/maps", "r");
-    char line[512];
-    char executable_path[256];
-    
-    // 获取可执行文件路径
-    ssize_t len = readlink("/proc/self/exe", executable_path, sizeof(executable_path) - 1);
-    if (len == -1) {
-        fclose(maps);
-        return -1;
+    // 块内但不是保护页（例如地址已被其他映射复用）
+    report_unlock();
+    handle_foreign_fault(sig, info, context);
+    return;
+  }
+
+  struct fault_access access;
+  decode_fault_access(fault_addr, context, &access);
+
+  // 恢复模式：每个（PC，分配栈）组合报告一次（受限流约束），之后单步越过出错指令
+  bool reported = false;
+  if (!toy_asan_flags.halt_on_error) {
+    enum recover_action action = recover_classify(context);
+    void *pc = NULL;
+    unwind_from_context(context, &pc, 1);
+    if (action != RECOVER_HALT && report_dedup_admit((uintptr_t)pc, rec->alloc_stack_id)) {
+      report_heap_buffer_overflow(fault_addr, rec, context, &access, symbolize_frames_async_safe);
+      reported = true;
     }
-    executable_path[len] = '\0';
-    
-    // 查找代码段的基址和文件偏移
-    while (fgets(line, sizeof(line), maps)) {
-        if (strstr(line, executable_path) && strstr(line, "r-xp")) {
-            uintptr_t addr_start, addr_end, offset;
-            char perms[5];
-            char dev[32];
-            char pathname[256];
-            
-            // 简化版本：只解析前4个字段
-            if (sscanf(line, "%lx-%lx %4s %lx", 
-                      &addr_start, &addr_end, perms, &offset) == 4) {
-                *load_base = addr_start;
-                *file_offset = offset;
-                fclose(maps);
-                return 0;
-            }
-        }
+    if (action != RECOVER_HALT && recover_step_over(fault_addr, context, action)) {
+      report_unlock();
+      return;
     }
-    fclose(maps);
-    return -1;
+  }
+
+  // 退出时不再做泄漏检测
+  toy_asan_error_reported = true;
+  if (!reported) {
+    report_heap_buffer_overflow(fault_addr, rec, context, &access, symbolize_frames_async_safe);
+  }
+  _exit(1);
 }
 
 /**
- * @brief 第2级：addr2line精确解析
- * @param addr 要解析的地址
- * @param output 输出缓冲区
- * @param output_size 输出缓冲区大小
- * @return 0成功，-1失败
+ * @brief 报告userfaultfd监控线程收到的保护页访问（uffd_monitor.c）
+ * @param fault_addr 出错地址
+ * @param context 监控线程合成的上下文，只有RIP/RSP/RBP有效
+ * @param access 按出错指令解码的访问
+ * @return 恢复模式下recover_classify()的结果：RECOVER_STEP时调用者放开该页、
+ *         待出错线程越过后重新监控，RECOVER_OPEN时保持放开；块已释放时返回RECOVER_OPEN
+ *
+ * 在监控线程中运行，出错线程阻塞在缺页中，因此可以用普通的符号化
+ * （symbolize_report_frames）。与信号处理器相同：halt_on_error=1或跳到保护页上
+ * 执行时报告后退出；恢复模式下按调用点预算分类，按（PC，分配栈）去重限流后返回。
  */
-static int resolve_symbol_with_addr2line(void *addr, char *output, size_t output_size) {
-    // 获取可执行文件路径
-    char executable_path[256];
-    ssize_t len = readlink("/proc/self/exe", executable_path, sizeof(executable_path) - 1);
-    if (len == -1) {
-        return -1;
-    }
-    executable_path[len] = '\0';
-    
-    // 解析内存布局
-    uintptr_t load_base, file_offset;
-    if (parse_memory_layout(&load_base, &file_offset) == -1) {
-        return -1;
-    }
-    
-    // 计算文件相对偏移：运行时虚拟地址 - 加载基址 + 文件偏移
-    uintptr_t file_relative_offset = (uintptr_t)addr - load_base + file_offset;
-    
-    // 构造正确命令（使用文件相对偏移）
-    char cmd[512];
-    snprintf(cmd, sizeof(cmd), "addr2line -fi -e %s %lx 2>/dev/null", executable_path, file_relative_offset);
-    
-    // 执行并解析结果
-    FILE *pipe = popen(cmd, "r");
-    if (!pipe) {
-        return -1;
-    }
-    
-    char function[256] = "??";
-    char location[256] = "??";
-    
-    // 读取函数名
-    if (fgets(function, sizeof(function), pipe)) {
-        // 去除换行符
-        function[strcspn(function, "\n")] = 0;
-    }
-    
-    // 读取位置信息
-    if (fgets(location, sizeof(location), pipe)) {
-        // 去除换行符
-        location[strcspn(location, "\n")] = 0;
+enum recover_action report_monitored_fault(void *fault_addr, void *context,
+                                           const struct fault_access *access) {
+  report_lock();
+  struct allocation_record *rec = find_allocation(fault_addr);
+  if (!rec) {
+    report_unlock();
+    return RECOVER_OPEN;
+  }
+
+  if (!toy_asan_flags.halt_on_error && !access->is_exec) {
+    enum recover_action action = recover_classify(context);
+    void *pc = NULL;
+    unwind_from_context(context, &pc, 1);
+    if (action != RECOVER_HALT && report_dedup_admit((uintptr_t)pc, rec->alloc_stack_id)) {
+      report_heap_buffer_overflow(fault_addr, rec, context, access, symbolize_report_frames);
     }
-    
-    pclose(pipe);
-    
-    // 格式化输出
-    if (strcmp(function, "??") != 0) {
-        if (strcmp(location, "??") != 0) {
-            snprintf(output, output_size, "%s (%s)", function, location);
-        } else {
-            snprintf(output, output_size, "%s", function);
-        }
-        return 0;
+    if (action != RECOVER_HALT) {
+      report_unlock();
+      return action;
     }
-    
-    return -1;
-}
+  }
 
-/**
- * @brief 主符号解析函数（多级回退）
- * @param addr 要解析的地址
- * @param output 输出缓冲区
- * @param output_size 输出缓冲区大小
- * @return 0成功，-1失败
- */
-int resolve_symbol(void *addr, char *output, size_t output_size) {
-    // // 第1级：dladdr（快速）
-    // if (resolve_symbol_with_dladdr(addr, output, output_size) == 0) {
-    //     return 0;
-    // }
-    
-    // 第2级：addr2line（准确）
-    if (resolve_symbol_with_addr2line(addr, output, output_size) == 0) {
-        return 0;
-    }
-    
-    // 第3级：fallback
-    snprintf(output, output_size, "??");
-    return -1;
+  toy_asan_error_reported = true;
+  report_heap_buffer_overflow(fault_addr, rec, context, access, symbolize_report_frames);
+  _exit(1);
 }
 
 /**
  * @brief 符号化调用栈打印
+ * @param context 信号处理器上下文
+ *
+ * 从ucontext中保存的RIP/RSP/RBP开始回溯，第0帧就是出错指令。
  */
-void print_call_stack_symbolized(void) {
-    void *buffer[MAX_BACKTRACE_FRAMES];
-    int frames = backtrace(buffer, MAX_BACKTRACE_FRAMES);
-    
-    printf("Current call stack:\n");
-    
-    // 跳过信号处理器本身
-    for (int i = 1; i < frames; i++) {
-        char symbol[512];
-        if (resolve_symbol(buffer[i], symbol, sizeof(symbol)) == 0) {
-            printf("    #%d %p in %s\n", i-1, buffer[i], symbol);
-        } else {
-            printf("    #%d %p in ??\n", i-1, buffer[i]);
-        }
-    }
+void print_call_stack_symbolized(void *context) {
+    static struct report_stacks rs;
+    rs.count = 0;
+    struct stack_ref current = report_add_current_stack(&rs, context);
+    symbolize_frames_async_safe(rs.pcs, rs.count, rs.symbols);
+
+    report_printf("Current call stack:\n");
+    report_print_stack(&rs, current);
+    print_report_modules(rs.pcs, rs.count);
 }
@@ -0,0 +1,209 @@
+/**
+ * @file site_stats.c
+ * @brief Toy AddressSanitizer 按分配调用点的统计
+ *
+ * toy_malloc()采集的分配调用栈原本只在崩溃报告里使用。
+ * 本文件把它们聚合成"调用点"（以栈仓库编号为键），统计：
+ * - live_count / live_bytes: 当前存活的块数和字节数
+ * - total_count / total_bytes: 累计分配的块数和字节数
+ * - free_count: 累计释放次数（与total_count一起反映churn）
+ *
+ * 并发设计：
+ * - 固定容量的开放寻址哈希表，不扩容、不删除
+ * - 插入用CAS抢占空槽位，计数器用原子加，malloc/free路径无锁
+ * - 表满后的新调用点统一计入溢出槽位（MAX_ALLOC_SITES-1号）
+ *
+ * 查询接口：
+ * - toy_asan_get_site_stats(): 拷贝出所有调用点统计
+ * - toy_asan_print_top_sites(): 按存活字节数打印前N个调用点
+ * - stats_interval_ms选项：后台线程定期打印前N个调用点
+ *
+ * @author Toy ASan Project
+ * @version 1.0
+ */
+
+#include "toy_asan.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define OVERFLOW_SITE (MAX_ALLOC_SITES - 1)
+#define SITE_TABLE_MASK (OVERFLOW_SITE - 1)  // 溢出槽位不参与探测
+
+struct alloc_site {
+  uint32_t stack_id;         // 栈仓库编号，0表示空槽位
+  uint64_t live_count;
+  uint64_t live_bytes;
+  uint64_t total_count;
+  uint64_t total_bytes;
+  uint64_t free_count;
+};
+
+static struct alloc_site site_table[MAX_ALLOC_SITES];
+
+/**
+ * @brief 查找或插入调用点
+ * @return 调用点编号（表满时返回溢出槽位）
+ */
+static int find_or_insert_site(uint32_t stack_id) {
+  size_t i = (size_t)((stack_id * 0x9e3779b97f4a7c15ull) >> 32) & SITE_TABLE_MASK;
+
+  for (size_t probe = 0; probe < OVERFLOW_SITE; probe++) {
+    struct alloc_site *site = &site_table[i];
+    uint32_t key = __atomic_load_n(&site->stack_id, __ATOMIC_ACQUIRE);
+
+    if (key == stack_id) {
+      return (int)i;
+    }
+    if (key == 0) {
+      uint32_t expected = 0;
+      if (__atomic_compare_exchange_n(&site->stack_id, &expected, stack_id, false,
+                                      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        return (int)i;
+      }
+      if (expected == stack_id) {
+        return (int)i; // 其他线程刚插入了同一个调用点
+      }
+    }
+    i = (i + 1) & SITE_TABLE_MASK;
+  }
+  return OVERFLOW_SITE;
+}
+
+/**
+ * @brief 记录一次分配（toy_malloc调用）
+ * @param stack_id 分配栈的栈仓库编号，0（仓库已满）计入溢出槽位
+ * @return 调用点编号，保存到分配记录中供释放时使用
+ */
+int site_stats_record_alloc(uint32_t stack_id, size_t size) {
+  int id = stack_id ? find_or_insert_site(stack_id) : OVERFLOW_SITE;
+  struct alloc_site *site = &site_table[id];
+
+  __atomic_fetch_add(&site->live_count, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&site->live_bytes, size, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&site->total_count, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&site->total_bytes, size, __ATOMIC_RELAXED);
+  return id;
+}
+
+/**
+ * @brief 记录一次释放（toy_free调用）
+ * @param site_id 分配时返回的调用点编号
+ * @param size 被释放块的用户大小
+ */
+void site_stats_record_free(int site_id, size_t size) {
+  if (site_id < 0 || site_id >= MAX_ALLOC_SITES) {
+    return;
+  }
+  struct alloc_site *site = &site_table[site_id];
+  __atomic_fetch_sub(&site->live_count, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_sub(&site->live_bytes, size, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&site->free_count, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief 拷贝出所有调用点的统计快照
+ * @param out 输出数组
+ * @param max_sites 数组容量
+ * @return 实际写入的调用点数量
+ *
+ * 各计数器分别原子读取，彼此之间不保证是同一时刻的值。
+ */
+int toy_asan_get_site_stats(struct toy_asan_site_stats *out, int max_sites) {
+  int n = 0;
+  for (int i = 0; i < MAX_ALLOC_SITES && n < max_sites; i++) {
+    struct alloc_site *site = &site_table[i];
+    uint64_t total = __atomic_load_n(&site->total_count, __ATOMIC_RELAXED);
+    if (total == 0) {
+      continue;
+    }
+
+    struct toy_asan_site_stats *s = &out[n++];
+    memset(s, 0, sizeof(*s));
+    s->site_id = i;
+    s->stack_id = __atomic_load_n(&site->stack_id, __ATOMIC_ACQUIRE);
+    s->live_count = __atomic_load_n(&site->live_count, __ATOMIC_RELAXED);
+    s->live_bytes = __atomic_load_n(&site->live_bytes, __ATOMIC_RELAXED);
+    s->total_count = total;
+    s->total_bytes = __atomic_load_n(&site->total_bytes, __ATOMIC_RELAXED);
+    s->free_count = __atomic_load_n(&site->free_count, __ATOMIC_RELAXED);
+    s->frame_count = stack_depot_get(s->stack_id, &s->frames);
+  }
+  return n;
+}
+
+static int compare_live_bytes(const void *a, const void *b) {
+  const struct toy_asan_site_stats *sa = a;
+  const struct toy_asan_site_stats *sb = b;
+  if (sa->live_bytes != sb->live_bytes) {
+    return sa->live_bytes > sb->live_bytes ? -1 : 1;
+  }
+  if (sa->total_count != sb->total_count) {
+    return sa->total_count > sb->total_count ? -1 : 1;
+  }
+  return 0;
+}
+
+/**
+ * @brief 按存活字节数打印前N个分配调用点
+ * @param top_n 打印数量
+ */
+void toy_asan_print_top_sites(int top_n) {
+  struct toy_asan_site_stats *stats =
+      malloc(MAX_ALLOC_SITES * sizeof(struct toy_asan_site_stats));
+  if (!stats) {
+    return;
+  }
+
+  int n = toy_asan_get_site_stats(stats, MAX_ALLOC_SITES);
+  qsort(stats, n, sizeof(*stats), compare_live_bytes);
+
+  printf("=== Top %d allocation sites (%d total) ===\n", top_n, n);
+  print_stack_capture_policy();
+  for (int i = 0; i < n && i < top_n; i++) {
+    struct toy_asan_site_stats *s = &stats[i];
+    printf("Site %d%s: live %llu blocks / %llu bytes, total %llu blocks / "
+           "%llu bytes, freed %llu\n",
+           s->site_id, s->site_id == OVERFLOW_SITE ? " (overflow)" : "",
+           (unsigned long long)s->live_count, (unsigned long long)s->live_bytes,
+           (unsigned long long)s->total_count, (unsigned long long)s->total_bytes,
+           (unsigned long long)s->free_count);
+    for (int f = 0; f < s->frame_count; f++) {
+      printf("    #%d %p\n", f, s->frames[f]);
+    }
+  }
+  printf("=====================================\n");
+  free(stats);
+}
+
+static void *stats_dump_thread(void *arg) {
+  (void)arg;
+  struct timespec interval;
+  interval.tv_sec = toy_asan_flags.stats_interval_ms / 1000;
+  interval.tv_nsec = (long)(toy_asan_flags.stats_interval_ms % 1000) * 1000000L;
+
+  for (;;) {
+    nanosleep(&interval, NULL);
+    toy_asan_print_top_sites(toy_asan_flags.stats_top_n);
+  }
+  return NULL;
+}
+
+/**
+ * @brief 按stats_interval_ms选项启动定期打印线程
+ *
+ * 选项为0（默认）时不启动。
+ */
+void start_site_stats_thread(void) {
+  if (toy_asan_flags.stats_interval_ms <= 0) {
+    return;
+  }
+
+  pthread_t tid;
+  if (pthread_create(&tid, NULL, stats_dump_thread, NULL) != 0) {
+    printf("Toy ASan: warning - failed to start stats thread\n");
+    return;
+  }
+  pthread_detach(tid);
+}
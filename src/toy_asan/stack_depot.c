@@ -0,0 +1,242 @@
+/**
+ * @file stack_depot.c
+ * @brief Toy AddressSanitizer 调用栈仓库与采集策略
+ *
+ * 分配记录不再内嵌固定长度的帧数组，而是只保存一个32位栈编号。
+ * 相同的调用栈在仓库中只存一份，帧连续存放在只追加的帧区中，
+ * 因此采集深度可以在运行时调大而不增加每条记录的大小。
+ *
+ * 仓库结构：
+ * - 开放寻址哈希表（以hash_stack()为键），编号 = 表下标 + 1，0表示无栈
+ * - 帧区只追加、从不回收，取到的帧指针在进程生命周期内一直有效
+ * - 查找无锁（条目写完后才发布哈希值），插入新栈时持有depot_lock
+ * - 表或帧区满后返回0，调用者按"无调用栈"处理
+ *
+ * 采集策略（TOY_ASAN_OPTIONS）：
+ * - malloc_context_size: 分配栈最大帧数（1..MAX_STACK_DEPTH）
+ * - free_context: 释放时也采集调用栈，用于use-after-free报告
+ * - sample_every: 同一调用点（以调用者PC区分）每N次分配才完整回溯一次，
+ *   其余沿用该调用点最近一次完整回溯的栈编号。调用点统计、泄漏分组和
+ *   报告去重都以栈编号为键，不会因采样把一个调用点拆成两份；代价是同一
+ *   调用者经不同路径的未采样分配记到同一条栈上
+ *
+ * @author Toy ASan Project
+ * @version 1.0
+ */
+
+#include "toy_asan.h"
+#include <stdio.h>
+#include <string.h>
+
+#define DEPOT_TABLE_MASK (STACK_DEPOT_SIZE - 1)
+#define SAMPLE_TABLE_SIZE 4096       // 采样计数表容量（2的幂）
+#define SAMPLE_TABLE_MASK (SAMPLE_TABLE_SIZE - 1)
+
+struct depot_entry {
+  uint64_t hash;             // 0表示空槽位；最后写入，作为发布标志
+  uint32_t offset;           // 帧在depot_frames中的起点
+  uint32_t count;            // 帧数
+};
+
+static struct depot_entry depot_table[STACK_DEPOT_SIZE];
+static void *depot_frames[STACK_DEPOT_FRAMES];
+static uint32_t depot_frames_used;
+static uint32_t depot_stack_count;
+static pthread_mutex_t depot_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// 采样计数：调用者PC → 该调用点的分配次数和最近一次完整回溯的栈编号
+static uintptr_t sample_pcs[SAMPLE_TABLE_SIZE];
+static uint32_t sample_counts[SAMPLE_TABLE_SIZE];
+static uint32_t sample_stack_ids[SAMPLE_TABLE_SIZE];
+
+/**
+ * @brief 计算调用栈哈希（FNV-1a）
+ * @return 非0哈希值（0保留给空槽位）
+ */
+uint64_t hash_stack(void *const *frames, int frame_count) {
+  uint64_t h = 0xcbf29ce484222325ull;
+  for (int i = 0; i < frame_count; i++) {
+    uintptr_t pc = (uintptr_t)frames[i];
+    for (size_t b = 0; b < sizeof(pc); b++) {
+      h ^= (pc >> (b * 8)) & 0xff;
+      h *= 0x100000001b3ull;
+    }
+  }
+  return h ? h : 1;
+}
+
+static bool entry_matches(const struct depot_entry *e, uint64_t hash,
+                          void *const *frames, int frame_count) {
+  return e->hash == hash && e->count == (uint32_t)frame_count &&
+         memcmp(&depot_frames[e->offset], frames, frame_count * sizeof(void *)) == 0;
+}
+
+/**
+ * @brief 在仓库中查找调用栈
+ * @return 栈编号，不存在返回0；*free_index输出探测到的第一个空槽位
+ */
+static uint32_t depot_find(uint64_t hash, void *const *frames, int frame_count,
+                           size_t *free_index) {
+  size_t i = (size_t)(hash ^ (hash >> 32)) & DEPOT_TABLE_MASK;
+  for (size_t probe = 0; probe < STACK_DEPOT_SIZE; probe++) {
+    struct depot_entry *e = &depot_table[i];
+    uint64_t key = __atomic_load_n(&e->hash, __ATOMIC_ACQUIRE);
+    if (key == 0) {
+      *free_index = i;
+      return 0;
+    }
+    if (entry_matches(e, hash, frames, frame_count)) {
+      return (uint32_t)i + 1;
+    }
+    i = (i + 1) & DEPOT_TABLE_MASK;
+  }
+  *free_index = STACK_DEPOT_SIZE; // 表满
+  return 0;
+}
+
+/**
+ * @brief 存入调用栈（已存在时直接返回原编号）
+ * @param frames 帧数组
+ * @param frame_count 帧数
+ * @return 栈编号，frame_count为0或仓库已满时返回0
+ */
+uint32_t stack_depot_put(void *const *frames, int frame_count) {
+  if (frame_count <= 0) {
+    return 0;
+  }
+  uint64_t hash = hash_stack(frames, frame_count);
+  size_t free_index;
+
+  // 快速路径：常见调用栈早已在仓库中，无锁命中
+  uint32_t id = depot_find(hash, frames, frame_count, &free_index);
+  if (id != 0) {
+    return id;
+  }
+
+  pthread_mutex_lock(&depot_lock);
+  // 持锁重查：等锁期间其他线程可能已插入同一个栈
+  id = depot_find(hash, frames, frame_count, &free_index);
+  if (id == 0 && free_index < STACK_DEPOT_SIZE &&
+      depot_frames_used + (uint32_t)frame_count <= STACK_DEPOT_FRAMES) {
+    struct depot_entry *e = &depot_table[free_index];
+    memcpy(&depot_frames[depot_frames_used], frames, frame_count * sizeof(void *));
+    e->offset = depot_frames_used;
+    e->count = (uint32_t)frame_count;
+    depot_frames_used += (uint32_t)frame_count;
+    __atomic_store_n(&depot_stack_count, depot_stack_count + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&e->hash, hash, __ATOMIC_RELEASE);
+    id = (uint32_t)free_index + 1;
+  }
+  pthread_mutex_unlock(&depot_lock);
+  return id;
+}
+
+/**
+ * @brief 取出调用栈
+ * @param id stack_depot_put()返回的编号
+ * @param frames 输出：指向仓库内帧数组（只读，长期有效）
+ * @return 帧数，编号无效返回0
+ *
+ * 无锁、不分配内存，信号处理器中也可以调用。
+ */
+int stack_depot_get(uint32_t id, void *const **frames) {
+  if (id == 0 || id > STACK_DEPOT_SIZE) {
+    *frames = NULL;
+    return 0;
+  }
+  struct depot_entry *e = &depot_table[id - 1];
+  if (__atomic_load_n(&e->hash, __ATOMIC_ACQUIRE) == 0) {
+    *frames = NULL;
+    return 0;
+  }
+  *frames = &depot_frames[e->offset];
+  return (int)e->count;
+}
+
+/**
+ * @brief 校正采集策略选项
+ *
+ * 在parse_toy_asan_options()之后调用，超出范围的值夹到合法区间。
+ */
+void stack_capture_init(void) {
+  if (toy_asan_flags.malloc_context_size < 1) {
+    toy_asan_flags.malloc_context_size = 1;
+  } else if (toy_asan_flags.malloc_context_size > MAX_STACK_DEPTH) {
+    toy_asan_flags.malloc_context_size = MAX_STACK_DEPTH;
+  }
+  if (toy_asan_flags.sample_every < 1) {
+    toy_asan_flags.sample_every = 1;
+  }
+}
+
+// 调用者PC在采样表中的下标（不存在时插入），表满时返回-1
+static int sample_slot(uintptr_t pc) {
+  size_t i = (size_t)((pc * 0x9e3779b97f4a7c15ull) >> 32) & SAMPLE_TABLE_MASK;
+  for (size_t probe = 0; probe < SAMPLE_TABLE_SIZE; probe++) {
+    uintptr_t key = __atomic_load_n(&sample_pcs[i], __ATOMIC_ACQUIRE);
+    if (key == 0) {
+      uintptr_t expected = 0;
+      if (!__atomic_compare_exchange_n(&sample_pcs[i], &expected, pc, false,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        key = expected;
+      } else {
+        key = pc;
+      }
+    }
+    if (key == pc) {
+      return (int)i;
+    }
+    i = (i + 1) & SAMPLE_TABLE_MASK;
+  }
+  return -1;
+}
+
+/**
+ * @brief 未被采样的分配沿用调用点最近一次完整回溯的栈
+ * @param caller 分配函数的调用者PC，用来区分调用点
+ * @return 栈编号；0表示本次需要完整回溯（之后调用record_sampled_alloc_stack）
+ *
+ * 每个调用点的第1、N+1、2N+1…次分配会被采样；调用点还没有完整的栈
+ * （例如并发的第一次回溯尚未完成）时也回溯。
+ * 计数表满后新调用点一律采样，宁可多花开销也不丢栈。
+ */
+uint32_t sampled_alloc_stack(void *caller) {
+  int every = toy_asan_flags.sample_every;
+  if (every <= 1) {
+    return 0;
+  }
+  int i = sample_slot((uintptr_t)caller);
+  if (i < 0) {
+    return 0;
+  }
+  uint32_t n = __atomic_fetch_add(&sample_counts[i], 1, __ATOMIC_RELAXED);
+  if (n % (uint32_t)every == 0) {
+    return 0;
+  }
+  return __atomic_load_n(&sample_stack_ids[i], __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief 记下调用点完整回溯得到的栈，供之后未被采样的分配沿用
+ */
+void record_sampled_alloc_stack(void *caller, uint32_t stack_id) {
+  if (toy_asan_flags.sample_every <= 1 || stack_id == 0) {
+    return;
+  }
+  int i = sample_slot((uintptr_t)caller);
+  if (i >= 0) {
+    __atomic_store_n(&sample_stack_ids[i], stack_id, __ATOMIC_RELEASE);
+  }
+}
+
+/**
+ * @brief 打印当前采集策略和仓库占用（统计输出的头部）
+ */
+void print_stack_capture_policy(void) {
+  printf("Stack capture: unwinder=%s, malloc_context_size=%d, free_context=%d, "
+         "sample_every=%d; depot %u stacks / %u frames\n",
+         unwinder_name(current_unwinder()), toy_asan_flags.malloc_context_size,
+         toy_asan_flags.free_context, toy_asan_flags.sample_every,
+         __atomic_load_n(&depot_stack_count, __ATOMIC_RELAXED),
+         __atomic_load_n(&depot_frames_used, __ATOMIC_RELAXED));
+}
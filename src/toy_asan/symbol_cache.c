@@ -0,0 +1,158 @@
+/**
+ * @file symbol_cache.c
+ * @brief Toy AddressSanitizer PC → 符号缓存
+ *
+ * 报告和泄漏分组里反复出现相同的返回地址（main、toy_malloc的调用者等），
+ * 每次都重新走进程内符号化器或外部符号化进程是浪费。本文件在
+ * resolve_symbols()之前加一层缓存，保存格式化好的"函数 (文件:行)"。
+ *
+ * 结构：
+ * - SYMBOL_CACHE_SETS组 × SYMBOL_CACHE_WAYS路的组相联表，静态分配，
+ *   查找和插入都不调用malloc，崩溃路径上也可以使用
+ * - 组内按最近使用时间淘汰
+ * - 只缓存解析成功的结果；超时或解析失败的地址下次仍会重试
+ * - 模块表重建（dlopen/dlclose）后整表清空，同一PC可能已属于别的模块
+ *
+ * 统计：命中、未命中、插入、淘汰次数，toy_asan_get_symbol_cache_stats()读取。
+ *
+ * @author Toy ASan Project
+ * @version 1.0
+ */
+
+#include "toy_asan.h"
+#include <stdio.h>
+#include <string.h>
+
+#define SYMBOL_CACHE_SETS 256        // 组数（2的幂）
+#define SYMBOL_CACHE_WAYS 4          // 每组路数
+
+struct symbol_cache_entry {
+  uintptr_t pc;                // 0表示空
+  uint64_t last_used;          // 最近使用时刻（cache_tick）
+  char symbol[SYMBOL_MAX];
+};
+
+static struct symbol_cache_entry cache[SYMBOL_CACHE_SETS][SYMBOL_CACHE_WAYS];
+static uint64_t cache_tick;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t cache_hits;
+static uint64_t cache_misses;
+static uint64_t cache_insertions;
+static uint64_t cache_evictions;
+
+static struct symbol_cache_entry *cache_set(uintptr_t pc) {
+  size_t set = (size_t)((pc * 0x9e3779b97f4a7c15ull) >> 32) & (SYMBOL_CACHE_SETS - 1);
+  return cache[set];
+}
+
+// 需持有cache_lock；复制不经过stdio，信号处理器中也可以调用
+static bool lookup_locked(uintptr_t pc, char *output, size_t output_size) {
+  struct symbol_cache_entry *set = cache_set(pc);
+  for (int way = 0; way < SYMBOL_CACHE_WAYS; way++) {
+    if (pc != 0 && set[way].pc == pc) {
+      set[way].last_used = ++cache_tick;
+      report_snprintf(output, output_size, "%s", set[way].symbol);
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief 查找缓存
+ * @param pc 运行时地址
+ * @param output 命中时写入符号
+ * @param output_size 输出缓冲区大小
+ * @return true命中
+ */
+bool symbol_cache_lookup(uintptr_t pc, char *output, size_t output_size) {
+  pthread_mutex_lock(&cache_lock);
+  bool hit = lookup_locked(pc, output, output_size);
+  pthread_mutex_unlock(&cache_lock);
+  __atomic_fetch_add(hit ? &cache_hits : &cache_misses, 1, __ATOMIC_RELAXED);
+  return hit;
+}
+
+/**
+ * @brief 信号处理器中的查找：锁被占用时直接视为未命中
+ *
+ * 出错线程可能正持有cache_lock（在符号化途中出错），不能阻塞等待。
+ */
+bool symbol_cache_try_lookup(uintptr_t pc, char *output, size_t output_size) {
+  if (pthread_mutex_trylock(&cache_lock) != 0) {
+    return false;
+  }
+  bool hit = lookup_locked(pc, output, output_size);
+  pthread_mutex_unlock(&cache_lock);
+  __atomic_fetch_add(hit ? &cache_hits : &cache_misses, 1, __ATOMIC_RELAXED);
+  return hit;
+}
+
+/**
+ * @brief 插入解析成功的符号，组满时淘汰最久未用的一路
+ */
+void symbol_cache_insert(uintptr_t pc, const char *symbol) {
+  if (pc == 0) {
+    return;
+  }
+  pthread_mutex_lock(&cache_lock);
+  struct symbol_cache_entry *set = cache_set(pc);
+  struct symbol_cache_entry *victim = &set[0];
+  for (int way = 0; way < SYMBOL_CACHE_WAYS; way++) {
+    if (set[way].pc == pc || set[way].pc == 0) {
+      victim = &set[way];
+      break;
+    }
+    if (set[way].last_used < victim->last_used) {
+      victim = &set[way];
+    }
+  }
+  if (victim->pc != 0 && victim->pc != pc) {
+    cache_evictions++;
+  }
+  if (victim->pc != pc) {
+    cache_insertions++;
+  }
+  victim->pc = pc;
+  victim->last_used = ++cache_tick;
+  snprintf(victim->symbol, sizeof(victim->symbol), "%s", symbol);
+  pthread_mutex_unlock(&cache_lock);
+}
+
+/**
+ * @brief 清空缓存（模块表重建后调用），统计计数保留
+ */
+void symbol_cache_clear(void) {
+  pthread_mutex_lock(&cache_lock);
+  for (int set = 0; set < SYMBOL_CACHE_SETS; set++) {
+    for (int way = 0; way < SYMBOL_CACHE_WAYS; way++) {
+      cache[set][way].pc = 0;
+    }
+  }
+  pthread_mutex_unlock(&cache_lock);
+}
+
+/**
+ * @brief 读取缓存统计
+ * @param out 输出
+ */
+void toy_asan_get_symbol_cache_stats(struct toy_asan_symbol_cache_stats *out) {
+  memset(out, 0, sizeof(*out));
+  out->capacity = SYMBOL_CACHE_SETS * SYMBOL_CACHE_WAYS;
+
+  pthread_mutex_lock(&cache_lock);
+  for (int set = 0; set < SYMBOL_CACHE_SETS; set++) {
+    for (int way = 0; way < SYMBOL_CACHE_WAYS; way++) {
+      if (cache[set][way].pc != 0) {
+        out->entries++;
+      }
+    }
+  }
+  out->insertions = cache_insertions;
+  out->evictions = cache_evictions;
+  pthread_mutex_unlock(&cache_lock);
+
+  out->hits = __atomic_load_n(&cache_hits, __ATOMIC_RELAXED);
+  out->misses = __atomic_load_n(&cache_misses, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,346 @@
+/**
+ * @file symbol_disk_cache.c
+ * @brief 持久化符号缓存的读写（格式见symbol_disk_cache.h）
+ *
+ * 打开时mmap整个文件、校验每条记录并建立按偏移排序的索引，
+ * 之后的查找只是一次二分。新的解析结果先暂存在内存里，
+ * 每批符号化结束时用一次O_APPEND write()追加，多个进程同时
+ * 追加同一个文件是安全的。
+ *
+ * 打开、查找、编码和symbol_disk_cache_append()只用系统调用和
+ * 调用者给的allocator，信号处理器中可用；暂存/flush带锁，不可用。
+ *
+ * @author Toy ASan Project
+ * @version 1.0
+ */
+
+#include "symbol_disk_cache.h"
+#include "symbolizer_alloc.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// 索引中的一条记录（字段已从可能不对齐的记录中复制出来）
+struct cache_slot {
+  uint64_t offset;
+  unsigned line;
+  const char *function;
+  const char *file;
+};
+
+struct symbol_disk_cache {
+  const struct symbolizer_allocator *alloc;  // NULL表示malloc
+  int fd;                       // O_APPEND打开
+  const uint8_t *map;
+  size_t map_size;
+  struct cache_slot *slots;     // 按offset升序
+  size_t slot_count;
+
+  pthread_mutex_t pending_lock;
+  char *pending;                // 待追加的记录
+  size_t pending_size;
+  size_t pending_cap;
+};
+
+static uint32_t fnv1a(uint32_t hash, const void *data, size_t size) {
+  const uint8_t *p = data;
+  for (size_t i = 0; i < size; i++) {
+    hash = (hash ^ p[i]) * 16777619u;
+  }
+  return hash;
+}
+
+// 记录的校验和：checksum字段按0计算
+static uint32_t record_checksum(const struct symbol_disk_cache_record *rec,
+                                const void *names, size_t names_size) {
+  struct symbol_disk_cache_record copy = *rec;
+  copy.checksum = 0;
+  uint32_t hash = fnv1a(2166136261u, &copy, sizeof(copy));
+  return fnv1a(hash, names, names_size);
+}
+
+static size_t record_size(size_t function_len, size_t file_len) {
+  size_t size = sizeof(struct symbol_disk_cache_record) + function_len + 1 + file_len + 1;
+  return (size + 7) & ~(size_t)7;
+}
+
+/**
+ * @brief 尝试在pos处解析一条完整记录
+ * @return 记录字节数，不是有效记录时返回0
+ */
+static size_t parse_record(const uint8_t *pos, const uint8_t *end, struct cache_slot *slot) {
+  struct symbol_disk_cache_record rec;
+  if ((size_t)(end - pos) < sizeof(rec)) {
+    return 0;
+  }
+  memcpy(&rec, pos, sizeof(rec));
+  if (rec.magic != SYMBOL_DISK_CACHE_RECORD_MAGIC || rec.function_len == 0 ||
+      rec.size != record_size(rec.function_len, rec.file_len) ||
+      rec.size > (size_t)(end - pos)) {
+    return 0;
+  }
+  const char *function = (const char *)pos + sizeof(rec);
+  const char *file = function + rec.function_len + 1;
+  if (function[rec.function_len] != '\0' || file[rec.file_len] != '\0' ||
+      record_checksum(&rec, function, rec.size - sizeof(rec)) != rec.checksum) {
+    return 0;
+  }
+  slot->offset = rec.offset;
+  slot->line = rec.line;
+  slot->function = function;
+  slot->file = rec.file_len ? file : NULL;
+  return rec.size;
+}
+
+static int compare_slots(const void *a, const void *b) {
+  const struct cache_slot *sa = a;
+  const struct cache_slot *sb = b;
+  if (sa->offset != sb->offset) {
+    return sa->offset < sb->offset ? -1 : 1;
+  }
+  return 0;
+}
+
+// 扫描全部记录建立索引；残缺的记录逐字节跳过，直到下一个有效记录
+static bool build_slots(struct symbol_disk_cache *cache) {
+  const uint8_t *pos = cache->map + sizeof(struct symbol_disk_cache_header);
+  const uint8_t *end = cache->map + cache->map_size;
+  size_t cap = 0;
+  while (pos < end) {
+    struct cache_slot slot;
+    size_t size = parse_record(pos, end, &slot);
+    if (size == 0) {
+      pos++;
+      continue;
+    }
+    if (cache->slot_count == cap) {
+      cap = cap ? 2 * cap : 256;
+      struct cache_slot *slots = symbolizer_realloc(cache->alloc, cache->slots,
+                                                    cache->slot_count * sizeof(*slots),
+                                                    cap * sizeof(*slots));
+      if (!slots) {
+        return false;
+      }
+      cache->slots = slots;
+    }
+    cache->slots[cache->slot_count++] = slot;
+    pos += size;
+  }
+  symbolizer_sort(cache->alloc, cache->slots, cache->slot_count, sizeof(*cache->slots),
+                  compare_slots);
+  return true;
+}
+
+// 在临时文件中写好文件头再link()到正式名；别的进程抢先创建时用对方的
+static int create_cache_file(const char *path, const uint8_t *build_id,
+                             size_t build_id_size) {
+  char pid[24];
+  char *p = pid + sizeof(pid) - 1;
+  *p = '\0';
+  for (unsigned long v = (unsigned long)getpid(); p == pid + sizeof(pid) - 1 || v; v /= 10) {
+    *--p = (char)('0' + v % 10);
+  }
+  char tmp[4096];
+  const char *parts[] = {path, ".tmp.", p, NULL};
+  if (!symbolizer_concat(tmp, sizeof(tmp), parts)) {
+    return -1;
+  }
+  int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return -1;
+  }
+  struct symbol_disk_cache_header hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, SYMBOL_DISK_CACHE_MAGIC, sizeof(SYMBOL_DISK_CACHE_MAGIC));
+  hdr.version = SYMBOL_DISK_CACHE_VERSION;
+  hdr.build_id_size = (uint32_t)build_id_size;
+  memcpy(hdr.build_id, build_id, build_id_size);
+  bool ok = write(fd, &hdr, sizeof(hdr)) == (ssize_t)sizeof(hdr);
+  close(fd);
+  int ret = ok && (link(tmp, path) == 0 || errno == EEXIST) ? 0 : -1;
+  unlink(tmp);
+  return ret;
+}
+
+struct symbol_disk_cache *symbol_disk_cache_open(const char *dir, const uint8_t *build_id,
+                                                 size_t build_id_size,
+                                                 const struct symbolizer_allocator *alloc) {
+  if (build_id_size == 0 || build_id_size > SYMBOL_DISK_CACHE_MAX_BUILD_ID) {
+    return NULL;
+  }
+  char hex[2 * SYMBOL_DISK_CACHE_MAX_BUILD_ID + 1];
+  symbolizer_hex(hex, sizeof(hex), build_id, build_id_size);
+  char path[4096];
+  const char *parts[] = {dir, "/", hex, SYMBOL_DISK_CACHE_SUFFIX, NULL};
+  if (!symbolizer_concat(path, sizeof(path), parts)) {
+    return NULL;
+  }
+
+  int fd = open(path, O_RDWR | O_APPEND | O_CLOEXEC);
+  if (fd < 0 && errno == ENOENT) {
+    mkdir(dir, 0755);  // 已存在时失败，忽略
+    if (create_cache_file(path, build_id, build_id_size) == 0) {
+      fd = open(path, O_RDWR | O_APPEND | O_CLOEXEC);
+    }
+  }
+  if (fd < 0) {
+    return NULL;
+  }
+
+  struct stat st;
+  void *map = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(struct symbol_disk_cache_header)) {
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  if (map == MAP_FAILED) {
+    close(fd);
+    return NULL;
+  }
+  const struct symbol_disk_cache_header *hdr = map;
+  if (memcmp(hdr->magic, SYMBOL_DISK_CACHE_MAGIC, sizeof(SYMBOL_DISK_CACHE_MAGIC)) != 0 ||
+      hdr->version != SYMBOL_DISK_CACHE_VERSION || hdr->build_id_size != build_id_size ||
+      memcmp(hdr->build_id, build_id, build_id_size) != 0) {
+    munmap(map, (size_t)st.st_size);
+    close(fd);
+    return NULL;
+  }
+
+  struct symbol_disk_cache *cache = symbolizer_calloc(alloc, 1, sizeof(*cache));
+  if (!cache) {
+    munmap(map, (size_t)st.st_size);
+    close(fd);
+    return NULL;
+  }
+  cache->alloc = alloc;
+  cache->fd = fd;
+  cache->map = map;
+  cache->map_size = (size_t)st.st_size;
+  pthread_mutex_init(&cache->pending_lock, NULL);
+  if (!build_slots(cache)) {
+    symbol_disk_cache_close(cache);
+    return NULL;
+  }
+  return cache;
+}
+
+void symbol_disk_cache_close(struct symbol_disk_cache *cache) {
+  if (!cache) {
+    return;
+  }
+  symbol_disk_cache_flush(cache);
+  munmap((void *)cache->map, cache->map_size);
+  close(cache->fd);
+  pthread_mutex_destroy(&cache->pending_lock);
+  symbolizer_free(cache->alloc, cache->pending);
+  symbolizer_free(cache->alloc, cache->slots);
+  symbolizer_free(cache->alloc, cache);
+}
+
+bool symbol_disk_cache_lookup(const struct symbol_disk_cache *cache, uint64_t offset,
+                              struct symbol_disk_cache_entry *out) {
+  size_t lo = 0, hi = cache->slot_count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (cache->slots[mid].offset < offset) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo == cache->slot_count || cache->slots[lo].offset != offset) {
+    return false;
+  }
+  out->function = cache->slots[lo].function;
+  out->file = cache->slots[lo].file;
+  out->line = cache->slots[lo].line;
+  return true;
+}
+
+// 一条记录的字节数，名字过长或函数名为空时返回0
+static size_t encoded_size(const char *function, const char *file) {
+  size_t function_len = strlen(function);
+  size_t file_len = file ? strlen(file) : 0;
+  if (function_len == 0 || function_len > UINT16_MAX || file_len > UINT16_MAX) {
+    return 0;
+  }
+  return record_size(function_len, file_len);
+}
+
+size_t symbol_disk_cache_encode(void *dst, size_t room, uint64_t offset, const char *function,
+                                const char *file, unsigned line) {
+  size_t size = encoded_size(function, file);
+  if (size == 0 || size > room) {
+    return 0;
+  }
+  struct symbol_disk_cache_record rec;
+  memset(&rec, 0, sizeof(rec));
+  rec.magic = SYMBOL_DISK_CACHE_RECORD_MAGIC;
+  rec.size = (uint32_t)size;
+  rec.offset = offset;
+  rec.line = file ? line : 0;
+  rec.function_len = (uint16_t)strlen(function);
+  rec.file_len = (uint16_t)(file ? strlen(file) : 0);
+
+  char *names = (char *)dst + sizeof(rec);
+  memset(names, 0, size - sizeof(rec));
+  memcpy(names, function, rec.function_len);
+  if (rec.file_len) {
+    memcpy(names + rec.function_len + 1, file, rec.file_len);
+  }
+  rec.checksum = record_checksum(&rec, names, size - sizeof(rec));
+  memcpy(dst, &rec, sizeof(rec));
+  return size;
+}
+
+void symbol_disk_cache_add(struct symbol_disk_cache *cache, uint64_t offset,
+                           const char *function, const char *file, unsigned line) {
+  size_t size = encoded_size(function, file);
+  if (size == 0) {
+    return;
+  }
+  pthread_mutex_lock(&cache->pending_lock);
+  if (cache->pending_size + size > cache->pending_cap) {
+    size_t cap = cache->pending_cap ? 2 * cache->pending_cap : 4096;
+    while (cap < cache->pending_size + size) {
+      cap *= 2;
+    }
+    char *pending = symbolizer_realloc(cache->alloc, cache->pending, cache->pending_size, cap);
+    if (!pending) {
+      pthread_mutex_unlock(&cache->pending_lock);
+      return;
+    }
+    cache->pending = pending;
+    cache->pending_cap = cap;
+  }
+  cache->pending_size += symbol_disk_cache_encode(cache->pending + cache->pending_size, size,
+                                                  offset, function, file, line);
+  pthread_mutex_unlock(&cache->pending_lock);
+}
+
+int symbol_disk_cache_append(struct symbol_disk_cache *cache, const void *records,
+                             size_t size) {
+  if (size == 0) {
+    return 0;
+  }
+  // 与flush相同：O_APPEND的一次write()不与其他进程的追加交错
+  ssize_t n = write(cache->fd, records, size);
+  return n == (ssize_t)size ? 0 : -1;
+}
+
+int symbol_disk_cache_flush(struct symbol_disk_cache *cache) {
+  pthread_mutex_lock(&cache->pending_lock);
+  int ret = 0;
+  if (cache->pending_size > 0) {
+    // 一次write()：O_APPEND保证整批落在文件末尾，不与其他进程的追加交错
+    ssize_t n = write(cache->fd, cache->pending, cache->pending_size);
+    ret = n == (ssize_t)cache->pending_size ? 0 : -1;
+    cache->pending_size = 0;
+  }
+  pthread_mutex_unlock(&cache->pending_lock);
+  return ret;
+}
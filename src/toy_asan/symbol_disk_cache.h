@@ -0,0 +1,131 @@
+/**
+ * @file symbol_disk_cache.h
+ * @brief 持久化符号缓存（按build-id + 偏移）
+ *
+ * 同一个二进制每天重启成千上万次，每次崩溃都从头符号化同样的地址。
+ * 持久化缓存把解析结果按模块build-id存到目录下的
+ * "<build-id十六进制>.symcache"，以后的进程（以及离线工具
+ * toy_asan_symbolize）命中时完全跳过符号化，连模块文件都不打开。
+ * 所有字段均为本机字节序。
+ *
+ * 文件布局（只追加）：
+ * ┌──────────────────────────────────────┐
+ * │ symbol_disk_cache_header             │ ← 建文件时一次写好
+ * ├──────────────────────────────────────┤
+ * │ 记录：symbol_disk_cache_record       │
+ * │       + 函数名'\0' + 文件名'\0'       │ ← 8字节对齐
+ * ├──────────────────────────────────────┤
+ * │ 记录 ...                             │
+ * └──────────────────────────────────────┘
+ *
+ * 并发：
+ * - 文件先在临时名下写好文件头再link()到正式名，读者不会看到半个文件头
+ * - 追加用O_APPEND，一批记录一次write()，多个进程同时追加也不会交错
+ * - 每条记录带校验和；进程在write()中途被杀留下的残缺记录被跳过，
+ *   之后的记录按记录标记重新同步
+ * - 同一偏移可能被不同进程各写一次，内容相同，读时取任意一条
+ *
+ * 运行时库与离线工具共用，只依赖libc。
+ *
+ * @author Toy ASan Project
+ * @version 1.0
+ */
+
+#ifndef TOY_ASAN_SYMBOL_DISK_CACHE_H
+#define TOY_ASAN_SYMBOL_DISK_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SYMBOL_DISK_CACHE_MAGIC "TOYSYMC"
+#define SYMBOL_DISK_CACHE_VERSION 1
+#define SYMBOL_DISK_CACHE_SUFFIX ".symcache"
+#define SYMBOL_DISK_CACHE_RECORD_MAGIC 0x52435354u  // "TSCR"
+#define SYMBOL_DISK_CACHE_MAX_BUILD_ID 32
+
+// 文件头
+struct symbol_disk_cache_header {
+  char magic[8];             // "TOYSYMC\0"
+  uint32_t version;          // SYMBOL_DISK_CACHE_VERSION
+  uint32_t build_id_size;
+  uint8_t build_id[SYMBOL_DISK_CACHE_MAX_BUILD_ID];
+};
+
+// 一条记录的固定部分，后跟函数名和文件名
+struct symbol_disk_cache_record {
+  uint32_t magic;            // SYMBOL_DISK_CACHE_RECORD_MAGIC
+  uint32_t size;             // 整条记录字节数（含名字和填充）
+  uint64_t offset;           // 链接时地址（运行时PC - 加载偏移）
+  uint32_t line;             // 行号，0表示未知
+  uint16_t function_len;     // 函数名长度（不含'\0'）
+  uint16_t file_len;         // 文件名长度，0表示没有行号信息
+  uint32_t checksum;         // 除本字段外整条记录的FNV-1a
+  uint32_t reserved;
+};
+
+// 查找结果，字符串指向缓存的mmap区域，随symbol_disk_cache_close失效
+struct symbol_disk_cache_entry {
+  const char *function;
+  const char *file;          // 没有行号信息时为NULL
+  unsigned line;
+};
+
+struct symbol_disk_cache;
+struct symbolizer_allocator;
+
+/**
+ * @brief 打开（必要时创建）模块的持久化缓存
+ * @param dir 缓存目录，不存在时创建
+ * @param build_id 模块build-id，没有build-id的模块不缓存
+ * @param alloc 索引和暂存区的内存来源，NULL表示malloc（见symbolizer_alloc.h）
+ * @return 缓存，目录不可写、文件损坏或build-id不一致时返回NULL
+ *
+ * 打开时读入已有记录并按偏移排序，其他进程之后追加的记录
+ * 下次打开时可见。alloc不调用malloc时可以在信号处理器中打开。
+ */
+struct symbol_disk_cache *symbol_disk_cache_open(const char *dir, const uint8_t *build_id,
+                                                 size_t build_id_size,
+                                                 const struct symbolizer_allocator *alloc);
+void symbol_disk_cache_close(struct symbol_disk_cache *cache);
+
+/**
+ * @brief 按偏移查找，O(log n)
+ * @return true命中
+ */
+bool symbol_disk_cache_lookup(const struct symbol_disk_cache *cache, uint64_t offset,
+                              struct symbol_disk_cache_entry *out);
+
+/**
+ * @brief 暂存一条解析结果，symbol_disk_cache_flush()时一次写入
+ * @param file 源文件，没有行号信息时为NULL
+ *
+ * 线程安全；暂存的记录不参与本进程的查找（本进程有PC缓存）。
+ */
+void symbol_disk_cache_add(struct symbol_disk_cache *cache, uint64_t offset,
+                           const char *function, const char *file, unsigned line);
+
+/**
+ * @brief 把一条记录编码到调用者的缓冲区（不分配内存，信号处理器中可用）
+ * @param room dst剩余的字节数
+ * @return 记录字节数，放不下或函数名为空时返回0
+ */
+size_t symbol_disk_cache_encode(void *dst, size_t room, uint64_t offset, const char *function,
+                                const char *file, unsigned line);
+
+/**
+ * @brief 把symbol_disk_cache_encode()编好的一批记录用一次write()追加
+ * @return 0成功，-1写入失败
+ *
+ * 不经过暂存区、不加锁，信号处理器中可用。
+ */
+int symbol_disk_cache_append(struct symbol_disk_cache *cache, const void *records,
+                             size_t size);
+
+/**
+ * @brief 把暂存的记录用一次O_APPEND write()追加到文件
+ * @return 0成功，-1写入失败（暂存的记录丢弃）
+ */
+int symbol_disk_cache_flush(struct symbol_disk_cache *cache);
+
+#endif // TOY_ASAN_SYMBOL_DISK_CACHE_H
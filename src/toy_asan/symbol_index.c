@@ -0,0 +1,145 @@
+/**
+ * @file symbol_index.c
+ * @brief Toy AddressSanitizer 构建期符号索引（运行时读取）
+ *
+ * 模块被strip、进程内ELF符号化器找不到函数名时，查找构建时
+ * 生成的旁路文件"<模块路径>.symidx"（格式见symbol_index.h）：
+ * - 整个文件只读mmap，不解析DWARF，不分配索引内容
+ * - 条目按地址排序，每次查找一次二分，O(log n)
+ * - 文件头中的build-id必须与已加载模块一致，否则忽略该索引
+ *
+ * @author Toy ASan Project
+ * @version 1.0
+ */
+
+#include "toy_asan.h"
+#include "symbol_index.h"
+#include "symbolizer_alloc.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct symbol_index {
+  const uint8_t *map;
+  size_t size;
+  const struct symbol_index_entry *entries;
+  uint64_t entry_count;
+  const char *strtab;
+  uint64_t strtab_size;
+};
+
+// 校验文件头和各段长度
+static bool index_valid(const uint8_t *map, size_t size) {
+  if (size < sizeof(struct symbol_index_header)) {
+    return false;
+  }
+  const struct symbol_index_header *h = (const struct symbol_index_header *)map;
+  if (memcmp(h->magic, SYMBOL_INDEX_MAGIC, sizeof(SYMBOL_INDEX_MAGIC)) != 0 ||
+      h->version != SYMBOL_INDEX_VERSION ||
+      h->build_id_size > SYMBOL_INDEX_MAX_BUILD_ID) {
+    return false;
+  }
+  uint64_t body = size - sizeof(*h);
+  if (h->entry_count > body / sizeof(struct symbol_index_entry)) {
+    return false;
+  }
+  return h->strtab_size == body - h->entry_count * sizeof(struct symbol_index_entry);
+}
+
+/**
+ * @brief 打开模块的符号索引
+ * @param module_path 模块路径，索引位于module_path + ".symidx"
+ * @param build_id 已加载模块的build-id
+ * @param build_id_size build-id字节数，0表示模块没有build-id（不使用索引）
+ * @param alloc 句柄的内存来源，NULL表示malloc。非NULL（信号处理器中）时
+ *              不经stdio打印警告，无效的索引只返回NULL
+ * @return 索引，不存在、格式错误或build-id不一致时返回NULL
+ */
+struct symbol_index *symbol_index_open(const char *module_path, const uint8_t *build_id,
+                                       size_t build_id_size,
+                                       const struct symbolizer_allocator *alloc) {
+  if (build_id_size == 0) {
+    return NULL;
+  }
+  char path[4096];
+  const char *parts[] = {module_path, SYMBOL_INDEX_SUFFIX, NULL};
+  if (!symbolizer_concat(path, sizeof(path), parts)) {
+    return NULL;
+  }
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return NULL;
+  }
+  struct stat st;
+  void *map = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (map == MAP_FAILED) {
+    return NULL;
+  }
+
+  const struct symbol_index_header *h = map;
+  if (!index_valid(map, (size_t)st.st_size)) {
+    if (!alloc) {
+      printf("Toy ASan: warning - %s is not a valid symbol index, ignored\n", path);
+    }
+    munmap(map, (size_t)st.st_size);
+    return NULL;
+  }
+  if (h->build_id_size != build_id_size ||
+      memcmp(h->build_id, build_id, build_id_size) != 0) {
+    if (!alloc) {
+      printf("Toy ASan: warning - %s was built for a different build-id, ignored\n", path);
+    }
+    munmap(map, (size_t)st.st_size);
+    return NULL;
+  }
+
+  struct symbol_index *idx = symbolizer_malloc(alloc, sizeof(*idx));
+  if (!idx) {
+    munmap(map, (size_t)st.st_size);
+    return NULL;
+  }
+  idx->map = map;
+  idx->size = (size_t)st.st_size;
+  idx->entries = (const struct symbol_index_entry *)(idx->map + sizeof(*h));
+  idx->entry_count = h->entry_count;
+  idx->strtab = (const char *)(idx->entries + h->entry_count);
+  idx->strtab_size = h->strtab_size;
+  return idx;
+}
+
+/**
+ * @brief 查找链接时地址所在的函数
+ * @param idx symbol_index_open()返回的索引
+ * @param vaddr 链接时地址（PC - 加载偏移）
+ * @param offset 输出：地址相对函数起点的偏移
+ * @return 函数名（指向mmap区域），未找到返回NULL
+ */
+const char *symbol_index_lookup(const struct symbol_index *idx, uint64_t vaddr,
+                                uint64_t *offset) {
+  uint64_t lo = 0, hi = idx->entry_count;
+  while (lo < hi) {
+    uint64_t mid = lo + (hi - lo) / 2;
+    if (idx->entries[mid].addr <= vaddr) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo == 0) {
+    return NULL;
+  }
+  const struct symbol_index_entry *e = &idx->entries[lo - 1];
+  if ((e->size != 0 && vaddr >= e->addr + e->size) || e->name_offset >= idx->strtab_size) {
+    return NULL;
+  }
+  *offset = vaddr - e->addr;
+  return idx->strtab + e->name_offset;
+}
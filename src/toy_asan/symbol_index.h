@@ -0,0 +1,52 @@
+/**
+ * @file symbol_index.h
+ * @brief Toy AddressSanitizer 构建期符号索引格式定义
+ *
+ * 发布的二进制通常被strip，运行时既没有.symtab也没有DWARF。
+ * 构建时由toy_asan_symindex从未strip的可执行文件提取函数表，
+ * 写成旁路文件"<可执行文件>.symidx"，运行时mmap后二分查找。
+ * 所有字段均为本机字节序。
+ *
+ * 文件布局：
+ * ┌──────────────────────────────────────┐
+ * │ symbol_index_header                  │
+ * ├──────────────────────────────────────┤
+ * │ symbol_index_entry × entry_count     │ ← 按addr升序
+ * ├──────────────────────────────────────┤
+ * │ 字符串表（strtab_size字节）           │ ← 以'\0'结尾的函数名
+ * └──────────────────────────────────────┘
+ *
+ * 索引只对build-id相同的二进制有效；strip不改变build-id。
+ *
+ * @author Toy ASan Project
+ * @version 1.0
+ */
+
+#ifndef TOY_ASAN_SYMBOL_INDEX_H
+#define TOY_ASAN_SYMBOL_INDEX_H
+
+#include <stdint.h>
+
+#define SYMBOL_INDEX_MAGIC "TOYSYMX"
+#define SYMBOL_INDEX_VERSION 1
+#define SYMBOL_INDEX_SUFFIX ".symidx"
+#define SYMBOL_INDEX_MAX_BUILD_ID 32
+
+// 文件头
+struct symbol_index_header {
+  char magic[8];             // "TOYSYMX\0"
+  uint32_t version;          // SYMBOL_INDEX_VERSION
+  uint32_t build_id_size;    // 生成索引的二进制的build-id字节数
+  uint8_t build_id[SYMBOL_INDEX_MAX_BUILD_ID];
+  uint64_t entry_count;      // 函数条目数
+  uint64_t strtab_size;      // 字符串表字节数
+};
+
+// 一个函数
+struct symbol_index_entry {
+  uint64_t addr;             // 链接时地址（运行时PC - 加载偏移）
+  uint32_t size;             // 函数大小，0表示未知
+  uint32_t name_offset;      // 函数名在字符串表中的偏移
+};
+
+#endif // TOY_ASAN_SYMBOL_INDEX_H
@@ -0,0 +1,787 @@
+/**
+ * @file symbolize.c
+ * @brief Toy AddressSanitizer 批量符号化
+ *
+ * 报告中的所有帧一次交给resolve_symbols()，按以下流程解析：
+ *
+ * 1. PC → 符号缓存：命中的帧直接填好，全部命中时不分配内存
+ * 2. 未命中的帧按PC排序并去重，同一PC只解析一次
+ * 3. 排好序的PC天然按模块分段（模块地址区间互不重叠），
+ *    每段查一次模块表，得到模块内升序的链接时地址
+ * 4. 设置了symbol_cache_dir时先查持久化缓存（build-id + 偏移），
+ *    整个模块都命中时不打开模块文件
+ * 5. 每个模块与其函数表、行表做一次线性归并（elf_symbolize_sorted），
+ *    找不到函数名的再查构建期符号索引；唯一PC很多时各模块并行。
+ *    新结果追加到持久化缓存
+ * 6. 仍未解析的地址一批交给常驻外部符号化进程
+ * 7. 结果写回缓存，再按原顺序分发给每个帧（重复的PC复制第一份结果）
+ *
+ * 泄漏报告可能引用数十万帧，逐帧二分查找加逐帧查模块的代价
+ * 变成排序一次加每模块一次线性扫描。
+ *
+ * symbolize=0时不走上述流程，只输出原始帧（describe_frames_raw）。
+ *
+ * 信号处理器中不能调用malloc，也不能阻塞在别的锁上，因此改用
+ * symbolize_frames_async_safe()：同样先查PC缓存和持久化缓存，
+ * 都未命中时才当场打开模块、解码行号表，内存取自symbolize_prepare()
+ * 在初始化时预留的区域。新解析的结果暂存在静态缓冲区，返回前
+ * 每个缓存文件一次write()追加，下次出错时直接命中，不再打开模块。
+ * 初始化时不打开任何模块文件，没出错的进程不付出符号化的代价。
+ *
+ * @author Toy ASan Project
+ * @version 1.0
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE      // dladdr
+#endif
+
+#include "toy_asan.h"
+#include "elf_symbolizer.h"
+#include "symbol_disk_cache.h"
+#include "symbolizer_alloc.h"
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define BULK_PARALLEL_MIN 1024       // 唯一PC达到该数量才多线程解析
+#define BULK_MAX_THREADS 8
+#define SIGNAL_ARENA_SIZE (256UL << 20)  // 只预留地址空间，用到时才占物理页
+#define SIGNAL_PENDING_MAX 256           // 一次信号路径符号化最多暂存的新结果
+#define SIGNAL_PENDING_BYTES (64 * 1024)
+
+// 每个模块一个进程内符号化器；模块文件在持久化缓存未命中时才打开
+struct module_symbolizer {
+  uintptr_t load_base;
+  char path[256];
+  bool loaded;                  // 已尝试打开sym和index
+  struct elf_symbolizer *sym;   // 打开失败时为NULL，不再重试
+  struct symbol_index *index;   // 构建期符号索引，没有时为NULL
+  struct symbol_disk_cache *disk_cache;  // 持久化缓存，未启用时为NULL
+};
+
+static struct module_symbolizer module_symbolizers[MAX_MODULES];
+static int module_symbolizer_count;
+static pthread_mutex_t module_symbolizer_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// 信号处理器中打开的模块和持久化缓存从这里分配，只分配不释放。
+// 在信号路径打开的缓存之后也会在普通路径上暂存记录，分配因此是原子的
+static char *signal_arena;
+static size_t signal_arena_used;
+
+static void *signal_arena_alloc(void *ctx, size_t size) {
+  (void)ctx;
+  size_t aligned = (size + 15) & ~(size_t)15;
+  size_t offset = __atomic_fetch_add(&signal_arena_used, aligned, __ATOMIC_RELAXED);
+  if (!signal_arena || offset > SIGNAL_ARENA_SIZE || aligned > SIGNAL_ARENA_SIZE - offset) {
+    return NULL;
+  }
+  return signal_arena + offset;
+}
+
+static const struct symbolizer_allocator signal_allocator = {signal_arena_alloc, NULL};
+
+// 信号路径新解析、待写入持久化缓存的一条结果（需持有module_symbolizer_lock）
+struct signal_record {
+  struct symbol_disk_cache *cache;
+  uint64_t vaddr;
+  const char *function;         // 指向模块的mmap区域或符号化器，一直有效
+  const char *file;
+  unsigned line;
+};
+
+static struct signal_record signal_records[SIGNAL_PENDING_MAX];
+static int signal_record_count;
+static char signal_record_buffer[SIGNAL_PENDING_BYTES];
+
+// 未命中缓存的一帧
+struct bulk_frame {
+  uintptr_t pc;
+  int index;                    // 在调用者数组中的下标
+  int unique;                   // 对应的bulk_pc下标
+};
+
+// 去重后的一个PC
+struct bulk_pc {
+  uintptr_t pc;
+  int first;                    // 第一次出现的帧下标，结果写在这里
+  bool resolved;
+};
+
+// 同一模块内连续的一段唯一PC
+struct bulk_module {
+  struct module_info mod;
+  struct module_symbolizer *ms;
+  int start;                    // bulk_pc下标
+  int count;
+};
+
+struct bulk_job {
+  struct bulk_pc *pcs;
+  struct bulk_module *groups;
+  int group_count;
+  int next_group;               // 工作线程原子领取
+  char (*outputs)[SYMBOL_MAX];
+};
+
+// 持久化缓存目录不可用时只警告一次（信号处理器中不警告）
+static void open_disk_cache(struct module_symbolizer *m, const struct module_info *mod,
+                            const struct symbolizer_allocator *alloc) {
+  static bool warned;
+  if (toy_asan_flags.symbol_cache_dir[0] == '\0' || mod->build_id_size == 0) {
+    return;
+  }
+  m->disk_cache = symbol_disk_cache_open(toy_asan_flags.symbol_cache_dir, mod->build_id,
+                                         mod->build_id_size, alloc);
+  if (!m->disk_cache && !alloc && !warned) {
+    warned = true;
+    printf("Toy ASan: warning - cannot use symbol cache in %s\n",
+           toy_asan_flags.symbol_cache_dir);
+  }
+}
+
+// 已有的模块符号化器（需持有module_symbolizer_lock）
+static struct module_symbolizer *find_module_symbolizer(const struct module_info *mod) {
+  for (int i = 0; i < module_symbolizer_count; i++) {
+    if (module_symbolizers[i].load_base == mod->load_base &&
+        strcmp(module_symbolizers[i].path, mod->path) == 0) {
+      return &module_symbolizers[i];
+    }
+  }
+  return NULL;
+}
+
+// 取模块对应的符号化器，只打开持久化缓存（需持有module_symbolizer_lock）
+static struct module_symbolizer *get_module_symbolizer(const struct module_info *mod,
+                                                       const struct symbolizer_allocator *alloc) {
+  struct module_symbolizer *found = find_module_symbolizer(mod);
+  if (found) {
+    return found;
+  }
+  if (module_symbolizer_count >= MAX_MODULES) {
+    return NULL;
+  }
+  struct module_symbolizer *m = &module_symbolizers[module_symbolizer_count++];
+  m->load_base = mod->load_base;
+  const char *parts[] = {mod->path, NULL};
+  symbolizer_concat(m->path, sizeof(m->path), parts);
+  open_disk_cache(m, mod, alloc);
+  return m;
+}
+
+// 打开模块文件和构建期符号索引（需持有module_symbolizer_lock）。
+// 行号表在这里解码，之后多个工作线程和信号处理器都只读访问
+static void load_module_symbolizer(struct module_symbolizer *m, const struct module_info *mod,
+                                   const struct symbolizer_allocator *alloc) {
+  if (m->loaded) {
+    return;
+  }
+  m->sym = elf_symbolizer_open(mod->path, alloc);
+  if (m->sym) {
+    elf_symbolizer_prepare(m->sym);
+  }
+  m->index = symbol_index_open(mod->path, mod->build_id, mod->build_id_size, alloc);
+  m->loaded = true;
+}
+
+// 有行号信息时输出 "函数 (文件:行)"，否则 "函数 (模块+0x偏移)"
+static void format_symbol(char *out, const char *function, const char *file, unsigned line,
+                          const char *module, uint64_t vaddr) {
+  if (file) {
+    report_snprintf(out, SYMBOL_MAX, "%s (%s:%u)", function, file, line);
+  } else {
+    report_snprintf(out, SYMBOL_MAX, "%s (%s+0x%lx)", function, module, (unsigned long)vaddr);
+  }
+}
+
+static bool module_contains(const struct module_info *mod, uintptr_t pc) {
+  for (int i = 0; i < mod->segment_count; i++) {
+    if (pc >= mod->segments[i].start && pc < mod->segments[i].end) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static int compare_frames(const void *a, const void *b) {
+  const struct bulk_frame *fa = a;
+  const struct bulk_frame *fb = b;
+  if (fa->pc != fb->pc) {
+    return fa->pc < fb->pc ? -1 : 1;
+  }
+  return fa->index - fb->index;
+}
+
+/**
+ * @brief 第0级：持久化缓存
+ * @return 该段中仍未解析的PC数
+ */
+static int resolve_from_disk_cache(struct bulk_job *job, struct bulk_module *g) {
+  struct symbol_disk_cache *cache = g->ms ? g->ms->disk_cache : NULL;
+  int missing = 0;
+  for (int i = 0; i < g->count; i++) {
+    struct bulk_pc *u = &job->pcs[g->start + i];
+    uint64_t vaddr = u->pc - g->mod.load_base;
+    struct symbol_disk_cache_entry e;
+    if (cache && symbol_disk_cache_lookup(cache, vaddr, &e)) {
+      format_symbol(job->outputs[u->first], e.function, e.file, e.line, g->mod.path, vaddr);
+      u->resolved = true;
+    } else {
+      missing++;
+    }
+  }
+  return missing;
+}
+
+/**
+ * @brief 第1级：进程内解析一个模块的一段升序PC
+ *
+ * 与ELF函数表、行表线性归并。模块被strip、ELF中找不到函数时
+ * 改查构建期符号索引。已由持久化缓存解析的PC跳过，
+ * 新解析的结果暂存到持久化缓存。
+ */
+static void resolve_module_group(struct bulk_job *job, struct bulk_module *g) {
+  struct module_symbolizer *ms = g->ms;
+  if (!ms) {
+    return;
+  }
+  uint64_t *vaddrs = malloc(g->count * sizeof(*vaddrs));
+  int *owners = malloc(g->count * sizeof(*owners));
+  struct elf_symbol_info *infos = malloc(g->count * sizeof(*infos));
+  if (!vaddrs || !owners || !infos) {
+    goto out;
+  }
+  int n = 0;
+  for (int i = 0; i < g->count; i++) {
+    if (!job->pcs[g->start + i].resolved) {
+      vaddrs[n] = job->pcs[g->start + i].pc - g->mod.load_base;
+      owners[n++] = g->start + i;
+    }
+  }
+  if (ms->sym) {
+    elf_symbolize_sorted(ms->sym, vaddrs, n, infos);
+  } else {
+    memset(infos, 0, n * sizeof(*infos));
+  }
+
+  for (int i = 0; i < n; i++) {
+    struct bulk_pc *u = &job->pcs[owners[i]];
+    uint64_t offset;
+    const char *function = infos[i].function;
+    const char *file = infos[i].file;
+    if (!function && ms->index) {
+      function = symbol_index_lookup(ms->index, vaddrs[i], &offset);
+      file = NULL;
+    }
+    if (!function) {
+      continue;
+    }
+    format_symbol(job->outputs[u->first], function, file, infos[i].line, g->mod.path,
+                  vaddrs[i]);
+    if (ms->disk_cache) {
+      symbol_disk_cache_add(ms->disk_cache, vaddrs[i], function, file, infos[i].line);
+    }
+    u->resolved = true;
+  }
+out:
+  free(infos);
+  free(owners);
+  free(vaddrs);
+}
+
+static void *bulk_worker_main(void *arg) {
+  struct bulk_job *job = arg;
+  for (;;) {
+    int g = __atomic_fetch_add(&job->next_group, 1, __ATOMIC_RELAXED);
+    if (g >= job->group_count) {
+      return NULL;
+    }
+    resolve_module_group(job, &job->groups[g]);
+  }
+}
+
+// 各模块互不相干，唯一PC很多时分给多个线程
+static void resolve_groups(struct bulk_job *job, int unique_count) {
+  int threads = 1;
+  if (unique_count >= BULK_PARALLEL_MIN && job->group_count > 1) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = job->group_count;
+    if (cpus > 0 && threads > cpus) {
+      threads = (int)cpus;
+    }
+    if (threads > BULK_MAX_THREADS) {
+      threads = BULK_MAX_THREADS;
+    }
+  }
+
+  pthread_t tids[BULK_MAX_THREADS];
+  int created = 0;
+  for (int i = 1; i < threads; i++) {
+    if (pthread_create(&tids[created], NULL, bulk_worker_main, job) == 0) {
+      created++;
+    }
+  }
+  bulk_worker_main(job);  // 当前线程也参与
+  for (int i = 0; i < created; i++) {
+    pthread_join(tids[i], NULL);
+  }
+}
+
+/**
+ * @brief 第2级：把进程内没能解析的PC一批交给外部符号化进程
+ */
+static void resolve_leftovers(struct bulk_job *job) {
+  int leftover = 0;
+  for (int g = 0; g < job->group_count; g++) {
+    for (int i = 0; i < job->groups[g].count; i++) {
+      leftover += !job->pcs[job->groups[g].start + i].resolved;
+    }
+  }
+  if (leftover == 0) {
+    return;
+  }
+  struct coproc_query *queries = malloc(leftover * sizeof(*queries));
+  int *owners = malloc(leftover * sizeof(*owners));
+  if (!queries || !owners) {
+    free(queries);
+    free(owners);
+    return;
+  }
+
+  int n = 0;
+  for (int g = 0; g < job->group_count; g++) {
+    struct bulk_module *grp = &job->groups[g];
+    for (int i = 0; i < grp->count; i++) {
+      struct bulk_pc *u = &job->pcs[grp->start + i];
+      if (u->resolved) {
+        continue;
+      }
+      queries[n].module = grp->mod.path;
+      queries[n].offset = u->pc - grp->mod.load_base;
+      queries[n].output = job->outputs[u->first];
+      queries[n].output_size = SYMBOL_MAX;
+      owners[n++] = grp->start + i;
+    }
+  }
+  coproc_symbolize(queries, n);
+  for (int i = 0; i < n; i++) {
+    job->pcs[owners[i]].resolved = queries[i].resolved;
+  }
+  free(owners);
+  free(queries);
+}
+
+/**
+ * @brief 批量符号解析
+ * @param addrs 地址数组（任意顺序，可重复）
+ * @param count 地址数量
+ * @param outputs 输出，每个地址一个缓冲区；解析失败填"??"，
+ *                地址属于已知模块时附带"(模块+0x偏移)"
+ * @return 成功解析的数量
+ *
+ * 先查PC → 符号缓存；未命中的地址排序去重、按模块分组后逐模块归并解析，
+ * 剩下的一次性交给常驻的外部符号化进程，整批只往返一次。
+ * 解析成功的结果写回缓存。全部命中时不分配内存。
+ */
+int resolve_symbols(void *const *addrs, int count, char (*outputs)[SYMBOL_MAX]) {
+  struct bulk_frame *frames = NULL;
+  int miss_count = 0;
+  int resolved = 0;
+
+  // 每批只检查一次dlopen/dlclose
+  if (module_map_refresh()) {
+    symbol_cache_clear();
+  }
+
+  // 第0级：PC → 符号缓存（命中时不分配内存）
+  for (int i = 0; i < count; i++) {
+    if (symbol_cache_lookup((uintptr_t)addrs[i], outputs[i], SYMBOL_MAX)) {
+      resolved++;
+      continue;
+    }
+    snprintf(outputs[i], SYMBOL_MAX, "??");
+    if (!frames) {
+      frames = malloc(count * sizeof(*frames));
+      if (!frames) {
+        return resolved;
+      }
+    }
+    frames[miss_count].pc = (uintptr_t)addrs[i];
+    frames[miss_count].index = i;
+    miss_count++;
+  }
+  if (miss_count == 0) {
+    return resolved;
+  }
+
+  struct bulk_job job;
+  memset(&job, 0, sizeof(job));
+  job.outputs = outputs;
+  job.pcs = malloc(miss_count * sizeof(*job.pcs));
+  job.groups = malloc(miss_count * sizeof(*job.groups));
+  if (!job.pcs || !job.groups) {
+    goto out;
+  }
+
+  // 排序去重：同一PC的第一帧承载结果
+  qsort(frames, miss_count, sizeof(*frames), compare_frames);
+  int unique_count = 0;
+  for (int i = 0; i < miss_count; i++) {
+    if (i == 0 || frames[i].pc != frames[i - 1].pc) {
+      job.pcs[unique_count].pc = frames[i].pc;
+      job.pcs[unique_count].first = frames[i].index;
+      job.pcs[unique_count].resolved = false;
+      unique_count++;
+    }
+    frames[i].unique = unique_count - 1;
+  }
+
+  // 按模块分段：PC升序，离开当前模块的段时才查一次模块表
+  struct bulk_module *cur = NULL;
+  for (int u = 0; u < unique_count; u++) {
+    struct bulk_pc *p = &job.pcs[u];
+    if (!cur || !module_contains(&cur->mod, p->pc)) {
+      cur = &job.groups[job.group_count];
+      if (module_map_lookup(p->pc, &cur->mod) != 0) {
+        cur = NULL;
+        continue;
+      }
+      cur->ms = NULL;
+      cur->start = u;
+      cur->count = 0;
+      job.group_count++;
+    }
+    // 前面的段没接上（中间有不属于任何模块的PC）时另起一段
+    if (cur->start + cur->count != u) {
+      struct bulk_module *next = &job.groups[job.group_count++];
+      *next = *cur;
+      next->start = u;
+      next->count = 0;
+      cur = next;
+    }
+    cur->count++;
+    // 各级都解析不出函数名时，至少给出模块和偏移，便于离线定位
+    snprintf(outputs[p->first], SYMBOL_MAX, "?? (%s+0x%lx)", cur->mod.path,
+             (unsigned long)(p->pc - cur->mod.load_base));
+  }
+
+  // 第0级：持久化缓存；第1级：进程内ELF/DWARF符号化与符号索引。
+  // 持锁期间模块符号化器只由本批使用
+  pthread_mutex_lock(&module_symbolizer_lock);
+  for (int g = 0; g < job.group_count; g++) {
+    struct bulk_module *grp = &job.groups[g];
+    grp->ms = get_module_symbolizer(&grp->mod, NULL);
+    if (resolve_from_disk_cache(&job, grp) > 0 && grp->ms) {
+      load_module_symbolizer(grp->ms, &grp->mod, NULL);
+    }
+  }
+  resolve_groups(&job, unique_count);
+  for (int g = 0; g < job.group_count; g++) {
+    if (job.groups[g].ms && job.groups[g].ms->disk_cache) {
+      symbol_disk_cache_flush(job.groups[g].ms->disk_cache);
+    }
+  }
+  pthread_mutex_unlock(&module_symbolizer_lock);
+
+  // 第2级：外部符号化进程（模块缺少符号表时的后备）
+  resolve_leftovers(&job);
+
+  // 写回缓存，再分发给重复的帧
+  for (int u = 0; u < unique_count; u++) {
+    if (job.pcs[u].resolved) {
+      symbol_cache_insert(job.pcs[u].pc, outputs[job.pcs[u].first]);
+    }
+  }
+  for (int i = 0; i < miss_count; i++) {
+    const struct bulk_pc *u = &job.pcs[frames[i].unique];
+    if (frames[i].index != u->first) {
+      memcpy(outputs[frames[i].index], outputs[u->first], SYMBOL_MAX);
+    }
+    resolved += u->resolved;
+  }
+
+out:
+  free(job.groups);
+  free(job.pcs);
+  free(frames);
+  return resolved;
+}
+
+/**
+ * @brief dladdr快速解析（保留备用）
+ * @param addr 要解析的地址
+ * @param output 输出缓冲区
+ * @param output_size 输出缓冲区大小
+ * @return 0成功，-1失败
+ */
+static int resolve_symbol_with_dladdr(void *addr, char *output, size_t output_size) {
+  Dl_info info;
+
+  if (dladdr(addr, &info)) {
+    if (info.dli_sname) {
+      snprintf(output, output_size, "%s", info.dli_sname);
+      return 0;
+    }
+  }
+  return -1;
+}
+
+/**
+ * @brief 单个地址的符号解析
+ * @param addr 要解析的地址
+ * @param output 输出缓冲区
+ * @param output_size 输出缓冲区大小
+ * @return 0成功，-1失败（output为"??"）
+ */
+int resolve_symbol(void *addr, char *output, size_t output_size) {
+  char symbol[1][SYMBOL_MAX];
+  int ok = resolve_symbols(&addr, 1, symbol) == 1;
+  snprintf(output, output_size, "%s", symbol[0]);
+  return ok ? 0 : -1;
+}
+
+/**
+ * @brief 只记录原始帧信息（symbolize=0）
+ * @param addrs 地址数组
+ * @param count 地址数量
+ * @param outputs 输出，每帧"?? (模块+0x偏移)"；不属于已知模块时为"??"
+ *
+ * 格式与无法符号化的帧相同，toy_asan_symbolize离线时按模块路径、
+ * 偏移和报告末尾的build-id还原。只读缓存的模块表，不分配内存、
+ * 不fork、不读文件，出错进程里只花几微秒。异步信号安全。
+ */
+static void describe_frames_raw(void *const *addrs, int count,
+                                char (*outputs)[SYMBOL_MAX]) {
+  for (int i = 0; i < count; i++) {
+    struct module_info mod;
+    uintptr_t pc = (uintptr_t)addrs[i];
+    if (module_map_try_lookup(pc, &mod) == 0) {
+      report_snprintf(outputs[i], SYMBOL_MAX, "?? (%s+0x%lx)", mod.path,
+                      (unsigned long)(pc - mod.load_base));
+    } else {
+      report_snprintf(outputs[i], SYMBOL_MAX, "??");
+    }
+  }
+}
+
+/**
+ * @brief 按symbolize选项解析报告中的帧
+ * @return 成功符号化的数量（symbolize=0时为0）
+ */
+int symbolize_report_frames(void *const *addrs, int count, char (*outputs)[SYMBOL_MAX]) {
+  if (!toy_asan_flags.symbolize) {
+    describe_frames_raw(addrs, count, outputs);
+    return 0;
+  }
+  return resolve_symbols(addrs, count, outputs);
+}
+
+/**
+ * @brief 为信号处理器预留符号化用的内存（symbolize=1时初始化阶段调用）
+ *
+ * 只预留地址空间，不打开任何模块：模块在第一次出现在报告中、
+ * 持久化缓存又没有命中时才打开和解码，信号处理器中也一样。
+ */
+void symbolize_prepare(void) {
+  if (!toy_asan_flags.symbolize || signal_arena) {
+    return;
+  }
+  void *arena = mmap(NULL, SIGNAL_ARENA_SIZE, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (arena == MAP_FAILED) {
+    printf("Toy ASan: warning - cannot reserve symbolizer memory, fault reports will show "
+           "raw frames for modules not symbolized before\n");
+    return;
+  }
+  signal_arena = arena;
+}
+
+// 暂存一条信号路径新解析的结果；同一报告中重复的PC只存一次
+static void queue_signal_record(struct symbol_disk_cache *cache, uint64_t vaddr,
+                                const char *function, const char *file, unsigned line) {
+  if (!cache || signal_record_count == SIGNAL_PENDING_MAX) {
+    return;
+  }
+  for (int i = 0; i < signal_record_count; i++) {
+    if (signal_records[i].cache == cache && signal_records[i].vaddr == vaddr) {
+      return;
+    }
+  }
+  struct signal_record *r = &signal_records[signal_record_count++];
+  r->cache = cache;
+  r->vaddr = vaddr;
+  r->function = function;
+  r->file = file;
+  r->line = line;
+}
+
+// 按缓存文件编码暂存的结果，每个文件一次write()
+static void flush_signal_records(void) {
+  for (int i = 0; i < signal_record_count; i++) {
+    struct symbol_disk_cache *cache = signal_records[i].cache;
+    if (!cache) {
+      continue;
+    }
+    size_t size = 0;
+    for (int j = i; j < signal_record_count; j++) {
+      struct signal_record *r = &signal_records[j];
+      if (r->cache == cache) {
+        size += symbol_disk_cache_encode(signal_record_buffer + size,
+                                         sizeof(signal_record_buffer) - size, r->vaddr,
+                                         r->function, r->file, r->line);
+        r->cache = NULL;
+      }
+    }
+    symbol_disk_cache_append(cache, signal_record_buffer, size);
+  }
+  signal_record_count = 0;
+}
+
+/**
+ * @brief 信号处理器中解析一个PC（需持有module_symbolizer_lock）
+ *
+ * 先查持久化缓存；未命中时才打开模块（内存取自预留区域），
+ * 解析出的结果暂存，稍后写入持久化缓存。
+ */
+static bool resolve_in_signal(struct module_symbolizer *ms, const struct module_info *mod,
+                              uint64_t vaddr, char *out) {
+  struct symbol_disk_cache_entry e;
+  if (ms->disk_cache && symbol_disk_cache_lookup(ms->disk_cache, vaddr, &e)) {
+    format_symbol(out, e.function, e.file, e.line, mod->path, vaddr);
+    return true;
+  }
+  if (signal_arena) {
+    load_module_symbolizer(ms, mod, &signal_allocator);
+  }
+  struct elf_symbol_info info;
+  const char *function = NULL;
+  const char *file = NULL;
+  unsigned line = 0;
+  if (ms->sym && elf_symbolize(ms->sym, vaddr, &info) == 0) {
+    function = info.function;
+    file = info.file;
+    line = info.line;
+  } else if (ms->index) {
+    uint64_t offset;
+    function = symbol_index_lookup(ms->index, vaddr, &offset);
+  }
+  if (!function) {
+    return false;
+  }
+  format_symbol(out, function, file, line, mod->path, vaddr);
+  queue_signal_record(ms->disk_cache, vaddr, function, file, line);
+  return true;
+}
+
+/**
+ * @brief 信号处理器中解析报告中的帧
+ * @return 成功符号化的数量
+ *
+ * 异步信号安全：不调用malloc、不经过stdio、不fork，所有锁只trylock
+ * （出错线程自己可能正持有它们）。依次查PC缓存、持久化缓存，
+ * 最后才打开并解码模块；新结果在返回前追加到持久化缓存。
+ * 拿不到锁或解析不了的帧输出"?? (模块+0x偏移)"，可以交给
+ * toy_asan_symbolize离线还原。
+ */
+int symbolize_frames_async_safe(void *const *addrs, int count,
+                                char (*outputs)[SYMBOL_MAX]) {
+  if (!toy_asan_flags.symbolize) {
+    describe_frames_raw(addrs, count, outputs);
+    return 0;
+  }
+  bool have_symbolizers = pthread_mutex_trylock(&module_symbolizer_lock) == 0;
+  int resolved = 0;
+  for (int i = 0; i < count; i++) {
+    uintptr_t pc = (uintptr_t)addrs[i];
+    if (symbol_cache_try_lookup(pc, outputs[i], SYMBOL_MAX)) {
+      resolved++;
+      continue;
+    }
+    struct module_info mod;
+    if (module_map_try_lookup(pc, &mod) != 0) {
+      report_snprintf(outputs[i], SYMBOL_MAX, "??");
+      continue;
+    }
+    uint64_t vaddr = pc - mod.load_base;
+    struct module_symbolizer *ms = NULL;
+    if (have_symbolizers) {
+      ms = signal_arena ? get_module_symbolizer(&mod, &signal_allocator)
+                        : find_module_symbolizer(&mod);
+    }
+    if (ms && resolve_in_signal(ms, &mod, vaddr, outputs[i])) {
+      resolved++;
+    } else {
+      report_snprintf(outputs[i], SYMBOL_MAX, "?? (%s+0x%lx)", mod.path, (unsigned long)vaddr);
+    }
+  }
+  if (have_symbolizers) {
+    flush_signal_records();
+    pthread_mutex_unlock(&module_symbolizer_lock);
+  }
+  return resolved;
+}
+
+/**
+ * @brief 对帧涉及的每个模块（去重）调用一次fn
+ * @param addrs 报告中的全部帧
+ * @param count 帧数
+ * @param fn 回调：模块信息和十六进制build-id（无build-id时为空串）
+ *
+ * 只读已建立的模块表，不分配内存，异步信号安全。
+ */
+void for_each_report_module(void *const *addrs, int count,
+                            void (*fn)(const struct module_info *mod, const char *build_id,
+                                       void *arg),
+                            void *arg) {
+  uintptr_t visited[MAX_MODULES];
+  int visited_count = 0;
+
+  for (int i = 0; i < count; i++) {
+    struct module_info mod;
+    if (module_map_try_lookup((uintptr_t)addrs[i], &mod) != 0) {
+      continue;
+    }
+    bool seen = false;
+    for (int j = 0; j < visited_count; j++) {
+      seen |= visited[j] == mod.start;
+    }
+    if (seen || visited_count >= MAX_MODULES) {
+      continue;
+    }
+    visited[visited_count++] = mod.start;
+
+    char build_id[2 * MAX_BUILD_ID_SIZE + 1];
+    static const char hex[] = "0123456789abcdef";
+    for (size_t b = 0; b < mod.build_id_size; b++) {
+      build_id[2 * b] = hex[mod.build_id[b] >> 4];
+      build_id[2 * b + 1] = hex[mod.build_id[b] & 0xf];
+    }
+    build_id[2 * mod.build_id_size] = '\0';
+    fn(&mod, build_id, arg);
+  }
+}
+
+static void print_module_line(const struct module_info *mod, const char *build_id, void *arg) {
+  (void)arg;
+  report_printf("    0x%lx-0x%lx %s (BuildId: %s)\n", (unsigned long)mod->start,
+                (unsigned long)mod->end, mod->path, build_id[0] ? build_id : "none");
+}
+
+/**
+ * @brief symbolize=0时在报告末尾列出帧涉及的模块及其build-id
+ * @param addrs 报告中的全部帧
+ * @param count 帧数
+ *
+ * 离线工具据此确认拿到的模块文件或调试文件与崩溃时是同一次构建。
+ * 写入报告缓冲区，异步信号安全。
+ */
+void print_report_modules(void *const *addrs, int count) {
+  if (toy_asan_flags.symbolize) {
+    return;
+  }
+  report_printf("Module map:\n");
+  for_each_report_module(addrs, count, print_module_line, NULL);
+}
@@ -0,0 +1,156 @@
+/**
+ * @file symbolizer_alloc.h
+ * @brief 符号化数据结构的内存来源
+ *
+ * elf_symbolizer.c、symbol_disk_cache.c、symbol_index.c与离线工具共用，
+ * allocator为NULL时用malloc和qsort。运行时的信号处理器第一次遇到某个模块时
+ * 传入从初始化时预留的区域分配的allocator（见symbolize.c），
+ * 不调用malloc就能当场打开模块、解码行号表。
+ *
+ * allocator只分配不释放：realloc总是分配新块再复制，free什么都不做。
+ * 排序改用不分配内存的堆排序（glibc的qsort会为临时缓冲区调用malloc）。
+ *
+ * @author Toy ASan Project
+ * @version 1.0
+ */
+
+#ifndef TOY_ASAN_SYMBOLIZER_ALLOC_H
+#define TOY_ASAN_SYMBOLIZER_ALLOC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct symbolizer_allocator {
+  void *(*alloc)(void *ctx, size_t size);  // 16字节对齐，失败返回NULL
+  void *ctx;
+};
+
+static inline void *symbolizer_malloc(const struct symbolizer_allocator *a, size_t size) {
+  return a ? a->alloc(a->ctx, size) : malloc(size);
+}
+
+static inline void *symbolizer_calloc(const struct symbolizer_allocator *a, size_t count,
+                                      size_t size) {
+  if (!a) {
+    return calloc(count, size);
+  }
+  if (size != 0 && count > SIZE_MAX / size) {
+    return NULL;
+  }
+  void *p = a->alloc(a->ctx, count * size);
+  if (p) {
+    memset(p, 0, count * size);
+  }
+  return p;
+}
+
+// old_size是ptr现有的字节数（allocator不记录块大小）
+static inline void *symbolizer_realloc(const struct symbolizer_allocator *a, void *ptr,
+                                       size_t old_size, size_t new_size) {
+  if (!a) {
+    return realloc(ptr, new_size);
+  }
+  void *p = a->alloc(a->ctx, new_size);
+  if (p && ptr) {
+    memcpy(p, ptr, old_size < new_size ? old_size : new_size);
+  }
+  return p;
+}
+
+static inline void symbolizer_free(const struct symbolizer_allocator *a, void *ptr) {
+  if (!a) {
+    free(ptr);
+  }
+}
+
+static inline char *symbolizer_strdup(const struct symbolizer_allocator *a, const char *s) {
+  size_t size = strlen(s) + 1;
+  char *p = symbolizer_malloc(a, size);
+  if (p) {
+    memcpy(p, s, size);
+  }
+  return p;
+}
+
+static inline void symbolizer_swap(char *x, char *y, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    char t = x[i];
+    x[i] = y[i];
+    y[i] = t;
+  }
+}
+
+static inline void symbolizer_sift_down(char *base, size_t root, size_t count, size_t size,
+                                        int (*cmp)(const void *, const void *)) {
+  for (;;) {
+    size_t child = 2 * root + 1;
+    if (child >= count) {
+      return;
+    }
+    if (child + 1 < count && cmp(base + child * size, base + (child + 1) * size) < 0) {
+      child++;
+    }
+    if (cmp(base + root * size, base + child * size) >= 0) {
+      return;
+    }
+    symbolizer_swap(base + root * size, base + child * size, size);
+    root = child;
+  }
+}
+
+// allocator非NULL时用原地堆排序，否则qsort
+static inline void symbolizer_sort(const struct symbolizer_allocator *a, void *base,
+                                   size_t count, size_t size,
+                                   int (*cmp)(const void *, const void *)) {
+  if (!a) {
+    qsort(base, count, size, cmp);
+    return;
+  }
+  char *b = base;
+  for (size_t i = count / 2; i-- > 0;) {
+    symbolizer_sift_down(b, i, count, size, cmp);
+  }
+  for (size_t end = count; end-- > 1;) {
+    symbolizer_swap(b, b + end * size, size);
+    symbolizer_sift_down(b, 0, end, size, cmp);
+  }
+}
+
+/**
+ * @brief 把若干字符串依次拼到out（代替snprintf("%s%s...")，不经stdio）
+ * @param parts 以NULL结尾的字符串数组
+ * @return false表示放不下（out仍以'\0'结尾）
+ */
+static inline bool symbolizer_concat(char *out, size_t size, const char *const *parts) {
+  size_t n = 0;
+  for (; *parts; parts++) {
+    for (const char *s = *parts; *s; s++) {
+      if (n + 1 >= size) {
+        out[n] = '\0';
+        return false;
+      }
+      out[n++] = *s;
+    }
+  }
+  out[n] = '\0';
+  return true;
+}
+
+// 字节串写成小写十六进制，返回写入的字符数（不含'\0'）
+static inline size_t symbolizer_hex(char *out, size_t size, const uint8_t *bytes,
+                                    size_t count) {
+  static const char hex[] = "0123456789abcdef";
+  size_t n = 0;
+  for (size_t i = 0; i < count && n + 2 < size; i++) {
+    out[n++] = hex[bytes[i] >> 4];
+    out[n++] = hex[bytes[i] & 0xf];
+  }
+  if (size > 0) {
+    out[n] = '\0';
+  }
+  return n;
+}
+
+#endif // TOY_ASAN_SYMBOLIZER_ALLOC_H
@@ -0,0 +1,383 @@
+/**
+ * @file symbolizer_coproc.c
+ * @brief Toy AddressSanitizer 常驻外部符号化进程
+ *
+ * 进程内符号化器找不到符号时（模块被strip、调试信息格式不支持），
+ * 退回外部符号化工具。以前每一帧popen一次addr2line；现在改为
+ * 常驻子进程，一份报告的所有帧一次发完、一次读回：
+ *
+ * - llvm-symbolizer：一个进程服务所有模块，每行查询 "模块" 0x偏移
+ * - addr2line：只能绑定一个模块，每个模块一个进程（最多MAX_COPROCS个）
+ *
+ * 通信用socketpair：写端用MSG_NOSIGNAL，子进程退出不会给我们发SIGPIPE。
+ * 读写都经过poll，批量请求较大时边写边读，不会因双方管道都满而死锁。
+ *
+ * 超时与重启：
+ * - 每批查询有总截止时间（symbolizer_timeout_ms），超时或子进程退出时
+ *   立即SIGKILL回收，未完成的帧按未解析处理，报告照常输出
+ * - 下一批查询时重新拉起子进程；连续失败MAX_COPROC_FAILURES次后
+ *   本进程内不再使用外部符号化
+ *
+ * 选项：
+ * - external_symbolizer_path: 工具路径；为空时在PATH中依次找
+ *   llvm-symbolizer、addr2line；文件名含"llvm-symbolizer"时按其协议通信
+ * - symbolizer_timeout_ms: 每批查询的超时
+ *
+ * @author Toy ASan Project
+ * @version 1.0
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "toy_asan.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_COPROCS 8
+#define MAX_COPROC_FAILURES 3
+#define COPROC_LINE_MAX 1024
+
+extern char **environ;
+
+struct coproc {
+  pid_t pid;                 // 0表示未运行
+  int fd;                    // socketpair的本端，pid > 0时有效
+  char module[256];          // addr2line绑定的模块；llvm-symbolizer为空
+  uint64_t last_used;
+};
+
+static struct coproc coprocs[MAX_COPROCS];
+static uint64_t use_clock;
+static int consecutive_failures;
+static bool tool_resolved;
+static bool tool_is_llvm;
+static char tool_path[256];
+static pthread_mutex_t coproc_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// 在PATH中查找可执行文件
+static bool find_in_path(const char *name, char *out, size_t out_size) {
+  const char *path = getenv("PATH");
+  if (!path) {
+    path = "/usr/bin:/bin";
+  }
+  while (*path) {
+    size_t len = strcspn(path, ":");
+    snprintf(out, out_size, "%.*s/%s", (int)len, path, name);
+    if (len > 0 && access(out, X_OK) == 0) {
+      return true;
+    }
+    path += len;
+    if (*path) {
+      path++;
+    }
+  }
+  return false;
+}
+
+// 确定使用的工具（只在第一次需要时做）
+static bool resolve_tool(void) {
+  if (tool_resolved) {
+    return tool_path[0] != '\0';
+  }
+  tool_resolved = true;
+
+  if (toy_asan_flags.external_symbolizer_path[0]) {
+    snprintf(tool_path, sizeof(tool_path), "%s", toy_asan_flags.external_symbolizer_path);
+  } else if (!find_in_path("llvm-symbolizer", tool_path, sizeof(tool_path)) &&
+             !find_in_path("addr2line", tool_path, sizeof(tool_path))) {
+    tool_path[0] = '\0';
+    return false;
+  }
+  const char *base = strrchr(tool_path, '/');
+  tool_is_llvm = strstr(base ? base + 1 : tool_path, "llvm-symbolizer") != NULL;
+  return true;
+}
+
+static void coproc_kill(struct coproc *cp) {
+  if (cp->pid > 0) {
+    kill(cp->pid, SIGKILL);
+    waitpid(cp->pid, NULL, 0);
+    close(cp->fd);
+  }
+  cp->pid = 0;
+  cp->module[0] = '\0';
+}
+
+static bool coproc_spawn(struct coproc *cp, const char *module) {
+  int sv[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) != 0) {
+    return false;
+  }
+
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_adddup2(&actions, sv[1], STDIN_FILENO);
+  posix_spawn_file_actions_adddup2(&actions, sv[1], STDOUT_FILENO);
+  posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+
+  char *argv[8];
+  int argc = 0;
+  argv[argc++] = tool_path;
+  if (!tool_is_llvm) {
+    argv[argc++] = "-f";
+    argv[argc++] = "-e";
+    argv[argc++] = (char *)module;
+  }
+  argv[argc] = NULL;
+
+  // 子进程不能被LD_PRELOAD的toy_asan再拦截一遍
+  char *envp[256];
+  int envc = 0;
+  for (char **e = environ; *e && envc < 255; e++) {
+    if (strncmp(*e, "LD_PRELOAD=", 11) != 0) {
+      envp[envc++] = *e;
+    }
+  }
+  envp[envc] = NULL;
+
+  pid_t pid;
+  int err = posix_spawn(&pid, tool_path, &actions, NULL, argv, envp);
+  posix_spawn_file_actions_destroy(&actions);
+  close(sv[1]);
+  if (err != 0) {
+    close(sv[0]);
+    return false;
+  }
+
+  cp->pid = pid;
+  cp->fd = sv[0];
+  snprintf(cp->module, sizeof(cp->module), "%s", tool_is_llvm ? "" : module);
+  return true;
+}
+
+// 取（必要时拉起）负责该模块的子进程；llvm-symbolizer只有一个
+static struct coproc *coproc_get(const char *module) {
+  const char *key = tool_is_llvm ? "" : module;
+  struct coproc *victim = &coprocs[0];
+  for (int i = 0; i < MAX_COPROCS; i++) {
+    struct coproc *cp = &coprocs[i];
+    if (cp->pid > 0 && strcmp(cp->module, key) == 0) {
+      cp->last_used = ++use_clock;
+      return cp;
+    }
+    if (cp->pid == 0 || (victim->pid > 0 && cp->last_used < victim->last_used)) {
+      victim = cp;
+    }
+  }
+  coproc_kill(victim); // 没有空位时淘汰最久未用的
+  if (!coproc_spawn(victim, module)) {
+    return NULL;
+  }
+  victim->last_used = ++use_clock;
+  return victim;
+}
+
+static int64_t now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// 把一次应答（函数名 + 位置）格式化成与进程内符号化一致的形式
+static bool format_answer(const char *function, const char *location, char *output,
+                          size_t output_size) {
+  if (strcmp(function, "??") == 0 || function[0] == '\0') {
+    return false;
+  }
+  if (strncmp(location, "??", 2) != 0) {
+    snprintf(output, output_size, "%s (%s)", function, location);
+  } else {
+    snprintf(output, output_size, "%s", function);
+  }
+  return true;
+}
+
+/**
+ * @brief 在一个子进程上执行一批查询
+ * @return 成功解析的数量；子进程超时或退出时返回已完成部分并回收子进程
+ *
+ * 每个查询的应答：
+ * - addr2line -f: 两行（函数名、文件:行）
+ * - llvm-symbolizer: 若干对（函数名、文件:行:列），内联展开时多于一对，
+ *   以空行结束；取第一对（最内层）
+ */
+static int run_batch(struct coproc *cp, struct coproc_query **queries, int count) {
+  // 组装请求
+  size_t req_cap = (size_t)count * (sizeof(cp->module) + 32);
+  char *req = malloc(req_cap);
+  if (!req) {
+    return 0;
+  }
+  size_t req_len = 0;
+  for (int i = 0; i < count; i++) {
+    if (tool_is_llvm) {
+      req_len += snprintf(req + req_len, req_cap - req_len, "\"%s\" 0x%llx\n",
+                          queries[i]->module, (unsigned long long)queries[i]->offset);
+    } else {
+      req_len += snprintf(req + req_len, req_cap - req_len, "0x%llx\n",
+                          (unsigned long long)queries[i]->offset);
+    }
+  }
+
+  char line[COPROC_LINE_MAX];
+  size_t line_len = 0;
+  char function[COPROC_LINE_MAX] = "";
+  int line_in_answer = 0;
+  int answered = 0;
+  int resolved = 0;
+  size_t written = 0;
+  bool failed = false;
+  int64_t deadline = now_ms() + toy_asan_flags.symbolizer_timeout_ms;
+
+  while (answered < count && !failed) {
+    int64_t remaining = deadline - now_ms();
+    if (remaining <= 0) {
+      failed = true;
+      break;
+    }
+    struct pollfd pfd = {cp->fd, POLLIN | (written < req_len ? POLLOUT : 0), 0};
+    int rc = poll(&pfd, 1, (int)remaining);
+    if (rc < 0 && errno == EINTR) {
+      continue;
+    }
+    if (rc <= 0) {
+      failed = true;
+      break;
+    }
+
+    if ((pfd.revents & POLLOUT) && written < req_len) {
+      ssize_t n = send(cp->fd, req + written, req_len - written, MSG_NOSIGNAL | MSG_DONTWAIT);
+      if (n < 0 && errno != EAGAIN && errno != EINTR) {
+        failed = true;
+        break;
+      }
+      written += n > 0 ? (size_t)n : 0;
+    }
+
+    if (pfd.revents & (POLLIN | POLLHUP | POLLERR)) {
+      char buf[4096];
+      ssize_t n = recv(cp->fd, buf, sizeof(buf), MSG_DONTWAIT);
+      if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+        failed = true; // 子进程退出
+        break;
+      }
+      for (ssize_t i = 0; i < n && answered < count; i++) {
+        if (buf[i] != '\n') {
+          if (line_len < sizeof(line) - 1) {
+            line[line_len++] = buf[i];
+          }
+          continue;
+        }
+        line[line_len] = '\0';
+        line_len = 0;
+
+        if (tool_is_llvm && line[0] == '\0') {
+          line_in_answer = 0; // 空行：本条应答结束
+          answered++;
+          continue;
+        }
+        if (line_in_answer == 0) {
+          snprintf(function, sizeof(function), "%s", line);
+        } else if (line_in_answer == 1) {
+          struct coproc_query *q = queries[answered];
+          q->resolved = format_answer(function, line, q->output, q->output_size);
+          resolved += q->resolved;
+        }
+        line_in_answer++;
+        if (!tool_is_llvm && line_in_answer == 2) {
+          line_in_answer = 0;
+          answered++;
+        }
+      }
+    }
+  }
+
+  free(req);
+  if (failed) {
+    coproc_kill(cp);
+    consecutive_failures++;
+    if (consecutive_failures == MAX_COPROC_FAILURES) {
+      printf("Toy ASan: warning - external symbolizer %s keeps failing, disabled\n",
+             tool_path);
+    }
+  } else {
+    consecutive_failures = 0;
+  }
+  return resolved;
+}
+
+static int compare_query_module(const void *a, const void *b) {
+  const struct coproc_query *qa = *(const struct coproc_query *const *)a;
+  const struct coproc_query *qb = *(const struct coproc_query *const *)b;
+  return strcmp(qa->module, qb->module);
+}
+
+/**
+ * @brief 用外部符号化进程批量解析
+ * @param queries 查询数组（模块路径 + 链接时地址），结果写回各自的output
+ * @param count 查询数量
+ * @return 成功解析的数量
+ *
+ * llvm-symbolizer一次发送全部查询；addr2line按模块分组，每组一批。
+ */
+int coproc_symbolize(struct coproc_query *queries, int count) {
+  if (count <= 0 || toy_asan_flags.symbolizer_timeout_ms <= 0) {
+    return 0;
+  }
+
+  pthread_mutex_lock(&coproc_lock);
+  int resolved = 0;
+  struct coproc_query **order = NULL;
+  if (!resolve_tool() || consecutive_failures >= MAX_COPROC_FAILURES) {
+    goto out;
+  }
+  order = malloc(count * sizeof(*order));
+  if (!order) {
+    goto out;
+  }
+  for (int i = 0; i < count; i++) {
+    queries[i].resolved = false;
+    order[i] = &queries[i];
+  }
+
+  if (tool_is_llvm) {
+    struct coproc *cp = coproc_get("");
+    if (cp) {
+      resolved = run_batch(cp, order, count);
+    } else {
+      consecutive_failures++;
+    }
+    goto out;
+  }
+
+  qsort(order, count, sizeof(*order), compare_query_module);
+  for (int start = 0; start < count && consecutive_failures < MAX_COPROC_FAILURES;) {
+    int end = start + 1;
+    while (end < count && strcmp(order[end]->module, order[start]->module) == 0) {
+      end++;
+    }
+    struct coproc *cp = coproc_get(order[start]->module);
+    if (cp) {
+      resolved += run_batch(cp, order + start, end - start);
+    } else {
+      consecutive_failures++;
+    }
+    start = end;
+  }
+
+out:
+  free(order);
+  pthread_mutex_unlock(&coproc_lock);
+  return resolved;
+}
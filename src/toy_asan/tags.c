@@ -0,0 +1,443 @@
+/**
+ * @file tags.c
+ * @brief Toy AddressSanitizer 分配标签与按标签统计
+ *
+ * 把受保护内存归属到子系统（cache、parser、network……）：
+ * - toy_asan_tag_register(): 注册标签名和可选的字节预算
+ * - toy_malloc_tagged(): 显式指定标签分配
+ * - TOY_ASAN_SCOPED_TAG(): 作用域内的"当前标签"，
+ *   仍然调用普通toy_malloc的代码也能被归属
+ *
+ * 统计分片：
+ * - 每个线程一个分片，分配/释放只改本线程分片，无锁无竞争
+ * - 分片内的字节增量超过TAG_FLUSH_BATCH时折叠进全局原子计数，
+ *   全局值用于预算检查和高水位（误差不超过 线程数 × 批量）
+ * - 读取时全局值 + 所有分片余量 = 当前值（与并发折叠只有瞬时偏差）
+ * - 线程退出时分片折叠进全局并回收
+ *
+ * 预算：超过预算的标签分配退化为不受保护的libc malloc，
+ * toy_free通过fallback集合识别并用free释放。集合同时记录大小，
+ * 泄漏检测把这些块当作根扫描（它们里面可能存着受保护块的指针）。
+ *
+ * @author Toy ASan Project
+ * @version 1.0
+ */
+
+#include "toy_asan.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TAG_FLUSH_BATCH (64 * 1024)
+
+// 全局（已折叠）计数
+struct tag_global {
+  char name[MAX_TAG_NAME];
+  bool registered;
+  size_t budget;                // 0表示不限
+  int64_t live_bytes;
+  int64_t live_count;
+  uint64_t alloc_count;
+  uint64_t fallback_count;
+  int64_t high_water;
+};
+
+// 线程分片：只由所属线程写入，其他线程原子读取
+struct tag_shard {
+  bool in_use;
+  int64_t live_bytes[MAX_TAGS];
+  int64_t live_count[MAX_TAGS];
+  uint64_t alloc_count[MAX_TAGS];
+};
+
+static struct tag_global tag_table[MAX_TAGS] = {{.name = "untagged", .registered = true}};
+static int tag_count = 1;
+static pthread_mutex_t tag_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct tag_shard tag_shards[MAX_THREADS];
+static __thread struct tag_shard *my_shard;
+static __thread bool shard_attempted;
+static __thread int current_tag;
+static pthread_key_t shard_exit_key;
+static pthread_once_t shard_key_once = PTHREAD_ONCE_INIT;
+
+// 不受保护的回退分配集合（开放寻址，按需扩容）
+static uintptr_t *fallback_keys;
+static size_t *fallback_sizes;          // 与fallback_keys一一对应
+static size_t fallback_capacity;
+static size_t fallback_used;
+static pthread_mutex_t fallback_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// ======================= 标签注册 =======================
+
+/**
+ * @brief 注册一个标签
+ * @param name 标签名（截断到MAX_TAG_NAME-1字节）
+ * @param budget_bytes 受保护字节预算，0表示不限
+ * @return 标签编号（>0），表满返回0（即untagged）
+ *
+ * 同名标签重复注册返回已有编号并更新预算。
+ */
+int toy_asan_tag_register(const char *name, size_t budget_bytes) {
+  int id = 0;
+  pthread_mutex_lock(&tag_lock);
+  for (int i = 1; i < tag_count; i++) {
+    if (strncmp(tag_table[i].name, name, MAX_TAG_NAME - 1) == 0) {
+      id = i;
+      break;
+    }
+  }
+  if (id == 0 && tag_count < MAX_TAGS) {
+    id = tag_count;
+    snprintf(tag_table[id].name, MAX_TAG_NAME, "%s", name);
+    __atomic_store_n(&tag_table[id].registered, true, __ATOMIC_RELEASE);
+    tag_count++;
+  }
+  if (id != 0) {
+    tag_table[id].budget = budget_bytes;
+  }
+  pthread_mutex_unlock(&tag_lock);
+  return id;
+}
+
+/**
+ * @brief 获取标签名
+ * @return 未注册的编号返回"untagged"
+ */
+const char *toy_asan_tag_name(int tag) {
+  if (tag <= 0 || tag >= MAX_TAGS ||
+      !__atomic_load_n(&tag_table[tag].registered, __ATOMIC_ACQUIRE)) {
+    return tag_table[0].name;
+  }
+  return tag_table[tag].name;
+}
+
+int toy_asan_tag_count(void) {
+  return __atomic_load_n(&tag_count, __ATOMIC_ACQUIRE);
+}
+
+// ======================= 当前标签 =======================
+
+/**
+ * @brief 设置当前线程的默认标签
+ * @return 之前的标签，用于恢复
+ */
+int toy_asan_set_current_tag(int tag) {
+  int prev = current_tag;
+  current_tag = (tag >= 0 && tag < MAX_TAGS) ? tag : 0;
+  return prev;
+}
+
+int toy_asan_current_tag(void) {
+  return current_tag;
+}
+
+// TOY_ASAN_SCOPED_TAG的cleanup回调
+void toy_asan_restore_tag(int *prev) {
+  current_tag = *prev;
+}
+
+// ======================= 分片统计 =======================
+
+static void fold_shard(struct tag_shard *shard) {
+  for (int t = 0; t < MAX_TAGS; t++) {
+    __atomic_fetch_add(&tag_table[t].live_bytes, shard->live_bytes[t], __ATOMIC_RELAXED);
+    __atomic_fetch_add(&tag_table[t].live_count, shard->live_count[t], __ATOMIC_RELAXED);
+    __atomic_fetch_add(&tag_table[t].alloc_count, shard->alloc_count[t], __ATOMIC_RELAXED);
+  }
+  memset(shard->live_bytes, 0, sizeof(shard->live_bytes));
+  memset(shard->live_count, 0, sizeof(shard->live_count));
+  memset(shard->alloc_count, 0, sizeof(shard->alloc_count));
+}
+
+static void release_shard(void *arg) {
+  struct tag_shard *shard = arg;
+  pthread_mutex_lock(&tag_lock);
+  fold_shard(shard);
+  shard->in_use = false;
+  pthread_mutex_unlock(&tag_lock);
+  my_shard = NULL; // 之后的析构函数中再分配/释放直接走全局计数
+}
+
+static void create_shard_key(void) {
+  pthread_key_create(&shard_exit_key, release_shard);
+}
+
+static struct tag_shard *get_my_shard(void) {
+  if (my_shard || shard_attempted) {
+    return my_shard;
+  }
+  shard_attempted = true;
+  pthread_once(&shard_key_once, create_shard_key);
+
+  pthread_mutex_lock(&tag_lock);
+  for (int i = 0; i < MAX_THREADS; i++) {
+    if (!tag_shards[i].in_use) {
+      tag_shards[i].in_use = true;
+      my_shard = &tag_shards[i];
+      break;
+    }
+  }
+  pthread_mutex_unlock(&tag_lock);
+
+  if (my_shard) {
+    pthread_setspecific(shard_exit_key, my_shard);
+  }
+  return my_shard; // 分片用完时返回NULL，直接更新全局计数
+}
+
+static void update_high_water(int tag, int64_t live) {
+  int64_t hw = __atomic_load_n(&tag_table[tag].high_water, __ATOMIC_RELAXED);
+  while (live > hw &&
+         !__atomic_compare_exchange_n(&tag_table[tag].high_water, &hw, live, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+  }
+}
+
+// 把本线程分片中某标签的字节增量折叠进全局
+static void flush_tag(struct tag_shard *shard, int tag) {
+  int64_t bytes = shard->live_bytes[tag];
+  int64_t count = shard->live_count[tag];
+  __atomic_store_n(&shard->live_bytes[tag], 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&shard->live_count[tag], 0, __ATOMIC_RELAXED);
+  int64_t live = __atomic_add_fetch(&tag_table[tag].live_bytes, bytes, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&tag_table[tag].live_count, count, __ATOMIC_RELAXED);
+  update_high_water(tag, live);
+}
+
+/**
+ * @brief 检查标签是否已超出预算
+ * @return true表示本次分配应退化为不受保护的分配
+ */
+bool tag_over_budget(int tag, size_t size) {
+  size_t budget = tag_table[tag].budget;
+  if (budget == 0) {
+    return false;
+  }
+  int64_t live = __atomic_load_n(&tag_table[tag].live_bytes, __ATOMIC_RELAXED);
+  struct tag_shard *shard = get_my_shard();
+  if (shard) {
+    live += shard->live_bytes[tag];
+  }
+  return live + (int64_t)size > (int64_t)budget;
+}
+
+void tag_stats_record_alloc(int tag, size_t size) {
+  struct tag_shard *shard = get_my_shard();
+  if (!shard) {
+    int64_t live = __atomic_add_fetch(&tag_table[tag].live_bytes, (int64_t)size,
+                                      __ATOMIC_RELAXED);
+    __atomic_fetch_add(&tag_table[tag].live_count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&tag_table[tag].alloc_count, 1, __ATOMIC_RELAXED);
+    update_high_water(tag, live);
+    return;
+  }
+  __atomic_store_n(&shard->live_bytes[tag], shard->live_bytes[tag] + (int64_t)size,
+                   __ATOMIC_RELAXED);
+  __atomic_store_n(&shard->live_count[tag], shard->live_count[tag] + 1,
+                   __ATOMIC_RELAXED);
+  __atomic_store_n(&shard->alloc_count[tag], shard->alloc_count[tag] + 1,
+                   __ATOMIC_RELAXED);
+  if (shard->live_bytes[tag] > TAG_FLUSH_BATCH) {
+    flush_tag(shard, tag);
+  }
+}
+
+void tag_stats_record_free(int tag, size_t size) {
+  if (tag < 0 || tag >= MAX_TAGS) {
+    return;
+  }
+  struct tag_shard *shard = get_my_shard();
+  if (!shard) {
+    __atomic_fetch_sub(&tag_table[tag].live_bytes, (int64_t)size, __ATOMIC_RELAXED);
+    __atomic_fetch_sub(&tag_table[tag].live_count, 1, __ATOMIC_RELAXED);
+    return;
+  }
+  // 跨线程释放时本分片可能为负，读取时合并即可
+  __atomic_store_n(&shard->live_bytes[tag], shard->live_bytes[tag] - (int64_t)size,
+                   __ATOMIC_RELAXED);
+  __atomic_store_n(&shard->live_count[tag], shard->live_count[tag] - 1,
+                   __ATOMIC_RELAXED);
+  if (shard->live_bytes[tag] < -TAG_FLUSH_BATCH) {
+    flush_tag(shard, tag);
+  }
+}
+
+/**
+ * @brief 读取某标签的合并统计
+ * @return 0成功，-1标签未注册
+ */
+int toy_asan_get_tag_stats(int tag, struct toy_asan_tag_stats *out) {
+  if (tag < 0 || tag >= MAX_TAGS ||
+      !__atomic_load_n(&tag_table[tag].registered, __ATOMIC_ACQUIRE)) {
+    return -1;
+  }
+
+  struct tag_global *g = &tag_table[tag];
+  int64_t live_bytes = __atomic_load_n(&g->live_bytes, __ATOMIC_RELAXED);
+  int64_t live_count = __atomic_load_n(&g->live_count, __ATOMIC_RELAXED);
+  uint64_t alloc_count = __atomic_load_n(&g->alloc_count, __ATOMIC_RELAXED);
+
+  pthread_mutex_lock(&tag_lock);
+  for (int i = 0; i < MAX_THREADS; i++) {
+    if (tag_shards[i].in_use) {
+      live_bytes += __atomic_load_n(&tag_shards[i].live_bytes[tag], __ATOMIC_RELAXED);
+      live_count += __atomic_load_n(&tag_shards[i].live_count[tag], __ATOMIC_RELAXED);
+      alloc_count += __atomic_load_n(&tag_shards[i].alloc_count[tag], __ATOMIC_RELAXED);
+    }
+  }
+  pthread_mutex_unlock(&tag_lock);
+
+  // 精确值也参与高水位，弥补分片未折叠的部分
+  update_high_water(tag, live_bytes);
+
+  memset(out, 0, sizeof(*out));
+  out->tag = tag;
+  out->name = g->name;
+  out->live_bytes = live_bytes;
+  out->live_count = live_count;
+  out->alloc_count = alloc_count;
+  out->high_water_bytes = __atomic_load_n(&g->high_water, __ATOMIC_RELAXED);
+  out->budget_bytes = g->budget;
+  out->fallback_count = __atomic_load_n(&g->fallback_count, __ATOMIC_RELAXED);
+  return 0;
+}
+
+/**
+ * @brief 打印所有标签的统计
+ */
+void toy_asan_print_tag_stats(void) {
+  printf("=== Toy ASan tag statistics ===\n");
+  for (int t = 0; t < toy_asan_tag_count(); t++) {
+    struct toy_asan_tag_stats s;
+    if (toy_asan_get_tag_stats(t, &s) != 0) {
+      continue;
+    }
+    printf("%-16s live %lld bytes in %lld blocks, %llu allocs, high-water %lld bytes",
+           s.name, (long long)s.live_bytes, (long long)s.live_count,
+           (unsigned long long)s.alloc_count, (long long)s.high_water_bytes);
+    if (s.budget_bytes) {
+      printf(", budget %zu, %llu unguarded", s.budget_bytes,
+             (unsigned long long)s.fallback_count);
+    }
+    printf("\n");
+  }
+  printf("===============================\n");
+}
+
+// ======================= 超预算回退 =======================
+
+static size_t fallback_hash(uintptr_t p, size_t mask) {
+  return (size_t)((p >> 4) * 0x9e3779b97f4a7c15ull >> 32) & mask;
+}
+
+static void fallback_insert_locked(uintptr_t p, size_t size) {
+  size_t mask = fallback_capacity - 1;
+  size_t i = fallback_hash(p, mask);
+  while (fallback_keys[i] != 0) {
+    i = (i + 1) & mask;
+  }
+  fallback_keys[i] = p;
+  fallback_sizes[i] = size;
+  fallback_used++;
+}
+
+static int fallback_grow_locked(void) {
+  size_t old_capacity = fallback_capacity;
+  uintptr_t *old_keys = fallback_keys;
+  size_t *old_sizes = fallback_sizes;
+  size_t capacity = old_capacity ? old_capacity * 2 : 1024;
+  uintptr_t *keys = calloc(capacity, sizeof(uintptr_t));
+  size_t *sizes = calloc(capacity, sizeof(size_t));
+  if (!keys || !sizes) {
+    free(keys);
+    free(sizes);
+    return -1;
+  }
+  fallback_keys = keys;
+  fallback_sizes = sizes;
+  fallback_capacity = capacity;
+  fallback_used = 0;
+  for (size_t i = 0; i < old_capacity; i++) {
+    if (old_keys[i]) {
+      fallback_insert_locked(old_keys[i], old_sizes[i]);
+    }
+  }
+  free(old_keys);
+  free(old_sizes);
+  return 0;
+}
+
+/**
+ * @brief 超预算时的不受保护分配
+ */
+void *tag_fallback_malloc(size_t size, int tag) {
+  void *p = malloc(size ? size : 1);
+  if (!p) {
+    return NULL;
+  }
+  pthread_mutex_lock(&fallback_lock);
+  if ((fallback_used + 1) * 2 > fallback_capacity && fallback_grow_locked() != 0) {
+    pthread_mutex_unlock(&fallback_lock);
+    free(p);
+    return NULL;
+  }
+  fallback_insert_locked((uintptr_t)p, size);
+  pthread_mutex_unlock(&fallback_lock);
+
+  __atomic_fetch_add(&tag_table[tag].fallback_count, 1, __ATOMIC_RELAXED);
+  return p;
+}
+
+/**
+ * @brief 若ptr是超预算回退分配则释放它
+ * @return true表示已处理
+ */
+bool tag_fallback_free(void *ptr) {
+  uintptr_t p = (uintptr_t)ptr;
+  bool found = false;
+
+  pthread_mutex_lock(&fallback_lock);
+  if (fallback_capacity) {
+    size_t mask = fallback_capacity - 1;
+    size_t i = fallback_hash(p, mask);
+    while (fallback_keys[i] != 0) {
+      if (fallback_keys[i] == p) {
+        found = true;
+        break;
+      }
+      i = (i + 1) & mask;
+    }
+    if (found) {
+      // 删除后重新插入同一探测链上的后续条目
+      fallback_keys[i] = 0;
+      fallback_used--;
+      for (size_t j = (i + 1) & mask; fallback_keys[j] != 0; j = (j + 1) & mask) {
+        uintptr_t k = fallback_keys[j];
+        fallback_keys[j] = 0;
+        fallback_used--;
+        fallback_insert_locked(k, fallback_sizes[j]);
+      }
+    }
+  }
+  pthread_mutex_unlock(&fallback_lock);
+
+  if (found) {
+    free(ptr);
+  }
+  return found;
+}
+
+/**
+ * @brief 遍历所有存活的回退分配（泄漏检测收集根集合使用）
+ * @param fn 对每块调用一次，持有fallback_lock，不能再分配或释放回退块
+ */
+void tag_fallback_for_each(void (*fn)(void *ptr, size_t size, void *arg), void *arg) {
+  pthread_mutex_lock(&fallback_lock);
+  for (size_t i = 0; i < fallback_capacity; i++) {
+    if (fallback_keys[i]) {
+      fn((void *)fallback_keys[i], fallback_sizes[i], arg);
+    }
+  }
+  pthread_mutex_unlock(&fallback_lock);
+}
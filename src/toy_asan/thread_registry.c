@@ -0,0 +1,121 @@
+/**
+ * @file thread_registry.c
+ * @brief Toy AddressSanitizer 线程登记表
+ *
+ * 记录每个调用过toy_malloc的线程的栈范围和静态TLS块，
+ * 供泄漏检测扫描根集合使用。
+ *
+ * 生命周期：
+ * - 线程第一次分配时登记（线程局部标志做快速路径），同时安装备用信号栈
+ * - 线程退出时由pthread key析构函数注销，备用栈放回空闲表
+ *
+ * @author Toy ASan Project
+ * @version 1.0
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "toy_asan.h"
+#include <link.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+struct thread_info thread_table[MAX_THREADS];
+pthread_mutex_t thread_table_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread struct thread_info *current_thread;
+static __thread bool registration_attempted;
+static pthread_key_t thread_exit_key;
+static pthread_once_t thread_key_once = PTHREAD_ONCE_INIT;
+
+static void unregister_thread(void *arg) {
+  struct thread_info *info = arg;
+  release_alt_stack(info->alt_stack);
+  pthread_mutex_lock(&thread_table_lock);
+  info->in_use = false;
+  pthread_mutex_unlock(&thread_table_lock);
+}
+
+static void create_thread_key(void) {
+  pthread_key_create(&thread_exit_key, unregister_thread);
+}
+
+// dl_iterate_phdr回调：记录当前线程各模块的TLS块
+static int collect_tls_callback(struct dl_phdr_info *info, size_t size,
+                                void *data) {
+  (void)size;
+  struct thread_info *t = data;
+  if (!info->dlpi_tls_data || t->tls_count >= MAX_TLS_BLOCKS) {
+    return 0;
+  }
+  for (int i = 0; i < info->dlpi_phnum; i++) {
+    if (info->dlpi_phdr[i].p_type == PT_TLS) {
+      uintptr_t start = (uintptr_t)info->dlpi_tls_data;
+      t->tls_start[t->tls_count] = start;
+      t->tls_end[t->tls_count] = start + info->dlpi_phdr[i].p_memsz;
+      t->tls_count++;
+      break;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief 登记当前线程（重复调用只有第一次生效）
+ */
+void register_current_thread(void) {
+  if (registration_attempted) {
+    return;
+  }
+  registration_attempted = true;
+
+  pthread_once(&thread_key_once, create_thread_key);
+
+  struct thread_info local;
+  memset(&local, 0, sizeof(local));
+  local.tid = (pid_t)syscall(SYS_gettid);
+
+  pthread_attr_t attr;
+  if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+    void *stack_addr;
+    size_t stack_size;
+    if (pthread_attr_getstack(&attr, &stack_addr, &stack_size) == 0) {
+      local.stack_lo = (uintptr_t)stack_addr;
+      local.stack_hi = (uintptr_t)stack_addr + stack_size;
+    }
+    pthread_attr_destroy(&attr);
+  }
+  dl_iterate_phdr(collect_tls_callback, &local);
+
+  pthread_mutex_lock(&thread_table_lock);
+  for (int i = 0; i < MAX_THREADS; i++) {
+    if (!thread_table[i].in_use) {
+      thread_table[i] = local;
+      thread_table[i].in_use = true;
+      current_thread = &thread_table[i];
+      break;
+    }
+  }
+  pthread_mutex_unlock(&thread_table_lock);
+
+  if (!current_thread) {
+    printf("Toy ASan: warning - thread table full, tid %d not tracked\n",
+           local.tid);
+    return;
+  }
+  // 只给登记成功的线程安装：退出时靠同一个key析构函数归还
+  current_thread->alt_stack = install_alt_stack();
+  pthread_setspecific(thread_exit_key, current_thread);
+}
+
+/**
+ * @brief 获取当前线程的登记信息
+ * @return 未登记时返回NULL
+ */
+struct thread_info *current_thread_info(void) {
+  return current_thread;
+}
@@ -13,6 +13,29 @@
  * - globals.c: 全局变量定义
  * - signal_handler.c: SIGSEGV处理器（待实现）
  * - init.c: 初始化函数（待实现）
+ * - module_map.c: 已加载模块信息（路径、基址、build-id）
+ * - heap_dump.c: 二进制堆快照导出
+ * - options.c: TOY_ASAN_OPTIONS运行时选项
+ * - site_stats.c: 按分配调用点的统计
+ * - thread_registry.c: 线程栈/TLS登记
+ * - alt_stack.c: 每线程备用信号栈（栈溢出时处理器仍可运行）
+ * - leak_check.c: 退出时泄漏检测
+ * - tags.c: 分配标签与按标签统计
+ * - unwind.c: 帧指针调用栈回溯
+ * - stack_depot.c: 调用栈仓库与采集策略
+ * - elf_symbolizer.c: 进程内ELF/DWARF符号化
+ * - symbolizer_coproc.c: 常驻外部符号化进程
+ * - symbolize.c: 批量符号化（去重、按模块归并、多级回退）
+ * - recover.c: 恢复模式（单步越过保护页访问）
+ * - report_writer.c: 异步信号安全的报告格式化与输出
+ * - report_dedup.c: 按（PC，分配栈）去重、限流与汇总
+ * - report_json.c: 写到log_path的结构化（JSON）报告
+ * - report_ring.c: 跨进程共享内存报告环（格式见report_ring.h，与toy_asan_collect共用）
+ * - fault_access.c: 从信号上下文解码访问方向、宽度和起始地址
+ * - uffd_monitor.c: userfaultfd保护页监控（fault_monitor=userfaultfd，SIGSEGV的替代）
+ * - symbol_disk_cache.c: 按build-id的持久化符号缓存（与离线工具共用）
+ * - symbol_cache.c: PC → 符号缓存
+ * - symbol_index.c: 构建期生成的符号索引（strip后的二进制）
  * 
  * @author Toy ASan Project
  * @version 1.0
@@ -25,11 +48,24 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <signal.h>
+#include <pthread.h>
+#include <sys/types.h>
 
 // 常量定义
 #define MAX_ALLOCATIONS 1000
-#define MAX_ALLOC_BACKTRACE 8
+#define MAX_STACK_DEPTH 64         // malloc_context_size上限
 #define MAX_BACKTRACE_FRAMES 16
+#define MAX_MODULES 128
+#define MAX_BUILD_ID_SIZE 32
+#define MAX_MODULE_SEGMENTS 8
+#define MAX_ALLOC_SITES 4096      // 调用点统计表容量（2的幂）
+#define ADDR_INDEX_SIZE 4096      // 页索引容量（2的幂，≥ 4 × MAX_ALLOCATIONS）
+#define MAX_THREADS 256
+#define MAX_TAGS 64
+#define MAX_TAG_NAME 32
+#define MAX_TLS_BLOCKS 16
+#define STACK_DEPOT_SIZE 16384    // 栈仓库哈希表容量（2的幂）
+#define STACK_DEPOT_FRAMES (1 << 18)  // 栈仓库帧区容量
 
 // 分配记录结构
 struct allocation_record {
@@ -40,9 +76,109 @@ struct allocation_record {
     void *right_guard;            // 右保护页地址
     bool in_use;                 // 是否使用中
     
-    // 新增字段：调用栈记录
-    void *alloc_backtrace[MAX_ALLOC_BACKTRACE];     // 分配时调用栈
-    int alloc_backtrace_size;                      // 调用栈大小
+    // 新增字段：调用栈记录（编号指向栈仓库，0表示无）
+    uint32_t alloc_stack_id;                       // 分配时调用栈
+    uint32_t free_stack_id;                        // 释放时调用栈（free_context=1）
+    int alloc_site_id;                             // 调用点统计编号
+    int tag;                                       // 分配标签，0表示untagged
+};
+
+// 运行时选项（TOY_ASAN_OPTIONS）
+struct toy_asan_options {
+    int stats_interval_ms;        // 定期打印调用点统计的间隔，0表示关闭
+    int stats_top_n;              // 每次打印的调用点数量
+    int detect_leaks;             // 退出时做泄漏检测
+    int leak_check_threads;       // 标记阶段线程数，0表示按CPU数
+    int leak_exitcode;            // 发现泄漏时的退出码，0表示不改变
+    char unwinder[8];             // 分配栈回溯器：fp / dwarf / auto
+    int malloc_context_size;      // 分配栈最大帧数
+    int free_context;             // 释放时也采集调用栈
+    int sample_every;             // 每个调用点每N次分配完整回溯一次
+    char external_symbolizer_path[256];  // 外部符号化工具，空表示自动查找
+    int symbolizer_timeout_ms;    // 外部符号化每批查询的超时，0表示不用外部工具
+    int symbolize;                // 0: 报告只输出原始帧和build-id，离线符号化
+    char symbol_cache_dir[256];   // 持久化符号缓存目录，空表示不启用
+    int report_fd;                // 错误报告写入的文件描述符
+    int halt_on_error;            // 0: 恢复模式，保护页访问报告后继续运行
+    int recover_site_budget;      // 恢复模式下每个调用点最多单步的次数，0表示不限
+    int max_reports;              // 完整报告总数上限，0表示不限
+    int reports_per_second;       // 每秒完整报告数上限，0表示不限
+    int report_summary_interval_ms;  // 定期写出去重汇总的间隔，0表示只在退出时
+    char log_path[256];           // 结构化报告写到<log_path>.<pid>，空表示不写
+    char report_ring[256];        // 共享内存报告环的路径或"memfd"，空表示不用
+    char fault_monitor[16];       // 保护页监控方式：signal / userfaultfd
+};
+
+// 调用栈回溯器
+enum unwinder_mode {
+    UNWINDER_FP,                  // 帧指针链（默认，最快）
+    UNWINDER_DWARF,               // glibc backtrace()，无帧指针的代码也能回溯
+    UNWINDER_AUTO,                // 帧指针链异常中断时改用DWARF
+};
+
+// 单个标签的统计（各线程分片合并后的结果）
+struct toy_asan_tag_stats {
+    int tag;
+    const char *name;
+    int64_t live_bytes;           // 当前存活的受保护字节数
+    int64_t live_count;           // 当前存活块数
+    uint64_t alloc_count;         // 累计受保护分配次数
+    int64_t high_water_bytes;     // 存活字节数高水位
+    size_t budget_bytes;          // 预算，0表示不限
+    uint64_t fallback_count;      // 超预算退化为不受保护分配的次数
+};
+
+// 线程登记信息（泄漏检测扫描根集合使用）
+struct thread_info {
+    bool in_use;
+    pid_t tid;
+    uintptr_t stack_lo;           // 栈范围 [stack_lo, stack_hi)
+    uintptr_t stack_hi;
+    int tls_count;
+    uintptr_t tls_start[MAX_TLS_BLOCKS];
+    uintptr_t tls_end[MAX_TLS_BLOCKS];
+    void *alt_stack;              // 备用信号栈映射基址，NULL表示未安装
+};
+
+// 单个分配调用点的统计
+struct toy_asan_site_stats {
+    int site_id;
+    uint32_t stack_id;            // 栈仓库编号
+    uint64_t live_count;          // 当前存活块数
+    uint64_t live_bytes;          // 当前存活字节数
+    uint64_t total_count;         // 累计分配块数
+    uint64_t total_bytes;         // 累计分配字节数
+    uint64_t free_count;          // 累计释放次数
+    int frame_count;
+    void *const *frames;          // 指向栈仓库，长期有效
+};
+
+// PC → 符号缓存统计
+struct toy_asan_symbol_cache_stats {
+    uint64_t hits;                // 命中次数
+    uint64_t misses;              // 未命中次数
+    uint64_t insertions;          // 新增条目次数
+    uint64_t evictions;           // 淘汰次数
+    int entries;                  // 当前条目数
+    int capacity;                 // 容量（固定）
+};
+
+// 模块的一个PT_LOAD段 [start, end)
+struct module_segment {
+    uintptr_t start;
+    uintptr_t end;
+};
+
+// 已加载模块信息
+struct module_info {
+    char path[256];               // 模块文件路径
+    uintptr_t load_base;          // 加载偏移（dlpi_addr）
+    uintptr_t start;              // 所有PT_LOAD段覆盖范围起点
+    uintptr_t end;                // 所有PT_LOAD段覆盖范围终点（不含）
+    uint8_t build_id[MAX_BUILD_ID_SIZE];
+    size_t build_id_size;         // build-id字节数，0表示无
+    struct module_segment segments[MAX_MODULE_SEGMENTS];
+    int segment_count;
 };
 
 // 全局变量声明
@@ -50,18 +186,64 @@ extern struct allocation_record alloc_table[MAX_ALLOCATIONS];
 extern int alloc_count;
 extern size_t page_size;
 extern bool toy_asan_initialized;
+extern pthread_mutex_t alloc_table_lock;
+extern struct toy_asan_options toy_asan_flags;
+extern bool toy_asan_error_reported;
+extern struct thread_info thread_table[MAX_THREADS];
+extern pthread_mutex_t thread_table_lock;
 
 // 核心内存分配函数
 void* toy_malloc(size_t size);
+void* toy_malloc_tagged(size_t size, int tag);
 void toy_free(void *ptr);
 
+// 分配标签
+int toy_asan_tag_register(const char *name, size_t budget_bytes);
+const char *toy_asan_tag_name(int tag);
+int toy_asan_tag_count(void);
+int toy_asan_set_current_tag(int tag);   // 返回之前的标签
+int toy_asan_current_tag(void);
+void toy_asan_restore_tag(int *prev);
+int toy_asan_get_tag_stats(int tag, struct toy_asan_tag_stats *out);
+void toy_asan_print_tag_stats(void);
+
+// 作用域标签：离开作用域时自动恢复之前的标签
+// { TOY_ASAN_SCOPED_TAG(parser_tag); toy_malloc(64); }
+#define TOY_ASAN_TAG_CONCAT_(a, b) a##b
+#define TOY_ASAN_TAG_CONCAT(a, b) TOY_ASAN_TAG_CONCAT_(a, b)
+#define TOY_ASAN_SCOPED_TAG(tag)                                           \
+    int TOY_ASAN_TAG_CONCAT(toy_asan_prev_tag_, __LINE__)                  \
+        __attribute__((cleanup(toy_asan_restore_tag), unused)) =           \
+            toy_asan_set_current_tag(tag)
+
+// 标签内部接口（toy_malloc.c使用）
+bool tag_over_budget(int tag, size_t size);
+void tag_stats_record_alloc(int tag, size_t size);
+void tag_stats_record_free(int tag, size_t size);
+void *tag_fallback_malloc(size_t size, int tag);
+bool tag_fallback_free(void *ptr);
+void tag_fallback_for_each(void (*fn)(void *ptr, size_t size, void *arg), void *arg);
+
 // 元数据管理函数
 int add_allocation(void *base, void *user, size_t user_size);
 struct allocation_record* find_allocation(void *addr);
 struct allocation_record* find_allocation_by_user_addr(void *user_addr);
-void remove_allocation(void *user_addr);
+struct allocation_record* find_freed_allocation(void *addr);
+bool in_toy_asan_region(const void *addr);  // O(1)、无锁，信号处理器用
+void remove_allocation(void *user_addr, uint32_t free_stack_id);
+int lookup_user_page(const void *addr);  // 需持有alloc_table_lock
 void print_allocations(void);  // 调试用
 
+// 堆快照导出：将当前所有分配记录以二进制格式写入fd，成功返回0
+int toy_asan_dump_heap(int fd);
+int toy_asan_dump_heap_to_file(const char *path);
+
+// 模块表：缓存dl_iterate_phdr结果，dlopen/dlclose后自动重建
+int collect_module_info(struct module_info *modules, int max_modules);
+bool module_map_refresh(void);  // 重建了模块表时返回true
+int module_map_lookup(uintptr_t pc, struct module_info *out);
+int module_map_try_lookup(uintptr_t pc, struct module_info *out);  // 信号处理器用
+
 // 内存布局计算函数
 void* user_to_base(void *user_ptr);
 void* base_to_user(void *base_ptr);
@@ -73,6 +255,44 @@ void setup_signal_handler(void);
 
 // 初始化函数
 void toy_asan_init(void);
+void parse_toy_asan_options(void);
+
+// 栈仓库与采集策略
+uint64_t hash_stack(void *const *frames, int frame_count);
+uint32_t stack_depot_put(void *const *frames, int frame_count);
+int stack_depot_get(uint32_t id, void *const **frames);  // 信号安全
+void stack_capture_init(void);
+uint32_t sampled_alloc_stack(void *caller);
+void record_sampled_alloc_stack(void *caller, uint32_t stack_id);
+void print_stack_capture_policy(void);
+
+// 调用点统计
+int site_stats_record_alloc(uint32_t stack_id, size_t size);
+void site_stats_record_free(int site_id, size_t size);
+int toy_asan_get_site_stats(struct toy_asan_site_stats *out, int max_sites);
+void toy_asan_print_top_sites(int top_n);
+void start_site_stats_thread(void);
+
+// 线程登记
+void register_current_thread(void);
+struct thread_info *current_thread_info(void);
+void *install_alt_stack(void);
+void release_alt_stack(void *base);
+bool is_stack_overflow(void *fault_addr, const void *context);
+
+// 调用栈采集：frames[0]是调用处的返回地址，语义同backtrace()
+void unwind_init(void);
+enum unwinder_mode current_unwinder(void);
+const char *unwinder_name(enum unwinder_mode mode);
+int capture_stack_trace(void **frames, int max_frames);
+int capture_stack_trace_with(enum unwinder_mode mode, void **frames, int max_frames);
+int unwind_fp_from(uintptr_t fp, uintptr_t stack_lo, uintptr_t stack_hi,
+                   void **frames, int max_frames, bool *complete);
+int unwind_from_context(const void *context, void **frames, int max_frames);  // 信号安全
+
+// 泄漏检测：返回泄漏块数量
+int toy_asan_check_leaks(void);
+void install_leak_check(void);
 
 // 辅助函数
 size_t get_system_page_size(void);
@@ -81,14 +301,116 @@ size_t get_system_page_size(void);
 void report_buffer_overflow(void *fault_addr, struct allocation_record *rec, bool is_left_guard);
 
 // 新增函数声明
-void print_call_stack(void);
-void print_call_stack_symbolized(void);
+void print_call_stack(void *context);
+void print_call_stack_symbolized(void *context);
 void print_memory_relation(void *fault_addr, struct allocation_record *rec);
 void print_allocation_location(struct allocation_record *rec);
-const char *infer_access_type(int si_code);
-void forward_to_default_handler(int sig, siginfo_t *info);
+void chain_signal(const struct sigaction *previous, int sig, siginfo_t *info, void *context);
+
+// 外部符号化进程的一条查询
+struct coproc_query {
+    const char *module;           // 模块路径
+    uint64_t offset;              // 链接时地址（PC - 加载偏移）
+    char *output;                 // 结果缓冲区
+    size_t output_size;
+    bool resolved;
+};
 
 // 符号解析函数声明
+#define SYMBOL_MAX 512
 int resolve_symbol(void *addr, char *output, size_t output_size);
+int resolve_symbols(void *const *addrs, int count, char (*outputs)[SYMBOL_MAX]);
+int coproc_symbolize(struct coproc_query *queries, int count);
+int symbolize_report_frames(void *const *addrs, int count, char (*outputs)[SYMBOL_MAX]);
+int symbolize_frames_async_safe(void *const *addrs, int count, char (*outputs)[SYMBOL_MAX]);
+void symbolize_prepare(void);
+void print_report_modules(void *const *addrs, int count);
+void for_each_report_module(void *const *addrs, int count,
+                            void (*fn)(const struct module_info *mod, const char *build_id,
+                                       void *arg),
+                            void *arg);
+
+// 报告输出：静态缓冲区 + 手写格式化，不经过stdio、不分配内存
+int report_snprintf(char *buf, size_t size, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+void report_printf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+void report_flush(void);
+void report_lock(void);
+void report_unlock(void);
+
+// 结构化报告：流式JSON，逗号和嵌套自动处理；数组元素的key传NULL
+void report_log_open(void);
+bool json_report_begin(void);
+void json_report_end(void);
+void json_object_begin(const char *key);
+void json_object_end(void);
+void json_array_begin(const char *key);
+void json_array_end(void);
+void json_string(const char *key, const char *value);
+void json_uint(const char *key, unsigned long value);
+void json_address(const char *key, const void *value);
+void json_bool(const char *key, bool value);
+void json_frames(const char *key, void *const *pcs, char (*symbols)[SYMBOL_MAX], int count);
+void json_modules(void *const *pcs, int count);
+
+// 共享内存报告环（见report_ring.h）
+struct fault_access;
+void report_ring_open(void);
+void report_ring_append(int error, const void *fault_addr, const struct fault_access *access,
+                        const struct allocation_record *rec, void *const *frames,
+                        int frame_count, void *const *alloc_frames, int alloc_frame_count,
+                        const char *symbol);
+
+// 恢复模式（halt_on_error=0）下对一次保护页访问的处理
+enum recover_action {
+    RECOVER_HALT,                 // 不支持恢复：报告后退出
+    RECOVER_STEP,                 // 单步越过（是否报告由report_dedup_admit决定）
+    RECOVER_OPEN,                 // 超出预算：保护页保持打开
+};
+
+void setup_recover_handler(void);
+enum recover_action recover_classify(void *context);
+bool recover_step_over(void *fault_addr, void *context, enum recover_action action);
+
+// 报告去重与限流
+bool report_dedup_admit(uintptr_t pc, uint32_t stack_id);
+void report_dedup_summary(void);
+void install_report_summary(void);
+
+// 出错指令的内存访问（解码失败时size为0、addr为si_addr）
+struct fault_access {
+    bool is_write;                // 页错误码的写标志
+    size_t size;                  // 访问宽度（字节），0表示未知
+    void *addr;                   // 访问的起始地址
+    bool is_exec;                 // 取指令出错（跳到了保护页上），此时size为0
+};
+
+void decode_fault_access(void *fault_addr, const void *context, struct fault_access *out);
+void decode_fault_access_at(const void *pc, bool is_write, void *fault_addr,
+                            struct fault_access *out);
+
+// userfaultfd保护页监控：不可用时退回SIGSEGV
+void uffd_monitor_start(void);
+bool uffd_monitor_active(void);
+bool uffd_monitor_protect(void *base, size_t size);
+void uffd_monitor_release(void *base, size_t size);
+enum recover_action report_monitored_fault(void *fault_addr, void *context,
+                                           const struct fault_access *access);
+
+// 构建期符号索引：<模块路径>.symidx，build-id不一致时不使用
+struct symbol_index;
+struct symbolizer_allocator;
+struct symbol_index *symbol_index_open(const char *module_path, const uint8_t *build_id,
+                                       size_t build_id_size,
+                                       const struct symbolizer_allocator *alloc);
+const char *symbol_index_lookup(const struct symbol_index *idx, uint64_t vaddr,
+                                uint64_t *offset);
+
+// PC → 符号缓存：静态分配，查找不调用malloc
+bool symbol_cache_lookup(uintptr_t pc, char *output, size_t output_size);
+bool symbol_cache_try_lookup(uintptr_t pc, char *output, size_t output_size);
+void symbol_cache_insert(uintptr_t pc, const char *symbol);
+void symbol_cache_clear(void);
+void toy_asan_get_symbol_cache_stats(struct toy_asan_symbol_cache_stats *out);
 
 #endif // TOY_ASAN_H
@@ -14,8 +14,12 @@
  * │     保护页           │ PROT_NONE  ← 检测右溢出
  * └─────────────────────────────────────────────┘
  *
+ * fault_monitor=userfaultfd时保护页不做mprotect，保持可读写但从不驻留，
+ * 由uffd_monitor.c的监控线程捕获访问。
+ *
  * 主要功能：
- * - toy_malloc(): 分配带保护页的内存
+ * - toy_malloc(): 分配带保护页的内存（归属当前线程的作用域标签）
+ * - toy_malloc_tagged(): 指定标签分配，超出标签预算时退化为libc malloc
  * - toy_free(): 释放整个内存块
  *
  * 依赖：
@@ -32,33 +36,30 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
-#include <execinfo.h>  // 新增：backtrace支持
 
 /**
- * @brief 分配具有保护页的内存块
- * @param size 用户请求的内存大小（字节）
- * @return 用户可访问的内存地址，失败返回NULL
- * @example
- * ```c
- * char *buf = toy_malloc(100);
- * strcpy(buf, "hello world");
- * buf[99] = 'x';     // 安全：在用户数据范围内
- * buf[-1] = 'x';     // 危险：触发左保护页SIGSEGV
- * buf[200] = 'x';    // 危险：触发右保护页SIGSEGV
- * toy_free(buf);
- * ```
- * @note
- * - 实际分配3页内存：[保护页][用户数据][保护页]
- * - 用户只能访问中间页，保护页访问会触发SIGSEGV
- * - 使用mmap+mprotect实现页面级保护，零运行时开销
- * - 分配失败时返回NULL，不设置errno
+ * @brief 带标签的受保护分配（toy_malloc与toy_malloc_tagged的公共实现）
+ *
+ * 强制内联，保证采集到的调用栈第0帧就是对外的分配函数本身。
  */
-void *toy_malloc(size_t size) {
+static inline __attribute__((always_inline)) void *
+guarded_malloc(size_t size, int tag) {
   // 确保已初始化
   if (!toy_asan_initialized) {
     toy_asan_init();
   }
 
+  // 登记当前线程的栈和TLS，供泄漏检测扫描
+  register_current_thread();
+
+  // 标签超出预算：退化为不受保护的分配
+  if (tag < 0 || tag >= MAX_TAGS) {
+    tag = 0;
+  }
+  if (tag_over_budget(tag, size)) {
+    return tag_fallback_malloc(size, tag);
+  }
+
   // 确保页面大小已获取
   size_t ps = get_system_page_size();
 
@@ -72,24 +73,39 @@ void *toy_malloc(size_t size) {
     return NULL;
   }
 
-  // 设置左边保护页为不可访问
-  if (mprotect(base_addr, ps, PROT_NONE) != 0) {
-    perror("mprotect left guard failed");
-    munmap(base_addr, total_size);
-    return NULL;
-  }
+  // fault_monitor=userfaultfd：保护页保持可读写但从不驻留，由监控线程捕获
+  if (!uffd_monitor_protect(base_addr, total_size)) {
+    // 设置左边保护页为不可访问
+    if (mprotect(base_addr, ps, PROT_NONE) != 0) {
+      perror("mprotect left guard failed");
+      munmap(base_addr, total_size);
+      return NULL;
+    }
 
-  // 设置右边保护页为不可访问
-  void *right_guard = (char *)base_addr + 2 * ps;
-  if (mprotect(right_guard, ps, PROT_NONE) != 0) {
-    perror("mprotect right guard failed");
-    munmap(base_addr, total_size);
-    return NULL;
+    // 设置右边保护页为不可访问
+    void *right_guard = (char *)base_addr + 2 * ps;
+    if (mprotect(right_guard, ps, PROT_NONE) != 0) {
+      perror("mprotect right guard failed");
+      munmap(base_addr, total_size);
+      return NULL;
+    }
   }
 
   // 计算用户看到的地址（中间页）
   void *user_addr = (char *)base_addr + ps;
 
+  // 关键：记录分配时的调用栈（按采集策略回溯，存入栈仓库后只保留编号）
+  void *caller = __builtin_return_address(0);
+  uint32_t stack_id = sampled_alloc_stack(caller);
+  if (stack_id == 0) {
+    void *frames[MAX_STACK_DEPTH];
+    int captured = capture_stack_trace(frames, toy_asan_flags.malloc_context_size);
+    stack_id = stack_depot_put(frames, captured);
+    record_sampled_alloc_stack(caller, stack_id);
+  }
+  void *const *frames;
+  int frame_count = stack_depot_get(stack_id, &frames); // 未被采样时沿用调用点的栈
+
   // 记录分配信息
   int slot = add_allocation(base_addr, user_addr, size);
   if (slot == -1) {
@@ -98,15 +114,20 @@ void *toy_malloc(size_t size) {
     return NULL;
   }
 
-  // 关键：记录分配时的调用栈
-  struct allocation_record *rec = find_allocation_by_user_addr(user_addr);
-  if (rec) {
-    rec->alloc_backtrace_size = backtrace(rec->alloc_backtrace, MAX_ALLOC_BACKTRACE);
-    
-    // 调试输出（可选）
-    if (rec->alloc_backtrace_size > 0) {
-      printf("DEBUG: Allocation stack recorded with %d frames\n", rec->alloc_backtrace_size);
-    }
+  // 计入调用点统计和标签统计
+  int site_id = site_stats_record_alloc(stack_id, size);
+  tag_stats_record_alloc(tag, size);
+
+  pthread_mutex_lock(&alloc_table_lock);
+  struct allocation_record *rec = &alloc_table[slot];
+  rec->alloc_stack_id = stack_id;
+  rec->alloc_site_id = site_id;
+  rec->tag = tag;
+  pthread_mutex_unlock(&alloc_table_lock);
+
+  // 调试输出（可选）
+  if (frame_count > 0) {
+    printf("DEBUG: Allocation stack recorded with %d frames\n", frame_count);
   }
 
   printf("toy_malloc: allocated %zu bytes at %p (base: %p)\n", size, user_addr,
@@ -115,6 +136,48 @@ void *toy_malloc(size_t size) {
   return user_addr;
 }
 
+/**
+ * @brief 分配具有保护页的内存块
+ * @param size 用户请求的内存大小（字节）
+ * @return 用户可访问的内存地址，失败返回NULL
+ * @example
+ * ```c
+ * char *buf = toy_malloc(100);
+ * strcpy(buf, "hello world");
+ * buf[99] = 'x';     // 安全：在用户数据范围内
+ * buf[-1] = 'x';     // 危险：触发左保护页SIGSEGV
+ * buf[200] = 'x';    // 危险：触发右保护页SIGSEGV
+ * toy_free(buf);
+ * ```
+ * @note
+ * - 实际分配3页内存：[保护页][用户数据][保护页]
+ * - 用户只能访问中间页，保护页访问会触发SIGSEGV
+ * - 使用mmap+mprotect实现页面级保护，零运行时开销
+ * - 分配失败时返回NULL，不设置errno
+ * - 分配归属当前线程的作用域标签（TOY_ASAN_SCOPED_TAG）
+ */
+void *toy_malloc(size_t size) {
+  return guarded_malloc(size, toy_asan_current_tag());
+}
+
+/**
+ * @brief 指定标签分配具有保护页的内存块
+ * @param size 用户请求的内存大小（字节）
+ * @param tag toy_asan_tag_register()返回的标签编号
+ * @return 用户可访问的内存地址，失败返回NULL
+ * @example
+ * ```c
+ * int cache_tag = toy_asan_tag_register("cache", 1 << 20); // 1MB预算
+ * void *entry = toy_malloc_tagged(256, cache_tag);
+ * toy_free(entry);
+ * ```
+ * @note 标签存活字节超过预算后，分配退化为不受保护的libc malloc，
+ *       仍然可以（也必须）用toy_free释放
+ */
+void *toy_malloc_tagged(size_t size, int tag) {
+  return guarded_malloc(size, tag);
+}
+
 /**
  * @brief 释放toy_malloc分配的内存
  * @param ptr toy_malloc返回的用户地址，可以为NULL
@@ -129,6 +192,7 @@ void *toy_malloc(size_t size) {
  * ```
  * @note
  * - 释放整个3页内存块，包括保护页和用户数据
+ * - free_context=1时地址空间保留为PROT_NONE，直到记录槽位被复用
  * - 如果地址不是toy_malloc分配的，会发出警告但不崩溃
  * - 重复free同一地址是安全的（会警告但不崩溃）
  * - free(NULL)是完全安全的，符合标准库行为
@@ -145,19 +209,52 @@ void toy_free(void *usr_addr) {
   // 查找分配记录
   struct allocation_record *rec = find_allocation_by_user_addr(usr_addr);
   if (!rec) {
+    if (tag_fallback_free(usr_addr)) {
+      return; // 超预算时的不受保护分配
+    }
     printf("toy_free: warning - %p not found in allocation table\n", usr_addr);
     return; // 不是我们分配的，不处理
   }
 
-  printf("toy_free: freeing %p (base: %p)\n", usr_addr, rec->base_addr);
+  // 移除记录后槽位可能立即被其他线程复用，先保存需要的字段
+  void *base_addr = rec->base_addr;
+  int site_id = rec->alloc_site_id;
+  int tag = rec->tag;
+  size_t user_size = rec->user_size;
+  printf("toy_free: freeing %p (base: %p)\n", usr_addr, base_addr);
 
-  // 移除分配记录
-  remove_allocation(usr_addr);
+  // free_context=1时记录释放栈，供use-after-free报告使用
+  uint32_t free_stack_id = 0;
+  if (toy_asan_flags.free_context) {
+    void *frames[MAX_STACK_DEPTH];
+    int frame_count = capture_stack_trace(frames, toy_asan_flags.malloc_context_size);
+    free_stack_id = stack_depot_put(frames, frame_count);
+  }
 
-  // 释放整个内存块
+  // 带释放栈的块不归还地址空间：原地换成PROT_NONE的保留映射，
+  // 直到槽位被复用（add_allocation）才munmap，其间地址不会分给其他映射，
+  // 落在其中的SIGSEGV一定是use-after-free。须在移除记录之前完成，
+  // 否则槽位复用时可能先munmap，MAP_FIXED再覆盖掉别人的新映射
   size_t ps = get_system_page_size();
   size_t total_size = 3 * ps;
-  if (munmap(rec->base_addr, total_size) != 0) {
+  uffd_monitor_release(base_addr, total_size);
+  bool reserved = false;
+  if (free_stack_id != 0) {
+    reserved = mmap(base_addr, total_size, PROT_NONE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1,
+                    0) != MAP_FAILED;
+    if (!reserved) {
+      free_stack_id = 0;  // 保留失败：不再报告这个块的use-after-free
+    }
+  }
+
+  // 移除分配记录
+  remove_allocation(usr_addr, free_stack_id);
+  site_stats_record_free(site_id, user_size);
+  tag_stats_record_free(tag, user_size);
+
+  // 释放整个内存块
+  if (!reserved && munmap(base_addr, total_size) != 0) {
     perror("munmap failed");
   }
 }
@@ -0,0 +1,423 @@
+/**
+ * @file uffd_monitor.c
+ * @brief Toy AddressSanitizer userfaultfd保护页监控（SIGSEGV的替代后端）
+ *
+ * 默认后端用PROT_NONE保护页和SIGSEGV处理器，有几个固有问题：
+ * 程序自己也用SIGSEGV时互相干扰，报告只能用异步信号安全的函数，
+ * 处理器运行在出错线程的栈上。fault_monitor=userfaultfd时改为：
+ *
+ * - 分配时先写入用户页使其驻留，再把整个三页映射以MISSING模式注册到
+ *   userfaultfd：保护页从未驻留，读写都会产生缺页事件，用户页不会
+ *   （一次ioctl代替两次mprotect，映射也不再被拆成三个VMA）
+ * - 出错线程在内核中阻塞；专门的监控线程读出事件（地址、读写、tid），
+ *   从/proc/self/task/<tid>/syscall取出错线程的PC和SP，
+ *   像普通代码一样查表、符号化、写报告
+ * - halt_on_error=1时报告后退出；恢复模式下与信号后端相同，按调用点
+ *   预算（recover_site_budget）分类、经去重限流后报告，再用UFFDIO_ZEROPAGE
+ *   放开该页让出错线程越过这次访问。约REARM_DELAY_MS之后（超时或下一个
+ *   事件时）用MADV_DONTNEED丢掉该页，重新产生缺页事件；出错线程还没越过时
+ *   只是再出错一次，计入同一调用点的预算。超出预算的调用点保持放开
+ *
+ * 监控线程拿不到出错线程的其余寄存器：
+ * - 访问宽度按PC处的指令解码，起始地址一般只能取出错地址
+ * - 调用栈第0帧是PC，其后从SP向上找第一个像帧记录的位置
+ *   （[更高的栈地址][模块内的返回地址]），再沿帧指针链回溯
+ *
+ * 只改变保护页的监控方式：已释放的块仍按toy_free()换成PROT_NONE保留映射
+ * 或munmap（注册随之失效），use-after-free、栈溢出和其他SIGSEGV仍由
+ * 信号处理器处理。释放前uffd_monitor_release()取消该块待恢复的保护页，
+ * MADV_DONTNEED不会落到复用了这段地址的其他映射上。
+ * 内核不支持、权限不够（vm.unprivileged_userfaultfd=0且不支持
+ * UFFD_USER_MODE_ONLY）或缺少所需特性时打印原因，退回SIGSEGV后端。
+ *
+ * fork不继承userfaultfd注册：子进程中把所有存活块的保护页改回
+ * PROT_NONE，由SIGSEGV后端接管。
+ *
+ * @author Toy ASan Project
+ * @version 1.0
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE      // REG_RIP等寄存器下标
+#endif
+
+#include "toy_asan.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/userfaultfd.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#define FRAME_SCAN_WORDS 512     // 从SP向上找帧记录的范围
+#define REARM_DELAY_MS 10        // 放开保护页后多久重新监控
+#define MAX_REARM_PAGES 64       // 同时等待重新监控的保护页
+
+static int uffd = -1;
+
+// 恢复模式下放开、等待重新监控的保护页
+struct rearm_page {
+  void *page;                    // NULL表示空
+  uint64_t deadline_ms;          // CLOCK_MONOTONIC
+};
+
+static struct rearm_page rearm_pages[MAX_REARM_PAGES];
+static pthread_mutex_t rearm_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief 是否由userfaultfd监控保护页
+ */
+bool uffd_monitor_active(void) {
+  return uffd >= 0;
+}
+
+/**
+ * @brief 把新分配的三页映射交给userfaultfd
+ * @param base 映射起始（左保护页）
+ * @param size 映射大小（三页）
+ * @return false未启用或注册失败，调用者改用mprotect
+ */
+bool uffd_monitor_protect(void *base, size_t size) {
+  if (uffd < 0) {
+    return false;
+  }
+  size_t ps = get_system_page_size();
+  *(volatile char *)((char *)base + ps) = 0;  // 用户页驻留后不会产生缺页事件
+
+  struct uffdio_register reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.range.start = (uintptr_t)base;
+  reg.range.len = size;
+  reg.mode = UFFDIO_REGISTER_MODE_MISSING;
+  return ioctl(uffd, UFFDIO_REGISTER, &reg) == 0;
+}
+
+static uint64_t now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief 重新监控到期的保护页
+ * @param force true时不看期限全部重新监控
+ * @return 距下一个期限的毫秒数，没有等待的页时返回-1（poll的超时）
+ *
+ * MADV_DONTNEED丢掉UFFDIO_ZEROPAGE填入的页，注册仍在，下次访问再产生缺页事件。
+ */
+static int rearm_expired(bool force) {
+  size_t ps = get_system_page_size();
+  uint64_t now = now_ms();
+  int timeout = -1;
+  pthread_mutex_lock(&rearm_lock);
+  for (int i = 0; i < MAX_REARM_PAGES; i++) {
+    struct rearm_page *r = &rearm_pages[i];
+    if (!r->page) {
+      continue;
+    }
+    if (force || r->deadline_ms <= now) {
+      madvise(r->page, ps, MADV_DONTNEED);
+      r->page = NULL;
+    } else if (timeout < 0 || r->deadline_ms - now < (uint64_t)timeout) {
+      timeout = (int)(r->deadline_ms - now);
+    }
+  }
+  pthread_mutex_unlock(&rearm_lock);
+  return timeout;
+}
+
+// 取消[base, base+size)中等待重新监控的页
+static void cancel_rearm(void *base, size_t size) {
+  uintptr_t lo = (uintptr_t)base;
+  pthread_mutex_lock(&rearm_lock);
+  for (int i = 0; i < MAX_REARM_PAGES; i++) {
+    uintptr_t page = (uintptr_t)rearm_pages[i].page;
+    if (page >= lo && page - lo < size) {
+      rearm_pages[i].page = NULL;
+    }
+  }
+  pthread_mutex_unlock(&rearm_lock);
+}
+
+/**
+ * @brief 登记一个要放开的保护页，表满时先把所有等待的页重新监控
+ * @return false块已被释放，不再监控
+ *
+ * 须在UFFDIO_ZEROPAGE之前调用。登记后块仍在分配表中，就说明之后的
+ * toy_free()一定会经uffd_monitor_release()取消它。
+ */
+static bool schedule_rearm(void *page) {
+  size_t ps = get_system_page_size();
+  bool added = false;
+  for (int attempt = 0; attempt < 2 && !added; attempt++) {
+    pthread_mutex_lock(&rearm_lock);
+    for (int i = 0; i < MAX_REARM_PAGES; i++) {
+      if (!rearm_pages[i].page || rearm_pages[i].page == page) {
+        rearm_pages[i].page = page;
+        rearm_pages[i].deadline_ms = now_ms() + REARM_DELAY_MS;
+        added = true;
+        break;
+      }
+    }
+    pthread_mutex_unlock(&rearm_lock);
+    if (!added) {
+      rearm_expired(true);
+    }
+  }
+  if (added && !find_allocation(page)) {
+    cancel_rearm(page, ps);
+    return false;
+  }
+  return added;
+}
+
+/**
+ * @brief 块释放前取消其中等待重新监控的保护页
+ * @param base 映射起始（左保护页）
+ * @param size 映射大小（三页）
+ *
+ * toy_free()在换掉或munmap映射、移除记录之前调用：之后这段地址可能
+ * 属于别的映射，不能再对它MADV_DONTNEED。
+ */
+void uffd_monitor_release(void *base, size_t size) {
+  if (uffd >= 0) {
+    cancel_rearm(base, size);
+  }
+}
+
+// 出错线程的栈上界；未登记的线程返回0
+static uintptr_t thread_stack_hi(pid_t tid, uintptr_t sp) {
+  uintptr_t hi = 0;
+  pthread_mutex_lock(&thread_table_lock);
+  for (int i = 0; i < MAX_THREADS; i++) {
+    const struct thread_info *t = &thread_table[i];
+    if (t->in_use && t->tid == tid && sp >= t->stack_lo && sp < t->stack_hi) {
+      hi = t->stack_hi;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&thread_table_lock);
+  return hi;
+}
+
+/**
+ * @brief 从SP向上找出错函数的帧记录
+ * @return 帧指针，找不到返回0
+ *
+ * 出错函数建立了栈帧时，RBP指向的[保存的RBP][返回地址]在SP之上，
+ * 保存的RBP更大且仍在栈内，返回地址落在某个已加载模块中。
+ * 局部变量恰好也形如这样一对时会误认，回溯从错误的位置开始。
+ */
+static uintptr_t find_frame_record(uintptr_t sp, uintptr_t hi) {
+  struct module_info mod;
+  for (int i = 0; i < FRAME_SCAN_WORDS; i++) {
+    uintptr_t fp = sp + (uintptr_t)i * sizeof(uintptr_t);
+    if (fp + 2 * sizeof(uintptr_t) > hi) {
+      break;
+    }
+    const uintptr_t *frame = (const uintptr_t *)fp;
+    if ((frame[0] == 0 || (frame[0] > fp && frame[0] < hi)) &&
+        module_map_lookup(frame[1], &mod) == 0) {
+      return fp;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief 取阻塞在缺页中的线程的PC和SP
+ * @return 0成功
+ *
+ * 线程不在系统调用中时/proc/<tid>/syscall的内容是"-1 <sp> <pc>"。
+ */
+static int read_thread_pc_sp(pid_t tid, uintptr_t *pc, uintptr_t *sp) {
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/self/task/%d/syscall", (int)tid);
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    return -1;
+  }
+  long nr;
+  unsigned long s, p;
+  int n = fscanf(f, "%ld 0x%lx 0x%lx", &nr, &s, &p);
+  fclose(f);
+  if (n != 3) {
+    return -1;
+  }
+  *sp = s;
+  *pc = p;
+  return 0;
+}
+
+/**
+ * @brief 处理一次保护页缺页
+ *
+ * 用出错线程的PC/SP和找到的帧指针合成一个ucontext，报告代码与
+ * 信号处理器共用（只读取RIP/RSP/RBP）。PC就在出错页上时是跳到保护页上
+ * 执行：不解码（读PC处的字节会让监控线程自己阻塞在这个缺页上）。
+ */
+static void handle_page_fault(const struct uffd_msg *msg) {
+  void *fault_addr = (void *)(uintptr_t)msg->arg.pagefault.address;
+  bool is_write = (msg->arg.pagefault.flags & UFFD_PAGEFAULT_FLAG_WRITE) != 0;
+  pid_t tid = (pid_t)msg->arg.pagefault.feat.ptid;
+
+  static ucontext_t uc;
+  memset(&uc, 0, sizeof(uc));
+  uintptr_t pc = 0, sp = 0;
+  if (read_thread_pc_sp(tid, &pc, &sp) == 0) {
+    uintptr_t hi = thread_stack_hi(tid, sp);
+    uc.uc_mcontext.gregs[REG_RIP] = (greg_t)pc;
+    uc.uc_mcontext.gregs[REG_RSP] = (greg_t)sp;
+    uc.uc_mcontext.gregs[REG_RBP] = hi ? (greg_t)find_frame_record(sp, hi) : 0;
+  }
+
+  size_t ps = get_system_page_size();
+  uintptr_t page = (uintptr_t)fault_addr & ~(uintptr_t)(ps - 1);
+  struct fault_access access = {.is_write = is_write, .addr = fault_addr};
+  if (pc - page < ps) {
+    access.is_exec = true;
+  } else if (pc != 0) {
+    decode_fault_access_at((const void *)pc, is_write, fault_addr, &access);
+  }
+
+  // halt_on_error=1时不返回；恢复模式下放开该页让出错线程继续
+  enum recover_action action = report_monitored_fault(fault_addr, &uc, &access);
+
+  bool rearm = action == RECOVER_STEP && schedule_rearm((void *)page);
+
+  struct uffdio_zeropage zero;
+  memset(&zero, 0, sizeof(zero));
+  zero.range.start = page;
+  zero.range.len = ps;
+  if (ioctl(uffd, UFFDIO_ZEROPAGE, &zero) != 0 && errno != EEXIST) {
+    // 块已被释放（映射不在了）：唤醒后重试的访问落到SIGSEGV处理器
+    if (rearm) {
+      cancel_rearm((void *)page, ps);
+    }
+    struct uffdio_range wake = zero.range;
+    ioctl(uffd, UFFDIO_WAKE, &wake);
+  }
+}
+
+static void *monitor_thread(void *arg) {
+  (void)arg;
+  for (;;) {
+    // 等待事件，最多等到下一个放开的页到期
+    struct pollfd pfd = {.fd = uffd, .events = POLLIN};
+    int ready = poll(&pfd, 1, rearm_expired(false));
+    if (ready == 0 || (ready < 0 && errno == EINTR)) {
+      continue;
+    }
+    rearm_expired(false);
+
+    struct uffd_msg msg;
+    ssize_t n = read(uffd, &msg, sizeof(msg));
+    if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+      continue;                  // poll之后事件可能已被唤醒
+    }
+    if (n != (ssize_t)sizeof(msg)) {
+      printf("Toy ASan: warning - userfaultfd monitor stopped (%s)\n", strerror(errno));
+      return NULL;
+    }
+    if (msg.event == UFFD_EVENT_PAGEFAULT) {
+      handle_page_fault(&msg);
+    }
+  }
+}
+
+// fork之前锁住分配表，子进程中按表改回PROT_NONE保护页
+static void fork_prepare(void) {
+  pthread_mutex_lock(&alloc_table_lock);
+  pthread_mutex_lock(&rearm_lock);
+}
+
+static void fork_parent(void) {
+  pthread_mutex_unlock(&rearm_lock);
+  pthread_mutex_unlock(&alloc_table_lock);
+}
+
+static void fork_child(void) {
+  size_t ps = get_system_page_size();
+  close(uffd);
+  uffd = -1;
+  for (int i = 0; i < MAX_ALLOCATIONS; i++) {
+    const struct allocation_record *rec = &alloc_table[i];
+    if (rec->in_use) {
+      mprotect(rec->base_addr, ps, PROT_NONE);
+      mprotect((char *)rec->base_addr + 2 * ps, ps, PROT_NONE);
+    }
+  }
+  memset(rearm_pages, 0, sizeof(rearm_pages));  // 放开的页已随上面的mprotect恢复保护
+  pthread_mutex_unlock(&rearm_lock);
+  pthread_mutex_unlock(&alloc_table_lock);
+}
+
+static int open_userfaultfd(const char **reason) {
+  // 只处理用户态缺页：vm.unprivileged_userfaultfd=0时普通用户也可以创建；
+  // 阻塞模式的userfaultfd上poll总是返回POLLERR，监控线程要用poll等待超时
+  int flags = O_CLOEXEC | O_NONBLOCK;
+  int fd = (int)syscall(SYS_userfaultfd, flags | UFFD_USER_MODE_ONLY);
+  if (fd < 0 && errno == EINVAL) {
+    fd = (int)syscall(SYS_userfaultfd, flags);  // 5.11之前的内核没有该标志
+  }
+  if (fd < 0) {
+    *reason = strerror(errno);
+    return -1;
+  }
+
+  struct uffdio_api api;
+  memset(&api, 0, sizeof(api));
+  api.api = UFFD_API;
+  api.features = UFFD_FEATURE_THREAD_ID | UFFD_FEATURE_EXACT_ADDRESS;
+  if (ioctl(fd, UFFDIO_API, &api) != 0) {
+    *reason = "kernel lacks thread id / exact address features";
+    close(fd);
+    return -1;
+  }
+  if (!(api.ioctls & (1ULL << _UFFDIO_REGISTER))) {
+    *reason = "UFFDIO_REGISTER not supported";
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/**
+ * @brief 按fault_monitor选项启动userfaultfd监控
+ *
+ * 在信号处理器安装之后调用：不可用时保持SIGSEGV后端，只打印原因。
+ */
+void uffd_monitor_start(void) {
+  if (strcmp(toy_asan_flags.fault_monitor, "userfaultfd") != 0) {
+    if (strcmp(toy_asan_flags.fault_monitor, "signal") != 0) {
+      printf("Toy ASan: warning - unknown fault_monitor '%s', using signal\n",
+             toy_asan_flags.fault_monitor);
+    }
+    return;
+  }
+
+  const char *reason = NULL;
+  int fd = open_userfaultfd(&reason);
+  if (fd < 0) {
+    printf("Toy ASan: userfaultfd unavailable (%s), using SIGSEGV\n", reason);
+    return;
+  }
+  uffd = fd;
+
+  pthread_t tid;
+  if (pthread_create(&tid, NULL, monitor_thread, NULL) != 0) {
+    printf("Toy ASan: userfaultfd unavailable (cannot start monitor thread), using SIGSEGV\n");
+    close(fd);
+    uffd = -1;
+    return;
+  }
+  pthread_detach(tid);
+  pthread_atfork(fork_prepare, fork_parent, fork_child);
+  printf("Toy ASan: guard pages monitored by userfaultfd\n");
+}
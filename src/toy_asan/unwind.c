@@ -0,0 +1,211 @@
+/**
+ * @file unwind.c
+ * @brief Toy AddressSanitizer 调用栈采集（帧指针快速回溯）
+ *
+ * glibc的backtrace()走libgcc的DWARF回溯器：每帧都要查.eh_frame，
+ * 首次调用还会dlopen libgcc_s并malloc，开销比mmap本身还大。
+ * 构建已经使用-fno-omit-frame-pointer，因此分配路径改为直接
+ * 沿帧指针链回溯：
+ *
+ *   rbp → [保存的上一帧rbp][返回地址]
+ *
+ * 每一步都做边界检查：帧指针必须对齐、位于当前线程栈范围内、
+ * 且严格递增，否则停止，不会因为没有帧指针的帧而读到野地址。
+ *
+ * 回溯器选择（unwinder选项）：
+ * - fp:    只用帧指针（默认）
+ * - dwarf: 只用glibc backtrace()
+ * - auto:  先用帧指针，链条异常中断时改用backtrace()
+ *
+ * 信号处理器中则从ucontext保存的寄存器开始回溯（unwind_from_context），
+ * 第0帧就是出错指令，不含处理器自身和内核trampoline的帧。
+ *
+ * @author Toy ASan Project
+ * @version 1.0
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE      // REG_RIP等寄存器下标
+#endif
+
+#include "toy_asan.h"
+#include <execinfo.h>
+#include <string.h>
+#include <ucontext.h>
+
+static enum unwinder_mode unwinder = UNWINDER_FP;
+
+/**
+ * @brief 根据unwinder选项选择回溯器
+ */
+void unwind_init(void) {
+  if (strcmp(toy_asan_flags.unwinder, "dwarf") == 0) {
+    unwinder = UNWINDER_DWARF;
+  } else if (strcmp(toy_asan_flags.unwinder, "auto") == 0) {
+    unwinder = UNWINDER_AUTO;
+  } else {
+    unwinder = UNWINDER_FP;
+  }
+}
+
+enum unwinder_mode current_unwinder(void) {
+  return unwinder;
+}
+
+const char *unwinder_name(enum unwinder_mode mode) {
+  switch (mode) {
+    case UNWINDER_DWARF:
+      return "dwarf";
+    case UNWINDER_AUTO:
+      return "auto";
+    default:
+      return "fp";
+  }
+}
+
+/**
+ * @brief 从给定帧指针开始沿帧指针链回溯
+ * @param fp 起始帧指针
+ * @param stack_lo 栈下界
+ * @param stack_hi 栈上界（不含）
+ * @param frames 输出数组
+ * @param max_frames 最多帧数
+ * @param complete 输出：是否正常走到链尾（fp为0）或填满
+ * @return 采集到的帧数
+ *
+ * 不调用任何库函数，信号处理器中也可以使用。
+ */
+int unwind_fp_from(uintptr_t fp, uintptr_t stack_lo, uintptr_t stack_hi,
+                   void **frames, int max_frames, bool *complete) {
+  int n = 0;
+  bool ok = true;
+
+  while (n < max_frames) {
+    if (fp == 0) {
+      break; // 链尾：_start等会把rbp清零
+    }
+    // 帧需要容纳[saved fp][return address]两个字
+    if ((fp & (sizeof(uintptr_t) - 1)) != 0 || fp < stack_lo ||
+        fp + 2 * sizeof(uintptr_t) > stack_hi) {
+      ok = false;
+      break;
+    }
+    const uintptr_t *frame = (const uintptr_t *)fp;
+    uintptr_t ret = frame[1];
+    if (ret == 0) {
+      break;
+    }
+    frames[n++] = (void *)ret;
+
+    uintptr_t next = frame[0];
+    if (next != 0 && next <= fp) {
+      ok = false; // 栈向低地址增长，上一帧的fp必须更大
+      break;
+    }
+    fp = next;
+  }
+
+  if (complete) {
+    *complete = ok;
+  }
+  return n;
+}
+
+// glibc backtrace()回溯，去掉调用者自身一帧；须内联进对外函数
+static inline __attribute__((always_inline)) int
+capture_dwarf(void **frames, int max_frames) {
+  void *buf[MAX_BACKTRACE_FRAMES + 1];
+  int limit = max_frames < MAX_BACKTRACE_FRAMES ? max_frames + 1
+                                                : MAX_BACKTRACE_FRAMES + 1;
+  int n = backtrace(buf, limit);
+  if (n <= 1) {
+    return 0;
+  }
+  memcpy(frames, buf + 1, (n - 1) * sizeof(void *));
+  return n - 1;
+}
+
+// 须内联进对外函数：那一帧中保存的返回地址正好是调用处
+static inline __attribute__((always_inline)) int
+capture_impl(enum unwinder_mode mode, void **frames, int max_frames) {
+  if (mode == UNWINDER_DWARF) {
+    return capture_dwarf(frames, max_frames);
+  }
+
+  uintptr_t lo, hi;
+  struct thread_info *t = current_thread_info();
+  uintptr_t fp = (uintptr_t)__builtin_frame_address(0);
+  if (t && t->stack_hi) {
+    lo = t->stack_lo;
+    hi = t->stack_hi;
+  } else {
+    // 未登记线程：只信任当前帧之上的有限范围
+    lo = fp;
+    hi = fp + 8 * 1024 * 1024;
+  }
+
+  bool complete;
+  int n = unwind_fp_from(fp, lo, hi, frames, max_frames, &complete);
+  if (mode == UNWINDER_AUTO && !complete) {
+    return capture_dwarf(frames, max_frames);
+  }
+  return n;
+}
+
+/**
+ * @brief 用unwinder选项选定的回溯器采集调用者的调用栈
+ * @param frames 输出数组
+ * @param max_frames 最多帧数
+ * @return 采集到的帧数
+ *
+ * 与backtrace()语义一致：frames[0]是调用本函数处的返回地址。
+ */
+__attribute__((noinline)) int capture_stack_trace(void **frames, int max_frames) {
+  return capture_impl(unwinder, frames, max_frames);
+}
+
+/**
+ * @brief 用指定回溯器采集调用者的调用栈（基准测试用）
+ */
+__attribute__((noinline)) int
+capture_stack_trace_with(enum unwinder_mode mode, void **frames, int max_frames) {
+  return capture_impl(mode, frames, max_frames);
+}
+
+/**
+ * @brief 从信号上下文回溯出错线程的调用栈
+ * @param context sigaction处理器的第三个参数（ucontext_t *）
+ * @param frames 输出数组
+ * @param max_frames 最多帧数
+ * @return 采集到的帧数
+ *
+ * frames[0]是出错指令的PC（REG_RIP），其后沿保存的RBP回溯。
+ * 帧指针必须落在[RSP, 线程栈顶)内：出错函数已建立栈帧时，
+ * 它的RBP不会低于RSP。只读内存和寄存器，不分配内存，
+ * 深度受max_frames限制，可以在信号处理器中调用。
+ */
+int unwind_from_context(const void *context, void **frames, int max_frames) {
+  if (!context || max_frames <= 0) {
+    return 0;
+  }
+#if defined(__x86_64__)
+  const ucontext_t *uc = (const ucontext_t *)context;
+  uintptr_t pc = (uintptr_t)uc->uc_mcontext.gregs[REG_RIP];
+  uintptr_t sp = (uintptr_t)uc->uc_mcontext.gregs[REG_RSP];
+  uintptr_t fp = (uintptr_t)uc->uc_mcontext.gregs[REG_RBP];
+
+  uintptr_t hi;
+  struct thread_info *t = current_thread_info();
+  if (t && t->stack_hi && sp >= t->stack_lo && sp < t->stack_hi) {
+    hi = t->stack_hi;
+  } else {
+    hi = sp + 8 * 1024 * 1024; // 未登记线程或栈溢出到别处：只信任有限范围
+  }
+
+  frames[0] = (void *)pc;
+  return 1 + unwind_fp_from(fp, sp, hi, frames + 1, max_frames - 1, NULL);
+#else
+  (void)frames;
+  return 0;
+#endif
+}